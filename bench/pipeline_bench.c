@@ -0,0 +1,31 @@
+/**
+ * 数据通路性能测试的主机版本(Linux)
+ *
+ * 与开启CONFIG_MESH_BENCH时相同，运行main/my_bench.c中的测试：sensor查找/读写、sensorif轮询、
+ * 队列传递和数据包打包，以及C++驱动层与函数指针的比较。
+ * sensor为main/example_sensor.c中的示例，FreeRTOS和ESP-IDF的接口使用port/中的主机替代，
+ * 每次操作的内存申请按glibc malloc已分配的字节数计算。
+ * 各功能的模拟(my_xxx_sim.c)依赖mesh的其他部分，只在板上运行。
+ *
+ * 表格输出到stderr，每个测试的一行JSON输出到stdout，可以保存后在不同版本之间比较：
+ *  pipeline_bench > result.json
+ *
+ * 用法：
+ *  pipeline_bench
+ * 次数在编译时修改，例如make CFLAGS+=-DCONFIG_MESH_BENCH_ITERATIONS=100000
+ */
+#include <pthread.h>
+
+#include "my_sensorif.h"
+#include "my_pool.h"
+#include "my_bench.h"
+
+int main(void)
+{
+    my_pool_init();
+    sensorif_init();
+    my_bench_start();
+
+    // 测试任务结束时程序退出
+    pthread_exit(NULL);
+}
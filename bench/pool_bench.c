@@ -0,0 +1,476 @@
+/**
+ * 数据包内存池的主机性能测试(Linux)
+ *
+ * 按mesh收发路径的方式申请内存（多数为sensor数据和控制消息的小块，少数为整个mesh包），
+ * 比较my_pool.c、系统堆(glibc malloc)和固定大小的首次适应堆的吞吐量和碎片。
+ * 首次适应堆按地址排序空闲块、释放时合并相邻块，与FreeRTOS heap_4的方法相同，
+ * 用于模拟板上pvPortMalloc长时间运行后的碎片；glibc malloc的堆可以向系统扩展，只比较吞吐量。
+ *
+ *  pair:    申请后立即释放，与发送任务打包一个数据包相同
+ *  churn:   同时保留多个块，随机申请或释放；另外有长期占用、不时更换的内存（模拟WiFi等其他使用者），
+ *           始终从堆中申请。结束时统计首次适应堆的空闲字节数和最大的空闲块
+ *  threads: 多个线程同时申请释放小块
+ *
+ * 用法：
+ *  pool_bench [-n 次数] [-t 线程数]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "sdkconfig.h"
+#include "esp_mesh.h"
+#include "my_pool.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define BENCH_SIZE_NUM      (4096)      /* 预先生成的申请大小，2的幂 */
+#define BENCH_LARGE_PCT     (20)        /* 整个mesh包的比例 */
+#define BENCH_SMALL_MIN     (8)
+#define BENCH_LIVE_NUM      (CONFIG_MESH_POOL_SMALL_NUM + CONFIG_MESH_POOL_LARGE_NUM - 2)
+#define BENCH_LONG_NUM      (64)        /* 长期占用的内存块数 */
+#define BENCH_LONG_PERIOD   (256)       /* 每隔多少次更换一个长期占用的块 */
+#define BENCH_LONG_MAX      (512)
+#define BENCH_SAMPLE_PERIOD (4096)      /* 每隔多少次记录一次最大的空闲块 */
+#define BENCH_THREAD_MAX    (16)
+
+#define ARENA_SIZE          (32 * 1024) /* 首次适应堆的大小 */
+#define ARENA_ALIGN         (8)
+#define ARENA_HDR           ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_SPLIT_MIN     (ARENA_HDR * 2) /* 剩余部分小于该值时不分割 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef enum {
+    BENCH_ALLOC_POOL = 0,   /* 数据包使用my_pool，其他使用者使用首次适应堆 */
+    BENCH_ALLOC_ARENA,      /* 都使用首次适应堆 */
+    BENCH_ALLOC_HEAP,       /* 都使用glibc malloc */
+
+    BENCH_ALLOC_NUM,
+} bench_alloc_t;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t ops;
+    uint64_t misses;        /* 数据包申请失败的次数 */
+    uint64_t long_misses;   /* 其他使用者申请失败的次数 */
+    uint64_t requested;     /* 数据包申请的字节数，用于计算块内浪费 */
+    uint64_t granted;       /* 数据包实际占用的字节数 */
+    size_t   free_bytes;    /* 结束时首次适应堆的空闲字节数 */
+    size_t   largest;       /* 结束时最大的空闲块 */
+    size_t   min_largest;   /* 运行中最大的空闲块的最小值 */
+} bench_result_t;
+
+typedef struct {
+    bench_alloc_t alloc;
+    uint64_t      cycles;
+    uint32_t      seed;
+    uint64_t      misses;
+} bench_thread_t;
+
+// 首次适应堆的块头，空闲块按地址排序
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;            /* 包括块头 */
+} arena_block_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *alloc_names[BENCH_ALLOC_NUM] = { "pool", "arena", "heap" };
+static uint16_t bench_sizes[BENCH_SIZE_NUM];
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+static arena_block_t arena_free;    /* 空闲链表头 */
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void arena_init(void);
+static void *arena_alloc(size_t size);
+static void arena_release(void *ptr);
+static size_t arena_block_size(const void *ptr);
+static void arena_stats(size_t *free_bytes, size_t *largest);
+static uint32_t bench_rand(uint32_t *seed, uint32_t range);
+static uint64_t bench_now_ns(void);
+static void *bench_alloc(bench_alloc_t alloc, size_t size);
+static void bench_free(bench_alloc_t alloc, void *ptr);
+static void *bench_long_alloc(bench_alloc_t alloc, size_t size);
+static void bench_long_free(bench_alloc_t alloc, void *ptr);
+static size_t bench_block_size(bench_alloc_t alloc, const void *ptr, size_t size);
+static void bench_pair(bench_alloc_t alloc, uint64_t cycles, bench_result_t *result);
+static void bench_churn(bench_alloc_t alloc, uint64_t cycles, bench_result_t *result);
+static void *bench_thread(void *arg);
+static void bench_threads(bench_alloc_t alloc, uint64_t cycles, int threads, bench_result_t *result);
+static void bench_print(const char *name, bench_alloc_t alloc, const bench_result_t *result);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static void arena_init(void)
+{
+    arena_block_t *block = (arena_block_t *)arena;
+
+    block->next = NULL;
+    block->size = sizeof(arena);
+    arena_free.next = block;
+    arena_free.size = 0;
+}
+
+// 使用第一个足够大的空闲块，剩余部分足够大时分割
+static void *arena_alloc(size_t size)
+{
+    size_t need = (size + ARENA_HDR + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    arena_block_t *prev = &arena_free;
+    arena_block_t *block, *rest;
+
+    for(block = prev->next; block != NULL; prev = block, block = block->next) {
+        if(block->size < need) {
+            continue;
+        }
+        if(block->size - need >= ARENA_SPLIT_MIN) {
+            rest = (arena_block_t *)((uint8_t *)block + need);
+            rest->size  = block->size - need;
+            rest->next  = block->next;
+            prev->next  = rest;
+            block->size = need;
+        }
+        else {
+            prev->next = block->next;
+        }
+        return (uint8_t *)block + ARENA_HDR;
+    }
+    return NULL;
+}
+
+// 按地址插入空闲链表，与前后相邻的空闲块合并
+static void arena_release(void *ptr)
+{
+    arena_block_t *block, *prev = &arena_free;
+
+    if(ptr == NULL) {
+        return;
+    }
+    block = (arena_block_t *)((uint8_t *)ptr - ARENA_HDR);
+    while((prev->next != NULL) && (prev->next < block)) {
+        prev = prev->next;
+    }
+    block->next = prev->next;
+    prev->next  = block;
+    if((block->next != NULL) && ((uint8_t *)block + block->size == (uint8_t *)block->next)) {
+        block->size += block->next->size;
+        block->next  = block->next->next;
+    }
+    if((prev != &arena_free) && ((uint8_t *)prev + prev->size == (uint8_t *)block)) {
+        prev->size += block->size;
+        prev->next  = block->next;
+    }
+}
+
+static size_t arena_block_size(const void *ptr)
+{
+    return ((const arena_block_t *)((const uint8_t *)ptr - ARENA_HDR))->size;
+}
+
+static void arena_stats(size_t *free_bytes, size_t *largest)
+{
+    *free_bytes = 0;
+    *largest = 0;
+    for(arena_block_t *block = arena_free.next; block != NULL; block = block->next) {
+        *free_bytes += block->size;
+        if(block->size > *largest) {
+            *largest = block->size;
+        }
+    }
+}
+
+// 与my_bench_rand相同的线性同余
+static uint32_t bench_rand(uint32_t *seed, uint32_t range)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return ((*seed >> 8) & 0xFFFFFF) % range;
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 数据包的申请
+static void *bench_alloc(bench_alloc_t alloc, size_t size)
+{
+    uint8_t *ptr;
+
+    switch(alloc) {
+    case BENCH_ALLOC_POOL:  ptr = my_pool_alloc(size); break;
+    case BENCH_ALLOC_ARENA: ptr = arena_alloc(size); break;
+    default:                ptr = malloc(size); break;
+    }
+    // 写入第一个字节，与打包数据时相同
+    if(ptr != NULL) {
+        ptr[0] = (uint8_t)size;
+    }
+    return ptr;
+}
+
+static void bench_free(bench_alloc_t alloc, void *ptr)
+{
+    switch(alloc) {
+    case BENCH_ALLOC_POOL:  my_pool_free(ptr); break;
+    case BENCH_ALLOC_ARENA: arena_release(ptr); break;
+    default:                free(ptr); break;
+    }
+}
+
+// 其他使用者的申请，不使用内存池
+static void *bench_long_alloc(bench_alloc_t alloc, size_t size)
+{
+    return (alloc == BENCH_ALLOC_HEAP) ? malloc(size) : arena_alloc(size);
+}
+
+static void bench_long_free(bench_alloc_t alloc, void *ptr)
+{
+    if(alloc == BENCH_ALLOC_HEAP) {
+        free(ptr);
+    }
+    else {
+        arena_release(ptr);
+    }
+}
+
+// 一个数据包实际占用的字节数，首次适应堆包括块头，glibc malloc不包括
+static size_t bench_block_size(bench_alloc_t alloc, const void *ptr, size_t size)
+{
+    my_pool_stats_t stats;
+
+    if(alloc == BENCH_ALLOC_ARENA) {
+        return arena_block_size(ptr);
+    }
+    if(alloc == BENCH_ALLOC_HEAP) {
+        return malloc_usable_size((void *)ptr);
+    }
+    for(uint8_t i = 0; i < MY_POOL_NUM; i++) {
+        my_pool_get_stats(i, &stats);
+        if(size <= stats.block_size) {
+            return stats.block_size;
+        }
+    }
+    return 0;
+}
+
+static void bench_pair(bench_alloc_t alloc, uint64_t cycles, bench_result_t *result)
+{
+    uint64_t start;
+    void *ptr;
+
+    memset(result, 0, sizeof(bench_result_t));
+    start = bench_now_ns();
+    for(uint64_t i = 0; i < cycles; i++) {
+        ptr = bench_alloc(alloc, bench_sizes[i & (BENCH_SIZE_NUM - 1)]);
+        if(ptr == NULL) {
+            result->misses++;
+            continue;
+        }
+        bench_free(alloc, ptr);
+    }
+    result->ns  = bench_now_ns() - start;
+    result->ops = cycles;
+}
+
+static void bench_churn(bench_alloc_t alloc, uint64_t cycles, bench_result_t *result)
+{
+    void *live[BENCH_LIVE_NUM] = {0};
+    void *longs[BENCH_LONG_NUM] = {0};
+    uint32_t seed = 1;
+    uint64_t start;
+    uint32_t k;
+    size_t size, free_bytes, largest;
+
+    memset(result, 0, sizeof(bench_result_t));
+    arena_init();
+    result->min_largest = (alloc == BENCH_ALLOC_HEAP) ? 0 : ARENA_SIZE;
+    start = bench_now_ns();
+    for(uint64_t i = 0; i < cycles; i++) {
+        if((i % BENCH_LONG_PERIOD) == 0) {
+            k = bench_rand(&seed, BENCH_LONG_NUM);
+            bench_long_free(alloc, longs[k]);
+            longs[k] = bench_long_alloc(alloc, BENCH_SMALL_MIN + bench_rand(&seed, BENCH_LONG_MAX - BENCH_SMALL_MIN));
+            result->long_misses += (longs[k] == NULL);
+        }
+        if((alloc != BENCH_ALLOC_HEAP) && ((i % BENCH_SAMPLE_PERIOD) == 0)) {
+            arena_stats(&free_bytes, &largest);
+            if(largest < result->min_largest) {
+                result->min_largest = largest;
+            }
+        }
+        k = bench_rand(&seed, BENCH_LIVE_NUM);
+        result->ops++;
+        if(live[k] != NULL) {
+            bench_free(alloc, live[k]);
+            live[k] = NULL;
+            continue;
+        }
+        size = bench_sizes[i & (BENCH_SIZE_NUM - 1)];
+        live[k] = bench_alloc(alloc, size);
+        if(live[k] == NULL) {
+            result->misses++;
+            continue;
+        }
+        result->requested += size;
+        result->granted   += bench_block_size(alloc, live[k], size);
+    }
+    result->ns = bench_now_ns() - start;
+
+    if(alloc != BENCH_ALLOC_HEAP) {
+        arena_stats(&result->free_bytes, &result->largest);
+    }
+    for(k = 0; k < BENCH_LIVE_NUM; k++) {
+        bench_free(alloc, live[k]);
+    }
+    for(k = 0; k < BENCH_LONG_NUM; k++) {
+        bench_long_free(alloc, longs[k]);
+    }
+}
+
+static void *bench_thread(void *arg)
+{
+    bench_thread_t *t = arg;
+    void *ptr;
+    size_t size;
+
+    for(uint64_t i = 0; i < t->cycles; i++) {
+        size = BENCH_SMALL_MIN + bench_rand(&t->seed, CONFIG_MESH_POOL_SMALL_SIZE - BENCH_SMALL_MIN + 1);
+        ptr = bench_alloc(t->alloc, size);
+        if(ptr == NULL) {
+            t->misses++;
+            continue;
+        }
+        bench_free(t->alloc, ptr);
+    }
+    return NULL;
+}
+
+// 首次适应堆不是线程安全的，只比较内存池和glibc malloc
+static void bench_threads(bench_alloc_t alloc, uint64_t cycles, int threads, bench_result_t *result)
+{
+    pthread_t ids[BENCH_THREAD_MAX];
+    bench_thread_t args[BENCH_THREAD_MAX];
+    uint64_t start;
+
+    memset(result, 0, sizeof(bench_result_t));
+    start = bench_now_ns();
+    for(int i = 0; i < threads; i++) {
+        memset(&args[i], 0, sizeof(bench_thread_t));
+        args[i].alloc  = alloc;
+        args[i].cycles = cycles / threads;
+        args[i].seed   = i + 1;
+        pthread_create(&ids[i], NULL, bench_thread, &args[i]);
+    }
+    for(int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        result->ops    += args[i].cycles;
+        result->misses += args[i].misses;
+    }
+    result->ns = bench_now_ns() - start;
+}
+
+static void bench_print(const char *name, bench_alloc_t alloc, const bench_result_t *result)
+{
+    printf("%-8s %-6s %8.1f %11.0f %9llu", name, alloc_names[alloc],
+           (double)result->ns / result->ops, result->ops * 1e9 / result->ns,
+           (unsigned long long)result->misses);
+    if(result->granted > 0) {
+        printf(" %6.1f%%", 100.0 * (result->granted - result->requested) / result->granted);
+    }
+    if(result->free_bytes > 0) {
+        printf(" %9llu %7zu %8zu %8zu", (unsigned long long)result->long_misses,
+               result->free_bytes, result->largest, result->min_largest);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t cycles = 10000000;
+    int threads = 4;
+    uint32_t seed = 1;
+    bench_result_t pair[BENCH_ALLOC_NUM], churn[BENCH_ALLOC_NUM];
+    bench_result_t multi[BENCH_ALLOC_NUM] = {0};
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:t:")) != -1) {
+        switch(opt) {
+        case 'n': cycles = strtoull(optarg, NULL, 0); break;
+        case 't': threads = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n cycles] [-t threads]\n", argv[0]);
+            return 1;
+        }
+    }
+    if((cycles < 1) || (threads < 1) || (threads > BENCH_THREAD_MAX)) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    for(uint32_t i = 0; i < BENCH_SIZE_NUM; i++) {
+        bench_sizes[i] = (bench_rand(&seed, 100) < BENCH_LARGE_PCT) ? MESH_MPS
+                         : BENCH_SMALL_MIN + bench_rand(&seed, CONFIG_MESH_POOL_SMALL_SIZE - BENCH_SMALL_MIN + 1);
+    }
+    my_pool_init();
+
+    for(int a = 0; a < BENCH_ALLOC_NUM; a++) {
+        arena_init();
+        bench_pair(a, cycles, &pair[a]);
+        bench_churn(a, cycles, &churn[a]);
+        if(a != BENCH_ALLOC_ARENA) {
+            bench_threads(a, cycles, threads, &multi[a]);
+        }
+    }
+
+    printf("pool: small %u x %u B, large %u x %u B; arena %u B; %llu cycles, %d threads\n",
+           CONFIG_MESH_POOL_SMALL_NUM, CONFIG_MESH_POOL_SMALL_SIZE, CONFIG_MESH_POOL_LARGE_NUM, MESH_MPS,
+           ARENA_SIZE, (unsigned long long)cycles, threads);
+    printf("%-8s %-6s %8s %11s %9s %7s %9s %7s %8s %8s\n", "case", "alloc", "ns/op", "ops/s", "misses",
+           "waste", "other", "free B", "largest", "min larg");
+    for(int a = 0; a < BENCH_ALLOC_NUM; a++) {
+        bench_print("pair", a, &pair[a]);
+    }
+    for(int a = 0; a < BENCH_ALLOC_NUM; a++) {
+        bench_print("churn", a, &churn[a]);
+    }
+    for(int a = 0; a < BENCH_ALLOC_NUM; a++) {
+        if(multi[a].ops > 0) {
+            bench_print("threads", a, &multi[a]);
+        }
+    }
+
+    // 一行JSON，格式与板上性能测试相同
+    printf("{\"bench\":\"pool_host\",\"cycles\":%llu,\"threads\":%d,\"small_size\":%u,\"small_num\":%u,"
+           "\"large_num\":%u,\"arena_bytes\":%u,\"results\":[",
+           (unsigned long long)cycles, threads, CONFIG_MESH_POOL_SMALL_SIZE, CONFIG_MESH_POOL_SMALL_NUM,
+           CONFIG_MESH_POOL_LARGE_NUM, ARENA_SIZE);
+    for(int a = 0; a < BENCH_ALLOC_NUM; a++) {
+        printf("%s{\"alloc\":\"%s\",\"pair_ns\":%.1f,\"churn_ns\":%.1f,\"churn_misses\":%llu,"
+               "\"churn_other_misses\":%llu,\"churn_waste_pct\":%.1f,\"free_bytes\":%zu,"
+               "\"largest_free\":%zu,\"min_largest_free\":%zu,\"threads_ops_per_s\":%.0f}",
+               (a == 0) ? "" : ",", alloc_names[a], (double)pair[a].ns / pair[a].ops,
+               (double)churn[a].ns / churn[a].ops, (unsigned long long)churn[a].misses,
+               (unsigned long long)churn[a].long_misses,
+               (churn[a].granted > 0) ? 100.0 * (churn[a].granted - churn[a].requested) / churn[a].granted : 0.0,
+               churn[a].free_bytes, churn[a].largest, churn[a].min_largest,
+               (multi[a].ops > 0) ? multi[a].ops * 1e9 / multi[a].ns : 0.0);
+    }
+    printf("]}\n");
+
+    return 0;
+}
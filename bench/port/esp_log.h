@@ -0,0 +1,48 @@
+/**
+ * ESP-IDF日志的主机替代，输出到stderr，不影响stdout上的JSON
+ * esp_log_level_set只支持"*"，即所有tag使用同一个级别
+ */
+#ifndef __PORT_ESP_LOG_H__
+#define __PORT_ESP_LOG_H__
+
+#include <stdio.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL     CONFIG_LOG_DEFAULT_LEVEL
+#endif
+
+extern esp_log_level_t port_log_level;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+#define ESP_LOG_LEVEL_LOCAL(_level, _tag, _fmt, ...) do { \
+        if((LOG_LOCAL_LEVEL >= (_level)) && (port_log_level >= (_level))) { \
+            fprintf(stderr, "%c (%s) " _fmt "\n", "NEWIDV"[_level], _tag, ##__VA_ARGS__); \
+        } \
+    } while(0)
+
+#define ESP_LOGE(_tag, _fmt, ...)   ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR,   _tag, _fmt, ##__VA_ARGS__)
+#define ESP_LOGW(_tag, _fmt, ...)   ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN,    _tag, _fmt, ##__VA_ARGS__)
+#define ESP_LOGI(_tag, _fmt, ...)   ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO,    _tag, _fmt, ##__VA_ARGS__)
+#define ESP_LOGD(_tag, _fmt, ...)   ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG,   _tag, _fmt, ##__VA_ARGS__)
+#define ESP_LOGV(_tag, _fmt, ...)   ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, _tag, _fmt, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
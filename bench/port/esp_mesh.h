@@ -0,0 +1,36 @@
+/**
+ * esp_mesh.h的主机替代，只提供测试用到的部分
+ */
+#ifndef __PORT_ESP_MESH_H__
+#define __PORT_ESP_MESH_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MESH_MPS    (1472)  /* 与ESP-IDF相同，一个mesh数据包的最大长度 */
+
+typedef enum {
+    MESH_PROTO_BIN = 0,
+    MESH_PROTO_HTTP,
+    MESH_PROTO_JSON,
+    MESH_PROTO_MQTT,
+} mesh_proto_t;
+
+typedef enum {
+    MESH_TOS_P2P = 0,
+    MESH_TOS_E2E,
+    MESH_TOS_DEF,
+} mesh_tos_t;
+
+typedef union {
+    uint8_t addr[6];
+} mesh_addr_t;
+
+typedef struct {
+    uint8_t      *data;
+    uint16_t     size;
+    mesh_proto_t proto;
+    mesh_tos_t   tos;
+} mesh_data_t;
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __PORT_ESP_SYSTEM_H__
+#define __PORT_ESP_SYSTEM_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 主机上为一个固定值减去malloc已分配的字节数，只用于计算前后的差
+uint32_t esp_get_free_heap_size(void);
+
+// 返回"host"
+const char *esp_get_idf_version(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __PORT_ESP_TIMER_H__
+#define __PORT_ESP_TIMER_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CLOCK_MONOTONIC的时间(us)
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
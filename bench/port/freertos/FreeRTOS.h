@@ -0,0 +1,46 @@
+/**
+ * FreeRTOS的主机替代，只提供测试用到的部分，实现在port.c中（pthread）
+ */
+#ifndef __PORT_FREERTOS_H__
+#define __PORT_FREERTOS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+typedef int         BaseType_t;
+typedef unsigned    UBaseType_t;
+typedef uint32_t    TickType_t;
+typedef uint8_t     StackType_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+// 只在CONFIG_MESH_STATIC_ALLOC时使用，主机上不开启
+typedef struct { int unused; } StaticTask_t;
+typedef struct { int unused; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+#define pdTRUE              (1)
+#define pdFALSE             (0)
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFF)
+#define configTICK_RATE_HZ  (100)
+#define portTICK_PERIOD_MS  (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(_ms)  ((TickType_t)(_ms) / portTICK_PERIOD_MS)
+#define tskNO_AFFINITY      (0x7FFFFFFF)
+
+// 临界区使用互斥锁，中断中的版本相同
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { PTHREAD_MUTEX_INITIALIZER }
+#define portENTER_CRITICAL(_mux)        pthread_mutex_lock(&(_mux)->mutex)
+#define portEXIT_CRITICAL(_mux)         pthread_mutex_unlock(&(_mux)->mutex)
+#define portENTER_CRITICAL_ISR(_mux)    portENTER_CRITICAL(_mux)
+#define portEXIT_CRITICAL_ISR(_mux)     portEXIT_CRITICAL(_mux)
+#define portYIELD_FROM_ISR()            do { } while(0)
+
+#endif
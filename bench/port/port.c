@@ -0,0 +1,398 @@
+/**
+ * 测试用到的FreeRTOS、ESP-IDF接口和main.c中函数的主机替代
+ * 任务为pthread线程，队列和互斥锁使用pthread的互斥锁和条件变量，
+ * 优先级和CPU核不起作用。只用于在主机上运行固件中的代码，不模拟调度。
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "my_mem.h"
+#include "my_sensorif.h"
+#include "my_main.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define PORT_HEAP_SIZE      (0x40000000)    /* esp_get_free_heap_size的基准 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+struct port_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;       /* 队列中的数据变化时通知所有等待者 */
+    UBaseType_t     length;
+    UBaseType_t     item_size;
+    UBaseType_t     head;
+    UBaseType_t     count;
+    uint8_t         *storage;
+};
+
+struct port_mutex {
+    pthread_mutex_t mutex;
+};
+
+// 任务的handle，只用于通知
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    uint32_t        notify;
+    TaskFunction_t  func;
+    void            *arg;
+} port_task_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+esp_log_level_t port_log_level = CONFIG_LOG_DEFAULT_LEVEL;
+static __thread port_task_t *port_self;
+static QueueHandle_t port_sensorif_queue;
+static QueueHandle_t port_mesh_queue;
+static pthread_once_t port_queue_once = PTHREAD_ONCE_INIT;
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void port_deadline(TickType_t wait, struct timespec *ts);
+static int port_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, TickType_t wait, const struct timespec *ts);
+static BaseType_t port_queue_put(QueueHandle_t queue, const void *item, TickType_t wait, bool front);
+static port_task_t *port_task_new(TaskFunction_t func, void *arg);
+static void *port_task_run(void *arg);
+static void port_queue_init(void);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 等待wait个tick的截止时间（CLOCK_REALTIME，pthread_cond_timedwait使用）
+static void port_deadline(TickType_t wait, struct timespec *ts)
+{
+    int64_t ns;
+
+    clock_gettime(CLOCK_REALTIME, ts);
+    if(wait == portMAX_DELAY) {
+        return;
+    }
+    ns = ts->tv_nsec + (int64_t)wait * portTICK_PERIOD_MS * 1000000;
+    ts->tv_sec  += ns / 1000000000;
+    ts->tv_nsec  = ns % 1000000000;
+}
+
+// 在持有mutex时等待cond，超时返回非0
+static int port_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, TickType_t wait, const struct timespec *ts)
+{
+    if(wait == 0) {
+        return 1;
+    }
+    if(wait == portMAX_DELAY) {
+        return pthread_cond_wait(cond, mutex);
+    }
+    return pthread_cond_timedwait(cond, mutex, ts);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    struct mallinfo2 info = mallinfo2();
+
+    return PORT_HEAP_SIZE - (uint32_t)(info.uordblks + info.hblkhd);
+}
+
+const char *esp_get_idf_version(void)
+{
+    return "host";
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    port_log_level = level;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec  = (int64_t)ticks * portTICK_PERIOD_MS / 1000,
+        .tv_nsec = ((int64_t)ticks * portTICK_PERIOD_MS % 1000) * 1000000,
+    };
+
+    nanosleep(&ts, NULL);
+}
+
+static port_task_t *port_task_new(TaskFunction_t func, void *arg)
+{
+    port_task_t *task = calloc(1, sizeof(port_task_t));
+
+    if(task != NULL) {
+        pthread_mutex_init(&task->mutex, NULL);
+        pthread_cond_init(&task->cond, NULL);
+        task->func = func;
+        task->arg  = arg;
+    }
+    return task;
+}
+
+static void *port_task_run(void *arg)
+{
+    port_self = arg;
+    port_self->func(port_self->arg);
+    return NULL;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // 不是由my_task_create创建的线程（主线程）在第一次使用时分配
+    if(port_self == NULL) {
+        port_self = port_task_new(NULL, NULL);
+    }
+    return port_self;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+    pthread_exit(NULL);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    port_task_t *task = handle;
+
+    pthread_mutex_lock(&task->mutex);
+    task->notify++;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->mutex);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    (void)woken;
+    xTaskNotifyGive(task);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    port_task_t *task = xTaskGetCurrentTaskHandle();
+    struct timespec ts;
+    uint32_t value;
+
+    port_deadline(wait, &ts);
+    pthread_mutex_lock(&task->mutex);
+    while(task->notify == 0) {
+        if(port_wait(&task->cond, &task->mutex, wait, &ts) != 0) {
+            break;
+        }
+    }
+    value = task->notify;
+    if(value > 0) {
+        task->notify = clear ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->mutex);
+    return value;
+}
+
+TaskHandle_t my_task_create(my_task_mem_t *mem, TaskFunction_t func, const char *name,
+                            UBaseType_t prio, BaseType_t core, void *arg)
+{
+    port_task_t *task = port_task_new(func, arg);
+    pthread_t thread;
+
+    (void)mem;
+    (void)prio;
+    (void)core;
+    if((task == NULL) || (pthread_create(&thread, NULL, port_task_run, task) != 0)) {
+        ESP_LOGE("port", "Create task %s failed!", name);
+        free(task);
+        return NULL;
+    }
+    pthread_detach(thread);
+    return task;
+}
+
+// 主机上只有测试任务会结束，测试结束时程序退出
+void my_task_exit(void)
+{
+    fflush(stdout);
+    exit(0);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct port_queue));
+
+    if(queue == NULL) {
+        return NULL;
+    }
+    queue->storage = malloc(length * item_size);
+    if(queue->storage == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->length    = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+QueueHandle_t my_queue_create(my_queue_mem_t *mem)
+{
+    return xQueueCreate(mem->length, mem->item_size);
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->cond);
+    free(queue->storage);
+    free(queue);
+}
+
+static BaseType_t port_queue_put(QueueHandle_t queue, const void *item, TickType_t wait, bool front)
+{
+    struct timespec ts;
+    UBaseType_t index;
+
+    port_deadline(wait, &ts);
+    pthread_mutex_lock(&queue->mutex);
+    while(queue->count == queue->length) {
+        if(port_wait(&queue->cond, &queue->mutex, wait, &ts) != 0) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+    }
+    if(front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        index = queue->head;
+    }
+    else {
+        index = (queue->head + queue->count) % queue->length;
+    }
+    memcpy(queue->storage + index * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    return port_queue_put(queue, item, wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    return port_queue_put(queue, item, wait, true);
+}
+
+BaseType_t xQueueSendToFrontFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    (void)woken;
+    return port_queue_put(queue, item, 0, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    struct timespec ts;
+
+    port_deadline(wait, &ts);
+    pthread_mutex_lock(&queue->mutex);
+    while(queue->count == 0) {
+        if(port_wait(&queue->cond, &queue->mutex, wait, &ts) != 0) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+    }
+    memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&queue->mutex);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t mutex = calloc(1, sizeof(struct port_mutex));
+
+    if(mutex != NULL) {
+        pthread_mutex_init(&mutex->mutex, NULL);
+    }
+    return mutex;
+}
+
+SemaphoreHandle_t my_mutex_create(my_mutex_mem_t *mem)
+{
+    (void)mem;
+    return xSemaphoreCreateMutex();
+}
+
+// 只支持不等待和一直等待
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait)
+{
+    if(wait == 0) {
+        return (pthread_mutex_trylock(&mutex->mutex) == 0) ? pdTRUE : pdFALSE;
+    }
+    pthread_mutex_lock(&mutex->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+    return pdTRUE;
+}
+
+// main.c中的队列，长度与板上相同
+static void port_queue_init(void)
+{
+    port_sensorif_queue = xQueueCreate(CONFIG_MESH_QUEUE_LEN_SENSORIF, sizeof(my_sensorif_ctrl_t));
+    port_mesh_queue     = xQueueCreate(CONFIG_MESH_QUEUE_LEN_MESH, sizeof(my_sensorif_data_t));
+}
+
+QueueHandle_t main_get_sensorif_queue(void)
+{
+    pthread_once(&port_queue_once, port_queue_init);
+    return port_sensorif_queue;
+}
+
+QueueHandle_t main_get_mesh_queue(void)
+{
+    pthread_once(&port_queue_once, port_queue_init);
+    return port_mesh_queue;
+}
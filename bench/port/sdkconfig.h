@@ -0,0 +1,37 @@
+/**
+ * 主机测试使用的配置，数值与Kconfig的默认值相同，
+ * 可以在编译时修改，例如make CFLAGS+=-DCONFIG_MESH_POOL_SMALL_NUM=64
+ * 其他功能不在主机上编译，保持关闭
+ */
+#ifndef __SDKCONFIG_H__
+#define __SDKCONFIG_H__
+
+#define CONFIG_FREERTOS_UNICORE         1   /* 主机上的任务不绑定CPU */
+#ifndef CONFIG_LOG_DEFAULT_LEVEL
+#define CONFIG_LOG_DEFAULT_LEVEL        3
+#endif
+
+#ifndef CONFIG_MESH_POOL_SMALL_SIZE
+#define CONFIG_MESH_POOL_SMALL_SIZE     64
+#endif
+#ifndef CONFIG_MESH_POOL_SMALL_NUM
+#define CONFIG_MESH_POOL_SMALL_NUM      16
+#endif
+#ifndef CONFIG_MESH_POOL_LARGE_NUM
+#define CONFIG_MESH_POOL_LARGE_NUM      4
+#endif
+
+#define CONFIG_MESH_BENCH               1
+#ifndef CONFIG_MESH_BENCH_ITERATIONS
+#define CONFIG_MESH_BENCH_ITERATIONS    1000000 /* 主机上的计时精度较低，次数比板上多 */
+#endif
+#ifndef CONFIG_MESH_SENSOR_CACHE
+#define CONFIG_MESH_SENSOR_CACHE        1
+#endif
+#define CONFIG_MESH_QUEUE_LEN_SENSORIF  5
+#define CONFIG_MESH_QUEUE_LEN_MESH      5
+#define CONFIG_MESH_TASK_STACK_SENSORIF 3072
+#define CONFIG_MESH_TASK_PRIO_SENSORIF  4
+#define CONFIG_MESH_TASK_PRIO_MESH_TX   5
+
+#endif
@@ -0,0 +1,146 @@
+#include "esp_log.h"
+#include "esp_timer.h"
+#if !CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE
+#include "driver/gpio.h"
+#endif
+#include "my_sensorif.h"
+#include "my_dlog.h"
+
+#if CONFIG_MESH_EXAMPLE_BUTTON
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define BUTTON_DEBOUNCE_MS  CONFIG_MESH_EXAMPLE_BUTTON_DEBOUNCE
+#if CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE
+#define BUTTON_SIM_PERIOD_US    (CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE_PERIOD * 1000ULL)
+#define BUTTON_SIM_BOUNCES      (3)     /* 每次翻转时的抖动次数 */
+#else
+#define BUTTON_GPIO         CONFIG_MESH_EXAMPLE_BUTTON_GPIO
+#endif
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *TAG = "Example_button";
+static uint8_t button_value = 0;
+#if CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE
+static esp_timer_handle_t button_timer;
+static uint8_t button_level = 1;    /* 模拟的电平，按下为0 */
+#endif
+MY_SENSOR_DECLARE(example_button);  /* 名称排在example之后，不改变example的sid */
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+#if CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE
+/**
+ * 模拟按键：定时翻转电平，翻转时先产生几次抖动
+ * 在esp_timer任务中调用，与在GPIO中断中的调用方式相同
+ */
+static void button_sim_timer(void *arg)
+{
+    button_level = !button_level;
+    for(uint8_t i = 0; i < BUTTON_SIM_BOUNCES; i++) {
+        my_sensor_event_from_isr(MY_SENSOR_DESC(example_button), (i % 2) ? !button_level : button_level);
+    }
+    my_sensor_event_from_isr(MY_SENSOR_DESC(example_button), button_level);
+}
+#else
+// 电平变化时的中断，数值为GPIO电平
+static void button_isr(void *arg)
+{
+    my_sensor_event_from_isr(MY_SENSOR_DESC(example_button), gpio_get_level(BUTTON_GPIO));
+}
+#endif
+
+static my_sensor_err_t init(void)
+{
+#if CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE
+    esp_timer_create_args_t timer_args = {
+        .callback = button_sim_timer,
+        .name     = "button_sim",
+    };
+    if((esp_timer_create(&timer_args, &button_timer) != ESP_OK)
+       || (esp_timer_start_periodic(button_timer, BUTTON_SIM_PERIOD_US) != ESP_OK)) {
+        ESP_LOGE(TAG, "Button simulation timer start failed!");
+        return MY_SENSOR_ERR_INVALID;
+    }
+    MY_DLOGW(TAG, "Example button init (simulated)!");
+#else
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << BUTTON_GPIO,
+        .mode         = GPIO_MODE_INPUT,
+        .pull_up_en   = GPIO_PULLUP_ENABLE,
+        .intr_type    = GPIO_INTR_ANYEDGE,
+    };
+    esp_err_t err = gpio_config(&io_conf);
+    // 中断服务可能已经由其他模块安装
+    if(err == ESP_OK) {
+        err = gpio_install_isr_service(0);
+        err = (err == ESP_ERR_INVALID_STATE) ? ESP_OK : err;
+    }
+    if(err == ESP_OK) {
+        err = gpio_isr_handler_add(BUTTON_GPIO, button_isr, NULL);
+    }
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Button gpio %d init failed: 0x%x", BUTTON_GPIO, err);
+        return MY_SENSOR_ERR_INVALID;
+    }
+    MY_DLOGW(TAG, "Example button init, gpio %d!", BUTTON_GPIO);
+#endif
+    return MY_SENSOR_ERR_OK;
+}
+
+static my_sensor_err_t exits(void)
+{
+#if CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE
+    esp_timer_stop(button_timer);
+    esp_timer_delete(button_timer);
+#else
+    gpio_isr_handler_remove(BUTTON_GPIO);
+#endif
+    MY_DLOGW(TAG, "Example button exit!");
+    return MY_SENSOR_ERR_OK;
+}
+
+static my_sensor_err_t write(void *arg)
+{
+    // 只读设备
+    return MY_SENSOR_ERR_ARGS;
+}
+
+// 读取当前电平，用于服务器的查询
+static my_sensor_err_t read_default(my_sensorif_data_t *out)
+{
+#if CONFIG_MESH_EXAMPLE_BUTTON_SIMULATE
+    button_value = button_level;
+#else
+    button_value = gpio_get_level(BUTTON_GPIO);
+#endif
+    out->num  = 1;
+    out->data = &button_value;
+    return MY_SENSOR_ERR_OK;
+}
+
+static my_sensor_err_t read(void *in, my_sensorif_data_t *out)
+{
+    return read_default(out);
+}
+
+/*******************************************************
+ *                Sensor Register
+ *******************************************************/
+MY_SENSOR_REGISTER(example_button,
+    .mode = MY_SENSOR_MODE_READ,
+    .type = MY_SENSOR_TYPE_BIN,
+    .init = init,
+    .exits = exits,
+    .write = write,
+    .read = read,
+    .read_default = read_default,
+    .event = true,
+    .debounce_ms = BUTTON_DEBOUNCE_MS,
+);
+
+#endif
@@ -1,6 +0,0 @@
-#ifndef __EXAMPLE_SENSOR_H__
-#define __EXAMPLE_SENSOR_H__
-
-void example_sensor_init(void);
-
-#endif
\ No newline at end of file
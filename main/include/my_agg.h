@@ -0,0 +1,129 @@
+#ifndef __MY_AGG_H__
+#define __MY_AGG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * 中间节点的数据聚合（开启CONFIG_MESH_AGG时）
+ *
+ * toDS数据包由ESP-MESH协议栈逐跳转发，中间节点的应用看不到，根节点和第2层节点
+ * 要逐个转发整个网络的数据包。开启后非根节点不再发送toDS，而是把sensor数据作为记录
+ * 发给父节点(MESH_CTRL_AGG，P2P)，每个节点把自己和子节点的记录合并到一个窗口中，
+ * 窗口结束时向父节点发送一个聚合帧；根节点把聚合帧拆成原来的记录交给上行，
+ * 服务器收到的数据格式不变。
+ * 平均模式下同一窗口内来源节点和sid都相同的记录合并为平均值，samples为合并的采样次数。
+ *
+ * 聚合帧格式：
+ *   my_agg_hdr_t | my_agg_rec_t | num个数值 | my_agg_rec_t | num个数值 ...
+ *
+ * 不加锁，同一个my_agg_t在多个任务中使用时由调用者加锁。
+ */
+
+#define MY_AGG_VALUES   (8)     /* 每条记录的数值个数上限，更多数值的数据不聚合 */
+
+// 聚合帧头部(MESH_PROTO_BIN)
+typedef struct __attribute__((packed)) {
+    uint8_t type;       /* MESH_CTRL_AGG */
+    uint8_t count;      /* 记录条数 */
+} my_agg_hdr_t;
+
+// 记录头部，后接num个uint8_t数值
+typedef struct __attribute__((packed)) {
+    uint8_t src[6];     /* 数据来源节点的mesh地址 */
+    uint8_t sid;
+    uint8_t samples;    /* 合并的采样次数，没有合并时为1 */
+    uint8_t num;        /* 数值个数 */
+} my_agg_rec_t;
+
+// 窗口中缓存的一条记录
+typedef struct {
+    my_agg_rec_t rec;
+    uint16_t sum[MY_AGG_VALUES];    /* 数值乘以采样次数的和 */
+} my_agg_slot_t;
+
+typedef struct {
+    my_agg_slot_t *slots;
+    uint16_t slot_num;
+    uint16_t used;
+    bool     average;       /* 平均模式 */
+    int64_t  window_us;
+    int64_t  first;         /* 窗口中第一条记录加入的时间(us) */
+    // 统计
+    uint32_t records;       /* 加入的记录数 */
+    uint32_t merged;        /* 平均模式下合并到已有记录中的记录数 */
+    uint32_t frames;        /* 输出的聚合帧数 */
+    uint32_t dropped;       /* 窗口已满并且无法发送，丢弃的记录数，由调用者统计 */
+} my_agg_t;
+
+/**
+ * 解析聚合帧时每条记录的回调
+ * values为记录中的数值，只在回调期间有效
+ */
+typedef void (*my_agg_rec_cb_t)(void *arg, const my_agg_rec_t *rec, const uint8_t *values);
+
+// 能放下slot_num条记录的聚合帧长度
+#define MY_AGG_FRAME_SIZE(_slots)   (sizeof(my_agg_hdr_t) + (_slots) * (sizeof(my_agg_rec_t) + MY_AGG_VALUES))
+
+#if CONFIG_MESH_AGG
+/**
+ * 功能：
+ *  初始化聚合窗口
+ * 参数：
+ *  [in]agg:       聚合窗口
+ *  [in]slots:     缓存记录的数组，由调用者提供
+ *  [in]slot_num:  数组长度，不超过255
+ *  [in]window_ms: 窗口长度(ms)，从第一条记录加入时开始
+ *  [in]average:   是否使用平均模式
+ **/
+void my_agg_init(my_agg_t *agg, my_agg_slot_t *slots, uint16_t slot_num, uint32_t window_ms, bool average);
+
+/**
+ * 功能：
+ *  加入一条记录
+ * 参数：
+ *  [in]agg:    聚合窗口
+ *  [in]rec:    记录头部
+ *  [in]values: rec->num个数值
+ *  [in]now:    当前时间(us)
+ * 返回值：
+ *  true: 成功
+ *  false: 数值个数超过MY_AGG_VALUES，或者窗口已满，需要先用my_agg_take取出
+ **/
+bool my_agg_add(my_agg_t *agg, const my_agg_rec_t *rec, const uint8_t *values, int64_t now);
+
+// 窗口已经结束，需要发送
+bool my_agg_due(const my_agg_t *agg, int64_t now);
+
+/**
+ * 功能：
+ *  取出窗口中的所有记录，组成聚合帧，并清空窗口
+ * 参数：
+ *  [in]agg:    聚合窗口
+ *  [out]frame: 聚合帧缓冲区
+ *  [in]size:   缓冲区长度，不小于MY_AGG_FRAME_SIZE(slot_num)时可以放下所有记录
+ * 返回值：
+ *  聚合帧长度，窗口为空时返回0
+ **/
+uint16_t my_agg_take(my_agg_t *agg, uint8_t *frame, uint16_t size);
+
+/**
+ * 功能：
+ *  解析聚合帧，对每条记录调用cb
+ * 参数：
+ *  [in]frame: 聚合帧
+ *  [in]len:   长度
+ *  [in]cb:    回调函数
+ *  [in]arg:   传给回调函数的参数
+ * 返回值：
+ *  记录条数，格式错误时返回-1（错误之前的记录已经处理）
+ **/
+int my_agg_foreach(const uint8_t *frame, uint16_t len, my_agg_rec_cb_t cb, void *arg);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中模拟一棵树，比较不聚合、合并和平均时根节点收到的帧数（my_agg_sim.c）
+void my_agg_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __MY_BENCH_H__
+#define __MY_BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * 数据通路的性能测试（开启CONFIG_MESH_BENCH时）
+ * 在目标板上依次测试sensor查找/读写、sensorif轮询、队列传递和数据包打包，
+ * 输出每次操作的耗时(ns)、吞吐量和每次操作的内存申请，
+ * 最后输出一行JSON，便于在不同版本之间比较。
+ * 也可以用bench/中的pipeline_bench在主机上运行，各功能的模拟除外。
+ *
+ * 各功能的模拟放在功能旁边的my_xxx_sim.c中（同时开启该功能时编译），由测试任务依次调用，
+ * 使用下面的随机数和JSON输出函数，每个模拟输出一行：
+ *   {"bench":"名称",参数...,"runs":[{...},{...}]}
+ * 这一行在my_bench_json_end时一次输出，期间的日志不会插入其中。
+ */
+
+#define MY_BENCH_TAG        "bench"
+
+// 数组的元素个数，用于各模拟的参数表
+#define MY_BENCH_COUNT(_a)  (sizeof(_a) / sizeof((_a)[0]))
+
+// 创建测试任务，测试完成后任务自动结束
+void my_bench_start(void);
+
+#if CONFIG_MESH_BENCH
+/**
+ * 功能：
+ *  模拟使用的伪随机数（线性同余），同一个种子得到的序列在主机和目标板上相同
+ * 参数：
+ *  [in,out]seed: 各模拟自己的状态
+ *  [in]range:    范围，不超过2^24
+ * 返回值：
+ *  [0, range)中的随机数
+ **/
+uint32_t my_bench_rand(uint32_t *seed, uint32_t range);
+
+/**
+ * 功能：
+ *  开始一行JSON，输出{"bench":"bench"，fmt不为NULL时接着输出,和fmt的内容
+ * 参数：
+ *  [in]bench: 名称
+ *  [in]fmt:   模拟的参数，如"\"nodes\":%u"，可以为NULL
+ **/
+void my_bench_json_begin(const char *bench, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// 开始一个名为key的数组，之后用my_bench_json_item输出其中的对象
+void my_bench_json_list(const char *key);
+
+// 输出数组中的一个对象{fmt的内容}，自动添加分隔的逗号
+void my_bench_json_item(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// 结束这一行JSON并输出，开始过数组时先结束数组
+void my_bench_json_end(void);
+
+// 比较C++驱动层在编译时展开的读取和sensorif的函数指针读取（my_sensor_driver_sim.cpp）
+void my_sensor_driver_sim(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef __MY_BUS_H__
+#define __MY_BUS_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/**
+ * 共享总线的传输调度（开启CONFIG_MESH_BUS时）
+ *
+ * 每条总线(I2C/SPI等)注册一个执行函数，由各自的任务执行，不同总线之间并行。
+ * 一次提交的多个传输用链表连接，执行函数尽量把它们放在一个命令链表或DMA传输中，
+ * 因此循环读取时同一总线上的所有sensor只需要一次总线事务。
+ * sensor在sif中用bus/xfer/decode声明所在的总线、读取需要的传输和数据的转换，
+ * 由sensorif的循环读取统一提交（见my_sensorif.h）。
+ */
+
+#define MY_BUS_NONE     (0)     /* 不在共享总线上，总线编号从1开始 */
+
+// 一次传输：先写入tx，再读取rx，长度为0时跳过
+typedef struct my_bus_xfer {
+    struct my_bus_xfer *next;
+    uint16_t      addr;     /* 设备地址(I2C)或片选(SPI) */
+    uint8_t       tx_len;
+    uint8_t       rx_len;
+    const uint8_t *tx;
+    uint8_t       *rx;
+    esp_err_t     err;      /* 传输结果，由执行函数写入 */
+} my_bus_xfer_t;
+
+/**
+ * 总线执行函数
+ * 按顺序执行链表中的所有传输，写入每个传输的err，在总线任务中调用
+ */
+typedef void (*my_bus_exec_t)(void *ctx, my_bus_xfer_t *xfers);
+
+#if CONFIG_MESH_BUS
+/**
+ * 功能：
+ *  注册总线，创建执行传输的任务
+ * 参数：
+ *  [in]bus:  总线编号，1~CONFIG_MESH_BUS_NUM
+ *  [in]name: 总线名称，同时作为任务名称
+ *  [in]exec: 执行函数
+ *  [in]ctx:  传给执行函数的参数
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_ARG: 总线编号错误
+ *  ESP_ERR_INVALID_STATE: 总线已经注册
+ *  ESP_ERR_NO_MEM: 创建任务或队列失败
+ **/
+esp_err_t my_bus_register(uint8_t bus, const char *name, my_bus_exec_t exec, void *ctx);
+
+/**
+ * 功能：
+ *  提交一组传输，立即返回，全部完成后把总线编号(uint8_t)发送到done队列
+ *  完成之前传输链表和缓冲区由总线任务使用，调用者不能修改
+ * 参数：
+ *  [in]bus:   总线编号
+ *  [in]xfers: 传输链表
+ *  [in]done:  完成通知的队列，元素为uint8_t，长度不小于同时提交的次数
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_STATE: 总线没有注册
+ *  ESP_ERR_NO_MEM: 总线的队列已满
+ **/
+esp_err_t my_bus_submit(uint8_t bus, my_bus_xfer_t *xfers, QueueHandle_t done);
+
+#if defined(ESP_PLATFORM)
+/**
+ * I2C主机的执行函数，ctx为I2C端口号，如(void *)I2C_NUM_0
+ * 所有传输放在一个命令链表中执行，失败时逐个重新执行以确定出错的设备
+ **/
+void my_bus_i2c_exec(void *ctx, my_bus_xfer_t *xfers);
+#endif
+
+#if CONFIG_MESH_BENCH
+// 性能测试中用模拟的总线比较逐个读取和合并提交的读取时间（my_bus_sim.c）
+void my_bus_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef __MY_CAPTURE_H__
+#define __MY_CAPTURE_H__
+
+/**
+ * mesh数据包抓包（开启CONFIG_MESH_CAPTURE时）
+ *
+ * 收发的每个mesh数据包写入一个环形缓冲区，缓冲区满时覆盖最早的记录。
+ * 缓冲区可以通过串口导出，由tools/replay解析后回放。
+ *
+ * 本文件的格式部分只依赖标准头文件，主机端程序可以直接包含。
+ * 所有多字节字段均为小端序（与esp32一致）。
+ *
+ * 导出的数据格式：
+ *   my_capture_file_hdr_t | my_capture_rec_t | payload | my_capture_rec_t | payload ...
+ * 串口输出时每行为 "CAP:" 加上最多64字节数据的十六进制，
+ * 以 "CAP-BEGIN" 和 "CAP-END" 行作为开始和结束。
+ */
+#include <stdint.h>
+
+#define MY_CAPTURE_MAGIC    (0x5043)    /* 内存中为 'C' 'P' */
+#define MY_CAPTURE_VERSION  (1)
+
+// 数据包方向
+typedef enum {
+    MY_CAPTURE_RX = 0,      /* 本节点收到 */
+    MY_CAPTURE_TX,          /* 本节点发出 */
+} my_capture_dir_t;
+
+// 导出数据的头部
+typedef struct __attribute__((packed)) {
+    uint16_t magic;         /* MY_CAPTURE_MAGIC */
+    uint8_t  version;       /* MY_CAPTURE_VERSION */
+    uint8_t  reserved;
+    uint8_t  self[6];       /* 抓包节点的mesh地址 */
+    uint16_t snaplen;       /* payload保存的最大长度 */
+    uint32_t dropped;       /* 被覆盖或未能记录的数据包数 */
+} my_capture_file_hdr_t;
+
+// 每个数据包的记录头部，后接cap_len字节的payload
+typedef struct __attribute__((packed)) {
+    uint32_t dt_us;         /* 与上一个记录的时间间隔(us) */
+    uint8_t  dir;           /* my_capture_dir_t */
+    uint8_t  proto;         /* mesh_proto_t */
+    uint8_t  tos;           /* mesh_tos_t */
+    uint8_t  flag;          /* MESH_DATA_xxx */
+    uint8_t  from[6];       /* mesh_addr_t */
+    uint8_t  to[6];         /* mesh_addr_t */
+    uint16_t len;           /* 原始长度 */
+    uint16_t cap_len;       /* 保存的长度，不超过snaplen */
+} my_capture_rec_t;
+
+#if defined(ESP_PLATFORM)
+#include "esp_mesh.h"
+
+#if CONFIG_MESH_CAPTURE
+/**
+ * 功能：
+ *  记录一个数据包，可以在多个任务中同时调用
+ * 参数：
+ *  [in]dir:  方向
+ *  [in]from: 源地址，为NULL时使用本节点地址
+ *  [in]to:   目的地址，为NULL时使用本节点地址
+ *  [in]data: 数据包
+ *  [in]flag: 收发时使用的MESH_DATA_xxx
+ **/
+void my_capture_frame(my_capture_dir_t dir, const mesh_addr_t *from, const mesh_addr_t *to,
+                      const mesh_data_t *data, int flag);
+
+// 通知抓包任务导出缓冲区，导出期间暂停记录
+void my_capture_dump(void);
+
+// 抓包初始化，self为本节点地址
+void my_capture_init(const mesh_addr_t *self);
+
+#define MY_CAPTURE_FRAME(_dir, _from, _to, _data, _flag)  my_capture_frame(_dir, _from, _to, _data, _flag)
+#else
+#define MY_CAPTURE_FRAME(_dir, _from, _to, _data, _flag)
+#endif
+
+#endif
+
+#endif
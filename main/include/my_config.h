@@ -0,0 +1,70 @@
+#ifndef __MY_CONFIG_H__
+#define __MY_CONFIG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "my_report.h"
+
+/**
+ * 可远程修改的sensor配置（开启CONFIG_MESH_SENSOR_CONFIG时）
+ *
+ * 循环读取的周期、sensor间隔，以及每个sensor是否读取、读取频率、平均次数、阈值和优先级，
+ * 由服务器下行(MY_REPORT_DOWN_CONFIG)或MQTT的config topic修改，格式为my_report_config_t。
+ * 根节点把配置作为MESH_CTRL_CONFIG控制消息转发给目的节点，节点收到后立即生效，
+ * sensorif任务在下一次循环读取时使用新的配置。
+ *
+ * 所有配置保存在NVS的一个blob中（MESH_NVS_KEY_SENSOR_CONFIG），按sensor名称的哈希对应，
+ * 增删sensor后其他sensor的配置仍然有效。修改后不立即写入，
+ * 第一次修改之后CONFIG_MESH_SENSOR_CONFIG_COMMIT_S秒内的所有修改合并为一次写入，
+ * 与已保存的内容相同时不写入，减少flash磨损。
+ */
+
+#define MY_CONFIG_SENSORS   (32)    /* 可以配置的sensor数，sid更大的sensor使用默认配置 */
+#define MY_CONFIG_VERSION   (1)     /* NVS中blob的格式版本 */
+
+// 统计信息
+typedef struct {
+    uint32_t applied;       /* 生效的配置消息数 */
+    uint32_t rejected;      /* 格式错误的配置消息数 */
+    uint32_t commits;       /* 写入NVS的次数 */
+    uint32_t unchanged;     /* 内容与已保存的相同、没有写入的次数 */
+} my_config_stats_t;
+
+#if CONFIG_MESH_SENSOR_CONFIG
+// 从NVS读取配置，没有保存时使用默认配置，在sensorif初始化时调用
+void my_config_init(void);
+
+/**
+ * 功能：
+ *  修改配置，立即生效，延时写入NVS
+ * 参数：
+ *  [in]data: my_report_config_t
+ *  [in]len:  长度
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_SIZE: 长度错误
+ *  ESP_ERR_INVALID_ARG: 数值超出范围
+ *  ESP_ERR_NOT_FOUND: sid不存在
+ **/
+esp_err_t my_config_apply(const uint8_t *data, uint16_t len);
+
+// 获取全局设置
+void my_config_get_global(my_report_config_global_t *global);
+
+// 获取sensor的设置，sid不存在或超出MY_CONFIG_SENSORS时为默认配置
+void my_config_get_sensor(uint8_t sid, my_report_config_sensor_t *sensor);
+
+/**
+ * 功能：
+ *  有修改并且到了写入时间时写入NVS，由mesh发送任务定期调用
+ * 参数：
+ *  [in]force: 有修改时立即写入，重启之前使用
+ **/
+void my_config_poll(bool force);
+
+// 获取统计信息
+void my_config_get_stats(my_config_stats_t *stats);
+#endif
+
+#endif
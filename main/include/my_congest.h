@@ -0,0 +1,64 @@
+#ifndef __MY_CONGEST_H__
+#define __MY_CONGEST_H__
+
+#include <stdint.h>
+#include "esp_mesh.h"
+
+/**
+ * mesh拥塞检测（开启CONFIG_MESH_ADAPTIVE_SAMPLING时）
+ *
+ * 根据本地的拥塞信号计算拥塞级别：
+ *  - mesh任务队列中等待发送的sensor数据个数
+ *  - mesh发往父节点的待发送数据包数(esp_mesh_get_tx_pending)
+ *  - (根节点)等待转发的toDS数据包数(esp_mesh_get_rx_pending)和上行丢弃的记录数
+ * 级别升高时立即生效，降低时每隔CONFIG_MESH_CONGEST_RECOVER_MS降一级。
+ * 根节点拥塞时向子节点发送拥塞通知，各节点收到后转发给自己的子节点，逐层到达所有节点，
+ * 节点使用本地级别和通知级别中较高的一个。
+ * sensorif任务根据级别降低发送的数据量：先加倍采样周期，拥塞较重时切换为聚合模式，
+ * 多次采样的平均值合并为一次发送。
+ */
+
+// 拥塞级别，每升高一级发送的数据量减半
+typedef enum {
+    MY_CONGEST_NONE = 0,
+    MY_CONGEST_LIGHT,
+    MY_CONGEST_HEAVY,       /* 开始聚合发送 */
+    MY_CONGEST_SEVERE,
+
+    MY_CONGEST_LEVEL_NUM,
+} my_congest_level_t;
+
+// 拥塞通知消息(MESH_PROTO_BIN)
+typedef struct __attribute__((packed)) {
+    uint8_t  type;          /* MESH_CTRL_CONGEST */
+    uint8_t  level;         /* my_congest_level_t */
+    uint16_t hold_s;        /* 有效时间(s)，超时未更新时失效 */
+} my_congest_msg_t;
+
+#if CONFIG_MESH_ADAPTIVE_SAMPLING
+/**
+ * 功能：
+ *  采集拥塞信号并更新拥塞级别，根节点在需要时发送拥塞通知
+ *  由sensorif任务在每次采样前调用
+ * 返回值：
+ *  当前的拥塞级别
+ **/
+my_congest_level_t my_congest_update(void);
+
+// 获取当前的拥塞级别
+my_congest_level_t my_congest_get_level(void);
+
+// 本地队列已满，数据被丢弃，立即升到最高级别
+void my_congest_drop(void);
+
+/**
+ * 功能：
+ *  处理根节点发送的拥塞通知
+ * 参数：
+ *  [in]from: 发送节点的地址
+ *  [in]data: mesh数据包，内容为my_congest_msg_t
+ **/
+void my_congest_recv(const mesh_addr_t *from, const mesh_data_t *data);
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef __MY_DLOG_H__
+#define __MY_DLOG_H__
+
+/**
+ * 延迟的二进制日志（开启CONFIG_MESH_DLOG时）
+ *
+ * 调用MY_DLOGx时不格式化，只将格式字符串和tag的地址以及原始参数写入无锁的环形缓冲区，
+ * 由低优先级的任务以十六进制行从串口输出，再由tools/dlog根据固件的elf文件格式化。
+ * 未开启时MY_DLOGx等同于ESP_LOGx。
+ *
+ * 限制：
+ *  - 参数最多MY_DLOG_ARGS_MAX个，每个参数按32位保存，不支持浮点数和64位整数
+ *  - %s的参数必须指向固件中的常量字符串
+ *
+ * 各模块可以在包含本文件之前定义MY_DLOG_LOCAL_LEVEL，编译时去掉更低级别的日志。
+ *
+ * 本文件的格式部分只依赖标准头文件，主机端程序可以直接包含。
+ * 在主机上编译固件代码时（bench/）定义MY_DLOG_HOST，MY_DLOGx使用主机替代的ESP_LOGx。
+ * 所有多字节字段均为小端序（与esp32一致）。
+ *
+ * 串口输出的格式：每行为 "DLOG:" 加上一条记录的十六进制，
+ *   my_dlog_rec_hdr_t | nargs个uint32_t参数
+ */
+#include <stdint.h>
+
+#define MY_DLOG_ARGS_MAX    (6)
+
+// 记录头部
+typedef struct __attribute__((packed)) {
+    uint32_t ts_us;     /* esp_timer_get_time()的低32位 */
+    uint32_t fmt;       /* 格式字符串的地址 */
+    uint32_t tag;       /* tag字符串的地址 */
+    uint8_t  level;     /* esp_log_level_t */
+    uint8_t  nargs;     /* 参数个数 */
+    uint16_t lost;      /* 上一条记录之后因缓冲区满丢弃的记录数 */
+} my_dlog_rec_hdr_t;
+
+#if defined(ESP_PLATFORM) || defined(MY_DLOG_HOST)
+#include "esp_log.h"
+
+#ifndef MY_DLOG_LOCAL_LEVEL
+#if CONFIG_MESH_DLOG
+#define MY_DLOG_LOCAL_LEVEL     CONFIG_MESH_DLOG_LEVEL
+#else
+#define MY_DLOG_LOCAL_LEVEL     LOG_LOCAL_LEVEL
+#endif
+#endif
+
+#if CONFIG_MESH_DLOG
+/**
+ * 功能：
+ *  写入一条记录，可以在任务和中断中调用，缓冲区满时丢弃
+ *  一般通过MY_DLOGx调用
+ * 参数：
+ *  [in]level: 日志级别
+ *  [in]tag:   tag，必须是常量字符串
+ *  [in]fmt:   格式字符串，必须是常量字符串
+ *  [in]nargs: 参数个数
+ *  [in]args:  参数
+ **/
+void my_dlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                   uint8_t nargs, const uint32_t *args);
+
+// 延迟日志初始化，启动输出任务
+void my_dlog_init(void);
+
+// 参数转换为uint32_t，并计算参数个数
+#define MY_DLOG_U32(_x)     ((uint32_t)(uintptr_t)(_x))
+#define MY_DLOG_A0()
+#define MY_DLOG_A1(a)                   , MY_DLOG_U32(a)
+#define MY_DLOG_A2(a, b)                MY_DLOG_A1(a) MY_DLOG_A1(b)
+#define MY_DLOG_A3(a, b, c)             MY_DLOG_A2(a, b) MY_DLOG_A1(c)
+#define MY_DLOG_A4(a, b, c, d)          MY_DLOG_A3(a, b, c) MY_DLOG_A1(d)
+#define MY_DLOG_A5(a, b, c, d, e)       MY_DLOG_A4(a, b, c, d) MY_DLOG_A1(e)
+#define MY_DLOG_A6(a, b, c, d, e, f)    MY_DLOG_A5(a, b, c, d, e) MY_DLOG_A1(f)
+#define MY_DLOG_SEL(_0, _1, _2, _3, _4, _5, _6, _n, ...)    _n
+#define MY_DLOG_NARGS(...)  MY_DLOG_SEL(_, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define MY_DLOG_CAT(_a, _b)     _a##_b
+#define MY_DLOG_XCAT(_a, _b)    MY_DLOG_CAT(_a, _b)
+
+// 格式字符串只能是字符串常量（"" _fmt ""）
+#define MY_DLOG_LEVEL(_level, _tag, _fmt, ...) do { \
+        if(MY_DLOG_LOCAL_LEVEL >= (_level)) { \
+            const uint32_t _dlog_args[] = { 0 MY_DLOG_XCAT(MY_DLOG_A, MY_DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__) }; \
+            my_dlog_write(_level, _tag, "" _fmt "", MY_DLOG_NARGS(__VA_ARGS__), _dlog_args + 1); \
+        } \
+    } while(0)
+#else
+#define MY_DLOG_LEVEL(_level, _tag, _fmt, ...) do { \
+        if(MY_DLOG_LOCAL_LEVEL >= (_level)) { \
+            ESP_LOG_LEVEL_LOCAL(_level, _tag, _fmt, ##__VA_ARGS__); \
+        } \
+    } while(0)
+#endif
+
+#define MY_DLOGE(_tag, _fmt, ...)   MY_DLOG_LEVEL(ESP_LOG_ERROR,   _tag, _fmt, ##__VA_ARGS__)
+#define MY_DLOGW(_tag, _fmt, ...)   MY_DLOG_LEVEL(ESP_LOG_WARN,    _tag, _fmt, ##__VA_ARGS__)
+#define MY_DLOGI(_tag, _fmt, ...)   MY_DLOG_LEVEL(ESP_LOG_INFO,    _tag, _fmt, ##__VA_ARGS__)
+#define MY_DLOGD(_tag, _fmt, ...)   MY_DLOG_LEVEL(ESP_LOG_DEBUG,   _tag, _fmt, ##__VA_ARGS__)
+#define MY_DLOGV(_tag, _fmt, ...)   MY_DLOG_LEVEL(ESP_LOG_VERBOSE, _tag, _fmt, ##__VA_ARGS__)
+
+#endif
+
+#endif
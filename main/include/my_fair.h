@@ -0,0 +1,138 @@
+#ifndef __MY_FAIR_H__
+#define __MY_FAIR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+
+/**
+ * 根节点转发的公平调度（开启CONFIG_MESH_FAIR时）
+ *
+ * 根节点收到的toDS数据包按来源节点(from)放入各自的队列：
+ *  - 每个来源节点有一个令牌桶，超过速率的数据包直接丢弃(throttled)
+ *  - 各队列之间按差额轮询(DRR)转发，每轮每个队列最多转发quantum字节
+ *  - 缓冲的数据包总数超过上限时，丢弃最长队列中最早的数据包
+ * 数据包复制到内存池中大小合适的块中缓存。
+ *
+ * 不加锁，同一个my_fair_t只能在一个任务中使用。
+ */
+
+#if CONFIG_MESH_FAIR
+
+/**
+ * 转发函数
+ * 返回ESP_ERR_NO_MEM表示暂时无法转发，数据包保留在队列中，下次再转发；
+ * 返回其他错误时数据包被丢弃
+ */
+typedef esp_err_t (*my_fair_sink_t)(const mesh_addr_t *from, const mesh_addr_t *to,
+                                    const mesh_data_t *data, int flag);
+
+// 缓存的数据包，存放在内存池的块中
+typedef struct my_fair_pkt {
+    struct my_fair_pkt *next;
+    mesh_addr_t to;
+    int         flag;
+    uint16_t    size;
+    uint8_t     proto;
+    uint8_t     tos;
+    uint8_t     data[];
+} my_fair_pkt_t;
+
+// 每个来源节点的状态
+typedef struct {
+    mesh_addr_t   addr;
+    bool          used;
+    bool          active;       /* 在轮询链表中 */
+    bool          credited;     /* 本轮已加过quantum */
+    uint16_t      qlen;
+    uint16_t      next;         /* 轮询链表中的下一个 */
+    int32_t       deficit;      /* 本轮还可以转发的字节数 */
+    int64_t       tat;          /* 令牌桶：下一个数据包的理论到达时间(us) */
+    int64_t       last_seen;
+    my_fair_pkt_t *head;
+    my_fair_pkt_t *tail;
+    uint32_t      forwarded;
+    uint32_t      throttled;
+    uint32_t      overflow;
+} my_fair_flow_t;
+
+// 统计信息
+typedef struct {
+    uint32_t enqueued;      /* 进入队列的数据包数 */
+    uint32_t forwarded;     /* 已转发的数据包数 */
+    uint32_t throttled;     /* 超过速率被丢弃的数据包数 */
+    uint32_t overflow;      /* 队列满被丢弃的数据包数 */
+    uint32_t dropped;       /* 转发失败或没有内存被丢弃的数据包数 */
+    uint16_t flows;         /* 当前记录的来源节点数 */
+    uint16_t queued;        /* 当前缓存的数据包数 */
+} my_fair_stats_t;
+
+typedef struct {
+    my_fair_flow_t  flows[CONFIG_MESH_FAIR_FLOWS];
+    uint16_t        active_head;
+    uint16_t        active_tail;
+    uint16_t        queued;
+    uint32_t        interval_us;    /* 令牌桶：每个数据包的间隔，0为不限速 */
+    uint32_t        tolerance_us;   /* 令牌桶：允许的突发 */
+    uint16_t        quantum;
+    my_fair_stats_t stats;
+} my_fair_t;
+
+/**
+ * 功能：
+ *  初始化
+ * 参数：
+ *  [in]fair:    调度器
+ *  [in]rate:    每个来源节点的速率(数据包/s)，0为不限速
+ *  [in]burst:   每个来源节点允许的突发数据包数
+ *  [in]quantum: 每轮每个来源节点可以转发的字节数
+ **/
+void my_fair_init(my_fair_t *fair, uint32_t rate, uint32_t burst, uint16_t quantum);
+
+/**
+ * 功能：
+ *  将一个数据包放入来源节点的队列，数据会被复制
+ * 参数：
+ *  [in]fair:   调度器
+ *  [in]from:   来源节点地址
+ *  [in]to:     目的地址
+ *  [in]data:   数据包
+ *  [in]flag:   接收时的flag
+ *  [in]now_us: 当前时间(us)
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_STATE: 超过速率被丢弃
+ *  ESP_ERR_NO_MEM: 队列满或没有内存被丢弃
+ **/
+esp_err_t my_fair_enqueue(my_fair_t *fair, const mesh_addr_t *from, const mesh_addr_t *to,
+                          const mesh_data_t *data, int flag, int64_t now_us);
+
+/**
+ * 功能：
+ *  按差额轮询转发缓存的数据包，sink返回ESP_ERR_NO_MEM时停止
+ * 参数：
+ *  [in]fair: 调度器
+ *  [in]sink: 转发函数
+ *  [in]max:  最多转发的数据包数
+ * 返回值：
+ *  转发的数据包数
+ **/
+uint32_t my_fair_dequeue(my_fair_t *fair, my_fair_sink_t sink, uint32_t max);
+
+// 丢弃所有缓存的数据包（不再是根节点时调用）
+void my_fair_flush(my_fair_t *fair);
+
+// 获取统计信息
+void my_fair_get_stats(const my_fair_t *fair, my_fair_stats_t *stats);
+
+// 输出统计信息和被限速最多的节点
+void my_fair_report(const my_fair_t *fair);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中模拟一个节点大量发送时按到达顺序转发和公平调度的结果（my_fair_sim.c）
+void my_fair_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __MY_LATEST_H__
+#define __MY_LATEST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "my_report.h"
+
+/**
+ * 根节点的最新数值表（开启CONFIG_MESH_LATEST时）
+ *
+ * 根节点交给上行的每条节点数据按(节点地址, sid)保存最近一次的数值和更新时间，
+ * 服务器用MY_REPORT_DOWN_QUERY一次读取多个数值，不需要进入mesh。
+ * 表为线性探测的开放寻址哈希表，键和数值分开存放：查找时只读连续的8字节键数组，
+ * 命中后才访问数值。超过max_age_s没有更新的数值不再返回，它们的位置可以重新使用；
+ * 占用达到3/4时替换最久没有更新的数值。删除使用向后移动，不留下删除标记。
+ *
+ * 不加锁，由调用者保证同一个my_latest_t不被同时使用。
+ */
+
+#if CONFIG_MESH_LATEST
+// 一个节点一个sensor的最新数值
+typedef struct {
+    int64_t  updated;       /* 最近一次更新的时间(us) */
+    uint8_t  num;           /* 保存的数值个数，超过CONFIG_MESH_LATEST_VALUES的部分不保存 */
+    uint8_t  values[CONFIG_MESH_LATEST_VALUES];
+} my_latest_val_t;
+
+// 统计信息
+typedef struct {
+    uint32_t updates;       /* 更新次数 */
+    uint32_t inserts;       /* 新增的键数 */
+    uint32_t evictions;     /* 表满时替换的数值数 */
+    uint32_t lookups;       /* 查找次数（包括更新） */
+    uint32_t probes;        /* 查找时检查的键数，probes / lookups为平均探测长度 */
+    uint32_t queries;       /* 处理的查询数 */
+} my_latest_stats_t;
+
+typedef struct {
+    uint64_t keys[CONFIG_MESH_LATEST_SIZE];     /* (地址 << 8) | sid，0为空位 */
+    my_latest_val_t vals[CONFIG_MESH_LATEST_SIZE];
+    uint16_t count;         /* 已使用的位置数，包括已过期的 */
+    int64_t  max_age_us;
+    my_latest_stats_t stats;
+} my_latest_t;
+
+/**
+ * 功能：
+ *  初始化最新数值表
+ * 参数：
+ *  [in]latest:    数值表
+ *  [in]max_age_s: 多久没有更新的数值不再返回，0为不限制
+ **/
+void my_latest_init(my_latest_t *latest, uint32_t max_age_s);
+
+/**
+ * 功能：
+ *  更新一个节点一个sensor的数值，不存在时添加
+ * 参数：
+ *  [in]latest: 数值表
+ *  [in]addr:   节点的mesh地址
+ *  [in]sid:    sensor id
+ *  [in]values: 数值
+ *  [in]num:    数值个数
+ *  [in]now:    当前时间(us)
+ **/
+void my_latest_update(my_latest_t *latest, const uint8_t addr[6], uint8_t sid,
+                      const uint8_t *values, uint8_t num, int64_t now);
+
+/**
+ * 功能：
+ *  更新节点数据(payload)中的数值，格式见my_report.h，没有sid的旧格式记为sid 0
+ * 参数：
+ *  [in]latest:  数值表
+ *  [in]addr:    节点的mesh地址
+ *  [in]payload: 节点数据
+ *  [in]len:     节点数据的长度
+ *  [in]now:     当前时间(us)
+ * 返回值：
+ *  格式正确时返回true
+ **/
+bool my_latest_update_payload(my_latest_t *latest, const uint8_t addr[6], const uint8_t *payload,
+                              uint16_t len, int64_t now);
+
+// 查找一个节点一个sensor的数值，不存在或已过期时返回NULL
+const my_latest_val_t *my_latest_get(my_latest_t *latest, const uint8_t addr[6], uint8_t sid, int64_t now);
+
+/**
+ * 功能：
+ *  按查询条件生成一条响应记录，从query->cursor开始，直到表尾或buf放不下
+ * 参数：
+ *  [in]latest: 数值表
+ *  [in]query:  查询，后接query->num个my_report_query_key_t
+ *  [in]now:    当前时间(us)
+ *  [out]buf:   响应记录(my_report_latest_hdr_t | 数值...)
+ *  [in]size:   buf的大小，至少能放下头部和一个数值
+ *  [in,out]cursor: 开始的位置，返回下一次开始的位置，表尾为MY_REPORT_QUERY_END
+ * 返回值：
+ *  响应记录的长度
+ **/
+uint16_t my_latest_query(my_latest_t *latest, const my_report_query_t *query, int64_t now,
+                         uint8_t *buf, uint16_t size, uint16_t *cursor);
+
+// 获取统计信息
+void my_latest_get_stats(const my_latest_t *latest, my_latest_stats_t *stats);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中模拟多个节点更新数值，输出更新、查找和查询的开销（my_latest_sim.c）
+void my_latest_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __MY_MEM_H__
+#define __MY_MEM_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+/**
+ * 任务、队列和互斥锁使用的内存
+ * 开启CONFIG_MESH_STATIC_ALLOC时，由下面的DEFINE宏定义静态内存，
+ * 创建时使用FreeRTOS的静态API；否则只记录大小，创建时从堆中申请
+ */
+typedef struct {
+    StackType_t  *stack;
+    StaticTask_t *tcb;
+    uint32_t     stack_size;    /* 栈大小(字节) */
+} my_task_mem_t;
+
+typedef struct {
+    uint8_t       *storage;
+    StaticQueue_t *queue;
+    UBaseType_t   length;
+    UBaseType_t   item_size;
+} my_queue_mem_t;
+
+typedef struct {
+    StaticSemaphore_t *mutex;
+} my_mutex_mem_t;
+
+#if CONFIG_MESH_STATIC_ALLOC
+#define MY_TASK_DEFINE(_name, _stack_size)                                  \
+    static StackType_t _name##_stack[_stack_size];                          \
+    static StaticTask_t _name##_tcb;                                        \
+    static my_task_mem_t _name = { _name##_stack, &_name##_tcb, _stack_size }
+
+#define MY_QUEUE_DEFINE(_name, _length, _item_size)                         \
+    static uint8_t _name##_storage[(_length) * (_item_size)];               \
+    static StaticQueue_t _name##_queue;                                     \
+    static my_queue_mem_t _name = { _name##_storage, &_name##_queue, _length, _item_size }
+
+#define MY_MUTEX_DEFINE(_name)                                              \
+    static StaticSemaphore_t _name##_mutex;                                 \
+    static my_mutex_mem_t _name = { &_name##_mutex }
+#else
+#define MY_TASK_DEFINE(_name, _stack_size)                                  \
+    static my_task_mem_t _name = { NULL, NULL, _stack_size }
+
+#define MY_QUEUE_DEFINE(_name, _length, _item_size)                         \
+    static my_queue_mem_t _name = { NULL, NULL, _length, _item_size }
+
+#define MY_MUTEX_DEFINE(_name)                                              \
+    static my_mutex_mem_t _name = { NULL }
+#endif
+
+// 任务绑定的CPU核，单核或配置为-1时不绑定
+#if CONFIG_FREERTOS_UNICORE
+#define MY_TASK_CORE(_core)     tskNO_AFFINITY
+#else
+#define MY_TASK_CORE(_core)     (((_core) < 0) ? tskNO_AFFINITY : (_core))
+#endif
+
+/**
+ * 功能：
+ *  创建任务，并记录到内存报告中
+ * 参数：
+ *  [in]mem:  MY_TASK_DEFINE定义的任务内存
+ *  [in]func: 任务函数
+ *  [in]name: 任务名称
+ *  [in]prio: 优先级
+ *  [in]core: 绑定的CPU核，使用MY_TASK_CORE转换，tskNO_AFFINITY为不绑定
+ *  [in]arg:  任务参数
+ * 返回值：
+ *  任务handle，失败时为NULL
+ **/
+TaskHandle_t my_task_create(my_task_mem_t *mem, TaskFunction_t func, const char *name,
+                            UBaseType_t prio, BaseType_t core, void *arg);
+
+/**
+ * 功能：
+ *  结束当前任务，从内存报告中移除后删除任务
+ *  通过my_task_create创建的任务需要结束时，用它代替vTaskDelete(NULL)
+ **/
+void my_task_exit(void);
+
+// 创建队列
+QueueHandle_t my_queue_create(my_queue_mem_t *mem);
+
+// 创建互斥锁
+SemaphoreHandle_t my_mutex_create(my_mutex_mem_t *mem);
+
+// 输出内存报告：各任务的栈使用峰值、静态内存总量和堆的使用情况
+void my_mem_report(void);
+
+#if CONFIG_MESH_CPU_LOAD_REPORT
+// 输出各任务自上次输出以来的CPU占用率
+void my_task_load_report(void);
+#endif
+
+// 输出一次内存报告（及CPU占用率），并按CONFIG_MESH_MEM_REPORT_PERIOD周期输出
+void my_mem_report_start(void);
+
+#endif
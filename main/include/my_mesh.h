@@ -1,12 +1,110 @@
 #ifndef __MY_MESH_H__
 #define __MY_MESH_H__
 
+#include <string.h>
+#include "esp_mesh.h"
+#include "my_sensorif.h"
+#include "my_txq.h"
+
 // nvs各个键名
 #define MESH_NVS_KEY_NAMESPACE       "mesh_info"
 #define MESH_NVS_KEY_ROUTER_SAVED    "rt_info_saved"
 #define MESH_NVS_KEY_ROUTER_SSID     "rt_ssid"
 #define MESH_NVS_KEY_ROUTER_PASSWORD "rt_pwd"
+#define MESH_NVS_KEY_SENSOR_CONFIG   "sensor_cfg"
+#define MESH_NVS_KEY_SHARD           "shard"
+#define MESH_NVS_KEY_SHARD_NUM       "shard_num"
+#define MESH_NVS_KEY_MESH_ID         "mesh_id"
+#define MESH_NVS_KEY_CHANNEL         "channel"
+
+// sensor数据打包后的长度：[num][data][sid]
+#define MESH_SENSOR_DATA_SIZE(_num)  (((_num) + 2) * sizeof(uint8_t))
+
+// esp_mesh_set_xon_qsize设置的接收队列长度
+#define MESH_XON_QSIZE               (64)
+
+// 节点之间的控制消息(MESH_PROTO_BIN)，第一个字节为消息类型
+typedef enum {
+    MESH_CTRL_NONE = 0,
+    MESH_CTRL_CONGEST,          /* 根节点的拥塞通知，见my_congest.h */
+    MESH_CTRL_TIME_REQ,         /* 向父节点请求时间，见my_time.h */
+    MESH_CTRL_TIME_RESP,        /* 父节点的时间响应 */
+    MESH_CTRL_AGG,              /* 子节点的聚合帧，见my_agg.h */
+    MESH_CTRL_REL_DATA,         /* 带序号的toDS数据，见my_rel.h */
+    MESH_CTRL_REL_ACK,          /* 根节点的确认 */
+    MESH_CTRL_CONFIG,           /* 根节点转发的sensor配置，见my_config.h */
+    MESH_CTRL_OTA_DATA,         /* 固件块或通告，见my_ota.h */
+    MESH_CTRL_OTA_STATUS,       /* 缺少的固件块，发给父节点；收齐后发给根节点 */
+    MESH_CTRL_OTA_REBOOT,       /* 根节点发出的重启 */
+
+    MESH_CTRL_NUM,
+} mesh_ctrl_type_t;
+
+/**
+ * 功能：
+ *  将sensor数据打包成发送给服务器的格式
+ *  放在头文件中内联，主机上的性能测试(bench/)不需要编译my_mesh.c
+ * 参数：
+ *  [in]data: sensor数据
+ *  [out]buf: 打包后的数据，至少MESH_SENSOR_DATA_SIZE(data->num)字节
+ * 返回值：
+ *  打包后的长度
+ **/
+static inline uint16_t mesh_pack_sensor_data(const my_sensorif_data_t *data, uint8_t *buf)
+{
+    buf[0] = data->num;
+    // 复制sensor读取到的数据
+    memcpy(buf+1, data->data, data->num * sizeof(uint8_t));
+    // sensor id放在最后，只读取数值的旧版本服务器不受影响
+    buf[1 + data->num] = data->sid;
+
+    return MESH_SENSOR_DATA_SIZE(data->num);
+}
+
+/**
+ * 功能：
+ *  获取父节点的mesh地址，用于向父节点发送P2P数据
+ * 参数：
+ *  [out]parent: 父节点的mesh地址(STA MAC)
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_STATE: 本节点为根节点
+ *  其他: 没有连接到父节点
+ **/
+esp_err_t mesh_get_parent_addr(mesh_addr_t *parent);
+
+/**
+ * 功能：
+ *  发送数据包，开启CONFIG_MESH_TXQ时复制到发送队列后立即返回，由发送队列任务以非阻塞方式发送，
+ *  数据包发出或放弃时在该任务中调用done；否则与esp_mesh_send(to, data, flag, NULL, 0)相同，
+ *  成功时在返回之前调用done
+ * 参数：
+ *  [in]to:   目的地址，NULL为根节点
+ *  [in]data: 数据包
+ *  [in]flag: esp_mesh_send的flag
+ *  [in]done: 完成时的回调，结果见my_txq_done_cb_t，为NULL时只记录失败
+ *  [in]arg:  传给done的参数
+ * 返回值：
+ *  ESP_OK: 成功，之后一定会调用done
+ *  ESP_ERR_NO_MEM: 发送队列已满（开启CONFIG_MESH_TXQ时），不会调用done
+ *  其他: esp_mesh_send的错误，不会调用done
+ **/
+esp_err_t mesh_send_data(const mesh_addr_t *to, const mesh_data_t *data, int flag,
+                         my_txq_done_cb_t done, void *arg);
 
+/**
+ * 功能：
+ *  发送给所有子节点（连接到本节点SoftAP的节点）。根节点的通知由各节点收到后
+ *  再发给自己的子节点，逐层到达所有节点，每条链路只发送一次
+ * 参数：
+ *  [in]data:   数据包
+ *  [in]flag:   MESH_DATA_P2P之外的esp_mesh_send的flag
+ *  [in]queued: 为true时通过mesh_send_data发送，开启CONFIG_MESH_TXQ时在发送队列中重试；
+ *              为false时直接调用esp_mesh_send
+ * 返回值：
+ *  子节点数
+ **/
+uint16_t mesh_send_children(const mesh_data_t *data, int flag, bool queued);
 
 void mesh_start(void);
 #endif
\ No newline at end of file
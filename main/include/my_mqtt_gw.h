@@ -0,0 +1,80 @@
+#ifndef __MY_MQTT_GW_H__
+#define __MY_MQTT_GW_H__
+
+#include "esp_err.h"
+#include "esp_mesh.h"
+
+/**
+ * 节点与根节点之间的MQTT消息(mesh_data.proto = MESH_PROTO_MQTT)：
+ *   my_mqtt_msg_hdr_t | payload
+ * 根节点将topic_id映射为完整的topic：
+ *   上行：<prefix>/<节点mac>/<topic>
+ *   下行：<prefix>/<节点mac|all>/down/<topic>
+ * 同一(节点, topic, qos)在批次时间内的多条消息合并为一条MQTT消息发布，
+ * 其payload由若干 [uint16_t 长度][数据] 组成。
+ */
+
+// topic id，与根节点中的topic名称表一一对应
+typedef enum {
+    MY_MQTT_TOPIC_DATA = 0,     /* 上行：sensor数据 */
+    MY_MQTT_TOPIC_STATUS,       /* 上行：节点状态 */
+    MY_MQTT_TOPIC_EVENT,        /* 上行：事件 */
+    MY_MQTT_TOPIC_CMD,          /* 下行：控制命令 */
+    MY_MQTT_TOPIC_CONFIG,       /* 下行：sensor配置，见my_config.h */
+
+    MY_MQTT_TOPIC_NUM,
+} my_mqtt_topic_t;
+
+// mesh中传输的MQTT消息头部
+typedef struct __attribute__((packed)) {
+    uint8_t topic_id;   /* my_mqtt_topic_t */
+    uint8_t qos;        /* 0或1 */
+} my_mqtt_msg_hdr_t;
+
+// 节点收到下行消息时的处理函数
+typedef void (*my_mqtt_gw_handler_t)(my_mqtt_topic_t topic, const uint8_t *data, uint16_t len);
+
+/**
+ * 功能：
+ *  发布一条消息，非根节点通过mesh发送给根节点，根节点直接放入批次
+ * 参数：
+ *  [in]topic: topic id
+ *  [in]qos:   0或1
+ *  [in]data:  消息内容
+ *  [in]len:   消息长度
+ * 返回值：
+ *  mesh_send_data或my_mqtt_gw_submit的返回值
+ **/
+esp_err_t my_mqtt_gw_publish(my_mqtt_topic_t topic, uint8_t qos, const uint8_t *data, uint16_t len);
+
+/**
+ * 功能：
+ *  (根节点)提交一条从mesh收到的MQTT消息
+ * 参数：
+ *  [in]from: 消息来源节点的mesh地址
+ *  [in]data: mesh数据包，proto为MESH_PROTO_MQTT
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_ARG: 消息格式错误
+ *  ESP_ERR_NO_MEM: 批次已满，消息被丢弃
+ **/
+esp_err_t my_mqtt_gw_submit(const mesh_addr_t *from, const mesh_data_t *data);
+
+/**
+ * 功能：
+ *  处理从根节点收到的下行MQTT消息，交给注册的处理函数
+ * 参数：
+ *  [in]data: mesh数据包，proto为MESH_PROTO_MQTT
+ **/
+void my_mqtt_gw_recv(const mesh_data_t *data);
+
+// 设置下行消息的处理函数
+void my_mqtt_gw_set_handler(my_mqtt_gw_handler_t handler);
+
+// 设置网关是否可用（根节点获取/失去IP时调用）
+void my_mqtt_gw_set_online(bool online);
+
+// 网关初始化，创建MQTT客户端和网关任务
+void my_mqtt_gw_init(void);
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef __MY_OTA_H__
+#define __MY_OTA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * mesh中的固件分发（开启CONFIG_MESH_OTA时）
+ *
+ * 根节点只下载一次镜像，按MY_OTA_CHUNK_SIZE分块，以MESH_CTRL_OTA_DATA发给自己的子节点；
+ * 每个节点收到新的块后写入OTA分区，再转发给自己的子节点（沿树逐跳多播），
+ * 每条链路上每个块只传输一次，更新时间取决于树的深度而不是节点数。
+ *  - 节点一段时间没有收到新的块时，向父节点发送缺少的块的位图(MESH_CTRL_OTA_STATUS)，
+ *    父节点从自己的OTA分区读出已有的块重发（选择性修复），修复在相邻两层之间完成
+ *  - 没有数据的MESH_CTRL_OTA_DATA为通告，父节点定期发送，之后加入的子节点据此开始接收
+ *  - 收齐后节点把done的状态发给根节点，根节点等所有节点完成或超时后
+ *    逐跳发送MESH_CTRL_OTA_REBOOT，收齐的节点从新分区重启
+ * flash的操作通过my_ota_flash_t完成，每个扇区在第一次写入之前擦除，块可以按任意顺序到达。
+ *
+ * 不加锁，同一个my_ota_t在多个任务中使用时由调用者加锁。
+ */
+
+#define MY_OTA_CHUNK_SIZE   (1024)  /* 每个块的长度，最后一个块可能更短 */
+#define MY_OTA_SECTOR_SIZE  (4096)  /* flash擦除的单位 */
+#define MY_OTA_STATUS_BITS  (256)   /* 一个状态消息中位图覆盖的块数 */
+#define MY_OTA_REPAIR_BURST (32)    /* 收到一个状态消息最多重发的块数 */
+#define MY_OTA_MAX_CHUNKS   (CONFIG_MESH_OTA_MAX_KB * 1024 / MY_OTA_CHUNK_SIZE)
+
+// 数据块(MESH_PROTO_BIN)，后接块的数据，没有数据时为通告
+typedef struct __attribute__((packed)) {
+    uint8_t  type;          /* MESH_CTRL_OTA_DATA */
+    uint8_t  reserved;
+    uint16_t chunk;         /* 块序号 */
+    uint32_t id;            /* 镜像编号，根节点开始下载时生成，不为0 */
+    uint32_t size;          /* 镜像长度 */
+} my_ota_data_hdr_t;
+
+// 接收状态(MESH_PROTO_BIN)，发给父节点请求修复，完成时发给根节点
+typedef struct __attribute__((packed)) {
+    uint8_t  type;          /* MESH_CTRL_OTA_STATUS */
+    uint8_t  done;          /* 已收齐 */
+    uint16_t base;          /* 第一个缺少的块 */
+    uint32_t id;
+    uint8_t  missing[MY_OTA_STATUS_BITS / 8];   /* 第i位为1表示块base + i缺少 */
+} my_ota_status_t;
+
+// 重启(MESH_PROTO_BIN)，根节点发出，逐跳转发
+typedef struct __attribute__((packed)) {
+    uint8_t  type;          /* MESH_CTRL_OTA_REBOOT */
+    uint8_t  reserved;
+    uint16_t delay_ms;      /* 转发之后等待多久重启 */
+    uint32_t id;            /* 只有收齐这个镜像的节点重启 */
+} my_ota_reboot_t;
+
+#define MY_OTA_FRAME_MAX    (sizeof(my_ota_data_hdr_t) + MY_OTA_CHUNK_SIZE)
+
+#if CONFIG_MESH_OTA
+
+// OTA分区的操作，offset为分区内的偏移
+typedef struct {
+    esp_err_t (*erase)(void *arg, uint32_t offset, uint32_t len);
+    esp_err_t (*write)(void *arg, uint32_t offset, const void *data, uint32_t len);
+    esp_err_t (*read)(void *arg, uint32_t offset, void *data, uint32_t len);
+    void *arg;
+} my_ota_flash_t;
+
+// 统计信息
+typedef struct {
+    uint32_t received;      /* 写入的新块数 */
+    uint32_t duplicate;     /* 已有的块数 */
+    uint32_t repaired;      /* 为子节点重发的块数 */
+    uint32_t requests;      /* 发给父节点的修复请求数 */
+    uint32_t errors;        /* flash操作失败次数 */
+} my_ota_stats_t;
+
+typedef struct {
+    const my_ota_flash_t *flash;
+    uint32_t id;            /* 0表示没有正在接收的镜像 */
+    uint32_t size;
+    uint16_t total;         /* 块数 */
+    uint16_t count;         /* 已收到的块数 */
+    int64_t  last_rx;       /* 最近一次收到新块的时间(us) */
+    int64_t  last_status;   /* 最近一次请求修复的时间(us) */
+    int64_t  repair_us;     /* 没有新块多久之后请求修复 */
+    uint8_t  have[(MY_OTA_MAX_CHUNKS + 7) / 8];
+    uint8_t  erased[(MY_OTA_MAX_CHUNKS * MY_OTA_CHUNK_SIZE / MY_OTA_SECTOR_SIZE + 7) / 8];
+    my_ota_stats_t stats;
+} my_ota_t;
+
+/**
+ * 发送一个数据块（头部和数据）
+ */
+typedef void (*my_ota_out_cb_t)(void *arg, const uint8_t *frame, uint16_t len);
+
+/**
+ * 功能：
+ *  初始化接收状态
+ * 参数：
+ *  [in]ota:       接收状态
+ *  [in]flash:     OTA分区的操作
+ *  [in]repair_ms: 没有新块多久之后请求修复(ms)
+ **/
+void my_ota_init(my_ota_t *ota, const my_ota_flash_t *flash, uint32_t repair_ms);
+
+/**
+ * 功能：
+ *  开始接收一个新镜像，清除之前的状态，id与当前相同时不做任何操作
+ * 参数：
+ *  [in]ota:  接收状态
+ *  [in]id:   镜像编号
+ *  [in]size: 镜像长度
+ *  [in]now:  当前时间(us)
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_SIZE: 镜像超过CONFIG_MESH_OTA_MAX_KB
+ **/
+esp_err_t my_ota_begin(my_ota_t *ota, uint32_t id, uint32_t size, int64_t now);
+
+/**
+ * 功能：
+ *  处理一个MESH_CTRL_OTA_DATA，编号不同时开始接收新镜像，新块写入flash
+ * 参数：
+ *  [in]ota:   接收状态
+ *  [in]frame: 数据块
+ *  [in]len:   长度
+ *  [in]now:   当前时间(us)
+ * 返回值：
+ *  ESP_OK: 新块，需要转发给子节点
+ *  ESP_ERR_INVALID_STATE: 已有的块或通告，不转发
+ *  ESP_ERR_INVALID_SIZE/ESP_ERR_INVALID_ARG: 格式错误
+ *  其他: flash操作的返回值
+ **/
+esp_err_t my_ota_recv(my_ota_t *ota, const uint8_t *frame, uint16_t len, int64_t now);
+
+// 是否有正在接收或已收齐的镜像
+bool my_ota_active(const my_ota_t *ota);
+
+// 当前镜像是否已收齐
+bool my_ota_complete(const my_ota_t *ota);
+
+// 填写当前的接收状态，base为第一个缺少的块
+void my_ota_get_status(const my_ota_t *ota, my_ota_status_t *status);
+
+/**
+ * 功能：
+ *  没有收齐并且超过repair_ms没有新块时，填写需要发给父节点的修复请求，定期调用
+ * 返回值：
+ *  true: 需要发送status
+ **/
+bool my_ota_poll(my_ota_t *ota, int64_t now, my_ota_status_t *status);
+
+/**
+ * 功能：
+ *  从flash读出一个已有的块，组成MESH_CTRL_OTA_DATA
+ * 参数：
+ *  [in]ota:    接收状态
+ *  [in]chunk:  块序号
+ *  [out]frame: 数据块，至少MY_OTA_FRAME_MAX字节
+ *  [out]len:   长度
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_NOT_FOUND: 还没有这个块
+ *  其他: flash操作的返回值
+ **/
+esp_err_t my_ota_frame(my_ota_t *ota, uint16_t chunk, uint8_t *frame, uint16_t *len);
+
+// 填写通告（没有数据的MESH_CTRL_OTA_DATA）
+void my_ota_announce(const my_ota_t *ota, my_ota_data_hdr_t *hdr);
+
+/**
+ * 功能：
+ *  处理子节点的修复请求，重发其中缺少、本节点已有的块，最多MY_OTA_REPAIR_BURST个
+ * 参数：
+ *  [in]ota:    接收状态
+ *  [in]status: 子节点的状态
+ *  [in]frame:  组成数据块的缓冲区，至少MY_OTA_FRAME_MAX字节
+ *  [in]out:    发送函数
+ *  [in]arg:    传给out的参数
+ * 返回值：
+ *  重发的块数
+ **/
+uint16_t my_ota_repair(my_ota_t *ota, const my_ota_status_t *status, uint8_t *frame,
+                       my_ota_out_cb_t out, void *arg);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中用模拟的flash分发镜像，与每个节点单独下载比较（my_ota_sim.c）
+void my_ota_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef __MY_PARENT_H__
+#define __MY_PARENT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * 按负载选择父节点（开启CONFIG_MESH_PARENT_BALANCE时）
+ *
+ * ESP-MESH按信号强度和层数选择父节点，常常出现一个父节点的SoftAP已满、附近的节点却没有子节点。
+ * 每个节点在SoftAP的信标中加入vendor IE发布自己的负载(my_parent_load_t)：
+ * 子节点数、向父节点发送队列的占用和每秒向父节点发送的数据包数（包括子树）。
+ * 非根节点定期扫描当前信道，记录收到的负载；同一层或更低层、信号强度与当前父节点相差不超过
+ * rssi_tolerance、还有空位的候选中，加入后的负载比当前父节点低hysteresis_pct以上时才换到该候选。
+ * 为了避免来回切换（多个节点根据同一次扫描同时换到同一个空闲的父节点）：
+ *  - 连续confirm次评估都选择同一个候选才切换
+ *  - 切换后hold_us之内不再切换，期间新父节点发布的负载已包含本节点
+ *
+ * 不加锁，由调用者保证同一个my_parent_t不被同时使用。
+ */
+
+#define MY_PARENT_CANDS     (8)     /* 记录的候选数 */
+#define MY_PARENT_IE_TYPE   (0x4C)  /* vendor IE的oui_type，与ESP-MESH自己的IE区分 */
+
+// 信标中发布的负载，放在vendor IE的payload中
+typedef struct __attribute__((packed)) {
+    uint8_t  layer;         /* 发布者所在的层 */
+    uint8_t  children;      /* SoftAP上的子节点数 */
+    uint8_t  capacity;      /* SoftAP最多的子节点数 */
+    uint8_t  queue_pct;     /* 向父节点发送队列的占用(%) */
+    uint16_t tx_rate;       /* 每秒向父节点发送的数据包数，包括子树 */
+} my_parent_load_t;
+
+#if CONFIG_MESH_PARENT_BALANCE
+// 候选父节点
+typedef struct {
+    uint8_t  addr[6];       /* SoftAP的MAC */
+    int8_t   rssi;
+    int64_t  seen;          /* 最近一次收到的时间(us) */
+    my_parent_load_t load;
+} my_parent_cand_t;
+
+// 切换策略
+typedef struct {
+    uint8_t  rssi_tolerance;    /* 候选比当前父节点弱多少dB以内 */
+    int8_t   rssi_min;          /* 候选的最低信号强度 */
+    uint8_t  hysteresis_pct;    /* 加入后的负载比当前父节点低多少才切换 */
+    uint8_t  confirm;           /* 连续几次评估选择同一个候选才切换 */
+    int64_t  hold_us;           /* 切换后多久之内不再切换 */
+    int64_t  stale_us;          /* 多久没有收到的候选不再使用 */
+} my_parent_policy_t;
+
+// 统计信息
+typedef struct {
+    uint32_t evaluations;   /* 评估次数 */
+    uint32_t switches;      /* 切换次数 */
+    uint32_t held;          /* 有更好的候选，但因为confirm或hold_us没有切换的次数 */
+} my_parent_stats_t;
+
+typedef struct {
+    my_parent_policy_t policy;
+    my_parent_cand_t cand[MY_PARENT_CANDS];
+    uint8_t  num;
+    uint8_t  pending[6];    /* 上次评估选择的候选 */
+    uint8_t  pending_count; /* 连续选择pending的次数 */
+    int64_t  last_switch;   /* 最近一次切换的时间(us)，0为没有切换过 */
+    my_parent_stats_t stats;
+} my_parent_t;
+
+// 初始化
+void my_parent_init(my_parent_t *parent, const my_parent_policy_t *policy);
+
+/**
+ * 功能：
+ *  记录收到的一个负载信息，候选已满时替换最久没有收到的
+ * 参数：
+ *  [in]parent: 状态
+ *  [in]addr:   发布者的SoftAP MAC
+ *  [in]rssi:   信号强度
+ *  [in]load:   负载
+ *  [in]now:    当前时间(us)
+ **/
+void my_parent_observe(my_parent_t *parent, const uint8_t addr[6], int8_t rssi,
+                       const my_parent_load_t *load, int64_t now);
+
+// 负载的代价，发送速率按队列占用加权，子节点数作为很小的附加项
+uint32_t my_parent_cost(const my_parent_load_t *load);
+
+/**
+ * 功能：
+ *  评估是否换到其他父节点，每次扫描之后调用
+ * 参数：
+ *  [in]parent:  状态
+ *  [in]current: 当前父节点的SoftAP MAC，没有收到它的负载时不切换
+ *  [in]my_rate: 本节点（包括子树）每秒向父节点发送的数据包数
+ *  [in]now:     当前时间(us)
+ * 返回值：
+ *  需要切换到的候选，NULL为不切换；返回非NULL时记为已切换
+ **/
+const my_parent_cand_t *my_parent_select(my_parent_t *parent, const uint8_t current[6],
+                                         uint16_t my_rate, int64_t now);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中模拟集中在一端的子节点，比较按信号和按负载选择父节点（my_parent_sim.c）
+void my_parent_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __MY_POOL_H__
+#define __MY_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 固定大小的数据包内存池
+ * 内存块静态分配，空闲链表使用CAS操作，不加锁，可以在任务和中断中使用。
+ * 申请时选择能放下的最小的块，块用完时使用更大的块。
+ */
+
+// 内存块大小类别
+typedef enum {
+    MY_POOL_SMALL = 0,      /* 小块，用于sensor数据和控制消息 */
+    MY_POOL_LARGE,          /* 大块，可存放一个完整的mesh数据包(MESH_MPS) */
+
+    MY_POOL_NUM,
+} my_pool_class_t;
+
+// 内存池统计信息
+typedef struct {
+    uint16_t block_size;    /* 块大小(字节) */
+    uint16_t total;         /* 块总数 */
+    uint16_t free;          /* 当前空闲块数 */
+    uint16_t min_free;      /* 运行以来空闲块数的最小值 */
+    uint32_t alloc_count;   /* 成功申请的次数 */
+    uint32_t alloc_fail;    /* 该类别的块用完的次数 */
+} my_pool_stats_t;
+
+/**
+ * 功能：
+ *  申请一个内存块
+ * 参数：
+ *  [in]size: 需要的大小(字节)
+ * 返回值：
+ *  内存块地址，没有可用的块时返回NULL
+ **/
+void *my_pool_alloc(size_t size);
+
+/**
+ * 功能：
+ *  从指定类别申请一个内存块，该类别用完时不使用更大的块。
+ *  用于长时间占用内存块的模块，不会占用其他模块需要的大块
+ * 参数：
+ *  [in]cls: 内存块类别
+ * 返回值：
+ *  内存块地址，没有可用的块时返回NULL
+ **/
+void *my_pool_alloc_class(my_pool_class_t cls);
+
+// 能放下size字节的最小类别，超过最大的块时返回MY_POOL_NUM
+my_pool_class_t my_pool_class(size_t size);
+
+/**
+ * 功能：
+ *  释放my_pool_alloc申请的内存块
+ * 参数：
+ *  [in]ptr: 内存块地址，为NULL时不做处理
+ **/
+void my_pool_free(void *ptr);
+
+// 获取指定类别的统计信息
+void my_pool_get_stats(my_pool_class_t cls, my_pool_stats_t *stats);
+
+// 内存池占用的静态内存(字节)
+uint32_t my_pool_static_size(void);
+
+// 内存池初始化，需在使用前调用一次
+void my_pool_init(void);
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef __MY_REL_H__
+#define __MY_REL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * 端到端的可靠传输（开启CONFIG_MESH_RELIABLE时）
+ *
+ * 非根节点发往服务器的每个数据包加上序号，以MESH_CTRL_REL_DATA(MESH_PROTO_BIN)发送toDS，
+ * 并保存在发送窗口中直到根节点确认。根节点去掉头部后交给上行，服务器收到的数据格式不变。
+ *  - 根节点对每个来源节点记录累积确认的序号next（之前的都已收到）和之后32个序号的接收位图，
+ *    已收到的序号不再交给上行（去重）
+ *  - 确认不是每个数据包一次：收到窗口的1/4、出现新的空洞、收到重复数据包
+ *    或第一个未确认的数据包等待超过确认延时时，发送一个MESH_CTRL_REL_ACK
+ *  - 发送节点收到确认后释放已确认的数据包；比已确认数据包更早发送、却没有被确认的
+ *    数据包视为丢失，立即重发（快速重传），其余的在超时后重发，超过重试次数后放弃
+ *  - 窗口按序号计算：最早的未确认序号之后最多发送窗口大小个序号，窗口满时放弃最早的
+ *    数据包，保证新数据能发送。数据头部带有窗口中最早的序号base，根节点据此跳过
+ *    发送节点已放弃的序号
+ * 序号为16位，按RFC 1982的方式比较。
+ *
+ * 不加锁，同一个my_rel_tx_t/my_rel_rx_t在多个任务中使用时由调用者加锁。
+ */
+
+#define MY_REL_SACK_BITS    (32)    /* 选择确认位图的长度，窗口不能超过这个值 */
+#define MY_REL_PAYLOAD_MAX  (48)    /* 窗口中保存的数据长度上限，更长的数据不经过可靠传输 */
+
+// 数据包头部(MESH_PROTO_BIN)，后接原来的数据
+typedef struct __attribute__((packed)) {
+    uint8_t  type;          /* MESH_CTRL_REL_DATA */
+    uint8_t  retry;         /* 重发次数，首次发送为0 */
+    uint16_t seq;
+    uint16_t base;          /* 发送窗口中最早的序号，更早的不会再发送 */
+} my_rel_hdr_t;
+
+// 确认(MESH_PROTO_BIN)
+typedef struct __attribute__((packed)) {
+    uint8_t  type;          /* MESH_CTRL_REL_ACK */
+    uint8_t  reserved;
+    uint16_t next;          /* 累积确认：之前的序号都已收到 */
+    uint32_t sack;          /* 第i位为1表示序号next + 1 + i已收到 */
+} my_rel_ack_t;
+
+#if CONFIG_MESH_RELIABLE
+
+// 发送窗口中的一个数据包
+typedef struct {
+    bool     used;
+    uint8_t  retry;
+    uint16_t seq;
+    uint16_t len;
+    int64_t  sent;          /* 最近一次发送的时间(us) */
+    uint8_t  data[MY_REL_PAYLOAD_MAX];
+} my_rel_slot_t;
+
+// 发送节点的统计信息
+typedef struct {
+    uint32_t sent;          /* 新数据包数 */
+    uint32_t acked;         /* 被确认的数据包数 */
+    uint32_t retransmit;    /* 重发次数 */
+    uint32_t fast;          /* 其中快速重传的次数 */
+    uint32_t expired;       /* 超过重试次数或窗口满被放弃的数据包数 */
+    uint32_t acks;          /* 收到的确认数 */
+} my_rel_tx_stats_t;
+
+typedef struct {
+    my_rel_slot_t     slots[CONFIG_MESH_RELIABLE_WINDOW];
+    uint16_t          next_seq;
+    uint8_t           inflight;
+    uint8_t           retries;
+    int64_t           rto_us;
+    my_rel_tx_stats_t stats;
+} my_rel_tx_t;
+
+// 根节点记录的每个来源节点
+typedef struct {
+    uint8_t  addr[6];
+    bool     used;
+    bool     ack_pending;   /* 有需要确认的数据包 */
+    uint8_t  unacked;       /* 上次确认之后收到的数据包数 */
+    uint16_t next;
+    uint32_t sack;
+    int64_t  ack_due;       /* 需要发送确认的时间(us) */
+    int64_t  last_seen;
+} my_rel_peer_t;
+
+// 根节点的统计信息
+typedef struct {
+    uint32_t delivered;     /* 交给上行的数据包数 */
+    uint32_t duplicate;     /* 重复的数据包数 */
+    uint32_t skipped;       /* 发送节点已放弃、没有收到的序号数 */
+    uint32_t acks;          /* 发送的确认数 */
+} my_rel_rx_stats_t;
+
+typedef struct {
+    my_rel_peer_t     peers[CONFIG_MESH_RELIABLE_PEERS];
+    uint8_t           ack_every;
+    int64_t           ack_delay_us;
+    my_rel_rx_stats_t stats;
+} my_rel_rx_t;
+
+/**
+ * 发送一个数据包（头部和数据）
+ * 返回值不是ESP_OK时视为丢失，超时后重发
+ */
+typedef esp_err_t (*my_rel_out_cb_t)(void *arg, const uint8_t *frame, uint16_t len);
+
+/**
+ * 根节点把去掉头部的数据交给上行
+ * 返回值不是ESP_OK时不记录为已收到，等待重发
+ */
+typedef esp_err_t (*my_rel_deliver_cb_t)(void *arg, const uint8_t *addr, const uint8_t *data, uint16_t len);
+
+// 根节点向来源节点发送确认
+typedef void (*my_rel_ack_cb_t)(void *arg, const uint8_t *addr, const my_rel_ack_t *ack);
+
+/**
+ * 功能：
+ *  初始化发送窗口
+ * 参数：
+ *  [in]tx:      发送窗口
+ *  [in]rto_ms:  重发超时(ms)
+ *  [in]retries: 最多重发次数
+ **/
+void my_rel_tx_init(my_rel_tx_t *tx, uint32_t rto_ms, uint8_t retries);
+
+/**
+ * 功能：
+ *  分配序号，保存到窗口中并发送，窗口满时先放弃最早的数据包
+ * 参数：
+ *  [in]tx:   发送窗口
+ *  [in]data: 数据
+ *  [in]len:  长度，不超过MY_REL_PAYLOAD_MAX
+ *  [in]now:  当前时间(us)
+ *  [in]out:  发送函数
+ *  [in]arg:  传给out的参数
+ * 返回值：
+ *  ESP_OK: 成功（发送失败也保存在窗口中）
+ *  ESP_ERR_INVALID_SIZE: 数据太长
+ **/
+esp_err_t my_rel_tx_send(my_rel_tx_t *tx, const uint8_t *data, uint16_t len, int64_t now,
+                         my_rel_out_cb_t out, void *arg);
+
+/**
+ * 功能：
+ *  处理根节点的确认：释放已确认的数据包，快速重传已确认数据包之前发送的未确认数据包
+ * 参数：
+ *  [in]tx:  发送窗口
+ *  [in]ack: 确认
+ *  [in]now: 当前时间(us)
+ *  [in]out: 发送函数
+ *  [in]arg: 传给out的参数
+ **/
+void my_rel_tx_ack(my_rel_tx_t *tx, const my_rel_ack_t *ack, int64_t now, my_rel_out_cb_t out, void *arg);
+
+/**
+ * 功能：
+ *  重发超时的数据包，放弃超过重试次数的数据包，定期调用
+ *  all为true时立即重发所有未确认的数据包（父节点变化后）
+ **/
+void my_rel_tx_poll(my_rel_tx_t *tx, int64_t now, bool all, my_rel_out_cb_t out, void *arg);
+
+/**
+ * 功能：
+ *  按序号顺序把窗口中所有未确认的数据（不含头部）交给cb并清空窗口，本节点成为根节点时使用
+ *  addr为传给cb的来源地址（本节点）
+ **/
+void my_rel_tx_flush(my_rel_tx_t *tx, const uint8_t *addr, my_rel_deliver_cb_t cb, void *arg);
+
+/**
+ * 功能：
+ *  初始化根节点的接收状态
+ * 参数：
+ *  [in]rx:           接收状态
+ *  [in]ack_every:    收到多少个数据包后确认
+ *  [in]ack_delay_ms: 第一个未确认的数据包最多等待多久确认(ms)
+ **/
+void my_rel_rx_init(my_rel_rx_t *rx, uint8_t ack_every, uint32_t ack_delay_ms);
+
+/**
+ * 功能：
+ *  处理一个MESH_CTRL_REL_DATA数据包，不是重复的数据交给deliver，确认在my_rel_rx_poll中发送
+ * 参数：
+ *  [in]rx:      接收状态
+ *  [in]addr:    来源节点地址
+ *  [in]frame:   数据包
+ *  [in]len:     长度
+ *  [in]now:     当前时间(us)
+ *  [in]deliver: 交给上行的函数
+ *  [in]arg:     传给deliver的参数
+ * 返回值：
+ *  ESP_OK: 交给上行或者是重复的数据包
+ *  ESP_ERR_INVALID_SIZE/ESP_ERR_INVALID_ARG: 格式错误或序号超出范围
+ *  其他: deliver的返回值
+ **/
+esp_err_t my_rel_rx_recv(my_rel_rx_t *rx, const uint8_t *addr, const uint8_t *frame, uint16_t len,
+                         int64_t now, my_rel_deliver_cb_t deliver, void *arg);
+
+// 发送到期的确认，定期调用，以及在处理完一批数据包后调用
+void my_rel_rx_poll(my_rel_rx_t *rx, int64_t now, my_rel_ack_cb_t cb, void *arg);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中模拟不同丢包率和一次父节点切换，比较不确认和可靠传输（my_rel_sim.c）
+void my_rel_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef __MY_REPORT_H__
+#define __MY_REPORT_H__
+
+/**
+ * 根节点与服务器之间的数据格式（上行和下行）
+ *
+ * 本文件只依赖标准头文件，服务器端程序可以直接包含。
+ * 所有多字节字段均为小端序（与esp32一致）。
+ *
+ * 一个批次(batch)的格式：
+ *   my_report_batch_hdr_t | my_report_rec_hdr_t | payload | my_report_rec_hdr_t | payload ...
+ */
+#include <stdint.h>
+
+#define MY_REPORT_MAGIC     (0x524D)    /* 内存中为 'M' 'R' */
+#define MY_REPORT_VERSION   (1)
+
+// 批次头部
+typedef struct __attribute__((packed)) {
+    uint16_t magic;     /* MY_REPORT_MAGIC */
+    uint8_t  version;   /* MY_REPORT_VERSION */
+    uint8_t  count;     /* 批次中的记录条数 */
+    uint16_t len;       /* 所有记录的总长度，不含本头部 */
+    uint16_t seq;       /* 批次序号，每条连接独立计数 */
+} my_report_batch_hdr_t;
+
+// 记录头部，后接len字节的节点数据
+typedef struct __attribute__((packed)) {
+    uint8_t  src[6];    /* 数据来源节点的mesh地址 */
+    uint8_t  proto;     /* mesh_proto_t */
+    uint8_t  shard;     /* 根节点所在的分片(CONFIG_MESH_SHARD)，未分片时为0 */
+    uint16_t len;       /* payload长度 */
+} my_report_rec_hdr_t;
+
+/**
+ * 节点数据(payload)格式，由my_mesh_task打包：
+ *   [0]     数据个数num
+ *   [1..]   num个uint8_t数值
+ *   [1+num] sensor id，旧版本的节点没有这个字节
+ */
+
+// 根节点对MY_REPORT_DOWN_QUERY的响应，记录头部的src为根节点，不是mesh_proto_t
+#define MY_REPORT_PROTO_LATEST  (0x80)
+
+/**
+ * 下行（服务器到根节点），与上行使用同一条连接：
+ *   my_report_down_hdr_t | payload
+ * 根节点按dst转发给节点，dst全为0xFF时发给所有节点。
+ */
+#define MY_REPORT_DOWN_MAGIC    (0x444D)    /* 内存中为 'M' 'D' */
+#define MY_REPORT_DOWN_MAX      (64)        /* payload长度上限 */
+
+// 下行消息类型
+typedef enum {
+    MY_REPORT_DOWN_NONE = 0,
+    MY_REPORT_DOWN_CONFIG,      /* sensor配置，payload为my_report_config_t */
+    MY_REPORT_DOWN_OTA,         /* 固件更新，payload为镜像的URL（不含'\0'），为空时使用默认URL，dst不使用 */
+    MY_REPORT_DOWN_QUERY,       /* 读取根节点保存的最新数值，payload为my_report_query_t，dst不使用 */
+
+    MY_REPORT_DOWN_NUM,
+} my_report_down_type_t;
+
+// 下行消息头部
+typedef struct __attribute__((packed)) {
+    uint16_t magic;     /* MY_REPORT_DOWN_MAGIC */
+    uint8_t  version;   /* MY_REPORT_VERSION */
+    uint8_t  type;      /* my_report_down_type_t */
+    uint8_t  dst[6];    /* 目的节点的mesh地址 */
+    uint16_t len;       /* payload长度 */
+} my_report_down_hdr_t;
+
+// 循环读取的全局设置
+typedef struct __attribute__((packed)) {
+    uint16_t period_ms;     /* 循环读取周期 */
+    uint16_t gap_ms;        /* 循环读取时sensor之间的间隔 */
+} my_report_config_global_t;
+
+// 每个sensor的设置
+typedef struct __attribute__((packed)) {
+    uint8_t  enabled;       /* 是否参与循环读取 */
+    uint8_t  every;         /* 每几次循环读取一次 */
+    uint8_t  samples;       /* 平均几次采样后发送，1为每次都发送 */
+    uint8_t  priority;      /* 非0时放在发送队列的最前面 */
+    uint8_t  low;           /* 任一数值低于low或高于high时立即发送，不参与平均 */
+    uint8_t  high;
+} my_report_config_sensor_t;
+
+#define MY_REPORT_CONFIG_GLOBAL     (0)         /* sid为0时修改全局设置 */
+#define MY_REPORT_CONFIG_ALL        (0xFF)      /* 修改所有sensor */
+
+// mask中的字段，全局设置只使用PERIOD和GAP
+#define MY_REPORT_CONFIG_PERIOD     (1 << 0)
+#define MY_REPORT_CONFIG_GAP        (1 << 1)
+#define MY_REPORT_CONFIG_ENABLED    (1 << 0)
+#define MY_REPORT_CONFIG_EVERY      (1 << 1)
+#define MY_REPORT_CONFIG_SAMPLES    (1 << 2)
+#define MY_REPORT_CONFIG_PRIORITY   (1 << 3)
+#define MY_REPORT_CONFIG_LOW        (1 << 4)
+#define MY_REPORT_CONFIG_HIGH       (1 << 5)
+
+// sensor配置，只修改mask中的字段，服务器下行和MQTT的config topic都使用这个格式
+typedef struct __attribute__((packed)) {
+    uint8_t  sid;
+    uint8_t  mask;
+    union {
+        my_report_config_global_t global;
+        my_report_config_sensor_t sensor;
+    };
+} my_report_config_t;
+
+/**
+ * 最新数值的查询(CONFIG_MESH_LATEST)，不需要进入mesh：
+ *   下行：my_report_query_t | num个my_report_query_key_t
+ *   上行：一条或多条MY_REPORT_PROTO_LATEST记录，
+ *         每条为my_report_latest_hdr_t | count个(my_report_latest_t | num个uint8_t数值)
+ * 匹配的数值太多、上行缓冲区放不下时，最后一条记录的next不是MY_REPORT_QUERY_END，
+ * 服务器以next为cursor再次查询。两次查询之间表有变化时可能重复或遗漏少量数值。
+ */
+#define MY_REPORT_QUERY_ANY_SID (0xFF)      /* 匹配节点的所有sensor */
+#define MY_REPORT_QUERY_END     (0xFFFF)    /* 已返回所有匹配的数值 */
+
+// 查询的一个条件，addr全为0xFF时匹配所有节点；sid为0表示没有发送sensor id的旧版本节点
+typedef struct __attribute__((packed)) {
+    uint8_t  addr[6];
+    uint8_t  sid;
+} my_report_query_key_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t id;            /* 请求编号，在响应中原样返回 */
+    uint16_t cursor;        /* 从表的哪个位置开始，第一次为0 */
+    uint16_t max_age_s;     /* 只返回max_age_s秒内更新过的数值，0为不限制 */
+    uint8_t  num;           /* 条件个数，0为返回所有数值 */
+} my_report_query_t;
+
+#define MY_REPORT_QUERY_KEYS    ((MY_REPORT_DOWN_MAX - sizeof(my_report_query_t)) / sizeof(my_report_query_key_t))
+
+// 响应记录的头部
+typedef struct __attribute__((packed)) {
+    uint16_t id;            /* 请求编号 */
+    uint16_t next;          /* 下次查询的cursor，MY_REPORT_QUERY_END为已结束 */
+    uint16_t count;         /* 本记录中的数值个数 */
+} my_report_latest_hdr_t;
+
+// 一个节点一个sensor的最新数值，后接num个uint8_t数值
+typedef struct __attribute__((packed)) {
+    uint8_t  addr[6];
+    uint8_t  sid;
+    uint8_t  num;
+    uint32_t age_ms;        /* 距离最近一次更新的时间 */
+} my_report_latest_t;
+
+#endif
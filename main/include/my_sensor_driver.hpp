@@ -0,0 +1,144 @@
+#ifndef __MY_SENSOR_DRIVER_HPP__
+#define __MY_SENSOR_DRIVER_HPP__
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#include "my_sensorif.h"
+
+/**
+ * C++ sensor驱动层（可选）
+ * 驱动继承my_sensor_driver<驱动类, 采样类型>，用静态函数实现类型确定的接口：
+ *  static my_sensor_err_t sample(sample_t &out);                       必须，读取一次数据
+ *  static my_sensor_err_t sample_ctrl(const ctrl_t &in, sample_t &out); 可选，带控制参数的读取
+ *  static my_sensor_err_t configure(const config_t &arg);               可选，写入配置
+ *  static my_sensor_err_t on_init(void);                                可选
+ *  static my_sensor_err_t on_exit(void);                                可选
+ * 没有实现的函数使用基类的默认实现。ctrl_t、config_t、mode和type可以在驱动中重新定义。
+ * 只有my_sensor_group::read_all中的调用在编译时确定，驱动可以直接内联到读取循环中。
+ * 用MY_SENSOR_DRIVER_REGISTER注册到sensorif的驱动与C驱动相同，由sensorif任务通过my_sensorif_t中的
+ * 函数指针调用，这时只省去了手写void *参数转换的代码，调用开销不变（比较见my_sensor_driver_sim.cpp）。
+ *
+ * 用法：
+ *  struct temp_sensor : my_sensor_driver<temp_sensor, uint16_t> {
+ *      static my_sensor_err_t sample(uint16_t &out) { out = ...; return MY_SENSOR_ERR_OK; }
+ *  };
+ *  MY_SENSOR_DRIVER_REGISTER(temp, temp_sensor);
+ */
+template <typename Driver, typename Sample>
+class my_sensor_driver {
+public:
+    typedef Sample  sample_t;
+    typedef uint8_t ctrl_t;     /* 默认的控制参数类型，与mesh任务发送的数据对应 */
+    typedef int     config_t;   /* 默认的配置参数类型 */
+
+    // 采样数据按字节发送，数据个数即字节数
+    static_assert(std::is_trivially_copyable<Sample>::value, "sample type must be trivially copyable");
+    static_assert(sizeof(Sample) <= UINT8_MAX, "sample type too large");
+
+    static constexpr my_sensor_mode_t mode = MY_SENSOR_MODE_READ;
+    static constexpr my_sensor_type_t type = MY_SENSOR_TYPE_ONE;
+
+    /* 默认实现 */
+    static my_sensor_err_t on_init(void) { return MY_SENSOR_ERR_OK; }
+    static my_sensor_err_t on_exit(void) { return MY_SENSOR_ERR_OK; }
+    static my_sensor_err_t configure(const config_t &) { return MY_SENSOR_ERR_ARGS; }
+    static my_sensor_err_t sample_ctrl(const ctrl_t &, Sample &out) { return Driver::sample(out); }
+
+    // 将采样数据编码到buf中，返回字节数
+    static uint8_t encode(const Sample &in, uint8_t *buf)
+    {
+        memcpy(buf, &in, sizeof(Sample));
+        return sizeof(Sample);
+    }
+
+    // 转换成sensorif使用的函数指针接口
+    static constexpr my_sensorif_t sif(void)
+    {
+        return { Driver::mode, Driver::type, c_init, c_exit, c_write, c_read, c_read_default };
+    }
+
+protected:
+    static Sample last;     /* 最近一次读取的数据，通过my_sensorif_data_t传出 */
+
+private:
+    static my_sensor_err_t to_data(my_sensor_err_t ret, my_sensorif_data_t *out)
+    {
+        if(ret == MY_SENSOR_ERR_OK) {
+            out->num  = sizeof(Sample);
+            out->data = &last;
+        }
+        return ret;
+    }
+
+    /* my_sensorif_t的各个函数，转换参数类型后调用驱动 */
+    static my_sensor_err_t c_init(void) { return Driver::on_init(); }
+    static my_sensor_err_t c_exit(void) { return Driver::on_exit(); }
+    static my_sensor_err_t c_write(void *arg)
+    {
+        if(arg == NULL) {
+            return MY_SENSOR_ERR_ARGS;
+        }
+        return Driver::configure(*static_cast<const typename Driver::config_t *>(arg));
+    }
+    static my_sensor_err_t c_read(void *in, my_sensorif_data_t *out)
+    {
+        if((in == NULL) || (out == NULL)) {
+            return MY_SENSOR_ERR_ARGS;
+        }
+        return to_data(Driver::sample_ctrl(*static_cast<const typename Driver::ctrl_t *>(in), last), out);
+    }
+    static my_sensor_err_t c_read_default(my_sensorif_data_t *out)
+    {
+        if(out == NULL) {
+            return MY_SENSOR_ERR_ARGS;
+        }
+        return to_data(Driver::sample(last), out);
+    }
+};
+
+template <typename Driver, typename Sample>
+Sample my_sensor_driver<Driver, Sample>::last;
+
+/**
+ * 一组在编译时确定的驱动
+ * read_all依次读取每个驱动并把编码后的数据交给sink，
+ * 驱动的sample直接调用，不经过函数指针。
+ * sink的形式：void sink(uint8_t index, const uint8_t *data, uint8_t len)
+ */
+template <typename... Drivers>
+class my_sensor_group {
+public:
+    static constexpr uint8_t num = sizeof...(Drivers);
+
+    template <typename Sink>
+    static void read_all(Sink &sink)
+    {
+        uint8_t index = 0;
+        // 按模板参数的顺序展开
+        int expand[] = { 0, (read_one<Drivers>(index++, sink), 0)... };
+        (void)expand;
+    }
+
+private:
+    template <typename Driver, typename Sink>
+    static void read_one(uint8_t index, Sink &sink)
+    {
+        typename Driver::sample_t sample;
+        uint8_t buf[sizeof(sample)];
+
+        if(Driver::sample(sample) == MY_SENSOR_ERR_OK) {
+            sink(index, buf, Driver::encode(sample, buf));
+        }
+    }
+};
+
+// 将C++驱动注册到sensorif，与MY_SENSOR_REGISTER相同，描述在编译时生成，读取仍通过函数指针
+#define MY_SENSOR_DRIVER_REGISTER(_name, _driver)                           \
+    static my_sensor_t _name##_sensor_state;                                \
+    static constexpr my_sensor_desc_t _name##_sensor_desc MY_SENSOR_SECTION(_name) \
+        __attribute__((aligned(__alignof__(my_sensor_desc_t)))) =           \
+        { #_name, _driver::sif(), &_name##_sensor_state }
+
+#endif
@@ -1,6 +1,13 @@
 #ifndef __MY_SENSORIF_H__
 #define __MY_SENSORIF_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // sensor操作模式
 typedef enum {
     MY_SENSOR_MODE_NONE = 0,
@@ -31,47 +38,127 @@ typedef enum {
     MY_SENSOR_ERR_NUM,
 } my_sensor_err_t;
 
+struct my_bus_xfer;
+
 // 采集数据的具体结构
 typedef struct {
     uint8_t num;    /* 数据个数 */
     void    *data;  /* 具体数值 */
+    uint8_t sid;    /* 发送给mesh任务时由sensorif填写，sensor读取时不需要设置 */
 } my_sensorif_data_t;
 
-// 获取指定sensor的控制信息
+// 缓存的数值个数上限（数值为uint8_t），更多数值的sensor不缓存
+#define MY_SENSOR_CACHE_SIZE    (8)
+
+/**
+ * 获取指定sensor的控制信息
+ * ctrl为NULL时使用read_default读取，max_age_ms内的缓存值可以直接使用，
+ * 0为必须重新读取；ctrl不为NULL时每次都调用read读取，不使用缓存
+ */
 typedef struct {
-    uint8_t sid;
-    void    *ctrl;
+    uint8_t  sid;
+    bool     event;         /* 由my_sensor_event_from_isr发送，其他模块不使用 */
+    uint16_t max_age_ms;
+    void     *ctrl;
 } my_sensorif_ctrl_t;
 
 typedef struct {
     my_sensor_mode_t mode;  /* sensor操作模式 */
     my_sensor_type_t type;  /* sensor类型 */
 
-    my_sensor_err_t (*init)(void);  /* 注册时执行的函数 */
+    my_sensor_err_t (*init)(void);  /* sensorif初始化时执行的函数 */
     my_sensor_err_t (*exits)(void); /* 注销时执行的函数 */
     my_sensor_err_t (*write)(void *arg);  /* 写入 */
     my_sensor_err_t (*read)(void *in, my_sensorif_data_t *out); /* 读取 */
     my_sensor_err_t (*read_default)(my_sensorif_data_t *out);   /* 无需写入参数的读取函数 */
+
+    bool     event;         /* 事件型sensor，由中断通知数值变化，不参与循环读取 */
+    uint16_t debounce_ms;   /* 事件型sensor的去抖时间 */
+
+    // 共享总线上的sensor（开启CONFIG_MESH_BUS时，见my_bus.h），
+    // 循环读取时和同一总线上的其他sensor一起执行xfer，再由decode转换为数据，不调用read_default
+    uint8_t  bus;           /* 所在的总线，0(MY_BUS_NONE)为不使用总线调度 */
+    struct my_bus_xfer *xfer;
+    my_sensor_err_t (*decode)(const struct my_bus_xfer *xfer, my_sensorif_data_t *out);
 } my_sensorif_t;
 
+// sensor运行时的状态，放在RAM中
 typedef struct {
-    uint8_t  sid;           /* sensor id */
     bool     valid;         /* 当前sensor是否有效 */
 
-    my_sensorif_t sif;
     my_sensorif_data_t data;
+
+    // read_default最近一次读取的结果，关闭CONFIG_MESH_SENSOR_CACHE时不使用
+    bool     cached;        /* 缓存是否有效 */
+    uint8_t  cache_num;
+    uint32_t cache_seq;     /* 每次读取硬件后加1 */
+    int64_t  cache_time;    /* 开始读取的时间(us) */
+    uint8_t  cache[MY_SENSOR_CACHE_SIZE];
+
+    // 事件型sensor，中断和sensorif任务共用
+    bool     event_posted;  /* 已发送到sensorif队列，还没有处理 */
+    bool     event_recheck; /* 去抖时间结束后需要再检查一次数值 */
+    uint8_t  event_value;   /* 中断中的最新数值 */
+    uint8_t  event_sent;    /* 最近一次发送的数值 */
+    int64_t  event_time;    /* 最近一次被接受的变化的时间(us)，去抖时间从这里开始 */
+
+    // 总线上的sensor，只在sensorif任务中使用
+    bool     bus_due;       /* 本次循环读取已提交到总线 */
 } my_sensor_t;
 
-/** 
+// sensor描述，编译时确定，放在flash中
+typedef struct {
+    const char    *name;    /* sensor名称 */
+    my_sensorif_t sif;
+    my_sensor_t   *state;   /* 运行时状态 */
+} my_sensor_desc_t;
+
+/**
+ * sensor注册
+ * 使用MY_SENSOR_REGISTER定义的sensor描述会放到专门的段中，
+ * 链接后所有sensor组成一个常量数组，启动时即可使用，不需要在运行时注册。
+ * ESP-IDF中由linker.lf按名称排序，sid为在数组中的序号+1；
+ * 主机编译时使用GCC生成的__start_/__stop_符号，顺序由链接顺序决定。
+ *
+ * 用法：
+ *  MY_SENSOR_REGISTER(example,
+ *      .mode = MY_SENSOR_MODE_READ,
+ *      .read = read,
+ *      ...
+ *  );
+ **/
+#if defined(ESP_PLATFORM)
+#define MY_SENSOR_SECTION(_name)    __attribute__((used, section(".my_sensor_desc." #_name)))
+#else
+#define MY_SENSOR_SECTION(_name)    __attribute__((used, section("my_sensor_desc")))
+#endif
+
+// 指定对齐，防止编译器为较大的变量增加对齐而在数组中产生空隙
+#define MY_SENSOR_REGISTER(_name, ...)                                      \
+    static my_sensor_t _name##_sensor_state;                                \
+    static const my_sensor_desc_t _name##_sensor_desc MY_SENSOR_SECTION(_name) \
+        __attribute__((aligned(__alignof__(my_sensor_desc_t)))) =           \
+        { #_name, { __VA_ARGS__ }, &_name##_sensor_state }
+
+// sensor描述的前向声明，驱动需要在MY_SENSOR_REGISTER之前使用描述时（如中断函数中）使用
+#define MY_SENSOR_DECLARE(_name)                                            \
+    static const my_sensor_desc_t _name##_sensor_desc
+
+// 驱动中获取自己的sensor描述
+#define MY_SENSOR_DESC(_name)       (&_name##_sensor_desc)
+
+// 注册的sensor数量
+uint8_t my_sensor_get_num(void);
+
+/**
  * 功能：
- *  注册sensor
+ *  获取指定sensor的描述
  * 参数：
- *  [in]sif: sensor接口参数
- *  [out]sid: 注册成功后返回的sensor id
+ *  [in]sid: sensor id
  * 返回值：
- *  错误代码
+ *  sensor描述，sid不存在时返回NULL
  **/
-my_sensor_err_t my_sensor_register(my_sensorif_t *sif, uint8_t *sid);
+const my_sensor_desc_t *my_sensor_get(uint8_t sid);
 
 /** 
  * 功能：
@@ -88,13 +175,29 @@ my_sensor_err_t my_sensor_unregister(uint8_t sid);
  *  读取指定sensor的数据
  * 参数：
  *  [in]sid:  sensor id
- *  [in]in:   传入给sensor的数据，如需要读取的数据地址等
+ *  [in]in:   传入给sensor的数据，如需要读取的数据地址等；
+ *            NULL时使用read_default读取，与my_sensor_read_cached(sid, 0, out)相同
  *  [out]out: sensor读取到的数据
  * 返回值：
  *  错误代码
  **/
 my_sensor_err_t my_sensor_read(uint8_t sid, void *in, my_sensorif_data_t *out);
 
+/**
+ * 功能：
+ *  使用read_default读取指定sensor的数据，缓存的数值不超过max_age_ms时直接返回缓存。
+ *  需要读取时，同一sensor同时只有一个读取，其他调用者等待并使用这次读取的结果，
+ *  因此短时间内的大量查询只会读取一次硬件。
+ *  关闭CONFIG_MESH_SENSOR_CACHE时每次都调用read_default
+ * 参数：
+ *  [in]sid:        sensor id
+ *  [in]max_age_ms: 可以接受的缓存时间(ms)，0为必须读取（仍与进行中的读取合并）
+ *  [out]out:       sensor读取到的数据，开启缓存时data指向sensor的缓存，下次读取前有效
+ * 返回值：
+ *  错误代码
+ **/
+my_sensor_err_t my_sensor_read_cached(uint8_t sid, uint32_t max_age_ms, my_sensorif_data_t *out);
+
 /** 
  * 功能：
  *  向指定sensor写入数据
@@ -106,6 +209,23 @@ my_sensor_err_t my_sensor_read(uint8_t sid, void *in, my_sensorif_data_t *out);
  **/
 my_sensor_err_t my_sensor_write(uint8_t sid, void *args);
 
-// sensor接口初始化,实际上创建了sensorif任务
+/**
+ * 功能：
+ *  事件型sensor的数值变化，在GPIO中断中调用
+ *  记录时间，与上次变化的间隔小于debounce_ms时只记录数值，
+ *  否则唤醒sensorif任务立即发送；去抖时间结束后数值与发送的不同时再发送一次。
+ *  会调用flash中的函数，不能在ESP_INTR_FLAG_IRAM的中断中使用
+ * 参数：
+ *  [in]sensor: sensor描述，使用MY_SENSOR_DESC获取
+ *  [in]value:  新的数值
+ **/
+void my_sensor_event_from_isr(const my_sensor_desc_t *sensor, uint8_t value);
+
+// sensor接口初始化，执行各sensor的init函数后创建sensorif任务
 void sensorif_init(void);
-#endif
\ No newline at end of file
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
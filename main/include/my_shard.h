@@ -0,0 +1,66 @@
+#ifndef __MY_SHARD_H__
+#define __MY_SHARD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * 多个mesh分片（开启CONFIG_MESH_SHARD时）
+ *
+ * 每个分片是一个独立的mesh，有自己的根节点和上行连接，上行的总吞吐随分片数增加。
+ * 以下内容可以在配网时写入NVS（MESH_NVS_KEY_NAMESPACE），没有时使用默认值：
+ *  - MESH_NVS_KEY_SHARD:     本节点的分片(u8)，不指定时由地址确定
+ *  - MESH_NVS_KEY_SHARD_NUM: 分片数(u8)，默认CONFIG_MESH_SHARD_NUM
+ *  - MESH_NVS_KEY_MESH_ID:   基础mesh ID(6字节blob)，默认为my_mesh.c中的MESH_ID
+ *  - MESH_NVS_KEY_CHANNEL:   信道(u8)，默认按CONFIG_MESH_SHARD_CHANNELS或CONFIG_MESH_CHANNEL
+ * 路由器仍使用NVS中的ssid和密码（MESH_NVS_KEY_ROUTER_SSID），各分片可以配置不同的路由器。
+ *
+ * 没有指定分片时按STA MAC的最高随机权重(rendezvous hashing)选择：同一地址总是得到同一分片，
+ * 各分片的节点数接近，分片数从n变为n + 1时只有约1/(n + 1)的节点改变分片。
+ * 分片k的mesh ID为基础mesh ID的最后一个字节加k，不同分片的节点不会加入同一个mesh。
+ * 根节点在上行记录头部的shard字段中填写分片编号，collector按节点地址合并各分片的数据。
+ */
+
+#define MY_SHARD_MAX    (16)    /* 分片数上限 */
+
+#if CONFIG_MESH_SHARD
+// 本节点使用的分片设置
+typedef struct {
+    uint8_t shard;          /* 分片编号，0 ~ num - 1 */
+    uint8_t num;            /* 分片数 */
+    uint8_t mesh_id[6];
+    uint8_t channel;        /* 0为自动选择 */
+    bool    assigned;       /* 分片由NVS指定，而不是由地址确定 */
+} my_shard_t;
+
+/**
+ * 功能：
+ *  按地址确定分片，同一地址和分片数总是得到相同的结果
+ * 参数：
+ *  [in]addr: 节点的STA MAC
+ *  [in]num:  分片数，1 ~ MY_SHARD_MAX
+ * 返回值：
+ *  分片编号
+ **/
+uint8_t my_shard_pick(const uint8_t addr[6], uint8_t num);
+
+/**
+ * 功能：
+ *  读取NVS中的分片设置，生成本节点的mesh ID和信道，在mesh启动前调用
+ * 参数：
+ *  [in]addr:    节点的STA MAC
+ *  [in]base_id: 默认的基础mesh ID
+ *  [out]shard:  分片设置
+ **/
+void my_shard_load(const uint8_t addr[6], const uint8_t base_id[6], my_shard_t *shard);
+
+// 本节点的分片编号，my_shard_load之前为0
+uint8_t my_shard_get(void);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中统计各分片的节点数和分片数改变时移动的节点（my_shard_sim.c）
+void my_shard_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef __MY_TIME_H__
+#define __MY_TIME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_mesh.h"
+
+/**
+ * mesh时间同步（开启CONFIG_MESH_TIME_SYNC时）
+ *
+ * mesh时间 = 本地时间(esp_timer_get_time) + 时间差，根节点为参考，
+ * 根节点连上外部网络后用SNTP把mesh时间校准为UTC(us)。
+ * 其他节点定期向父节点发送请求，按NTP的方法由四个时间戳计算与父节点的时间差和往返延时：
+ *  t1 发送请求（本节点的本地时间）   t2 父节点收到请求（父节点的mesh时间）
+ *  t3 父节点发送响应（父节点的mesh时间） t4 收到响应（本节点的本地时间）
+ *  offset = ((t2 - t1) + (t3 - t4)) / 2
+ *  delay  = (t4 - t1) - (t3 - t2)
+ * 逐跳同步，每一跳只补偿与父节点之间的延时，误差来自每跳两个方向延时的差。
+ * 最近几次交换中往返延时最小的一次受排队影响最小，使用它的时间差；
+ * 最近几次都受到排队影响（延时远大于平时的最小延时）时不更新。
+ * sensorif任务在同步之后把循环读取对齐到mesh时间的周期边界，各节点在同一时刻采样。
+ */
+
+#define MY_TIME_FILTER_SIZE     (4)         /* 时间差滤波保留的交换次数 */
+#define MY_TIME_STRATUM_NONE    (0xFF)      /* 没有同步 */
+
+// 时间同步消息(MESH_PROTO_BIN)，请求和响应使用相同的格式
+typedef struct __attribute__((packed)) {
+    uint8_t  type;          /* MESH_CTRL_TIME_REQ/MESH_CTRL_TIME_RESP */
+    uint8_t  seq;           /* 响应中与请求相同 */
+    uint8_t  stratum;       /* 响应：发送节点到根节点的跳数，MY_TIME_STRATUM_NONE为没有同步 */
+    uint8_t  utc;           /* 响应：mesh时间已经校准为UTC */
+    int64_t  t1;
+    int64_t  t2;            /* 响应中有效 */
+    int64_t  t3;            /* 响应中有效 */
+} my_time_msg_t;
+
+// 时间差滤波，保存最近几次交换的结果
+typedef struct {
+    uint8_t num;
+    uint8_t next;
+    int64_t offset[MY_TIME_FILTER_SIZE];
+    int64_t delay[MY_TIME_FILTER_SIZE];
+    int64_t time[MY_TIME_FILTER_SIZE];  /* 收到响应的本地时间(t4) */
+    int64_t floor;                      /* 平时的最小往返延时，0为还没有 */
+} my_time_filter_t;
+
+#if CONFIG_MESH_TIME_SYNC
+// 清空滤波器，父节点变化时使用
+void my_time_filter_reset(my_time_filter_t *filter);
+
+/**
+ * 功能：
+ *  加入一次交换的四个时间戳，选出最近几次中最可信的时间差。
+ *  较早的结果按时钟的最大漂移增加误差，因此延时相近时使用较新的结果。
+ *  选出的延时超过平时最小延时的2倍时不使用，同时逐渐提高平时的最小延时，
+ *  路径的延时确实变大时几次之后恢复
+ * 参数：
+ *  [in]filter:  滤波器
+ *  [in]t1~t4:   四个时间戳(us)
+ *  [out]offset: 选出的时间差(us)，mesh时间 = 本地时间 + 时间差
+ *  [out]delay:  选出的那次交换的往返延时(us)，可以为NULL
+ * 返回值：
+ *  true: 时间差可用
+ *  false: 最近几次的延时都太大，继续使用原来的时间差
+ **/
+bool my_time_filter_add(my_time_filter_t *filter, int64_t t1, int64_t t2, int64_t t3, int64_t t4,
+                        int64_t *offset, int64_t *delay);
+
+// 启动时间同步，在mesh启动时调用
+void my_time_init(void);
+
+// 父节点变化（连接到新的父节点或成为根节点），重新同步
+void my_time_parent_changed(void);
+
+// 根节点连接/断开外部网络，连接后启动SNTP
+void my_time_set_online(bool online);
+
+// 当前的mesh时间(us)，没有同步时为本地时间加上最近一次的时间差
+int64_t my_time_get_us(void);
+
+// 是否已经同步到根节点
+bool my_time_synced(void);
+
+// mesh时间是否为UTC（根节点的SNTP已经同步）
+bool my_time_is_utc(void);
+
+/**
+ * 功能：
+ *  计算到mesh时间下一个周期边界（周期的整数倍）的等待时间，向上取整，误差在一个tick内
+ * 参数：
+ *  [in]period_ms: 周期(ms)
+ * 返回值：
+ *  等待的tick数
+ **/
+TickType_t my_time_until_boundary(uint32_t period_ms);
+
+/**
+ * 功能：
+ *  处理时间同步消息：回复子节点的请求，或用父节点的响应更新时间差
+ * 参数：
+ *  [in]from: 发送节点的地址
+ *  [in]data: mesh数据包，内容为my_time_msg_t
+ **/
+void my_time_recv(const mesh_addr_t *from, const mesh_data_t *data);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中模拟多层的链，比较每层与根节点的误差（my_time_sim.c）
+void my_time_sim(void);
+#endif
+#endif
+
+#endif
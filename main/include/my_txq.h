@@ -0,0 +1,155 @@
+#ifndef __MY_TXQ_H__
+#define __MY_TXQ_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "my_pool.h"
+
+/**
+ * mesh的异步发送队列（开启CONFIG_MESH_TXQ时）
+ *
+ * 不带MESH_DATA_NONBLOCK的esp_mesh_send会一直等到数据包进入ESP-MESH的发送队列，
+ * 父节点很慢或已经断开时，调用它的mesh发送任务（sensor数据）和接收任务（转发）都会停住。
+ * 开启后这些发送先复制到有界的队列中，由单独的发送任务以MESH_DATA_NONBLOCK发送：
+ *  - 队列满时立即返回ESP_ERR_NO_MEM，提交者不会被阻塞；一个目的地址最多占用3/4的队列，
+ *    它停住时发往其他地址的数据包仍可以提交
+ *  - ESP-MESH的队列满、没有内存、超时或暂时断开时，同一目的地址的数据包一起等待重试，
+ *    间隔从retry_ms开始加倍，最多retry_max_ms；提交后超过ttl_ms仍未发出的数据包放弃。
+ *    其他目的地址的数据包不受影响
+ *  - 同一目的地址的数据包按提交的顺序发送
+ *  - 每个数据包发出或放弃时调用提交时给出的回调，把结果通知提交者。my_txq_poll只输出
+ *    完成的数据包，由调用者释放锁之后再调用回调，回调中可以再提交
+ * 数据包的内容复制到my_pool申请的内存中，只使用能放下的最小类别的块，每个类别留出一部分
+ * 给其他模块（接收缓冲区、发送前打包的数据包），队列满时不会让接收和打包申请不到内存。
+ *
+ * 不加锁，同一个my_txq_t在多个任务中使用时由调用者加锁。
+ */
+
+/**
+ * 数据包的结果，result为ESP_OK表示已交给ESP-MESH，否则为最后一次发送的错误
+ * 或ESP_ERR_TIMEOUT（超过ttl_ms）
+ */
+typedef void (*my_txq_done_cb_t)(void *arg, esp_err_t result);
+
+/**
+ * 实际的发送函数，to为NULL时发给根节点（与esp_mesh_send相同）
+ */
+typedef esp_err_t (*my_txq_send_t)(void *arg, const mesh_addr_t *to, const mesh_data_t *data, int flag);
+
+// 完成的数据包，由my_txq_poll输出
+typedef struct {
+    my_txq_done_cb_t done;
+    void      *arg;
+    esp_err_t result;
+} my_txq_result_t;
+
+#if CONFIG_MESH_TXQ
+// 队列中的一个数据包
+typedef struct {
+    bool     used;
+    uint8_t  dest;          /* 目的地址在dests中的下标 */
+    uint32_t seq;           /* 提交的顺序 */
+    int      flag;
+    mesh_data_t data;       /* data.data为my_pool申请的内存 */
+    uint8_t  cls;           /* data.data的内存块类别 */
+    int64_t  expire;        /* 放弃的时间(us) */
+    my_txq_done_cb_t done;
+    void     *arg;
+} my_txq_item_t;
+
+// 目的地址的重试状态
+typedef struct {
+    mesh_addr_t addr;
+    bool     to_root;       /* esp_mesh_send的to为NULL */
+    uint16_t pending;       /* 队列中发往这个地址的数据包数，为0时可以换成其他地址 */
+    uint8_t  backoff;       /* 连续失败的次数 */
+    int64_t  retry_at;      /* 下次发送的时间(us) */
+} my_txq_dest_t;
+
+// 统计信息
+typedef struct {
+    uint32_t submitted;
+    uint32_t sent;          /* 交给ESP-MESH的数据包数 */
+    uint32_t retries;       /* 需要重试的发送次数 */
+    uint32_t expired;       /* 超过ttl_ms放弃的数据包数 */
+    uint32_t failed;        /* 发送函数返回不能重试的错误而放弃的数据包数 */
+    uint32_t full;          /* 队列已满、没有内存而拒绝的提交数 */
+    uint16_t depth;         /* 当前的数据包数 */
+    uint16_t depth_max;     /* 数据包数的峰值 */
+} my_txq_stats_t;
+
+typedef struct {
+    my_txq_item_t items[CONFIG_MESH_TXQ_LEN];
+    my_txq_dest_t dests[CONFIG_MESH_TXQ_DESTS];
+    uint16_t blocks[MY_POOL_NUM];   /* 各类别占用的内存块数 */
+    uint32_t next_seq;
+    int64_t  retry_us;
+    int64_t  retry_max_us;
+    int64_t  ttl_us;
+    my_txq_stats_t stats;
+} my_txq_t;
+
+/**
+ * 功能：
+ *  初始化发送队列
+ * 参数：
+ *  [in]txq:          发送队列
+ *  [in]retry_ms:     第一次重试的间隔(ms)
+ *  [in]retry_max_ms: 重试间隔的上限(ms)
+ *  [in]ttl_ms:       提交后多久没有发出就放弃(ms)
+ **/
+void my_txq_init(my_txq_t *txq, uint32_t retry_ms, uint32_t retry_max_ms, uint32_t ttl_ms);
+
+/**
+ * 功能：
+ *  提交一个数据包，复制后立即返回
+ * 参数：
+ *  [in]txq:  发送队列
+ *  [in]to:   目的地址，NULL为根节点
+ *  [in]data: 数据包
+ *  [in]flag: esp_mesh_send的flag，发送时加上MESH_DATA_NONBLOCK
+ *  [in]now:  当前时间(us)
+ *  [in]done: 完成时的回调，可以为NULL
+ *  [in]arg:  传给done的参数
+ * 返回值：
+ *  ESP_OK: 成功，之后一定会调用done
+ *  ESP_ERR_NO_MEM: 队列或目的地址已满，或者没有内存（包括用完了可以占用的内存块），不会调用done
+ **/
+esp_err_t my_txq_submit(my_txq_t *txq, const mesh_addr_t *to, const mesh_data_t *data, int flag,
+                        int64_t now, my_txq_done_cb_t done, void *arg);
+
+/**
+ * 功能：
+ *  发送到了时间的数据包，放弃超时的数据包，由发送任务调用。
+ *  不调用完成回调，有回调的数据包输出到results中，由调用者依次调用my_txq_notify
+ * 参数：
+ *  [in]txq:      发送队列
+ *  [in]now:      当前时间(us)
+ *  [in]send:     发送函数
+ *  [in]arg:      传给send的参数
+ *  [out]results: 完成的数据包，长度不小于CONFIG_MESH_TXQ_LEN
+ *  [out]num:     results中的个数
+ * 返回值：
+ *  下次需要调用的时间(us)，队列为空时为INT64_MAX
+ **/
+int64_t my_txq_poll(my_txq_t *txq, int64_t now, my_txq_send_t send, void *arg,
+                    my_txq_result_t *results, uint16_t *num);
+
+// 调用my_txq_poll输出的完成回调，不需要持有发送队列的锁
+void my_txq_notify(const my_txq_result_t *results, uint16_t num);
+
+// 父节点变化等情况下，所有目的地址立即重试
+void my_txq_kick(my_txq_t *txq, int64_t now);
+
+// 获取统计信息
+void my_txq_get_stats(const my_txq_t *txq, my_txq_stats_t *stats);
+
+#if CONFIG_MESH_BENCH
+// 性能测试中模拟根节点方向停住，比较阻塞发送和使用发送队列（my_txq_sim.c）
+void my_txq_sim(void);
+#endif
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __MY_UPLINK_H__
+#define __MY_UPLINK_H__
+
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "my_report.h"
+
+// 上行统计信息
+typedef struct {
+    uint32_t reports;       /* 已发送的记录数 */
+    uint32_t batches;       /* 已发送的批次数 */
+    uint32_t bytes;         /* 已发送的字节数 */
+    uint32_t dropped;       /* 缓冲区满而丢弃的记录数 */
+    uint32_t reconnects;    /* 建立连接的次数 */
+    uint32_t conn_up;       /* 当前可用的连接数 */
+    uint32_t down_msgs;     /* 收到的下行消息数 */
+    uint32_t down_errors;   /* 下行数据中被跳过的错误字节数 */
+} my_uplink_stats_t;
+
+/**
+ * 下行消息的处理函数，在上行任务中调用
+ * payload长度为hdr->len，不超过MY_REPORT_DOWN_MAX
+ */
+typedef void (*my_uplink_down_handler_t)(const my_report_down_hdr_t *hdr, const uint8_t *payload);
+
+/**
+ * 功能：
+ *  提交一条需要转发到服务器的数据，数据会被复制到批次缓冲区中
+ * 参数：
+ *  [in]from: 数据来源节点的mesh地址
+ *  [in]data: mesh数据包
+ * 返回值：
+ *  ESP_OK: 成功
+ *  ESP_ERR_INVALID_STATE: 上行未启动
+ *  ESP_ERR_INVALID_SIZE: 数据超过一个批次能容纳的长度
+ *  ESP_ERR_NO_MEM: 缓冲区已满，数据被丢弃
+ **/
+esp_err_t my_uplink_submit(const mesh_addr_t *from, const mesh_data_t *data);
+
+/**
+ * 功能：
+ *  设置上行是否可用（根节点获取/失去IP时调用）
+ *  不可用时关闭所有连接，可用时在上行任务中重新连接
+ * 参数：
+ *  [in]online: 是否可用
+ **/
+void my_uplink_set_online(bool online);
+
+// 设置下行消息的处理函数
+void my_uplink_set_down_handler(my_uplink_down_handler_t handler);
+
+// 获取上行统计信息
+void my_uplink_get_stats(my_uplink_stats_t *stats);
+
+// 上行初始化，创建上行任务
+void my_uplink_init(void);
+
+#endif
@@ -6,10 +6,12 @@
 #include "freertos/queue.h"
 
 #include "my_main.h"
+#include "my_mem.h"
+#include "my_pool.h"
+#include "my_dlog.h"
 #include "my_mesh.h"
 #include "my_smartconfig.h"
 #include "my_sensorif.h"
-#include "example_sensor.h"
 
 
 /*******************************************************
@@ -21,6 +23,9 @@ static bool wifi_inited = false;
 static QueueHandle_t sensorif_queue;
 // mesh任务使用的消息队列，主要接收sensor接口任务发送的sensor数据
 static QueueHandle_t mesh_queue;
+// 两个队列使用的内存
+MY_QUEUE_DEFINE(sensorif_queue_mem, CONFIG_MESH_QUEUE_LEN_SENSORIF, sizeof(my_sensorif_ctrl_t));
+MY_QUEUE_DEFINE(mesh_queue_mem, CONFIG_MESH_QUEUE_LEN_MESH, sizeof(my_sensorif_data_t));
 
 /*******************************************************
  *                Function Declarations
@@ -78,6 +83,11 @@ QueueHandle_t main_get_mesh_queue(void)
 
 void app_main(void)
 {
+#if CONFIG_MESH_DLOG
+    // 最先初始化延迟日志，之前的记录会被丢弃
+    my_dlog_init();
+#endif
+
     // 初始化NVS
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -93,14 +103,17 @@ void app_main(void)
     // 初始化事件循环
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+    // 初始化数据包内存池
+    my_pool_init();
+
     // 创建消息队列
     /* 接收sensor控制信息的队列 */
-    sensorif_queue = xQueueCreate(5, sizeof(my_sensorif_ctrl_t));
+    sensorif_queue = my_queue_create(&sensorif_queue_mem);
     if(sensorif_queue == 0) {
         ESP_LOGE(MAIN_TAG, "Sensorif queue create failed!");
     }
     /* 接收sensor采集到的数据的队列 */
-    mesh_queue     = xQueueCreate(5, sizeof(my_sensorif_data_t));
+    mesh_queue     = my_queue_create(&mesh_queue_mem);
     if(mesh_queue == 0) {
         ESP_LOGE(MAIN_TAG, "Mesh queue create failed!");
     }
@@ -120,7 +133,6 @@ void app_main(void)
     smartconfig_start();
     #endif
 
-    // 注册示例sensor到sensor接口
-    example_sensor_init();
-
+    // 输出内存报告，之后按配置的周期输出
+    my_mem_report_start();
 }
@@ -0,0 +1,136 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "my_agg.h"
+#include "my_mesh.h"
+
+#if CONFIG_MESH_AGG
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static my_agg_slot_t *agg_find(my_agg_t *agg, const my_agg_rec_t *rec);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+void my_agg_init(my_agg_t *agg, my_agg_slot_t *slots, uint16_t slot_num, uint32_t window_ms, bool average)
+{
+    memset(agg, 0, sizeof(*agg));
+    agg->slots     = slots;
+    agg->slot_num  = (slot_num > UINT8_MAX) ? UINT8_MAX : slot_num;   /* 帧头部的count为uint8_t */
+    agg->average   = average;
+    agg->window_us = (int64_t)window_ms * 1000;
+}
+
+// 平均模式下查找可以合并的记录：来源节点、sid和数值个数相同，合并后采样次数不溢出
+static my_agg_slot_t *agg_find(my_agg_t *agg, const my_agg_rec_t *rec)
+{
+    for(uint16_t i = 0; i < agg->used; i++) {
+        my_agg_slot_t *slot = &agg->slots[i];
+        if((slot->rec.sid == rec->sid) && (slot->rec.num == rec->num)
+           && (memcmp(slot->rec.src, rec->src, sizeof(rec->src)) == 0)
+           && (slot->rec.samples + rec->samples <= UINT8_MAX)) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+bool my_agg_add(my_agg_t *agg, const my_agg_rec_t *rec, const uint8_t *values, int64_t now)
+{
+    my_agg_slot_t *slot = NULL;
+    uint8_t samples = (rec->samples > 0) ? rec->samples : 1;
+
+    if(rec->num > MY_AGG_VALUES) {
+        return false;
+    }
+    if(agg->average) {
+        slot = agg_find(agg, rec);
+    }
+    if(slot != NULL) {
+        agg->merged++;
+    }
+    else {
+        if(agg->used >= agg->slot_num) {
+            return false;
+        }
+        if(agg->used == 0) {
+            agg->first = now;
+        }
+        slot = &agg->slots[agg->used++];
+        memset(slot, 0, sizeof(*slot));
+        memcpy(slot->rec.src, rec->src, sizeof(rec->src));
+        slot->rec.sid = rec->sid;
+        slot->rec.num = rec->num;
+    }
+    // 记录中的数值已经是平均值，按采样次数加权
+    for(uint8_t i = 0; i < rec->num; i++) {
+        slot->sum[i] += (uint16_t)values[i] * samples;
+    }
+    slot->rec.samples += samples;
+    agg->records++;
+    return true;
+}
+
+bool my_agg_due(const my_agg_t *agg, int64_t now)
+{
+    // 窗口已满时不提前发送，平均模式下还可以合并，放不下新记录时由my_agg_add返回false
+    return (agg->used > 0) && (now - agg->first >= agg->window_us);
+}
+
+uint16_t my_agg_take(my_agg_t *agg, uint8_t *frame, uint16_t size)
+{
+    my_agg_hdr_t hdr = { .type = MESH_CTRL_AGG, .count = 0 };
+    uint16_t len = sizeof(hdr);
+
+    if((agg->used == 0) || (size < sizeof(hdr))) {
+        return 0;
+    }
+    for(uint16_t i = 0; i < agg->used; i++) {
+        my_agg_slot_t *slot = &agg->slots[i];
+        uint8_t *values = frame + len + sizeof(my_agg_rec_t);
+
+        if(len + sizeof(my_agg_rec_t) + slot->rec.num > size) {
+            break;
+        }
+        memcpy(frame + len, &slot->rec, sizeof(my_agg_rec_t));
+        for(uint8_t j = 0; j < slot->rec.num; j++) {
+            values[j] = (slot->sum[j] + slot->rec.samples / 2) / slot->rec.samples;
+        }
+        len += sizeof(my_agg_rec_t) + slot->rec.num;
+        hdr.count++;
+    }
+    memcpy(frame, &hdr, sizeof(hdr));
+    // 缓冲区放不下的记录丢弃，缓冲区足够大时不会发生
+    agg->used = 0;
+    agg->frames++;
+    return len;
+}
+
+int my_agg_foreach(const uint8_t *frame, uint16_t len, my_agg_rec_cb_t cb, void *arg)
+{
+    my_agg_hdr_t hdr;
+    my_agg_rec_t rec;
+    uint16_t off = sizeof(hdr);
+
+    if(len < sizeof(hdr)) {
+        return -1;
+    }
+    memcpy(&hdr, frame, sizeof(hdr));
+    for(uint8_t i = 0; i < hdr.count; i++) {
+        if(off + sizeof(rec) > len) {
+            return -1;
+        }
+        memcpy(&rec, frame + off, sizeof(rec));
+        off += sizeof(rec);
+        if((rec.num > MY_AGG_VALUES) || (off + rec.num > len)) {
+            return -1;
+        }
+        cb(arg, &rec, frame + off);
+        off += rec.num;
+    }
+    return hdr.count;
+}
+
+#endif
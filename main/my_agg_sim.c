@@ -0,0 +1,200 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_agg.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_AGG
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 中间节点聚合的模拟：6层、每个节点3个子节点的树(根节点以下363个节点)，
+// 每个节点每秒采样一个sensor，相位随机
+#define AGG_SIM_BRANCH      (3)
+#define AGG_SIM_LAYERS      (6)         /* 含根节点 */
+#define AGG_SIM_NODES       (1 + 3 + 9 + 27 + 81 + 243)
+#define AGG_SIM_SECONDS     (60)
+#define AGG_SIM_STEP_MS     (100)
+#define AGG_SIM_PERIOD_MS   (1000)      /* 采样周期 */
+#define AGG_SIM_AVG_WINDOW  (3000)      /* 平均模式的窗口，包含3次采样 */
+#define AGG_SIM_VALUES      (2)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 模拟中每个节点的聚合窗口，按层次遍历的顺序编号，节点i的父节点为(i - 1) / AGG_SIM_BRANCH
+typedef struct {
+    my_agg_t      *agg;             /* 各节点的窗口，根节点不使用 */
+    my_agg_slot_t *slots;
+    int64_t       now;
+    uint16_t      rx_node;          /* 正在接收聚合帧的节点 */
+    uint32_t      layer_frames[AGG_SIM_LAYERS];     /* 各层节点收到的帧数，[0]为根节点 */
+    uint32_t      root_records;
+    uint32_t      root_samples;
+} agg_sim_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static uint8_t agg_sim_frame[AGG_SIM_LAYERS][MY_AGG_FRAME_SIZE(CONFIG_MESH_AGG_RECORDS)];
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static uint8_t agg_sim_layer(uint16_t node);
+static void agg_sim_add(agg_sim_t *sim, uint16_t node, const my_agg_rec_t *rec, const uint8_t *values);
+static void agg_sim_rx(void *arg, const my_agg_rec_t *rec, const uint8_t *values);
+static void agg_sim_deliver(agg_sim_t *sim, uint16_t node);
+static bool agg_sim_run(agg_sim_t *sim, uint32_t window_ms, bool average, const uint16_t *phase);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static uint8_t agg_sim_layer(uint16_t node)
+{
+    uint8_t layer = 0;
+
+    while(node > 0) {
+        node = (node - 1) / AGG_SIM_BRANCH;
+        layer++;
+    }
+    return layer;
+}
+
+// 与mesh_agg_add相同：根节点交给上行，其他节点加入窗口，已满时先发送
+static void agg_sim_add(agg_sim_t *sim, uint16_t node, const my_agg_rec_t *rec, const uint8_t *values)
+{
+    if(node == 0) {
+        sim->root_records++;
+        sim->root_samples += rec->samples;
+        return;
+    }
+    if(!my_agg_add(&sim->agg[node], rec, values, sim->now)) {
+        agg_sim_deliver(sim, node);
+        my_agg_add(&sim->agg[node], rec, values, sim->now);
+    }
+}
+
+// 父节点收到聚合帧中的一条记录
+static void agg_sim_rx(void *arg, const my_agg_rec_t *rec, const uint8_t *values)
+{
+    agg_sim_t *sim = arg;
+
+    agg_sim_add(sim, sim->rx_node, rec, values);
+}
+
+// 取出节点的窗口发给父节点，每层使用自己的帧缓冲区，父节点已满时可以继续向上发送
+static void agg_sim_deliver(agg_sim_t *sim, uint16_t node)
+{
+    uint16_t parent = (node - 1) / AGG_SIM_BRANCH;
+    uint8_t *frame = agg_sim_frame[agg_sim_layer(node)];
+    uint16_t len = my_agg_take(&sim->agg[node], frame, sizeof(agg_sim_frame[0]));
+    uint16_t rx_node = sim->rx_node;
+
+    if(len > 0) {
+        sim->layer_frames[agg_sim_layer(parent)]++;
+        sim->rx_node = parent;
+        my_agg_foreach(frame, len, agg_sim_rx, sim);
+        sim->rx_node = rx_node;
+    }
+}
+
+/**
+ * 模拟一种模式，window_ms为0时为不聚合：每次采样一个toDS数据包，全部由根节点收到
+ * 每一步先由各节点采样，再从最深的节点开始发送到期的窗口，子节点的帧在同一步内到达父节点
+ */
+static bool agg_sim_run(agg_sim_t *sim, uint32_t window_ms, bool average, const uint16_t *phase)
+{
+    uint8_t values[AGG_SIM_VALUES] = { 20, 50 };
+    my_agg_rec_t rec = { .sid = 1, .samples = 1, .num = AGG_SIM_VALUES };
+    uint32_t per_node[AGG_SIM_LAYERS], slot_total = 0, subtree = 0;
+
+    memset(sim, 0, sizeof(*sim));
+    if(window_ms > 0) {
+        // 每个节点的窗口为一个窗口内子树的记录数，不超过CONFIG_MESH_AGG_RECORDS，与实际相同
+        for(int8_t l = AGG_SIM_LAYERS - 1; l >= 0; l--) {
+            subtree = subtree * AGG_SIM_BRANCH + 1;
+            per_node[l] = subtree * (average ? 1 : (window_ms + AGG_SIM_PERIOD_MS - 1) / AGG_SIM_PERIOD_MS);
+            per_node[l] = (per_node[l] > CONFIG_MESH_AGG_RECORDS) ? CONFIG_MESH_AGG_RECORDS : per_node[l];
+        }
+        for(uint16_t n = 1; n < AGG_SIM_NODES; n++) {
+            slot_total += per_node[agg_sim_layer(n)];
+        }
+        sim->agg   = calloc(AGG_SIM_NODES, sizeof(my_agg_t));
+        sim->slots = calloc(slot_total, sizeof(my_agg_slot_t));
+        if((sim->agg == NULL) || (sim->slots == NULL)) {
+            free(sim->agg);
+            free(sim->slots);
+            return false;
+        }
+        for(uint32_t n = 1, off = 0; n < AGG_SIM_NODES; n++) {
+            my_agg_init(&sim->agg[n], &sim->slots[off], per_node[agg_sim_layer(n)], window_ms, average);
+            off += per_node[agg_sim_layer(n)];
+        }
+    }
+
+    for(uint32_t ms = 0; ms < AGG_SIM_SECONDS * 1000; ms += AGG_SIM_STEP_MS) {
+        sim->now = (int64_t)ms * 1000;
+        for(uint16_t n = AGG_SIM_NODES - 1; n > 0; n--) {
+            if((ms % AGG_SIM_PERIOD_MS) == phase[n]) {
+                if(window_ms == 0) {
+                    sim->layer_frames[0]++;
+                    sim->root_records++;
+                    sim->root_samples++;
+                }
+                else {
+                    memcpy(rec.src, &n, sizeof(n));
+                    agg_sim_add(sim, n, &rec, values);
+                }
+            }
+            if((window_ms > 0) && my_agg_due(&sim->agg[n], sim->now)) {
+                agg_sim_deliver(sim, n);
+            }
+        }
+    }
+    free(sim->agg);
+    free(sim->slots);
+    return true;
+}
+
+/**
+ * 比较不聚合、合并和平均三种模式下根节点收到的帧数和记录数
+ */
+void my_agg_sim(void)
+{
+    static uint16_t phase[AGG_SIM_NODES];
+    static agg_sim_t direct, merge, average;
+    char layers[AGG_SIM_LAYERS * 11];
+    uint32_t seed = 1;
+    int len = 0;
+
+    for(uint16_t n = 0; n < AGG_SIM_NODES; n++) {
+        phase[n] = my_bench_rand(&seed, AGG_SIM_PERIOD_MS / AGG_SIM_STEP_MS) * AGG_SIM_STEP_MS;
+    }
+    if(!agg_sim_run(&direct, 0, false, phase)
+       || !agg_sim_run(&merge, CONFIG_MESH_AGG_WINDOW_MS, false, phase)
+       || !agg_sim_run(&average, AGG_SIM_AVG_WINDOW, true, phase)) {
+        ESP_LOGE(MY_BENCH_TAG, "Aggregation simulation out of memory!");
+        return;
+    }
+
+    ESP_LOGI(MY_BENCH_TAG, "aggregation %u nodes: frames at root direct %u, merged %u, averaged %u",
+             AGG_SIM_NODES - 1, direct.layer_frames[0], merge.layer_frames[0], average.layer_frames[0]);
+    for(uint8_t l = 0; l < AGG_SIM_LAYERS - 1; l++) {
+        len += snprintf(layers + len, sizeof(layers) - len, "%s%u", (l == 0) ? "" : ",", merge.layer_frames[l]);
+    }
+    my_bench_json_begin("mesh_aggregation", "\"nodes\":%u,\"branch\":%u,\"layers\":%u,\"seconds\":%u,"
+                        "\"direct\":{\"root_frames\":%u,\"records\":%u},"
+                        "\"merge\":{\"window_ms\":%u,\"root_frames\":%u,\"records\":%u,\"layer_frames\":[%s]},"
+                        "\"average\":{\"window_ms\":%u,\"root_frames\":%u,\"records\":%u,\"samples\":%u}",
+                        AGG_SIM_NODES - 1, AGG_SIM_BRANCH, AGG_SIM_LAYERS, AGG_SIM_SECONDS,
+                        direct.layer_frames[0], direct.root_records,
+                        CONFIG_MESH_AGG_WINDOW_MS, merge.layer_frames[0], merge.root_records, layers,
+                        AGG_SIM_AVG_WINDOW, average.layer_frames[0], average.root_records, average.root_samples);
+    my_bench_json_end();
+}
+
+#endif
@@ -0,0 +1,371 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "my_bench.h"
+#include "my_sensorif.h"
+#include "my_mesh.h"
+#include "my_mem.h"
+#include "my_pool.h"
+#if CONFIG_MESH_FAIR
+#include "my_fair.h"
+#endif
+#if CONFIG_MESH_BUS
+#include "my_bus.h"
+#endif
+#if CONFIG_MESH_TIME_SYNC
+#include "my_time.h"
+#endif
+#if CONFIG_MESH_AGG
+#include "my_agg.h"
+#endif
+#if CONFIG_MESH_RELIABLE
+#include "my_rel.h"
+#endif
+#if CONFIG_MESH_OTA
+#include "my_ota.h"
+#endif
+#if CONFIG_MESH_SHARD
+#include "my_shard.h"
+#endif
+#if CONFIG_MESH_PARENT_BALANCE
+#include "my_parent.h"
+#endif
+#if CONFIG_MESH_TXQ
+#include "my_txq.h"
+#endif
+#if CONFIG_MESH_LATEST
+#include "my_latest.h"
+#endif
+
+#if CONFIG_MESH_BENCH
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define BENCH_ITERATIONS    CONFIG_MESH_BENCH_ITERATIONS
+#define BENCH_SID           (1)     /* 测试使用的sensor */
+#define BENCH_JSON_SIZE     (2048)  /* 一行JSON的上限 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef void (*bench_func_t)(void);
+
+typedef struct {
+    const char   *name;
+    bench_func_t func;
+} bench_case_t;
+
+typedef struct {
+    uint32_t ns_per_op;
+    uint32_t ops_per_s;
+    uint32_t pool_allocs;   /* 所有迭代中内存池的申请次数 */
+    int32_t  heap_bytes;    /* 所有迭代中堆减少的字节数 */
+} bench_result_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *BENCH_TAG = MY_BENCH_TAG;
+// 一行JSON先写入缓冲区，结束时一次输出，不会被模拟中的日志分开
+static char bench_json[BENCH_JSON_SIZE];
+static size_t bench_json_len = 0;
+static bool bench_json_list = false;    /* 当前行是否开始了数组 */
+static uint16_t bench_json_items = 0;   /* 数组中已输出的对象数 */
+MY_TASK_DEFINE(bench_task_mem, 4096);
+static QueueHandle_t bench_queue;
+static my_sensorif_data_t bench_data;
+static uint8_t bench_ctrl = 1;      /* 与mesh任务手动读取时发送的控制数据相同 */
+static int bench_write_arg = 0;
+static uint8_t bench_value = 0;    /* sensor读取失败时使用的数据 */
+static volatile uint32_t bench_sink; /* 防止结果被优化掉 */
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void bench_sensor_get(void);
+static void bench_sensor_read(void);
+static void bench_sensor_read_cached(void);
+static void bench_sensor_write(void);
+static void bench_sensorif_sweep(void);
+static void bench_queue_handoff(void);
+static void bench_packet_build(void);
+static void bench_run(const bench_case_t *bench, bench_result_t *result);
+static void bench_json_vappend(const char *fmt, va_list args);
+static void bench_json_append(const char *fmt, ...);
+static void bench_task(void *arg);
+
+static const bench_case_t bench_cases[] = {
+    { "sensor_get",     bench_sensor_get },
+    { "sensor_read",    bench_sensor_read },
+    { "sensor_read_cached", bench_sensor_read_cached },
+    { "sensor_write",   bench_sensor_write },
+    { "sensorif_sweep", bench_sensorif_sweep },
+    { "queue_handoff",  bench_queue_handoff },
+    { "packet_build",   bench_packet_build },
+};
+#define BENCH_CASE_NUM  MY_BENCH_COUNT(bench_cases)
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// sid到sensor描述的查找
+static void bench_sensor_get(void)
+{
+    bench_sink += (my_sensor_get(BENCH_SID) != NULL);
+}
+
+// my_sensor_read的完整调用
+static void bench_sensor_read(void)
+{
+    bench_sink += my_sensor_read(BENCH_SID, &bench_ctrl, &bench_data);
+}
+
+// 缓存命中时的my_sensor_read_cached，关闭缓存时与read_default相同
+static void bench_sensor_read_cached(void)
+{
+    my_sensorif_data_t data;
+
+    bench_sink += my_sensor_read_cached(BENCH_SID, UINT32_MAX / 1000, &data);
+}
+
+static void bench_sensor_write(void)
+{
+    bench_sink += my_sensor_write(BENCH_SID, &bench_write_arg);
+}
+
+// 与sensorif任务中的循环读取相同，但不发送到队列
+static void bench_sensorif_sweep(void)
+{
+    for(uint8_t sid = 1; sid <= my_sensor_get_num(); sid++) {
+        const my_sensor_desc_t *sensor = my_sensor_get(sid);
+        if(sensor->state->valid == true) {
+            my_sensor_read_cached(sid, 0, &bench_data);
+            memcpy(&sensor->state->data, &bench_data, sizeof(my_sensorif_data_t));
+        }
+    }
+}
+
+// sensorif任务到mesh任务的队列传递，发送和接收各一次
+static void bench_queue_handoff(void)
+{
+    my_sensorif_data_t data;
+
+    xQueueSend(bench_queue, &bench_data, 0);
+    xQueueReceive(bench_queue, &data, 0);
+    bench_sink += data.num;
+}
+
+// mesh发送任务中的数据包打包：申请缓冲区、打包、释放
+static void bench_packet_build(void)
+{
+    uint8_t *ptr = my_pool_alloc(MESH_SENSOR_DATA_SIZE(bench_data.num));
+
+    if(ptr != NULL) {
+        bench_sink += mesh_pack_sensor_data(&bench_data, ptr);
+        my_pool_free(ptr);
+    }
+}
+
+static uint32_t bench_pool_allocs(void)
+{
+    my_pool_stats_t stats;
+    uint32_t count = 0;
+
+    for(uint8_t i = 0; i < MY_POOL_NUM; i++) {
+        my_pool_get_stats(i, &stats);
+        count += stats.alloc_count;
+    }
+    return count;
+}
+
+static void bench_run(const bench_case_t *bench, bench_result_t *result)
+{
+    uint32_t allocs;
+    uint32_t heap;
+    int64_t start, elapsed;
+
+    // 预热一次，排除第一次调用时的cache缺失
+    bench->func();
+
+    allocs = bench_pool_allocs();
+    heap   = esp_get_free_heap_size();
+    start  = esp_timer_get_time();
+    for(uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench->func();
+    }
+    elapsed = esp_timer_get_time() - start;
+
+    result->pool_allocs = bench_pool_allocs() - allocs;
+    result->heap_bytes  = (int32_t)(heap - esp_get_free_heap_size());
+    result->ns_per_op   = (uint32_t)(elapsed * 1000 / BENCH_ITERATIONS);
+    result->ops_per_s   = (elapsed > 0) ? (uint32_t)(BENCH_ITERATIONS * 1000000LL / elapsed) : 0;
+}
+
+uint32_t my_bench_rand(uint32_t *seed, uint32_t range)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return ((*seed >> 8) & 0xFFFFFF) % range;
+}
+
+// 追加到当前行，超出缓冲区时bench_json_len停在末尾，结束时报错
+static void bench_json_vappend(const char *fmt, va_list args)
+{
+    int len;
+
+    if(bench_json_len >= sizeof(bench_json)) {
+        return;
+    }
+    len = vsnprintf(bench_json + bench_json_len, sizeof(bench_json) - bench_json_len, fmt, args);
+    bench_json_len = (len < 0) ? sizeof(bench_json) : bench_json_len + len;
+}
+
+static void bench_json_append(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    bench_json_vappend(fmt, args);
+    va_end(args);
+}
+
+void my_bench_json_begin(const char *bench, const char *fmt, ...)
+{
+    va_list args;
+
+    bench_json_len  = 0;
+    bench_json_list = false;
+    bench_json_append("{\"bench\":\"%s\"", bench);
+    if(fmt != NULL) {
+        bench_json_append(",");
+        va_start(args, fmt);
+        bench_json_vappend(fmt, args);
+        va_end(args);
+    }
+}
+
+void my_bench_json_list(const char *key)
+{
+    bench_json_list  = true;
+    bench_json_items = 0;
+    bench_json_append(",\"%s\":[", key);
+}
+
+void my_bench_json_item(const char *fmt, ...)
+{
+    va_list args;
+
+    bench_json_append((bench_json_items++ == 0) ? "{" : ",{");
+    va_start(args, fmt);
+    bench_json_vappend(fmt, args);
+    va_end(args);
+    bench_json_append("}");
+}
+
+void my_bench_json_end(void)
+{
+    bench_json_append(bench_json_list ? "]}" : "}");
+    if(bench_json_len >= sizeof(bench_json)) {
+        ESP_LOGE(BENCH_TAG, "JSON line longer than %u bytes, dropped!", BENCH_JSON_SIZE);
+    }
+    else {
+        printf("%s\n", bench_json);
+    }
+    bench_json_list = false;
+}
+
+static void bench_task(void *arg)
+{
+    bench_result_t results[BENCH_CASE_NUM];
+
+    // 测试数据与示例sensor读取的数据相同
+    my_sensor_read(BENCH_SID, &bench_ctrl, &bench_data);
+    if(bench_data.data == NULL) {
+        bench_data.num  = 1;
+        bench_data.data = &bench_value;
+    }
+    bench_queue = xQueueCreate(1, sizeof(my_sensorif_data_t));
+    if(bench_queue == NULL) {
+        ESP_LOGE(BENCH_TAG, "Bench queue create failed!");
+        my_task_exit();
+    }
+
+    // sensor的读写函数中会输出日志，测试期间关闭
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    for(uint8_t i = 0; i < BENCH_CASE_NUM; i++) {
+        bench_run(&bench_cases[i], &results[i]);
+    }
+    esp_log_level_set("*", CONFIG_LOG_DEFAULT_LEVEL);
+
+    ESP_LOGI(BENCH_TAG, "%-16s %9s %10s %12s %12s", "case", "ns/op", "ops/s", "pool allocs", "heap bytes");
+    for(uint8_t i = 0; i < BENCH_CASE_NUM; i++) {
+        ESP_LOGI(BENCH_TAG, "%-16s %9u %10u %12.3f %12.3f", bench_cases[i].name,
+                 results[i].ns_per_op, results[i].ops_per_s,
+                 (double)results[i].pool_allocs / BENCH_ITERATIONS,
+                 (double)results[i].heap_bytes / BENCH_ITERATIONS);
+    }
+
+    // 一行JSON，可以从串口日志中提取后比较
+    my_bench_json_begin("mesh_pipeline", "\"idf\":\"%s\",\"iterations\":%u,\"sensors\":%u",
+                        esp_get_idf_version(), BENCH_ITERATIONS, my_sensor_get_num());
+    my_bench_json_list("results");
+    for(uint8_t i = 0; i < BENCH_CASE_NUM; i++) {
+        my_bench_json_item("\"name\":\"%s\",\"ns_per_op\":%u,\"ops_per_s\":%u,"
+                           "\"pool_allocs_per_op\":%.3f,\"heap_bytes_per_op\":%.3f",
+                           bench_cases[i].name, results[i].ns_per_op, results[i].ops_per_s,
+                           (double)results[i].pool_allocs / BENCH_ITERATIONS,
+                           (double)results[i].heap_bytes / BENCH_ITERATIONS);
+    }
+    my_bench_json_end();
+
+    my_sensor_driver_sim();
+#if CONFIG_MESH_FAIR
+    my_fair_sim();
+#endif
+#if CONFIG_MESH_BUS
+    my_bus_sim();
+#endif
+#if CONFIG_MESH_TIME_SYNC
+    my_time_sim();
+#endif
+#if CONFIG_MESH_AGG
+    my_agg_sim();
+#endif
+#if CONFIG_MESH_RELIABLE
+    my_rel_sim();
+#endif
+#if CONFIG_MESH_OTA
+    my_ota_sim();
+#endif
+#if CONFIG_MESH_SHARD
+    my_shard_sim();
+#endif
+#if CONFIG_MESH_PARENT_BALANCE
+    my_parent_sim();
+#endif
+#if CONFIG_MESH_TXQ
+    my_txq_sim();
+#endif
+#if CONFIG_MESH_LATEST
+    my_latest_sim();
+#endif
+
+    vQueueDelete(bench_queue);
+    my_task_exit();
+}
+
+void my_bench_start(void)
+{
+    // 与mesh发送任务使用相同的优先级和CPU核
+    my_task_create(&bench_task_mem, bench_task, "bench_task", CONFIG_MESH_TASK_PRIO_MESH_TX,
+                   MY_TASK_CORE(CONFIG_MESH_TASK_CORE_MESH_TX), NULL);
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#if defined(ESP_PLATFORM)
+#include "driver/i2c.h"
+#endif
+
+#include "my_bus.h"
+#include "my_mem.h"
+#include "my_dlog.h"
+
+#if CONFIG_MESH_BUS
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define BUS_NUM             CONFIG_MESH_BUS_NUM
+#define BUS_QUEUE_LEN       (4)
+#define BUS_TASK_STACK      (2048)
+#define BUS_TASK_PRIO       (CONFIG_MESH_TASK_PRIO_SENSORIF + 1)    /* 高于sensorif，提交后立即执行 */
+#define BUS_I2C_TIMEOUT     (100 / portTICK_PERIOD_MS)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 总线队列中的请求
+typedef struct {
+    my_bus_xfer_t *xfers;
+    QueueHandle_t done;
+} bus_req_t;
+
+typedef struct {
+    uint8_t       id;
+    my_bus_exec_t exec;
+    void          *ctx;
+    QueueHandle_t queue;    /* NULL为没有注册 */
+} bus_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *BUS_TAG = "bus";
+static bus_t buses[BUS_NUM];
+static my_task_mem_t bus_task_mem[BUS_NUM];
+static my_queue_mem_t bus_queue_mem[BUS_NUM];
+#if CONFIG_MESH_STATIC_ALLOC
+static StackType_t bus_task_stack[BUS_NUM][BUS_TASK_STACK];
+static StaticTask_t bus_task_tcb[BUS_NUM];
+static uint8_t bus_queue_storage[BUS_NUM][BUS_QUEUE_LEN * sizeof(bus_req_t)];
+static StaticQueue_t bus_queue_buf[BUS_NUM];
+#endif
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void bus_task(void *arg);
+#if defined(ESP_PLATFORM)
+static esp_err_t bus_i2c_run(i2c_port_t port, my_bus_xfer_t *xfers, my_bus_xfer_t *end);
+#endif
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static void bus_task(void *arg)
+{
+    bus_t *bus = arg;
+    bus_req_t req;
+
+    while(1) {
+        if(xQueueReceive(bus->queue, &req, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        bus->exec(bus->ctx, req.xfers);
+        if(req.done != NULL) {
+            xQueueSend(req.done, &bus->id, portMAX_DELAY);
+        }
+    }
+    my_task_exit();
+}
+
+esp_err_t my_bus_register(uint8_t bus, const char *name, my_bus_exec_t exec, void *ctx)
+{
+    bus_t *b;
+    uint8_t i = bus - 1;
+
+    if((bus == MY_BUS_NONE) || (bus > BUS_NUM) || (exec == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    b = &buses[i];
+    if(b->queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+#if CONFIG_MESH_STATIC_ALLOC
+    bus_task_mem[i].stack    = bus_task_stack[i];
+    bus_task_mem[i].tcb      = &bus_task_tcb[i];
+    bus_queue_mem[i].storage = bus_queue_storage[i];
+    bus_queue_mem[i].queue   = &bus_queue_buf[i];
+#endif
+    bus_task_mem[i].stack_size  = BUS_TASK_STACK;
+    bus_queue_mem[i].length     = BUS_QUEUE_LEN;
+    bus_queue_mem[i].item_size  = sizeof(bus_req_t);
+
+    b->id   = bus;
+    b->exec = exec;
+    b->ctx  = ctx;
+    b->queue = my_queue_create(&bus_queue_mem[i]);
+    if(b->queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // 不绑定CPU核，两条总线可以同时在两个核上执行
+    if(my_task_create(&bus_task_mem[i], bus_task, name, BUS_TASK_PRIO, tskNO_AFFINITY, b) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(BUS_TAG, "Bus %d (%s) registered", bus, name);
+    return ESP_OK;
+}
+
+esp_err_t my_bus_submit(uint8_t bus, my_bus_xfer_t *xfers, QueueHandle_t done)
+{
+    bus_req_t req = { xfers, done };
+
+    if((bus == MY_BUS_NONE) || (bus > BUS_NUM) || (buses[bus - 1].queue == NULL)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(xQueueSend(buses[bus - 1].queue, &req, 0) != pdTRUE) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+#if defined(ESP_PLATFORM)
+// 把[xfers, end)中的传输放在一个命令链表中执行
+static esp_err_t bus_i2c_run(i2c_port_t port, my_bus_xfer_t *xfers, my_bus_xfer_t *end)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    esp_err_t err;
+
+    if(cmd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for(my_bus_xfer_t *x = xfers; x != end; x = x->next) {
+        if(x->tx_len > 0) {
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, (x->addr << 1) | I2C_MASTER_WRITE, true);
+            i2c_master_write(cmd, (uint8_t *)x->tx, x->tx_len, true);
+        }
+        if(x->rx_len > 0) {
+            // 写入之后为重复起始条件
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, (x->addr << 1) | I2C_MASTER_READ, true);
+            i2c_master_read(cmd, x->rx, x->rx_len, I2C_MASTER_LAST_NACK);
+        }
+    }
+    i2c_master_stop(cmd);
+    err = i2c_master_cmd_begin(port, cmd, BUS_I2C_TIMEOUT);
+    i2c_cmd_link_delete(cmd);
+
+    return err;
+}
+
+void my_bus_i2c_exec(void *ctx, my_bus_xfer_t *xfers)
+{
+    i2c_port_t port = (i2c_port_t)(intptr_t)ctx;
+    esp_err_t err = bus_i2c_run(port, xfers, NULL);
+
+    for(my_bus_xfer_t *x = xfers; x != NULL; x = x->next) {
+        x->err = err;
+    }
+    if((err == ESP_OK) || (xfers->next == NULL)) {
+        return;
+    }
+    // 有设备没有应答时整个命令链表失败，逐个执行找出出错的设备
+    MY_DLOGW(BUS_TAG, "I2C%d batch failed (0x%x), retry one by one", port, err);
+    for(my_bus_xfer_t *x = xfers; x != NULL; x = x->next) {
+        x->err = bus_i2c_run(port, x, x->next);
+    }
+}
+#endif
+
+#endif
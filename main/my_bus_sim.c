@@ -0,0 +1,158 @@
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "my_bench.h"
+#include "my_bus.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_BUS
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 共享总线的模拟：8个sensor平均分在两条总线上，每个sensor写1字节寄存器地址后读2字节
+#define BUS_SIM_SENSORS     (8)
+#define BUS_SIM_BUSES       ((CONFIG_MESH_BUS_NUM < 2) ? CONFIG_MESH_BUS_NUM : 2)
+#define BUS_SIM_SETUP_US    (200)       /* 每次总线事务的固定开销（驱动调用、中断） */
+#define BUS_SIM_BYTE_US     (90)        /* 100kHz I2C每字节(含ACK)的时间 */
+#define BUS_SIM_GAP_MS      (100)       /* 原来的循环读取中sensor之间的间隔 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 模拟的总线，传输期间总线任务阻塞等待定时器，与实际驱动等待中断相同，不占用CPU
+typedef struct {
+    esp_timer_handle_t timer;
+    TaskHandle_t       task;
+} bus_sim_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static my_bus_xfer_t bus_sim_xfer[BUS_SIM_SENSORS];
+static uint8_t bus_sim_reg = 0x00;
+static uint8_t bus_sim_rx[BUS_SIM_SENSORS][2];
+static volatile uint32_t bus_sim_transactions;
+static bus_sim_t bus_sim[BUS_SIM_BUSES];
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void bus_sim_done(void *arg);
+static void bus_sim_exec(void *ctx, my_bus_xfer_t *xfers);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 模拟的传输完成中断
+static void bus_sim_done(void *arg)
+{
+    xTaskNotifyGive(((bus_sim_t *)arg)->task);
+}
+
+// 模拟的总线：按传输的字节数计算总线被占用的时间，等待这段时间后完成
+static void bus_sim_exec(void *ctx, my_bus_xfer_t *xfers)
+{
+    bus_sim_t *sim = ctx;
+    int64_t us = BUS_SIM_SETUP_US;
+
+    for(my_bus_xfer_t *x = xfers; x != NULL; x = x->next) {
+        // 地址字节 + 写入，重复起始后地址字节 + 读取
+        us += (1 + x->tx_len + ((x->rx_len > 0) ? 1 + x->rx_len : 0)) * BUS_SIM_BYTE_US;
+        memset(x->rx, x->addr, x->rx_len);
+        x->err = ESP_OK;
+    }
+    sim->task = xTaskGetCurrentTaskHandle();
+    esp_timer_start_once(sim->timer, us);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bus_sim_transactions++;
+}
+
+/**
+ * 比较逐个读取（每个sensor单独提交并等待，即原来的方式去掉间隔）和
+ * 每条总线合并提交、各总线并行的读取时间，原来的循环读取再加上每个sensor 100ms的间隔。
+ * 模拟的总线注册后不再注销，不要和实际的总线同时使用
+ */
+void my_bus_sim(void)
+{
+    QueueHandle_t done = xQueueCreate(BUS_SIM_BUSES, sizeof(uint8_t));
+    my_bus_xfer_t *tail[BUS_SIM_BUSES] = { NULL };
+    uint32_t seq_us, batch_us, seq_trans, batch_trans;
+    uint8_t bus, id;
+    int64_t start;
+
+    if(done == NULL) {
+        return;
+    }
+    for(bus = 1; bus <= BUS_SIM_BUSES; bus++) {
+        esp_timer_create_args_t timer_args = {
+            .callback = bus_sim_done,
+            .arg      = &bus_sim[bus - 1],
+            .name     = "bus_sim",
+        };
+        if(esp_timer_create(&timer_args, &bus_sim[bus - 1].timer) != ESP_OK) {
+            vQueueDelete(done);
+            return;
+        }
+        if(my_bus_register(bus, (bus == 1) ? "bus_sim1" : "bus_sim2", bus_sim_exec,
+                           &bus_sim[bus - 1]) != ESP_OK) {
+            ESP_LOGW(MY_BENCH_TAG, "Bus %d in use, skip bus simulation", bus);
+            vQueueDelete(done);
+            return;
+        }
+    }
+    for(uint8_t i = 0; i < BUS_SIM_SENSORS; i++) {
+        bus_sim_xfer[i].addr   = 0x40 + i;
+        bus_sim_xfer[i].tx     = &bus_sim_reg;
+        bus_sim_xfer[i].tx_len = sizeof(bus_sim_reg);
+        bus_sim_xfer[i].rx     = bus_sim_rx[i];
+        bus_sim_xfer[i].rx_len = sizeof(bus_sim_rx[i]);
+    }
+
+    // 逐个读取
+    bus_sim_transactions = 0;
+    start = esp_timer_get_time();
+    for(uint8_t i = 0; i < BUS_SIM_SENSORS; i++) {
+        bus_sim_xfer[i].next = NULL;
+        my_bus_submit(i % BUS_SIM_BUSES + 1, &bus_sim_xfer[i], done);
+        xQueueReceive(done, &id, portMAX_DELAY);
+    }
+    seq_us = esp_timer_get_time() - start;
+    seq_trans = bus_sim_transactions;
+
+    // 每条总线的传输连成链表，所有总线同时提交
+    for(uint8_t i = 0; i < BUS_SIM_SENSORS; i++) {
+        uint8_t b = i % BUS_SIM_BUSES;
+        bus_sim_xfer[i].next = NULL;
+        if(tail[b] != NULL) {
+            tail[b]->next = &bus_sim_xfer[i];
+        }
+        tail[b] = &bus_sim_xfer[i];
+    }
+    bus_sim_transactions = 0;
+    start = esp_timer_get_time();
+    for(bus = 0; bus < BUS_SIM_BUSES; bus++) {
+        my_bus_submit(bus + 1, &bus_sim_xfer[bus], done);
+    }
+    for(bus = 0; bus < BUS_SIM_BUSES; bus++) {
+        xQueueReceive(done, &id, portMAX_DELAY);
+    }
+    batch_us = esp_timer_get_time() - start;
+    batch_trans = bus_sim_transactions;
+    vQueueDelete(done);
+
+    ESP_LOGI(MY_BENCH_TAG, "bus sweep %u sensors on %u buses: one by one %u us, batched %u us",
+             BUS_SIM_SENSORS, BUS_SIM_BUSES, seq_us, batch_us);
+    my_bench_json_begin("bus_sweep", "\"sensors\":%u,\"buses\":%u,\"legacy_ms\":%u,"
+                        "\"one_by_one\":{\"us\":%u,\"transactions\":%u},"
+                        "\"batched\":{\"us\":%u,\"transactions\":%u}",
+                        BUS_SIM_SENSORS, BUS_SIM_BUSES, BUS_SIM_SENSORS * BUS_SIM_GAP_MS + seq_us / 1000,
+                        seq_us, seq_trans, batch_us, batch_trans);
+    my_bench_json_end();
+}
+
+#endif
@@ -0,0 +1,239 @@
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "my_capture.h"
+#include "my_mem.h"
+
+#if CONFIG_MESH_CAPTURE
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define CAPTURE_BUF_SIZE    CONFIG_MESH_CAPTURE_BUF_SIZE
+#define CAPTURE_SNAPLEN     CONFIG_MESH_CAPTURE_SNAPLEN
+#define CAPTURE_LINE_BYTES  (64)    /* 串口输出时每行的字节数 */
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *CAPTURE_TAG = "capture";
+static uint8_t ring[CAPTURE_BUF_SIZE];
+static uint32_t ring_head = 0;      /* 下一个记录的写入位置 */
+static uint32_t ring_tail = 0;      /* 最早的记录的位置 */
+static uint32_t ring_used = 0;
+static uint32_t dropped = 0;
+static int64_t last_time = 0;
+static bool paused = false;         /* 导出期间暂停记录 */
+static uint8_t self_addr[6];
+static portMUX_TYPE ring_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t capture_task_handle;
+#if CONFIG_MESH_CAPTURE_DUMP_PERIOD > 0
+static esp_timer_handle_t dump_timer;
+#endif
+MY_TASK_DEFINE(capture_task_mem, 3072);
+
+// 导出时的行缓冲
+static uint8_t line_buf[CAPTURE_LINE_BYTES];
+static uint8_t line_len = 0;
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void ring_put(const void *data, uint32_t len);
+static void ring_get(uint32_t pos, void *data, uint32_t len);
+static void capture_dump_bytes(const uint8_t *data, uint32_t len);
+static void capture_dump_flush(void);
+static void capture_task(void *arg);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 写入环形缓冲区，调用前需确认空间足够
+static void ring_put(const void *data, uint32_t len)
+{
+    uint32_t first = CAPTURE_BUF_SIZE - ring_head;
+
+    if(len <= first) {
+        memcpy(ring + ring_head, data, len);
+    }
+    else {
+        memcpy(ring + ring_head, data, first);
+        memcpy(ring, (const uint8_t *)data + first, len - first);
+    }
+    ring_head = (ring_head + len) % CAPTURE_BUF_SIZE;
+    ring_used += len;
+}
+
+static void ring_get(uint32_t pos, void *data, uint32_t len)
+{
+    uint32_t first = CAPTURE_BUF_SIZE - pos;
+
+    if(len <= first) {
+        memcpy(data, ring + pos, len);
+    }
+    else {
+        memcpy(data, ring + pos, first);
+        memcpy((uint8_t *)data + first, ring, len - first);
+    }
+}
+
+void my_capture_frame(my_capture_dir_t dir, const mesh_addr_t *from, const mesh_addr_t *to,
+                      const mesh_data_t *data, int flag)
+{
+    my_capture_rec_t rec;
+    int64_t now = esp_timer_get_time();
+
+    rec.dir     = dir;
+    rec.proto   = data->proto;
+    rec.tos     = data->tos;
+    rec.flag    = (uint8_t)flag;
+    rec.len     = data->size;
+    rec.cap_len = (data->size > CAPTURE_SNAPLEN) ? CAPTURE_SNAPLEN : data->size;
+    memcpy(rec.from, (from != NULL) ? from->addr : self_addr, sizeof(rec.from));
+    memcpy(rec.to, (to != NULL) ? to->addr : self_addr, sizeof(rec.to));
+
+    portENTER_CRITICAL(&ring_mux);
+    if(paused) {
+        dropped++;
+        portEXIT_CRITICAL(&ring_mux);
+        return;
+    }
+    // 空间不足时丢弃最早的记录
+    while(CAPTURE_BUF_SIZE - ring_used < sizeof(rec) + rec.cap_len) {
+        my_capture_rec_t old;
+        ring_get(ring_tail, &old, sizeof(old));
+        ring_tail = (ring_tail + sizeof(old) + old.cap_len) % CAPTURE_BUF_SIZE;
+        ring_used -= sizeof(old) + old.cap_len;
+        dropped++;
+    }
+    rec.dt_us = (now - last_time > UINT32_MAX) ? UINT32_MAX : (uint32_t)(now - last_time);
+    last_time = now;
+    ring_put(&rec, sizeof(rec));
+    ring_put(data->data, rec.cap_len);
+    portEXIT_CRITICAL(&ring_mux);
+}
+
+static void capture_dump_flush(void)
+{
+    char line[CAPTURE_LINE_BYTES * 2 + 8] = "CAP:";
+    char *p = line + 4;
+
+    if(line_len == 0) {
+        return;
+    }
+    for(uint8_t i = 0; i < line_len; i++) {
+        p += sprintf(p, "%02x", line_buf[i]);
+    }
+    // 整行一次输出，避免与其他任务的日志混在同一行中
+    printf("%s\n", line);
+    line_len = 0;
+}
+
+static void capture_dump_bytes(const uint8_t *data, uint32_t len)
+{
+    while(len > 0) {
+        uint32_t n = CAPTURE_LINE_BYTES - line_len;
+        if(n > len) {
+            n = len;
+        }
+        memcpy(line_buf + line_len, data, n);
+        line_len += n;
+        data += n;
+        len -= n;
+        if(line_len == CAPTURE_LINE_BYTES) {
+            capture_dump_flush();
+        }
+    }
+}
+
+// 以十六进制文本输出缓冲区中的所有记录，输出后清空缓冲区
+static void capture_dump_ring(void)
+{
+    my_capture_file_hdr_t hdr;
+    uint8_t chunk[CAPTURE_LINE_BYTES];
+    uint32_t pos, used;
+
+    // 暂停记录，输出期间缓冲区内容不变
+    portENTER_CRITICAL(&ring_mux);
+    paused = true;
+    pos  = ring_tail;
+    used = ring_used;
+    hdr.dropped = dropped;
+    portEXIT_CRITICAL(&ring_mux);
+
+    hdr.magic    = MY_CAPTURE_MAGIC;
+    hdr.version  = MY_CAPTURE_VERSION;
+    hdr.reserved = 0;
+    hdr.snaplen  = CAPTURE_SNAPLEN;
+    memcpy(hdr.self, self_addr, sizeof(hdr.self));
+
+    ESP_LOGI(CAPTURE_TAG, "Dump %u bytes, %u dropped", used, hdr.dropped);
+    printf("CAP-BEGIN %u\n", (uint32_t)(sizeof(hdr) + used));
+    capture_dump_bytes((const uint8_t *)&hdr, sizeof(hdr));
+    while(used > 0) {
+        uint32_t n = (used > sizeof(chunk)) ? sizeof(chunk) : used;
+        ring_get(pos, chunk, n);
+        capture_dump_bytes(chunk, n);
+        pos = (pos + n) % CAPTURE_BUF_SIZE;
+        used -= n;
+    }
+    capture_dump_flush();
+    printf("CAP-END\n");
+
+    portENTER_CRITICAL(&ring_mux);
+    ring_head = ring_tail = ring_used = 0;
+    dropped = 0;
+    paused = false;
+    portEXIT_CRITICAL(&ring_mux);
+}
+
+static void capture_task(void *arg)
+{
+    while(1) {
+        // 等待导出请求
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        capture_dump_ring();
+    }
+    my_task_exit();
+}
+
+void my_capture_dump(void)
+{
+    if(capture_task_handle != NULL) {
+        xTaskNotifyGive(capture_task_handle);
+    }
+}
+
+#if CONFIG_MESH_CAPTURE_DUMP_PERIOD > 0
+static void dump_timer_callback(void *arg)
+{
+    my_capture_dump();
+}
+#endif
+
+void my_capture_init(const mesh_addr_t *self)
+{
+    memcpy(self_addr, self->addr, sizeof(self_addr));
+    if(capture_task_handle != NULL) {
+        return;
+    }
+
+    // 导出较慢，使用最低的优先级，不影响收发
+    capture_task_handle = my_task_create(&capture_task_mem, capture_task, "capture_task", 1,
+                                         tskNO_AFFINITY, NULL);
+#if CONFIG_MESH_CAPTURE_DUMP_PERIOD > 0
+    const esp_timer_create_args_t dump_timer_args = {
+        .callback = &dump_timer_callback,
+        .name = "capture-dump"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&dump_timer_args, &dump_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(dump_timer, CONFIG_MESH_CAPTURE_DUMP_PERIOD * 1000 * 1000LL));
+#endif
+    ESP_LOGI(CAPTURE_TAG, "Capture started, buffer %u bytes, snaplen %u", CAPTURE_BUF_SIZE, CAPTURE_SNAPLEN);
+}
+
+#endif
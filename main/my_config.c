@@ -0,0 +1,334 @@
+#include <string.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+
+#include "my_config.h"
+#include "my_mesh.h"
+#include "my_sensorif.h"
+
+#if CONFIG_MESH_SENSOR_CONFIG
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define CONFIG_COMMIT_US    (CONFIG_MESH_SENSOR_CONFIG_COMMIT_S * 1000000LL)
+// 默认配置，与关闭CONFIG_MESH_SENSOR_CONFIG时sensorif的行为相同
+#define CONFIG_PERIOD_MS    (1000)
+#define CONFIG_GAP_MS       (100)
+#define CONFIG_PERIOD_MIN   (100)
+#define CONFIG_PERIOD_MAX   (60000)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// NVS中保存的blob，只保存注册的sensor
+typedef struct __attribute__((packed)) {
+    uint8_t  version;       /* MY_CONFIG_VERSION */
+    uint8_t  count;         /* sensor个数 */
+    my_report_config_global_t global;
+    struct __attribute__((packed)) {
+        uint16_t name_hash; /* sensor名称的哈希，增删sensor后sid会变化 */
+        my_report_config_sensor_t cfg;
+    } sensors[MY_CONFIG_SENSORS];
+} config_blob_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *CONFIG_TAG = "config";
+static const my_report_config_sensor_t config_default = {
+    .enabled = 1, .every = 1, .samples = 1, .priority = 0, .low = 0, .high = UINT8_MAX,
+};
+// 以下变量在接收配置的任务、sensorif任务和mesh发送任务中使用，由config_mux保护
+static portMUX_TYPE config_mux = portMUX_INITIALIZER_UNLOCKED;
+static my_report_config_global_t config_global = { CONFIG_PERIOD_MS, CONFIG_GAP_MS };
+static my_report_config_sensor_t config_sensor[MY_CONFIG_SENSORS];
+static bool config_dirty = false;
+static int64_t config_commit_at = 0;        /* 写入NVS的时间(us) */
+static my_config_stats_t config_stats;
+// 初始化后不再修改
+static uint16_t config_hash[MY_CONFIG_SENSORS];
+static uint8_t config_num = 0;              /* 可以配置的sensor数 */
+// 在初始化和mesh发送任务中使用
+static config_blob_t config_blob, config_saved;
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static uint16_t config_name_hash(const char *name);
+static bool config_global_valid(const my_report_config_global_t *global);
+static bool config_sensor_valid(const my_report_config_sensor_t *sensor);
+static void config_merge(my_report_config_sensor_t *out, const my_report_config_t *msg);
+static void config_load(void);
+static void config_retry(void);
+static esp_err_t config_reject(esp_err_t err);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// FNV-1a，折叠为16位
+static uint16_t config_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261UL;
+
+    while(*name != '\0') {
+        hash = (hash ^ (uint8_t)*name++) * 16777619UL;
+    }
+    return (hash >> 16) ^ (hash & 0xFFFF);
+}
+
+static bool config_global_valid(const my_report_config_global_t *global)
+{
+    return (global->period_ms >= CONFIG_PERIOD_MIN) && (global->period_ms <= CONFIG_PERIOD_MAX)
+           && (global->gap_ms <= global->period_ms);
+}
+
+static bool config_sensor_valid(const my_report_config_sensor_t *sensor)
+{
+    return (sensor->every > 0) && (sensor->samples > 0) && (sensor->low <= sensor->high);
+}
+
+// 把消息中mask指定的字段合并到out中
+static void config_merge(my_report_config_sensor_t *out, const my_report_config_t *msg)
+{
+    if(msg->mask & MY_REPORT_CONFIG_ENABLED) {
+        out->enabled = (msg->sensor.enabled != 0);
+    }
+    if(msg->mask & MY_REPORT_CONFIG_EVERY) {
+        out->every = msg->sensor.every;
+    }
+    if(msg->mask & MY_REPORT_CONFIG_SAMPLES) {
+        out->samples = msg->sensor.samples;
+    }
+    if(msg->mask & MY_REPORT_CONFIG_PRIORITY) {
+        out->priority = msg->sensor.priority;
+    }
+    if(msg->mask & MY_REPORT_CONFIG_LOW) {
+        out->low = msg->sensor.low;
+    }
+    if(msg->mask & MY_REPORT_CONFIG_HIGH) {
+        out->high = msg->sensor.high;
+    }
+}
+
+// 读取NVS中保存的配置，格式或数值错误的部分使用默认配置
+static void config_load(void)
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(config_blob);
+    uint8_t loaded = 0;
+    esp_err_t err;
+
+    err = nvs_open(MESH_NVS_KEY_NAMESPACE, NVS_READONLY, &handle);
+    if(err == ESP_OK) {
+        err = nvs_get_blob(handle, MESH_NVS_KEY_SENSOR_CONFIG, &config_blob, &len);
+        nvs_close(handle);
+    }
+    if(err != ESP_OK) {
+        ESP_LOGI(CONFIG_TAG, "No saved sensor config, using defaults");
+        return;
+    }
+    if((len < offsetof(config_blob_t, sensors)) || (config_blob.version != MY_CONFIG_VERSION)
+       || (config_blob.count > MY_CONFIG_SENSORS)
+       || (len != offsetof(config_blob_t, sensors) + config_blob.count * sizeof(config_blob.sensors[0]))) {
+        ESP_LOGW(CONFIG_TAG, "Saved sensor config invalid (%d bytes), using defaults", (int)len);
+        return;
+    }
+    if(config_global_valid(&config_blob.global)) {
+        config_global = config_blob.global;
+    }
+    for(uint8_t i = 0; i < config_blob.count; i++) {
+        for(uint8_t j = 0; j < config_num; j++) {
+            if((config_hash[j] == config_blob.sensors[i].name_hash)
+               && config_sensor_valid(&config_blob.sensors[i].cfg)) {
+                config_sensor[j] = config_blob.sensors[i].cfg;
+                loaded++;
+                break;
+            }
+        }
+    }
+    ESP_LOGI(CONFIG_TAG, "Sensor config loaded: period %d ms, %d of %d sensors",
+             config_global.period_ms, loaded, config_blob.count);
+}
+
+void my_config_init(void)
+{
+    config_num = (my_sensor_get_num() < MY_CONFIG_SENSORS) ? my_sensor_get_num() : MY_CONFIG_SENSORS;
+    for(uint8_t i = 0; i < MY_CONFIG_SENSORS; i++) {
+        config_sensor[i] = config_default;
+    }
+    for(uint8_t i = 0; i < config_num; i++) {
+        config_hash[i] = config_name_hash(my_sensor_get(i + 1)->name);
+    }
+    config_load();
+}
+
+esp_err_t my_config_apply(const uint8_t *data, uint16_t len)
+{
+    my_report_config_t msg = { 0 };
+    my_report_config_sensor_t merged[MY_CONFIG_SENSORS];
+    my_report_config_global_t global;
+    uint8_t first, last;
+    bool valid = true;
+
+    if(len < offsetof(my_report_config_t, global)) {
+        return config_reject(ESP_ERR_INVALID_SIZE);
+    }
+    memcpy(&msg, data, (len < sizeof(msg)) ? len : sizeof(msg));
+    if(len < offsetof(my_report_config_t, global)
+             + ((msg.sid == MY_REPORT_CONFIG_GLOBAL) ? sizeof(msg.global) : sizeof(msg.sensor))) {
+        return config_reject(ESP_ERR_INVALID_SIZE);
+    }
+    if((msg.sid != MY_REPORT_CONFIG_GLOBAL) && (msg.sid != MY_REPORT_CONFIG_ALL) && (msg.sid > config_num)) {
+        return config_reject(ESP_ERR_NOT_FOUND);
+    }
+    first = (msg.sid == MY_REPORT_CONFIG_ALL) ? 0 : msg.sid - 1;
+    last  = (msg.sid == MY_REPORT_CONFIG_ALL) ? config_num : msg.sid;
+
+    // 先检查合并后的配置，有一个无效时都不修改
+    portENTER_CRITICAL(&config_mux);
+    if(msg.sid == MY_REPORT_CONFIG_GLOBAL) {
+        global = config_global;
+        if(msg.mask & MY_REPORT_CONFIG_PERIOD) {
+            global.period_ms = msg.global.period_ms;
+        }
+        if(msg.mask & MY_REPORT_CONFIG_GAP) {
+            global.gap_ms = msg.global.gap_ms;
+        }
+        valid = config_global_valid(&global);
+        if(valid) {
+            config_global = global;
+        }
+    }
+    else {
+        for(uint8_t i = first; valid && (i < last); i++) {
+            merged[i] = config_sensor[i];
+            config_merge(&merged[i], &msg);
+            valid = config_sensor_valid(&merged[i]);
+        }
+        if(valid) {
+            memcpy(&config_sensor[first], &merged[first], (last - first) * sizeof(merged[0]));
+        }
+    }
+    if(valid && !config_dirty) {
+        // 第一次修改时开始计时，之后的修改一起写入
+        config_dirty = true;
+        config_commit_at = esp_timer_get_time() + CONFIG_COMMIT_US;
+    }
+    if(valid) {
+        config_stats.applied++;
+    }
+    else {
+        config_stats.rejected++;
+    }
+    portEXIT_CRITICAL(&config_mux);
+
+    if(!valid) {
+        ESP_LOGW(CONFIG_TAG, "Invalid config for sid %d (mask 0x%02x) rejected", msg.sid, msg.mask);
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI(CONFIG_TAG, "Config for sid %d (mask 0x%02x) applied", msg.sid, msg.mask);
+    return ESP_OK;
+}
+
+// 写入失败，稍后再写入
+static void config_retry(void)
+{
+    portENTER_CRITICAL(&config_mux);
+    if(!config_dirty) {
+        config_dirty = true;
+        config_commit_at = esp_timer_get_time() + CONFIG_COMMIT_US;
+    }
+    portEXIT_CRITICAL(&config_mux);
+}
+
+static esp_err_t config_reject(esp_err_t err)
+{
+    portENTER_CRITICAL(&config_mux);
+    config_stats.rejected++;
+    portEXIT_CRITICAL(&config_mux);
+    return err;
+}
+
+void my_config_get_global(my_report_config_global_t *global)
+{
+    portENTER_CRITICAL(&config_mux);
+    *global = config_global;
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void my_config_get_sensor(uint8_t sid, my_report_config_sensor_t *sensor)
+{
+    if((sid == 0) || (sid > config_num)) {
+        *sensor = config_default;
+        return;
+    }
+    portENTER_CRITICAL(&config_mux);
+    *sensor = config_sensor[sid - 1];
+    portEXIT_CRITICAL(&config_mux);
+}
+
+void my_config_poll(bool force)
+{
+    size_t len = offsetof(config_blob_t, sensors) + config_num * sizeof(config_blob.sensors[0]);
+    size_t saved_len = sizeof(config_saved);
+    nvs_handle_t handle;
+    esp_err_t err;
+
+    portENTER_CRITICAL(&config_mux);
+    if(!config_dirty || (!force && (esp_timer_get_time() < config_commit_at))) {
+        portEXIT_CRITICAL(&config_mux);
+        return;
+    }
+    config_dirty = false;
+    config_blob.version = MY_CONFIG_VERSION;
+    config_blob.count   = config_num;
+    config_blob.global  = config_global;
+    for(uint8_t i = 0; i < config_num; i++) {
+        config_blob.sensors[i].name_hash = config_hash[i];
+        config_blob.sensors[i].cfg = config_sensor[i];
+    }
+    portEXIT_CRITICAL(&config_mux);
+
+    err = nvs_open(MESH_NVS_KEY_NAMESPACE, NVS_READWRITE, &handle);
+    if(err != ESP_OK) {
+        ESP_LOGE(CONFIG_TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        config_retry();
+        return;
+    }
+    // 改回原来的值时不需要写入
+    if((nvs_get_blob(handle, MESH_NVS_KEY_SENSOR_CONFIG, &config_saved, &saved_len) == ESP_OK)
+       && (saved_len == len) && (memcmp(&config_saved, &config_blob, len) == 0)) {
+        portENTER_CRITICAL(&config_mux);
+        config_stats.unchanged++;
+        portEXIT_CRITICAL(&config_mux);
+        nvs_close(handle);
+        return;
+    }
+    err = nvs_set_blob(handle, MESH_NVS_KEY_SENSOR_CONFIG, &config_blob, len);
+    if(err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if(err != ESP_OK) {
+        ESP_LOGE(CONFIG_TAG, "Error (%s) saving sensor config!", esp_err_to_name(err));
+        config_retry();
+        return;
+    }
+    portENTER_CRITICAL(&config_mux);
+    config_stats.commits++;
+    portEXIT_CRITICAL(&config_mux);
+    ESP_LOGI(CONFIG_TAG, "Sensor config saved (%d bytes)", (int)len);
+}
+
+void my_config_get_stats(my_config_stats_t *stats)
+{
+    portENTER_CRITICAL(&config_mux);
+    *stats = config_stats;
+    portEXIT_CRITICAL(&config_mux);
+}
+
+#endif
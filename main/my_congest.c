@@ -0,0 +1,203 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_mesh.h"
+
+#include "my_congest.h"
+#include "my_main.h"
+#include "my_mesh.h"
+#include "my_dlog.h"
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+#include "my_uplink.h"
+#endif
+
+#if CONFIG_MESH_ADAPTIVE_SAMPLING
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define CONGEST_THRESHOLD   CONFIG_MESH_CONGEST_THRESHOLD               /* 开始拥塞的占用率(%) */
+#define CONGEST_RECOVER     (CONFIG_MESH_CONGEST_RECOVER_MS / portTICK_PERIOD_MS)
+#define CONGEST_HOLD_S      CONFIG_MESH_CONGEST_HOLD
+#define CONGEST_REFRESH     (CONGEST_HOLD_S * 1000 / 2 / portTICK_PERIOD_MS)  /* 根节点重发通知的周期 */
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *CONGEST_TAG = "congest";
+static my_congest_level_t local_level = MY_CONGEST_NONE;    /* 本地信号计算的级别 */
+static my_congest_level_t level = MY_CONGEST_NONE;          /* 生效的级别 */
+static TickType_t local_change;     /* 本地级别上次变化的时间 */
+static bool dropped = false;        /* 上次更新之后本地队列满过 */
+// 根节点的通知，在mesh接收任务中写入
+static portMUX_TYPE root_mux = portMUX_INITIALIZER_UNLOCKED;
+static my_congest_level_t root_level = MY_CONGEST_NONE;
+static TickType_t root_expire;
+// 根节点发出的通知
+static my_congest_level_t notify_level = MY_CONGEST_NONE;
+static TickType_t notify_time;
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+static uint32_t uplink_dropped = 0;
+#endif
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static uint32_t congest_occupancy(void);
+static my_congest_level_t congest_local_target(void);
+static void congest_notify(my_congest_level_t notify);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 各个队列中占用率最高的一个(%)
+static uint32_t congest_occupancy(void)
+{
+    mesh_tx_pending_t tx = {0};
+    mesh_rx_pending_t rx = {0};
+    uint32_t occ, max;
+
+    // sensorif到mesh任务的队列
+    max = uxQueueMessagesWaiting(main_get_mesh_queue()) * 100 / CONFIG_MESH_QUEUE_LEN_MESH;
+
+    // 发往父节点的数据包
+    if(esp_mesh_get_tx_pending(&tx) == ESP_OK) {
+        occ = (tx.to_parent + tx.to_parent_p2p) * 100 / MESH_XON_QSIZE;
+        max = (occ > max) ? occ : max;
+    }
+    // 根节点等待转发的数据包
+    if(esp_mesh_is_root() && (esp_mesh_get_rx_pending(&rx) == ESP_OK)) {
+        occ = rx.toDS * 100 / MESH_XON_QSIZE;
+        max = (occ > max) ? occ : max;
+    }
+    return max;
+}
+
+static my_congest_level_t congest_local_target(void)
+{
+    uint32_t occ = congest_occupancy();
+
+    if(dropped) {
+        dropped = false;
+        return MY_CONGEST_SEVERE;
+    }
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+    // 根节点的上行缓冲区满过
+    if(esp_mesh_is_root()) {
+        my_uplink_stats_t stats;
+        my_uplink_get_stats(&stats);
+        bool uplink_full = (stats.dropped != uplink_dropped);
+        uplink_dropped = stats.dropped;
+        if(uplink_full) {
+            return MY_CONGEST_SEVERE;
+        }
+    }
+#endif
+    if(occ >= 100) {
+        return MY_CONGEST_SEVERE;
+    }
+    if(occ >= (CONGEST_THRESHOLD + 100) / 2) {
+        return MY_CONGEST_HEAVY;
+    }
+    if(occ >= CONGEST_THRESHOLD) {
+        return MY_CONGEST_LIGHT;
+    }
+    return MY_CONGEST_NONE;
+}
+
+// 根节点向子节点发送拥塞通知，由各节点逐层转发，发送失败的节点等待下一次
+static void congest_notify(my_congest_level_t notify)
+{
+    my_congest_msg_t msg = {
+        .type   = MESH_CTRL_CONGEST,
+        .level  = notify,
+        .hold_s = CONGEST_HOLD_S,
+    };
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)&msg,
+        .size  = sizeof(msg),
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+    uint16_t children;
+
+    // 拥塞时ESP-MESH的队列很可能已满，经过发送队列稍后重试，不直接丢失通知
+    children = mesh_send_children(&mesh_data, MESH_DATA_NONBLOCK, true);
+    notify_level = notify;
+    notify_time = xTaskGetTickCount();
+    MY_DLOGI(CONGEST_TAG, "Notify level %d to %d children", notify, children);
+}
+
+my_congest_level_t my_congest_update(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    my_congest_level_t target = congest_local_target();
+    my_congest_level_t remote = MY_CONGEST_NONE;
+
+    // 升高立即生效，降低时每隔一段时间降一级
+    if(target > local_level) {
+        local_level = target;
+        local_change = now;
+    }
+    else if((target < local_level) && ((now - local_change) >= CONGEST_RECOVER)) {
+        local_level--;
+        local_change = now;
+    }
+
+    if(esp_mesh_is_root()) {
+        // 级别变化时或拥塞期间定期发送通知，恢复时发送一次NONE
+        if((local_level != notify_level)
+           || ((local_level > MY_CONGEST_NONE) && ((now - notify_time) >= CONGEST_REFRESH))) {
+            congest_notify(local_level);
+        }
+    }
+    else {
+        portENTER_CRITICAL(&root_mux);
+        if((int32_t)(root_expire - now) > 0) {
+            remote = root_level;
+        }
+        portEXIT_CRITICAL(&root_mux);
+    }
+
+    my_congest_level_t effective = (remote > local_level) ? remote : local_level;
+    if(effective != level) {
+        MY_DLOGW(CONGEST_TAG, "Congestion level %d -> %d (local %d, root %d)",
+                 level, effective, local_level, remote);
+        level = effective;
+    }
+    return level;
+}
+
+my_congest_level_t my_congest_get_level(void)
+{
+    return level;
+}
+
+void my_congest_drop(void)
+{
+    dropped = true;
+}
+
+void my_congest_recv(const mesh_addr_t *from, const mesh_data_t *data)
+{
+    my_congest_msg_t msg;
+
+    if(data->size < sizeof(msg)) {
+        return;
+    }
+    memcpy(&msg, data->data, sizeof(msg));
+    if(msg.level >= MY_CONGEST_LEVEL_NUM) {
+        return;
+    }
+    portENTER_CRITICAL(&root_mux);
+    root_level = msg.level;
+    root_expire = xTaskGetTickCount() + msg.hold_s * 1000 / portTICK_PERIOD_MS;
+    portEXIT_CRITICAL(&root_mux);
+    // 转发给自己的子节点
+    mesh_send_children(data, MESH_DATA_NONBLOCK, true);
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "my_dlog.h"
+#include "my_mem.h"
+
+#if CONFIG_MESH_DLOG
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define DLOG_RECORDS        CONFIG_MESH_DLOG_BUF_RECORDS
+#define DLOG_MASK           (DLOG_RECORDS - 1)
+#define DLOG_DRAIN_MS       CONFIG_MESH_DLOG_DRAIN_PERIOD
+#define DLOG_REC_MAX        (sizeof(my_dlog_rec_hdr_t) + MY_DLOG_ARGS_MAX * sizeof(uint32_t))
+
+_Static_assert((DLOG_RECORDS & DLOG_MASK) == 0, "CONFIG_MESH_DLOG_BUF_RECORDS must be a power of 2");
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 缓冲区中的一条记录，seq用于生产者与消费者之间的同步
+typedef struct {
+    uint32_t seq;
+    my_dlog_rec_hdr_t hdr;
+    uint32_t args[MY_DLOG_ARGS_MAX];
+} dlog_slot_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *DLOG_TAG = "dlog";
+static dlog_slot_t slots[DLOG_RECORDS];
+static uint32_t enqueue_pos = 0;    /* 多个生产者通过CAS竞争 */
+static uint32_t dequeue_pos = 0;    /* 只有输出任务访问 */
+static uint32_t lost = 0;
+static bool inited = false;
+MY_TASK_DEFINE(dlog_task_mem, 3072);
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static bool dlog_read(dlog_slot_t *out);
+static void dlog_task(void *arg);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+/**
+ * 有界的多生产者队列：
+ * 每个slot的seq等于写入位置时可写，等于写入位置+1时可读，
+ * 读出后seq加上DLOG_RECORDS，供下一轮写入
+ */
+void my_dlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                   uint8_t nargs, const uint32_t *args)
+{
+    dlog_slot_t *slot;
+    uint32_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+
+    if(!inited) {
+        return;
+    }
+    while(1) {
+        slot = &slots[pos & DLOG_MASK];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if(diff == 0) {
+            // 抢占这个slot，失败时pos被更新为最新的写入位置
+            if(__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if(diff < 0) {
+            // 缓冲区满
+            __atomic_add_fetch(&lost, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else {
+            pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    if(nargs > MY_DLOG_ARGS_MAX) {
+        nargs = MY_DLOG_ARGS_MAX;
+    }
+    uint32_t n = __atomic_exchange_n(&lost, 0, __ATOMIC_RELAXED);
+    if(n > UINT16_MAX) {
+        // 超出的部分留给下一条记录
+        __atomic_add_fetch(&lost, n - UINT16_MAX, __ATOMIC_RELAXED);
+        n = UINT16_MAX;
+    }
+    slot->hdr.ts_us = (uint32_t)esp_timer_get_time();
+    slot->hdr.fmt   = (uint32_t)(uintptr_t)fmt;
+    slot->hdr.tag   = (uint32_t)(uintptr_t)tag;
+    slot->hdr.level = (uint8_t)level;
+    slot->hdr.nargs = nargs;
+    slot->hdr.lost  = (uint16_t)n;
+    memcpy(slot->args, args, nargs * sizeof(uint32_t));
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+// 读出一条记录，没有记录时返回false
+static bool dlog_read(dlog_slot_t *out)
+{
+    dlog_slot_t *slot = &slots[dequeue_pos & DLOG_MASK];
+
+    if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != dequeue_pos + 1) {
+        return false;
+    }
+    memcpy(out, slot, sizeof(*out));
+    __atomic_store_n(&slot->seq, dequeue_pos + DLOG_RECORDS, __ATOMIC_RELEASE);
+    dequeue_pos++;
+    return true;
+}
+
+static void dlog_task(void *arg)
+{
+    dlog_slot_t rec;
+    uint8_t buf[DLOG_REC_MAX];
+    char line[DLOG_REC_MAX * 2 + 8];
+
+    while(1) {
+        while(dlog_read(&rec)) {
+            uint32_t len = sizeof(rec.hdr) + rec.hdr.nargs * sizeof(uint32_t);
+            memcpy(buf, &rec.hdr, sizeof(rec.hdr));
+            memcpy(buf + sizeof(rec.hdr), rec.args, rec.hdr.nargs * sizeof(uint32_t));
+            char *p = line + sprintf(line, "DLOG:");
+            for(uint32_t i = 0; i < len; i++) {
+                p += sprintf(p, "%02x", buf[i]);
+            }
+            // 整行一次输出，避免与其他任务的日志混在同一行中
+            printf("%s\n", line);
+        }
+        vTaskDelay(DLOG_DRAIN_MS / portTICK_PERIOD_MS);
+    }
+    my_task_exit();
+}
+
+void my_dlog_init(void)
+{
+    if(inited) {
+        return;
+    }
+    for(uint32_t i = 0; i < DLOG_RECORDS; i++) {
+        slots[i].seq = i;
+    }
+    inited = true;
+
+    // 输出较慢，使用最低的优先级，不影响调用者
+    my_task_create(&dlog_task_mem, dlog_task, "dlog_task", 1, tskNO_AFFINITY, NULL);
+    ESP_LOGI(DLOG_TAG, "Deferred log started, %u records, level %d", DLOG_RECORDS, CONFIG_MESH_DLOG_LEVEL);
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include <string.h>
+#include "esp_log.h"
+
+#include "my_fair.h"
+#include "my_pool.h"
+
+#if CONFIG_MESH_FAIR
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define FAIR_FLOWS          CONFIG_MESH_FAIR_FLOWS
+#define FAIR_FLOW_QUEUE     CONFIG_MESH_FAIR_FLOW_QUEUE
+#define FAIR_QUEUE_MAX      CONFIG_MESH_FAIR_QUEUE_MAX
+#define FAIR_NONE           (0xFFFF)
+#define FAIR_REPORT_TOP     (3)     /* 报告中输出被限速最多的节点数 */
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *FAIR_TAG = "fair";
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static my_fair_flow_t *fair_flow_get(my_fair_t *fair, const mesh_addr_t *from, int64_t now_us);
+static void fair_flow_drop_head(my_fair_t *fair, my_fair_flow_t *flow);
+static void fair_active_push(my_fair_t *fair, my_fair_flow_t *flow);
+static void fair_active_pop(my_fair_t *fair);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 查找来源节点，不存在时使用空闲的位置或替换最久没有数据的空队列
+static my_fair_flow_t *fair_flow_get(my_fair_t *fair, const mesh_addr_t *from, int64_t now_us)
+{
+    my_fair_flow_t *idle = NULL;
+
+    for(uint16_t i = 0; i < FAIR_FLOWS; i++) {
+        my_fair_flow_t *flow = &fair->flows[i];
+        if(flow->used && (memcmp(flow->addr.addr, from->addr, sizeof(from->addr)) == 0)) {
+            return flow;
+        }
+        if(!flow->used) {
+            if((idle == NULL) || idle->used) {
+                idle = flow;
+            }
+        }
+        else if((flow->qlen == 0) && !flow->active
+                && ((idle == NULL) || (idle->used && (flow->last_seen < idle->last_seen)))) {
+            idle = flow;
+        }
+    }
+    if(idle == NULL) {
+        return NULL;
+    }
+
+    if(!idle->used) {
+        fair->stats.flows++;
+    }
+    memset(idle, 0, sizeof(*idle));
+    idle->addr = *from;
+    idle->used = true;
+    idle->next = FAIR_NONE;
+    idle->tat  = now_us;
+    return idle;
+}
+
+// 丢弃队列中最早的数据包
+static void fair_flow_drop_head(my_fair_t *fair, my_fair_flow_t *flow)
+{
+    my_fair_pkt_t *pkt = flow->head;
+
+    flow->head = pkt->next;
+    if(flow->head == NULL) {
+        flow->tail = NULL;
+    }
+    flow->qlen--;
+    fair->queued--;
+    my_pool_free(pkt);
+}
+
+static void fair_active_push(my_fair_t *fair, my_fair_flow_t *flow)
+{
+    uint16_t idx = flow - fair->flows;
+
+    flow->next = FAIR_NONE;
+    flow->active = true;
+    if(fair->active_tail == FAIR_NONE) {
+        fair->active_head = idx;
+    }
+    else {
+        fair->flows[fair->active_tail].next = idx;
+    }
+    fair->active_tail = idx;
+}
+
+static void fair_active_pop(my_fair_t *fair)
+{
+    my_fair_flow_t *flow = &fair->flows[fair->active_head];
+
+    fair->active_head = flow->next;
+    if(fair->active_head == FAIR_NONE) {
+        fair->active_tail = FAIR_NONE;
+    }
+    flow->next = FAIR_NONE;
+    flow->active = false;
+}
+
+void my_fair_init(my_fair_t *fair, uint32_t rate, uint32_t burst, uint16_t quantum)
+{
+    memset(fair, 0, sizeof(*fair));
+    fair->active_head = FAIR_NONE;
+    fair->active_tail = FAIR_NONE;
+    fair->interval_us = (rate > 0) ? (1000000 / rate) : 0;
+    fair->tolerance_us = (burst > 1) ? (burst - 1) * fair->interval_us : 0;
+    fair->quantum = quantum;
+}
+
+esp_err_t my_fair_enqueue(my_fair_t *fair, const mesh_addr_t *from, const mesh_addr_t *to,
+                          const mesh_data_t *data, int flag, int64_t now_us)
+{
+    my_fair_flow_t *flow = fair_flow_get(fair, from, now_us);
+    my_fair_pkt_t *pkt;
+
+    if(flow == NULL) {
+        // 所有位置的队列中都有数据包
+        fair->stats.overflow++;
+        return ESP_ERR_NO_MEM;
+    }
+    flow->last_seen = now_us;
+
+    /**
+     * 令牌桶（GCRA形式）：
+     * tat为按速率计算的下一个数据包的到达时间，
+     * 比当前时间超前不超过tolerance_us（即burst个数据包）时允许通过
+     */
+    if(fair->interval_us > 0) {
+        if(flow->tat < now_us) {
+            flow->tat = now_us;
+        }
+        if(flow->tat - now_us > fair->tolerance_us) {
+            flow->throttled++;
+            fair->stats.throttled++;
+            return ESP_ERR_INVALID_STATE;
+        }
+        flow->tat += fair->interval_us;
+    }
+
+    if(flow->qlen >= FAIR_FLOW_QUEUE) {
+        flow->overflow++;
+        fair->stats.overflow++;
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 缓存已满或内存池用完时，丢弃最长队列中最早的数据包
+    pkt = (fair->queued < FAIR_QUEUE_MAX) ? my_pool_alloc(sizeof(*pkt) + data->size) : NULL;
+    if(pkt == NULL) {
+        my_fair_flow_t *longest = flow;
+        for(uint16_t i = 0; i < FAIR_FLOWS; i++) {
+            if(fair->flows[i].qlen > longest->qlen) {
+                longest = &fair->flows[i];
+            }
+        }
+        if(longest->qlen > flow->qlen) {
+            longest->overflow++;
+            fair->stats.overflow++;
+            fair_flow_drop_head(fair, longest);
+            pkt = my_pool_alloc(sizeof(*pkt) + data->size);
+        }
+        if(pkt == NULL) {
+            flow->overflow++;
+            fair->stats.overflow++;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    pkt->next  = NULL;
+    pkt->to    = *to;
+    pkt->flag  = flag;
+    pkt->size  = data->size;
+    pkt->proto = data->proto;
+    pkt->tos   = data->tos;
+    memcpy(pkt->data, data->data, data->size);
+
+    if(flow->tail == NULL) {
+        flow->head = pkt;
+    }
+    else {
+        flow->tail->next = pkt;
+    }
+    flow->tail = pkt;
+    flow->qlen++;
+    fair->queued++;
+    fair->stats.enqueued++;
+    if(!flow->active) {
+        flow->deficit = 0;
+        flow->credited = false;
+        fair_active_push(fair, flow);
+    }
+
+    return ESP_OK;
+}
+
+uint32_t my_fair_dequeue(my_fair_t *fair, my_fair_sink_t sink, uint32_t max)
+{
+    uint32_t count = 0;
+
+    while((fair->active_head != FAIR_NONE) && (count < max)) {
+        my_fair_flow_t *flow = &fair->flows[fair->active_head];
+
+        // 每轮开始时加上quantum，sink忙返回后继续本轮时不再加
+        if(!flow->credited) {
+            flow->deficit += fair->quantum;
+            flow->credited = true;
+        }
+        while((flow->head != NULL) && (flow->head->size <= flow->deficit) && (count < max)) {
+            my_fair_pkt_t *pkt = flow->head;
+            mesh_data_t data = {
+                .data  = pkt->data,
+                .size  = pkt->size,
+                .proto = pkt->proto,
+                .tos   = pkt->tos,
+            };
+            esp_err_t err = sink(&flow->addr, &pkt->to, &data, pkt->flag);
+            if(err == ESP_ERR_NO_MEM) {
+                return count;
+            }
+            if(err == ESP_OK) {
+                flow->forwarded++;
+                fair->stats.forwarded++;
+            }
+            else {
+                fair->stats.dropped++;
+            }
+            flow->deficit -= pkt->size;
+            fair_flow_drop_head(fair, flow);
+            count++;
+        }
+
+        if(flow->head == NULL) {
+            // 队列空，退出轮询，不保留差额
+            flow->deficit = 0;
+            fair_active_pop(fair);
+        }
+        else if((flow->head->size > flow->deficit) || (count < max)) {
+            // 本轮额度用完，移到链表尾部
+            fair_active_pop(fair);
+            flow->credited = false;
+            fair_active_push(fair, flow);
+        }
+    }
+
+    return count;
+}
+
+void my_fair_flush(my_fair_t *fair)
+{
+    while(fair->active_head != FAIR_NONE) {
+        my_fair_flow_t *flow = &fair->flows[fair->active_head];
+        while(flow->head != NULL) {
+            fair->stats.dropped++;
+            fair_flow_drop_head(fair, flow);
+        }
+        flow->deficit = 0;
+        fair_active_pop(fair);
+    }
+}
+
+void my_fair_get_stats(const my_fair_t *fair, my_fair_stats_t *stats)
+{
+    *stats = fair->stats;
+    stats->queued = fair->queued;
+}
+
+void my_fair_report(const my_fair_t *fair)
+{
+    const my_fair_flow_t *top[FAIR_REPORT_TOP] = { NULL };
+
+    ESP_LOGI(FAIR_TAG, "nodes:%u, queued:%u, forwarded:%u, throttled:%u, overflow:%u, dropped:%u",
+             fair->stats.flows, fair->queued, fair->stats.forwarded, fair->stats.throttled,
+             fair->stats.overflow, fair->stats.dropped);
+
+    // 被限速或丢弃最多的节点
+    for(uint16_t i = 0; i < FAIR_FLOWS; i++) {
+        const my_fair_flow_t *flow = &fair->flows[i];
+        uint32_t lost = flow->throttled + flow->overflow;
+        if(!flow->used || (lost == 0)) {
+            continue;
+        }
+        for(uint8_t t = 0; t < FAIR_REPORT_TOP; t++) {
+            if((top[t] == NULL) || (lost > top[t]->throttled + top[t]->overflow)) {
+                memmove(&top[t + 1], &top[t], (FAIR_REPORT_TOP - t - 1) * sizeof(top[0]));
+                top[t] = flow;
+                break;
+            }
+        }
+    }
+    for(uint8_t t = 0; (t < FAIR_REPORT_TOP) && (top[t] != NULL); t++) {
+        ESP_LOGI(FAIR_TAG, "  "MACSTR" forwarded:%u, throttled:%u, overflow:%u",
+                 MAC2STR(top[t]->addr.addr), top[t]->forwarded, top[t]->throttled, top[t]->overflow);
+    }
+}
+
+#endif
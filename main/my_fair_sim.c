@@ -0,0 +1,135 @@
+#include <string.h>
+#include <stdio.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_fair.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_FAIR
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 根节点转发公平性的模拟：50个节点，其中一个节点大量发送，转发能力小于总流量
+#define FAIR_SIM_NODES      (50)
+#define FAIR_SIM_TICK_US    (10000)     /* 模拟的时间步长 */
+#define FAIR_SIM_TICKS      (1000)      /* 共模拟10s */
+#define FAIR_SIM_FLOOD      (20)        /* 大量发送的节点每步发送的数据包数 */
+#define FAIR_SIM_PERIOD     (10)        /* 其他节点每隔几步发送一个数据包 */
+#define FAIR_SIM_SINK       (6)         /* 每步最多转发的数据包数，大于其他节点的总流量 */
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static my_fair_t fair_sim;
+static uint32_t fair_sim_sent[FAIR_SIM_NODES];
+static uint32_t fair_sim_budget;
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static esp_err_t fair_sim_sink(const mesh_addr_t *from, const mesh_addr_t *to,
+                               const mesh_data_t *data, int flag);
+static void fair_sim_result(const uint32_t *sent, uint32_t offered, double *ratio, double *jain);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 模拟的转发：每步最多转发FAIR_SIM_SINK个数据包，之后返回缓冲区满
+static esp_err_t fair_sim_sink(const mesh_addr_t *from, const mesh_addr_t *to,
+                               const mesh_data_t *data, int flag)
+{
+    if(fair_sim_budget == 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    fair_sim_budget--;
+    fair_sim_sent[from->addr[5]]++;
+    return ESP_OK;
+}
+
+// 其他节点（不含节点0）的转发比例和Jain公平指数（1为完全公平）
+static void fair_sim_result(const uint32_t *sent, uint32_t offered, double *ratio, double *jain)
+{
+    double sum = 0, sum2 = 0;
+
+    for(uint8_t i = 1; i < FAIR_SIM_NODES; i++) {
+        sum  += sent[i];
+        sum2 += (double)sent[i] * sent[i];
+    }
+    *ratio = offered ? sum / offered : 0;
+    *jain  = (sum2 > 0) ? (sum * sum) / ((FAIR_SIM_NODES - 1) * sum2) : 0;
+}
+
+/**
+ * 节点0每步发送FAIR_SIM_FLOOD个数据包，其他节点每FAIR_SIM_PERIOD步发送一个，
+ * 每步中各节点的发送顺序随机。
+ * 分别按到达顺序(FIFO，与未开启时相同)和使用my_fair转发，比较其他节点的数据包被转发的比例
+ */
+void my_fair_sim(void)
+{
+    static uint32_t fifo_sent[FAIR_SIM_NODES];
+    uint8_t fifo[CONFIG_MESH_FAIR_QUEUE_MAX];   /* FIFO中数据包的来源节点 */
+    uint8_t order[FAIR_SIM_NODES];
+    uint32_t seed = 1, offered = 0;
+    uint16_t fifo_head = 0, fifo_len = 0;
+    uint8_t payload[2] = { 0 };
+    mesh_data_t data = { .data = payload, .size = sizeof(payload), .proto = MESH_PROTO_BIN };
+    mesh_addr_t from = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 } };
+    mesh_addr_t to = { 0 };
+    my_fair_stats_t stats;
+
+    memset(fifo_sent, 0, sizeof(fifo_sent));
+    memset(fair_sim_sent, 0, sizeof(fair_sim_sent));
+    my_fair_init(&fair_sim, CONFIG_MESH_FAIR_RATE, CONFIG_MESH_FAIR_BURST, CONFIG_MESH_FAIR_QUANTUM);
+
+    for(uint32_t tick = 0; tick < FAIR_SIM_TICKS; tick++) {
+        int64_t now = (int64_t)tick * FAIR_SIM_TICK_US;
+        // 随机打乱发送顺序
+        for(uint8_t i = 0; i < FAIR_SIM_NODES; i++) {
+            order[i] = i;
+        }
+        for(uint8_t i = FAIR_SIM_NODES - 1; i > 0; i--) {
+            uint8_t j = my_bench_rand(&seed, i + 1);
+            uint8_t t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        for(uint8_t n = 0; n < FAIR_SIM_NODES; n++) {
+            uint8_t node = order[n];
+            uint8_t num = (node == 0) ? FAIR_SIM_FLOOD : (((tick + node) % FAIR_SIM_PERIOD) == 0);
+            offered += (node == 0) ? 0 : num;
+            from.addr[5] = node;
+            for(uint8_t i = 0; i < num; i++) {
+                // FIFO：队列满时丢弃新到的数据包
+                if(fifo_len < CONFIG_MESH_FAIR_QUEUE_MAX) {
+                    fifo[(fifo_head + fifo_len++) % CONFIG_MESH_FAIR_QUEUE_MAX] = node;
+                }
+                my_fair_enqueue(&fair_sim, &from, &to, &data, MESH_DATA_TODS, now);
+            }
+        }
+        for(uint8_t i = 0; (i < FAIR_SIM_SINK) && (fifo_len > 0); i++) {
+            fifo_sent[fifo[fifo_head]]++;
+            fifo_head = (fifo_head + 1) % CONFIG_MESH_FAIR_QUEUE_MAX;
+            fifo_len--;
+        }
+        fair_sim_budget = FAIR_SIM_SINK;
+        my_fair_dequeue(&fair_sim, fair_sim_sink, UINT32_MAX);
+    }
+    my_fair_get_stats(&fair_sim, &stats);
+    my_fair_flush(&fair_sim);
+
+    double fifo_ratio, fifo_jain, fair_ratio, fair_jain;
+    fair_sim_result(fifo_sent, offered, &fifo_ratio, &fifo_jain);
+    fair_sim_result(fair_sim_sent, offered, &fair_ratio, &fair_jain);
+    ESP_LOGI(MY_BENCH_TAG, "fairness %u nodes, other nodes delivered: fifo %.3f (jain %.3f), fair %.3f (jain %.3f)",
+             FAIR_SIM_NODES, fifo_ratio, fifo_jain, fair_ratio, fair_jain);
+    my_bench_json_begin("root_fairness", "\"nodes\":%u,\"seconds\":%u,\"offered\":%u,"
+                        "\"fifo\":{\"delivered\":%.3f,\"jain\":%.3f,\"flooder\":%u},"
+                        "\"fair\":{\"delivered\":%.3f,\"jain\":%.3f,\"flooder\":%u,\"throttled\":%u,\"overflow\":%u}",
+                        FAIR_SIM_NODES, FAIR_SIM_TICKS * FAIR_SIM_TICK_US / 1000000, offered,
+                        fifo_ratio, fifo_jain, fifo_sent[0], fair_ratio, fair_jain, fair_sim_sent[0],
+                        stats.throttled, stats.overflow);
+    my_bench_json_end();
+}
+
+#endif
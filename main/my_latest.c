@@ -0,0 +1,235 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "my_latest.h"
+
+#if CONFIG_MESH_LATEST
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define LATEST_SIZE     CONFIG_MESH_LATEST_SIZE
+#define LATEST_MASK     (LATEST_SIZE - 1)
+#define LATEST_SHIFT    (64 - __builtin_ctz(LATEST_SIZE))
+#define LATEST_LOAD_MAX (LATEST_SIZE - LATEST_SIZE / 4)    /* 最多使用的位置数 */
+_Static_assert((LATEST_SIZE & LATEST_MASK) == 0, "CONFIG_MESH_LATEST_SIZE must be a power of 2");
+_Static_assert(LATEST_SIZE < MY_REPORT_QUERY_END, "CONFIG_MESH_LATEST_SIZE too large for the query cursor");
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static uint64_t latest_key(const uint8_t addr[6], uint8_t sid);
+static uint16_t latest_home(uint64_t key);
+static int latest_find(my_latest_t *latest, uint64_t key);
+static bool latest_expired(const my_latest_t *latest, uint16_t i, int64_t now);
+static void latest_remove(my_latest_t *latest, uint16_t i);
+static void latest_evict(my_latest_t *latest, int64_t now);
+static bool latest_match(const my_report_query_t *query, uint64_t key);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 节点地址不会全为0，键不会是0
+static uint64_t latest_key(const uint8_t addr[6], uint8_t sid)
+{
+    uint64_t key = 0;
+
+    for(int i = 0; i < 6; i++) {
+        key = (key << 8) | addr[i];
+    }
+    return (key << 8) | sid;
+}
+
+// 乘法哈希取高位，相近的地址也分散开
+static uint16_t latest_home(uint64_t key)
+{
+    return (uint16_t)((key * 0x9E3779B97F4A7C15ULL) >> LATEST_SHIFT);
+}
+
+// 查找键的位置，不存在时返回-1
+static int latest_find(my_latest_t *latest, uint64_t key)
+{
+    uint16_t i = latest_home(key);
+
+    latest->stats.lookups++;
+    for(uint16_t n = 0; n < LATEST_SIZE; n++, i = (i + 1) & LATEST_MASK) {
+        latest->stats.probes++;
+        if(latest->keys[i] == key) {
+            return i;
+        }
+        if(latest->keys[i] == 0) {
+            break;
+        }
+    }
+    return -1;
+}
+
+static bool latest_expired(const my_latest_t *latest, uint16_t i, int64_t now)
+{
+    return (latest->max_age_us > 0) && (now - latest->vals[i].updated > latest->max_age_us);
+}
+
+// 删除位置i，之后同一探测序列中的键向前移动，使查找不会提前遇到空位
+static void latest_remove(my_latest_t *latest, uint16_t i)
+{
+    uint16_t j = i;
+
+    while(1) {
+        latest->keys[i] = 0;
+        while(1) {
+            uint16_t home;
+            j = (j + 1) & LATEST_MASK;
+            if(latest->keys[j] == 0) {
+                latest->count--;
+                return;
+            }
+            home = latest_home(latest->keys[j]);
+            // home在(i, j]之间时j不需要移动
+            if((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j))) {
+                continue;
+            }
+            break;
+        }
+        latest->keys[i] = latest->keys[j];
+        latest->vals[i] = latest->vals[j];
+        i = j;
+    }
+}
+
+// 表满时删除已过期或最久没有更新的数值
+static void latest_evict(my_latest_t *latest, int64_t now)
+{
+    int oldest = -1;
+
+    for(uint16_t i = 0; i < LATEST_SIZE; i++) {
+        if(latest->keys[i] == 0) {
+            continue;
+        }
+        if(latest_expired(latest, i, now)) {
+            oldest = i;
+            break;
+        }
+        if((oldest < 0) || (latest->vals[i].updated < latest->vals[oldest].updated)) {
+            oldest = i;
+        }
+    }
+    if(oldest >= 0) {
+        latest->stats.evictions++;
+        latest_remove(latest, oldest);
+    }
+}
+
+// 键是否满足任一条件
+static bool latest_match(const my_report_query_t *query, uint64_t key)
+{
+    static const uint8_t any[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    const my_report_query_key_t *keys = (const my_report_query_key_t *)(query + 1);
+
+    if(query->num == 0) {
+        return true;
+    }
+    for(uint8_t k = 0; k < query->num; k++) {
+        uint64_t addr = latest_key(keys[k].addr, 0);
+        if(((memcmp(keys[k].addr, any, sizeof(any)) == 0) || ((key & ~0xFFULL) == addr))
+           && ((keys[k].sid == MY_REPORT_QUERY_ANY_SID) || ((key & 0xFF) == keys[k].sid))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void my_latest_init(my_latest_t *latest, uint32_t max_age_s)
+{
+    memset(latest, 0, sizeof(*latest));
+    latest->max_age_us = max_age_s * 1000000LL;
+}
+
+void my_latest_update(my_latest_t *latest, const uint8_t addr[6], uint8_t sid,
+                      const uint8_t *values, uint8_t num, int64_t now)
+{
+    uint64_t key = latest_key(addr, sid);
+    int i = latest_find(latest, key);
+    my_latest_val_t *val;
+
+    if(i < 0) {
+        if(latest->count >= LATEST_LOAD_MAX) {
+            latest_evict(latest, now);
+        }
+        // 删除后探测序列可能改变，重新找空位
+        for(i = latest_home(key); latest->keys[i] != 0; i = (i + 1) & LATEST_MASK);
+        latest->keys[i] = key;
+        latest->count++;
+        latest->stats.inserts++;
+    }
+    val = &latest->vals[i];
+    val->updated = now;
+    val->num = (num > CONFIG_MESH_LATEST_VALUES) ? CONFIG_MESH_LATEST_VALUES : num;
+    memcpy(val->values, values, val->num);
+    latest->stats.updates++;
+}
+
+bool my_latest_update_payload(my_latest_t *latest, const uint8_t addr[6], const uint8_t *payload,
+                              uint16_t len, int64_t now)
+{
+    if((len < 1) || (payload[0] + 1u > len)) {
+        return false;
+    }
+    my_latest_update(latest, addr, (len >= payload[0] + 2u) ? payload[1 + payload[0]] : 0,
+                     payload + 1, payload[0], now);
+    return true;
+}
+
+const my_latest_val_t *my_latest_get(my_latest_t *latest, const uint8_t addr[6], uint8_t sid, int64_t now)
+{
+    int i = latest_find(latest, latest_key(addr, sid));
+
+    if((i < 0) || latest_expired(latest, i, now)) {
+        return NULL;
+    }
+    return &latest->vals[i];
+}
+
+uint16_t my_latest_query(my_latest_t *latest, const my_report_query_t *query, int64_t now,
+                         uint8_t *buf, uint16_t size, uint16_t *cursor)
+{
+    my_report_latest_hdr_t hdr = { .id = query->id, .next = MY_REPORT_QUERY_END, .count = 0 };
+    int64_t max_age = query->max_age_s * 1000000LL;
+    uint16_t len = sizeof(hdr);
+
+    latest->stats.queries++;
+    // 只顺序读取键数组，匹配后才读取数值
+    for(uint16_t i = *cursor; i < LATEST_SIZE; i++) {
+        const my_latest_val_t *val = &latest->vals[i];
+        my_report_latest_t ent;
+        uint64_t key = latest->keys[i];
+
+        if((key == 0) || !latest_match(query, key) || latest_expired(latest, i, now)
+           || ((max_age > 0) && (now - val->updated > max_age))) {
+            continue;
+        }
+        if(len + sizeof(ent) + val->num > size) {
+            hdr.next = i;
+            break;
+        }
+        for(int b = 0; b < 6; b++) {
+            ent.addr[b] = key >> (8 * (6 - b));
+        }
+        ent.sid    = key & 0xFF;
+        ent.num    = val->num;
+        ent.age_ms = (now - val->updated) / 1000;
+        memcpy(buf + len, &ent, sizeof(ent));
+        memcpy(buf + len + sizeof(ent), val->values, val->num);
+        len += sizeof(ent) + val->num;
+        hdr.count++;
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    *cursor = hdr.next;
+    return len;
+}
+
+void my_latest_get_stats(const my_latest_t *latest, my_latest_stats_t *stats)
+{
+    *stats = latest->stats;
+}
+
+#endif
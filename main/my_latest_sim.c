@@ -0,0 +1,148 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "my_bench.h"
+#include "my_latest.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_LATEST
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 根节点最新数值表的模拟：每个节点2个sensor，每5s各发送一次4个数值，相位不同，
+// 1/4的节点在30s时停止发送；60s时服务器读取所有数值和最近10s内更新的数值
+#define LATEST_SIM_SIDS     (2)
+#define LATEST_SIM_VALUES   (4)
+#define LATEST_SIM_PERIOD_S (5)
+#define LATEST_SIM_SECONDS  (60)
+#define LATEST_SIM_SILENT_S (30)
+#define LATEST_SIM_FRESH_S  (10)
+#define LATEST_SIM_RECORD   (CONFIG_MESH_UPLINK_BATCH_SIZE / 2)    /* 与my_mesh中响应记录的上限相同 */
+#define LATEST_SIM_GETS     (100000)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 一次查询的结果
+typedef struct {
+    uint32_t records;
+    uint32_t values;
+    uint32_t bytes;
+    int64_t  us;            /* 生成所有响应记录的时间 */
+} latest_sim_query_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static my_latest_t latest_sim;
+static uint8_t latest_sim_buf[LATEST_SIM_RECORD];
+static const uint16_t latest_sim_nodes[] = { 64, 192, 256 };
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void latest_sim_addr(uint16_t node, uint8_t addr[6]);
+static void latest_sim_query(uint16_t max_age_s, int64_t now, latest_sim_query_t *result);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static void latest_sim_addr(uint16_t node, uint8_t addr[6])
+{
+    addr[0] = 0x24;
+    addr[1] = 0x6F;
+    addr[2] = 0x28;
+    addr[3] = 0;
+    addr[4] = node >> 8;
+    addr[5] = node & 0xFF;
+}
+
+// 按cursor读取完所有匹配的数值
+static void latest_sim_query(uint16_t max_age_s, int64_t now, latest_sim_query_t *result)
+{
+    my_report_query_t query = { .id = 1, .cursor = 0, .max_age_s = max_age_s, .num = 0 };
+    my_report_latest_hdr_t hdr;
+    uint16_t cursor = 0;
+    int64_t start = esp_timer_get_time();
+
+    memset(result, 0, sizeof(*result));
+    do {
+        result->bytes += my_latest_query(&latest_sim, &query, now, latest_sim_buf, sizeof(latest_sim_buf), &cursor);
+        memcpy(&hdr, latest_sim_buf, sizeof(hdr));
+        result->values += hdr.count;
+        result->records++;
+    } while(cursor != MY_REPORT_QUERY_END);
+    result->us = esp_timer_get_time() - start;
+}
+
+/**
+ * 输出更新和按键查找的时间、平均探测长度、表满时的替换数，
+ * 以及服务器一次读取所有数值需要的响应记录数、字节数和时间
+ */
+void my_latest_sim(void)
+{
+    uint8_t values[LATEST_SIM_VALUES] = { 1, 2, 3, 4 };
+    uint8_t addr[6];
+
+    my_bench_json_begin("mesh_latest", "\"slots\":%u,\"sids\":%u,\"values\":%u,\"record\":%u",
+                        CONFIG_MESH_LATEST_SIZE, LATEST_SIM_SIDS, LATEST_SIM_VALUES, LATEST_SIM_RECORD);
+    my_bench_json_list("runs");
+    for(uint8_t r = 0; r < MY_BENCH_COUNT(latest_sim_nodes); r++) {
+        uint16_t nodes = latest_sim_nodes[r];
+        int64_t now = LATEST_SIM_SECONDS * 1000000LL;
+        latest_sim_query_t all, fresh;
+        uint32_t updates = 0, hits = 0, lookups, probes;
+        int64_t start, update_us, get_us;
+
+        my_latest_init(&latest_sim, CONFIG_MESH_LATEST_MAX_AGE_S);
+        start = esp_timer_get_time();
+        for(uint16_t sec = 0; sec < LATEST_SIM_SECONDS; sec++) {
+            for(uint16_t n = 0; n < nodes; n++) {
+                if(((n % 4) == 0) && (sec >= LATEST_SIM_SILENT_S)) {
+                    continue;
+                }
+                latest_sim_addr(n, addr);
+                for(uint8_t sid = 1; sid <= LATEST_SIM_SIDS; sid++) {
+                    if((n * 7 + sid * 3) % LATEST_SIM_PERIOD_S == sec % LATEST_SIM_PERIOD_S) {
+                        values[0] = sec;
+                        my_latest_update(&latest_sim, addr, sid, values, sizeof(values), sec * 1000000LL + n * 1000);
+                        updates++;
+                    }
+                }
+            }
+        }
+        update_us = esp_timer_get_time() - start;
+
+        lookups = latest_sim.stats.lookups;
+        probes  = latest_sim.stats.probes;
+        start = esp_timer_get_time();
+        for(uint32_t i = 0; i < LATEST_SIM_GETS; i++) {
+            latest_sim_addr(i % nodes, addr);
+            hits += (my_latest_get(&latest_sim, addr, 1 + (i / nodes) % LATEST_SIM_SIDS, now) != NULL);
+        }
+        get_us  = esp_timer_get_time() - start;
+        lookups = latest_sim.stats.lookups - lookups;
+        probes  = latest_sim.stats.probes - probes;
+
+        latest_sim_query(0, now, &all);
+        latest_sim_query(LATEST_SIM_FRESH_S, now, &fresh);
+
+        ESP_LOGI(MY_BENCH_TAG, "latest %u nodes: %u keys, %u evictions, update %.0fns, get %.0fns (%.2f probes), "
+                 "all %u values in %u records (%u bytes, %lluus), fresh %u",
+                 nodes, latest_sim.count, latest_sim.stats.evictions, update_us * 1000.0 / updates,
+                 get_us * 1000.0 / LATEST_SIM_GETS, (double)probes / lookups, all.values, all.records, all.bytes,
+                 (unsigned long long)all.us, fresh.values);
+        my_bench_json_item("\"nodes\":%u,\"keys\":%u,\"updates\":%u,\"evictions\":%u,\"update_ns\":%.0f,"
+                           "\"get_ns\":%.0f,\"probes_per_get\":%.2f,\"hit_pct\":%.1f,"
+                           "\"all\":{\"values\":%u,\"records\":%u,\"bytes\":%u,\"us\":%llu},"
+                           "\"fresh\":{\"values\":%u,\"records\":%u,\"bytes\":%u}",
+                           nodes, latest_sim.count, updates, latest_sim.stats.evictions,
+                           update_us * 1000.0 / updates, get_us * 1000.0 / LATEST_SIM_GETS, (double)probes / lookups,
+                           100.0 * hits / LATEST_SIM_GETS, all.values, all.records, all.bytes, (unsigned long long)all.us,
+                           fresh.values, fresh.records, fresh.bytes);
+    }
+    my_bench_json_end();
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "my_mem.h"
+#include "my_pool.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 可记录的任务数量：MPRX、MPTX、sensorif_task和smartconfig_task，加上开启的功能创建的任务
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+#define MEM_TASK_UPLINK     (1)
+#else
+#define MEM_TASK_UPLINK     (0)
+#endif
+#if CONFIG_MESH_MQTT_GATEWAY
+#define MEM_TASK_MQTT_GW    (1)
+#else
+#define MEM_TASK_MQTT_GW    (0)
+#endif
+#if CONFIG_MESH_TXQ
+#define MEM_TASK_TXQ        (1)
+#else
+#define MEM_TASK_TXQ        (0)
+#endif
+#if CONFIG_MESH_OTA
+#define MEM_TASK_OTA        (1)
+#else
+#define MEM_TASK_OTA        (0)
+#endif
+#if CONFIG_MESH_BUS
+#define MEM_TASK_BUS        (CONFIG_MESH_BUS_NUM)
+#else
+#define MEM_TASK_BUS        (0)
+#endif
+#if CONFIG_MESH_DLOG
+#define MEM_TASK_DLOG       (1)
+#else
+#define MEM_TASK_DLOG       (0)
+#endif
+#if CONFIG_MESH_CAPTURE_DUMP_PERIOD > 0
+#define MEM_TASK_CAPTURE    (1)
+#else
+#define MEM_TASK_CAPTURE    (0)
+#endif
+#if CONFIG_MESH_BENCH
+#define MEM_TASK_BENCH      (1)
+#else
+#define MEM_TASK_BENCH      (0)
+#endif
+#define MEM_TASK_NUM_MAX    (4 + MEM_TASK_UPLINK + MEM_TASK_MQTT_GW + MEM_TASK_TXQ + MEM_TASK_OTA \
+                             + MEM_TASK_BUS + MEM_TASK_DLOG + MEM_TASK_CAPTURE + MEM_TASK_BENCH)
+#define MEM_LOAD_TASK_MAX   (24)    /* CPU占用率统计的任务数量，包括系统任务 */
+#if CONFIG_MESH_STATIC_ALLOC
+#define MEM_ALLOC_MODE      "static"
+#else
+#define MEM_ALLOC_MODE      "heap"
+#endif
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    TaskHandle_t handle;
+    const char   *name;
+    uint32_t     stack_size;
+} mem_task_t;
+
+#if CONFIG_MESH_CPU_LOAD_REPORT
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t     run_time;  /* 上次输出时的运行时间 */
+} mem_load_t;
+#endif
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *MEM_TAG = "mem";
+static mem_task_t tasks[MEM_TASK_NUM_MAX] = {0};
+static portMUX_TYPE tasks_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t static_bytes = 0;   /* 静态分配的任务/队列/互斥锁内存 */
+static esp_timer_handle_t report_timer;
+#if CONFIG_MESH_CPU_LOAD_REPORT
+static TaskStatus_t load_status[MEM_LOAD_TASK_MAX];
+static mem_load_t load_last[MEM_LOAD_TASK_MAX];
+static uint32_t load_last_total = 0;
+#endif
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+#if CONFIG_MESH_MEM_REPORT_PERIOD > 0
+static void mem_report_callback(void *arg);
+#endif
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+TaskHandle_t my_task_create(my_task_mem_t *mem, TaskFunction_t func, const char *name,
+                            UBaseType_t prio, BaseType_t core, void *arg)
+{
+    TaskHandle_t handle = NULL;
+    uint8_t i;
+
+#if CONFIG_MESH_STATIC_ALLOC
+    handle = xTaskCreateStaticPinnedToCore(func, name, mem->stack_size, arg, prio,
+                                           mem->stack, mem->tcb, core);
+#else
+    if(xTaskCreatePinnedToCore(func, name, mem->stack_size, arg, prio, &handle, core) != pdPASS) {
+        handle = NULL;
+    }
+#endif
+    if(handle == NULL) {
+        ESP_LOGE(MEM_TAG, "Task %s create failed!", name);
+        return NULL;
+    }
+
+    portENTER_CRITICAL(&tasks_mux);
+    // 同名任务重新创建时复用原来的位置
+    for(i = 0; i < MEM_TASK_NUM_MAX; i++) {
+        if((tasks[i].name == NULL) || (strcmp(tasks[i].name, name) == 0)) {
+        #if CONFIG_MESH_STATIC_ALLOC
+            if(tasks[i].name == NULL) {
+                static_bytes += mem->stack_size + sizeof(StaticTask_t);
+            }
+        #endif
+            tasks[i].handle = handle;
+            tasks[i].name = name;
+            tasks[i].stack_size = mem->stack_size;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&tasks_mux);
+    if(i == MEM_TASK_NUM_MAX) {
+        ESP_LOGE(MEM_TAG, "Task %s not recorded, MEM_TASK_NUM_MAX too small!", name);
+    }
+
+    return handle;
+}
+
+void my_task_exit(void)
+{
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL(&tasks_mux);
+    for(uint8_t i = 0; i < MEM_TASK_NUM_MAX; i++) {
+        if(tasks[i].handle == handle) {
+            // 保留名称，之后同名任务重新创建时复用
+            tasks[i].handle = NULL;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&tasks_mux);
+
+    vTaskDelete(NULL);
+}
+
+QueueHandle_t my_queue_create(my_queue_mem_t *mem)
+{
+#if CONFIG_MESH_STATIC_ALLOC
+    static_bytes += mem->length * mem->item_size + sizeof(StaticQueue_t);
+    return xQueueCreateStatic(mem->length, mem->item_size, mem->storage, mem->queue);
+#else
+    return xQueueCreate(mem->length, mem->item_size);
+#endif
+}
+
+SemaphoreHandle_t my_mutex_create(my_mutex_mem_t *mem)
+{
+#if CONFIG_MESH_STATIC_ALLOC
+    static_bytes += sizeof(StaticSemaphore_t);
+    return xSemaphoreCreateMutexStatic(mem->mutex);
+#else
+    return xSemaphoreCreateMutex();
+#endif
+}
+
+void my_mem_report(void)
+{
+    mem_task_t list[MEM_TASK_NUM_MAX];
+
+    portENTER_CRITICAL(&tasks_mux);
+    memcpy(list, tasks, sizeof(list));
+    portEXIT_CRITICAL(&tasks_mux);
+
+    ESP_LOGI(MEM_TAG, "%-16s %6s %9s", "task", "stack", "min free");
+    for(uint8_t i = 0; i < MEM_TASK_NUM_MAX; i++) {
+        if(list[i].handle == NULL) {
+            continue;
+        }
+        // ESP32上栈以字节为单位，返回的是运行以来栈剩余空间的最小值
+        ESP_LOGI(MEM_TAG, "%-16s %6u %9u", list[i].name, list[i].stack_size,
+                 uxTaskGetStackHighWaterMark(list[i].handle));
+    }
+    // 数据包内存池的使用情况
+    for(uint8_t i = 0; i < MY_POOL_NUM; i++) {
+        my_pool_stats_t pool;
+        my_pool_get_stats(i, &pool);
+        ESP_LOGI(MEM_TAG, "pool %4uB x %-3u free:%u, min free:%u, exhausted:%u", pool.block_size,
+                 pool.total, pool.free, pool.min_free, pool.alloc_fail);
+    }
+    ESP_LOGI(MEM_TAG, "mode:%s, static:%u bytes, pool:%u bytes, heap free:%u, min free:%u, largest block:%u",
+             MEM_ALLOC_MODE, static_bytes, my_pool_static_size(),
+             esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+#if CONFIG_MESH_CPU_LOAD_REPORT
+void my_task_load_report(void)
+{
+    uint32_t total, elapsed, last;
+    uint64_t load;
+    UBaseType_t num;
+
+    num = uxTaskGetSystemState(load_status, MEM_LOAD_TASK_MAX, &total);
+    if(num == 0) {
+        ESP_LOGW(MEM_TAG, "Too many tasks for load report!");
+        return;
+    }
+    // 运行时间是每个核各自累计的，占用率为相对单个核的百分比
+    elapsed = total - load_last_total;
+    if(elapsed == 0) {
+        return;
+    }
+
+    ESP_LOGI(MEM_TAG, "%-16s %4s %4s %7s", "task", "core", "prio", "load");
+    for(UBaseType_t i = 0; i < num; i++) {
+        TaskStatus_t *status = &load_status[i];
+        BaseType_t core = -1;
+
+        last = 0;
+        for(uint8_t j = 0; j < MEM_LOAD_TASK_MAX; j++) {
+            if(load_last[j].handle == status->xHandle) {
+                last = load_last[j].run_time;
+                break;
+            }
+        }
+        load = (uint64_t)(status->ulRunTimeCounter - last) * 1000 / elapsed;
+    #if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        core = (status->xCoreID == tskNO_AFFINITY) ? -1 : status->xCoreID;
+    #endif
+        ESP_LOGI(MEM_TAG, "%-16s %4d %4u %5u.%u%%", status->pcTaskName, core,
+                 status->uxCurrentPriority, (uint32_t)(load / 10), (uint32_t)(load % 10));
+    }
+
+    // 记录本次的运行时间，下次输出时计算差值
+    memset(load_last, 0, sizeof(load_last));
+    for(UBaseType_t i = 0; i < num; i++) {
+        load_last[i].handle   = load_status[i].xHandle;
+        load_last[i].run_time = load_status[i].ulRunTimeCounter;
+    }
+    load_last_total = total;
+}
+#endif
+
+#if CONFIG_MESH_MEM_REPORT_PERIOD > 0
+static void mem_report_callback(void *arg)
+{
+    my_mem_report();
+#if CONFIG_MESH_CPU_LOAD_REPORT
+    my_task_load_report();
+#endif
+}
+#endif
+
+void my_mem_report_start(void)
+{
+    my_mem_report();
+#if CONFIG_MESH_CPU_LOAD_REPORT
+    // 启动以来的CPU占用率
+    my_task_load_report();
+#endif
+
+#if CONFIG_MESH_MEM_REPORT_PERIOD > 0
+    if(report_timer == NULL) {
+        const esp_timer_create_args_t report_timer_args = {
+            .callback = &mem_report_callback,
+            .name = "mem-report"
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&report_timer_args, &report_timer));
+        ESP_ERROR_CHECK(esp_timer_start_periodic(report_timer, CONFIG_MESH_MEM_REPORT_PERIOD * 1000 * 1000LL));
+    }
+#endif
+}
@@ -23,6 +23,100 @@
 #include "my_mesh.h"
 #include "my_smartconfig.h"
 #include "my_sensorif.h"
+#include "my_mem.h"
+#include "my_pool.h"
+#include "my_capture.h"
+#include "my_dlog.h"
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+#include "lwip/sockets.h"
+#include "my_uplink.h"
+#endif
+#if CONFIG_MESH_MQTT_GATEWAY
+#include "my_mqtt_gw.h"
+#endif
+#if CONFIG_MESH_BENCH
+#include "my_bench.h"
+#endif
+#if CONFIG_MESH_FAIR
+#include "my_fair.h"
+#endif
+#if CONFIG_MESH_ADAPTIVE_SAMPLING
+#include "my_congest.h"
+#endif
+#if CONFIG_MESH_TIME_SYNC
+#include "my_time.h"
+#endif
+#if CONFIG_MESH_AGG
+#include "freertos/semphr.h"
+#include "my_agg.h"
+#endif
+#if CONFIG_MESH_RELIABLE
+#include "freertos/semphr.h"
+#include "my_rel.h"
+#endif
+#if CONFIG_MESH_SENSOR_CONFIG
+#include "my_config.h"
+#endif
+#if CONFIG_MESH_OTA
+#include "freertos/semphr.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_http_client.h"
+#include "my_ota.h"
+#endif
+#if CONFIG_MESH_SHARD
+#include "my_shard.h"
+#endif
+#if CONFIG_MESH_PARENT_BALANCE
+#include "my_parent.h"
+#endif
+#if CONFIG_MESH_TXQ
+#include "freertos/semphr.h"
+#include "my_txq.h"
+#endif
+#if CONFIG_MESH_LATEST
+#include "freertos/semphr.h"
+#include "my_latest.h"
+#endif
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define MESH_RX_WAIT_MS     (50)    /* 接收任务每次等待数据包的时间 */
+#define MESH_FAIR_REPORT_MS (10000) /* 转发公平调度统计信息的输出周期 */
+#if CONFIG_MESH_AGG
+#define MESH_AGG_RECORDS    CONFIG_MESH_AGG_RECORDS
+#if CONFIG_MESH_AGG_AVERAGE
+#define MESH_AGG_AVERAGE    (true)      /* 同一节点同一sensor的记录合并为平均值 */
+#else
+#define MESH_AGG_AVERAGE    (false)
+#endif
+_Static_assert(MY_AGG_FRAME_SIZE(MESH_AGG_RECORDS) <= MESH_MPS, "CONFIG_MESH_AGG_RECORDS too large for one mesh packet");
+#endif
+#if CONFIG_MESH_RELIABLE
+#define MESH_REL_ACK_EVERY  (CONFIG_MESH_RELIABLE_WINDOW / 4)   /* 收到窗口的1/4时确认 */
+#endif
+#if CONFIG_MESH_OTA
+#define MESH_OTA_ANNOUNCE_MS    (5000)  /* 通告和重发完成状态的周期 */
+#define MESH_OTA_REBOOT_MS      (3000)  /* 转发重启消息后等待的时间，子节点先收到 */
+#endif
+#if CONFIG_MESH_PARENT_BALANCE
+#define MESH_PARENT_PERIOD_US   (CONFIG_MESH_PARENT_PERIOD_S * 1000000LL)
+#define MESH_PARENT_OUI         { 0x18, 0xFE, 0x34 }    /* vendor IE使用的OUI */
+#define MESH_PARENT_SCAN_US     (5000000LL)     /* 扫描没有完成时放弃的时间 */
+#endif
+#if CONFIG_MESH_TXQ
+#define MESH_TXQ_REPORT_MS  (10000)     /* 有数据包丢弃时输出统计信息的最短间隔 */
+#endif
+#if CONFIG_MESH_LATEST
+#define MESH_LATEST_RECORD  (CONFIG_MESH_UPLINK_BATCH_SIZE / 2)    /* 查询响应每条记录的上限，一个批次放两条 */
+#endif
+// 根节点处理服务器的下行消息
+#define MESH_DOWNLINK       (CONFIG_MESH_DATA_SEND_TO_SERVER && (CONFIG_MESH_SENSOR_CONFIG || CONFIG_MESH_OTA || CONFIG_MESH_LATEST))
+#if CONFIG_MESH_MQTT_GATEWAY
+#define MESH_CMD_LEN_ARG    (2)     /* cmd: [sid][参数] */
+#define MESH_CMD_LEN_AGE    (3)     /* cmd: [sid][max_age_ms低8位][max_age_ms高8位] */
+#endif
 
 /*******************************************************
  *                Variable Definitions
@@ -34,6 +128,83 @@ static bool is_got_ip = false;
 static mesh_addr_t mesh_parent_addr;
 static int mesh_layer = -1;
 static esp_netif_t *netif_mesh_sta, *netif_mesh_ap;  /* mesh网络层handle */
+static mesh_addr_t mesh_self_addr;                  /* 本节点的mesh地址(STA MAC) */
+MY_TASK_DEFINE(mesh_rx_task_mem, CONFIG_MESH_TASK_STACK_MESH_RX);
+MY_TASK_DEFINE(mesh_tx_task_mem, CONFIG_MESH_TASK_STACK_MESH);
+#if CONFIG_MESH_FAIR
+static my_fair_t mesh_fair;     /* 根节点转发的公平调度，只在接收任务中使用 */
+#endif
+#if CONFIG_MESH_AGG
+// 本节点和子节点的记录，接收任务和发送任务共用
+static my_agg_t mesh_agg;
+static my_agg_slot_t mesh_agg_slots[MESH_AGG_RECORDS];
+static SemaphoreHandle_t mesh_agg_mutex;
+MY_MUTEX_DEFINE(mesh_agg_mutex_mem);
+#endif
+#if CONFIG_MESH_RELIABLE
+// 发送窗口在发送任务和接收任务（处理确认）中使用，接收状态只在根节点的接收任务中使用
+static my_rel_tx_t mesh_rel_tx;
+static my_rel_rx_t mesh_rel_rx;
+static SemaphoreHandle_t mesh_rel_mutex;
+MY_MUTEX_DEFINE(mesh_rel_mutex_mem);
+static bool mesh_rel_resend = false;    /* 父节点变化，立即重发未确认的数据 */
+#endif
+#if CONFIG_MESH_SENSOR_CONFIG && CONFIG_MESH_DATA_SEND_TO_SERVER
+static mesh_addr_t mesh_route_table[CONFIG_MESH_ROUTE_TABLE_SIZE];  /* 只在上行任务中使用 */
+#endif
+#if CONFIG_MESH_OTA
+// 接收状态在接收任务、发送任务和根节点的下载任务中使用，由mesh_ota_mutex保护
+static my_ota_t mesh_ota;
+static my_ota_flash_t mesh_ota_flash;
+static const esp_partition_t *mesh_ota_part;
+static SemaphoreHandle_t mesh_ota_mutex;
+MY_MUTEX_DEFINE(mesh_ota_mutex_mem);
+static int64_t mesh_ota_announce_at = 0;    /* 下次通告的时间(us) */
+static int64_t mesh_ota_reboot_at = 0;      /* 重启的时间(us)，0为不重启 */
+// 只在根节点使用
+MY_TASK_DEFINE(mesh_ota_task_mem, 4096);
+static volatile bool mesh_ota_busy = false;     /* 下载任务运行中 */
+// 分发起点的状态在下载任务、接收任务和发送任务中使用，由mesh_ota_src_mutex保护
+static SemaphoreHandle_t mesh_ota_src_mutex;
+MY_MUTEX_DEFINE(mesh_ota_src_mutex_mem);
+static bool mesh_ota_source = false;            /* 本节点是分发的起点，等待各节点完成 */
+static uint32_t mesh_ota_source_id;             /* 分发的镜像编号 */
+static int64_t mesh_ota_deadline;
+static mesh_addr_t mesh_ota_done[CONFIG_MESH_ROUTE_TABLE_SIZE];     /* 已收齐的节点 */
+static uint16_t mesh_ota_done_num;
+static char mesh_ota_url[MY_REPORT_DOWN_MAX + 1];
+static uint8_t mesh_ota_buf[MY_OTA_FRAME_MAX];  /* 只在下载任务中使用 */
+#endif
+#if CONFIG_MESH_PARENT_BALANCE
+// 候选在wifi任务中记录、在发送任务中评估，由mesh_parent_mux保护
+static my_parent_t mesh_parent;
+static portMUX_TYPE mesh_parent_mux = portMUX_INITIALIZER_UNLOCKED;
+// 以下变量只在发送任务中使用
+static int64_t mesh_parent_scan_at = 0;     /* 下次扫描的时间(us) */
+static int64_t mesh_parent_rate_at = 0;     /* 开始计数的时间(us) */
+static uint32_t mesh_parent_sent = 0;       /* 本节点产生的数据包数 */
+static uint16_t mesh_parent_rate = 0;       /* 本节点和子树每秒向父节点发送的数据包数 */
+static uint8_t mesh_parent_ie[sizeof(vendor_ie_data_t) + sizeof(my_parent_load_t)];
+static uint8_t mesh_parent_channel;         /* 扫描的信道 */
+// 扫描在发送任务中开始，在事件任务中(MESH_EVENT_SCAN_DONE)结束
+static volatile bool mesh_parent_scanning = false;
+static volatile bool mesh_parent_scanned = false;
+#endif
+#if CONFIG_MESH_TXQ
+// 发送任务、接收任务和其他模块提交，发送队列任务发送，由mesh_txq_mutex保护
+static my_txq_t mesh_txq;
+static SemaphoreHandle_t mesh_txq_mutex;
+MY_MUTEX_DEFINE(mesh_txq_mutex_mem);
+MY_TASK_DEFINE(mesh_txq_task_mem, CONFIG_MESH_TASK_STACK_MESH_TXQ);
+static TaskHandle_t mesh_txq_task;
+#endif
+#if CONFIG_MESH_LATEST
+// 根节点在接收任务和发送任务中更新，在上行任务中查询，由mesh_latest_mutex保护
+static my_latest_t mesh_latest;
+static SemaphoreHandle_t mesh_latest_mutex;
+MY_MUTEX_DEFINE(mesh_latest_mutex_mem);
+static uint8_t mesh_latest_buf[MESH_LATEST_RECORD];     /* 只在上行任务中使用 */
+#endif
 
 #if CONFIG_MESH_ENABLE_TIMEOUT
 static esp_timer_handle_t mesh_timer;   /* 定时器handle */
@@ -42,7 +213,24 @@ static esp_timer_handle_t mesh_timer;   /* 定时器handle */
 /*******************************************************
  *                Function Declarations
  *******************************************************/
-static void my_mesh_task(void *arg);
+static esp_err_t mesh_recv_self(int timeout_ms);
+static void mesh_recv_ctrl(const mesh_addr_t *from, const mesh_data_t *data);
+static esp_err_t mesh_recv_toDS(int timeout_ms);
+static esp_err_t mesh_forward_toDS(const mesh_addr_t *from, const mesh_addr_t *to,
+                                   const mesh_data_t *data, int flag);
+static void my_mesh_rx_task(void *arg);
+static void my_mesh_tx_task(void *arg);
+static void mesh_send_done(void *arg, esp_err_t result);
+#if CONFIG_MESH_TXQ
+static esp_err_t mesh_txq_send(void *arg, const mesh_addr_t *to, const mesh_data_t *data, int flag);
+static void mesh_txq_kick(void);
+static void my_mesh_txq_task(void *arg);
+#endif
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+static void mesh_send_sensor_data(const my_sensorif_data_t *data);
+static void mesh_sensor_done(void *arg, esp_err_t result);
+static esp_err_t mesh_report_submit(const mesh_addr_t *from, const mesh_data_t *data);
+#endif
 static esp_err_t my_mesh_task_start(void);
 static void mesh_event_handler(void *arg, esp_event_base_t event_base,
                         int32_t event_id, void *event_data);
@@ -52,146 +240,1333 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
 #if CONFIG_MESH_ENABLE_TIMEOUT
 static void mesh_timeout_callback(void* arg);
 #endif
+#if CONFIG_MESH_MQTT_GATEWAY
+static void mesh_mqtt_handler(my_mqtt_topic_t topic, const uint8_t *data, uint16_t len);
+#endif
+#if CONFIG_MESH_AGG
+static void mesh_agg_submit(void *arg, const my_agg_rec_t *rec, const uint8_t *values);
+static void mesh_agg_flush(bool force, int flag);
+static void mesh_agg_add(void *arg, const my_agg_rec_t *rec, const uint8_t *values);
+#endif
+#if CONFIG_MESH_RELIABLE
+static esp_err_t mesh_rel_out(void *arg, const uint8_t *frame, uint16_t len);
+static esp_err_t mesh_rel_deliver(void *arg, const uint8_t *addr, const uint8_t *data, uint16_t len);
+static void mesh_rel_ack(void *arg, const uint8_t *addr, const my_rel_ack_t *ack);
+static void mesh_rel_poll(void);
+#endif
+#if CONFIG_MESH_SENSOR_CONFIG && CONFIG_MESH_DATA_SEND_TO_SERVER
+static void mesh_config_down(const my_report_down_hdr_t *hdr, const uint8_t *payload);
+#endif
+#if MESH_DOWNLINK
+static void mesh_uplink_down(const my_report_down_hdr_t *hdr, const uint8_t *payload);
+#endif
+#if CONFIG_MESH_LATEST
+static void mesh_latest_query(const my_report_down_hdr_t *hdr, const uint8_t *payload);
+#endif
+#if CONFIG_MESH_OTA
+static esp_err_t mesh_ota_erase(void *arg, uint32_t offset, uint32_t len);
+static esp_err_t mesh_ota_write(void *arg, uint32_t offset, const void *data, uint32_t len);
+static esp_err_t mesh_ota_read(void *arg, uint32_t offset, void *data, uint32_t len);
+static void mesh_ota_children(const uint8_t *frame, uint16_t len);
+static void mesh_ota_out(void *arg, const uint8_t *frame, uint16_t len);
+static void mesh_ota_finish(void);
+static void mesh_ota_recv(const mesh_addr_t *from, const mesh_data_t *data);
+static void mesh_ota_task(void *arg);
+static void mesh_ota_start(const char *url, uint16_t len);
+static void mesh_ota_poll(void);
+#endif
+#if CONFIG_MESH_PARENT_BALANCE
+static void mesh_parent_ie_cb(void *ctx, wifi_vendor_ie_type_t type, const uint8_t sa[6],
+                              const vendor_ie_data_t *ie, int rssi);
+static void mesh_parent_publish(int64_t now);
+static void mesh_parent_scan_done(void);
+static void mesh_parent_switch(int64_t now);
+static void mesh_parent_poll(void);
+#endif
 
 /*******************************************************
  *                Function Definitions
  *******************************************************/
-static void my_mesh_task(void *arg)
+esp_err_t mesh_get_parent_addr(mesh_addr_t *parent)
 {
-    BaseType_t ret;
-    uint8_t count = 0;
-    my_sensorif_ctrl_t ctrl = {0};  /* 需要发送的sensor控制数据 */
-    my_sensorif_data_t data = {0};  /* 接收到的sensor数据 */
-    uint8_t sensor_ctrl = 1;        /* (假设的)控制sensor读取需要的数值 */
+    esp_err_t err;
 
-    mesh_rx_pending_t rx_pendig = {0};  /* 各接收队列中等待的数据个数 */
+    if(esp_mesh_is_root()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    err = esp_mesh_get_parent_bssid(parent);
+    if(err == ESP_OK) {
+        // 父节点的SoftAP MAC为STA MAC(mesh地址)加1，最后一个字节为0时向前借位
+        for(int i = sizeof(parent->addr) - 1; i >= 0; i--) {
+            if(parent->addr[i]-- != 0) {
+                break;
+            }
+        }
+    }
+    return err;
+}
 
-    mesh_data_t mesh_data;
-    mesh_addr_t from, to;
-    int flag;
+esp_err_t mesh_send_data(const mesh_addr_t *to, const mesh_data_t *data, int flag,
+                         my_txq_done_cb_t done, void *arg)
+{
+    esp_err_t err;
+
+    if(done == NULL) {
+        done = mesh_send_done;
+    }
+#if CONFIG_MESH_TXQ
+    xSemaphoreTake(mesh_txq_mutex, portMAX_DELAY);
+    err = my_txq_submit(&mesh_txq, to, data, flag, esp_timer_get_time(), done, arg);
+    xSemaphoreGive(mesh_txq_mutex);
+    if(err == ESP_OK) {
+        xTaskNotifyGive(mesh_txq_task);
+    }
+#else
+    err = esp_mesh_send(to, data, flag, NULL, 0);
+    if(err == ESP_OK) {
+        done(arg, ESP_OK);
+    }
+#endif
+    return err;
+}
+
+uint16_t mesh_send_children(const mesh_data_t *data, int flag, bool queued)
+{
+    wifi_sta_list_t list;
+    mesh_addr_t to;
+
+    if(esp_wifi_ap_get_sta_list(&list) != ESP_OK) {
+        return 0;
+    }
+    // 连接到本节点SoftAP的station，其STA MAC就是子节点的mesh地址
+    for(int i = 0; i < list.num; i++) {
+        memcpy(to.addr, list.sta[i].mac, sizeof(to.addr));
+        MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &to, data, MESH_DATA_P2P);
+        if(queued) {
+            mesh_send_data(&to, data, MESH_DATA_P2P | flag, NULL, NULL);
+        }
+        else {
+            esp_mesh_send(&to, data, MESH_DATA_P2P | flag, NULL, 0);
+        }
+    }
+    return list.num;
+}
+
+// 调用者没有给出回调时使用，只记录失败
+static void mesh_send_done(void *arg, esp_err_t result)
+{
+    if(result != ESP_OK) {
+        MY_DLOGW(MESH_TAG, "Queued packet dropped: %s", esp_err_to_name(result));
+    }
+}
+
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+// 交给上行，根节点同时记录节点数据的最新数值
+static esp_err_t mesh_report_submit(const mesh_addr_t *from, const mesh_data_t *data)
+{
+#if CONFIG_MESH_LATEST
+    if(data->proto == MESH_PROTO_HTTP) {
+        xSemaphoreTake(mesh_latest_mutex, portMAX_DELAY);
+        my_latest_update_payload(&mesh_latest, from->addr, data->data, data->size, esp_timer_get_time());
+        xSemaphoreGive(mesh_latest_mutex);
+    }
+#endif
+    return my_uplink_submit(from, data);
+}
+#endif
+
+#if CONFIG_MESH_TXQ
+// 发送队列使用的发送函数，flag已包含MESH_DATA_NONBLOCK
+static esp_err_t mesh_txq_send(void *arg, const mesh_addr_t *to, const mesh_data_t *data, int flag)
+{
+    return esp_mesh_send(to, data, flag, NULL, 0);
+}
+
+// 父节点变化后不等退避结束，立即重试
+static void mesh_txq_kick(void)
+{
+    // 第一次连接到父节点时任务还没有创建
+    if(mesh_txq_task == NULL) {
+        return;
+    }
+    xSemaphoreTake(mesh_txq_mutex, portMAX_DELAY);
+    my_txq_kick(&mesh_txq, esp_timer_get_time());
+    xSemaphoreGive(mesh_txq_mutex);
+    xTaskNotifyGive(mesh_txq_task);
+}
 
+/**
+ * mesh发送队列任务
+ * 以非阻塞方式发送队列中的数据包，等待到下一个数据包需要重试或放弃的时间，有新的数据包时被唤醒
+ */
+static void my_mesh_txq_task(void *arg)
+{
+    // 回调可能再提交，在释放mesh_txq_mutex之后调用
+    static my_txq_result_t results[CONFIG_MESH_TXQ_LEN];
+    uint16_t num;
+    my_txq_stats_t stats;
+    uint32_t lost = 0;                  /* 上次输出时丢弃的数据包数 */
+    TickType_t last_report = xTaskGetTickCount();
+    TickType_t wait;
+    int64_t now, next;
 
     while(1) {
-        /* 优先处理mesh网络内部的数据包 */
-        // 取得接收队列中数据包个数
-        esp_mesh_get_rx_pending(&rx_pendig);
+        xSemaphoreTake(mesh_txq_mutex, portMAX_DELAY);
+        now  = esp_timer_get_time();
+        next = my_txq_poll(&mesh_txq, now, mesh_txq_send, NULL, results, &num);
+        my_txq_get_stats(&mesh_txq, &stats);
+        xSemaphoreGive(mesh_txq_mutex);
+        my_txq_notify(results, num);
+
+        if((stats.expired + stats.failed + stats.full != lost)
+           && ((xTaskGetTickCount() - last_report) >= (MESH_TXQ_REPORT_MS / portTICK_PERIOD_MS))) {
+            last_report = xTaskGetTickCount();
+            lost = stats.expired + stats.failed + stats.full;
+            ESP_LOGW(MESH_TAG, "Transmit queue: sent %u, retries %u, expired %u, failed %u, full %u, depth %u/%u",
+                     stats.sent, stats.retries, stats.expired, stats.failed, stats.full,
+                     stats.depth, stats.depth_max);
+        }
+
+        // 至少等待1个tick，队列为空时等到有新的数据包
+        if(next == INT64_MAX) {
+            wait = portMAX_DELAY;
+        }
+        else {
+            wait = (next - now) / 1000 / portTICK_PERIOD_MS + 1;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+    my_task_exit();
+}
+#endif
+
+#if CONFIG_MESH_AGG
+// 根节点把聚合帧中的一条记录还原为节点数据，交给上行
+static void mesh_agg_submit(void *arg, const my_agg_rec_t *rec, const uint8_t *values)
+{
+    uint8_t buf[MESH_SENSOR_DATA_SIZE(MY_AGG_VALUES)];
+    my_sensorif_data_t data = { .sid = rec->sid, .num = rec->num, .data = (void *)values };
+    mesh_data_t mesh_data = {
+        .data  = buf,
+        .size  = mesh_pack_sensor_data(&data, buf),
+        .proto = MESH_PROTO_HTTP,
+        .tos   = MESH_TOS_P2P,
+    };
+    mesh_addr_t from;
+
+    memcpy(from.addr, rec->src, sizeof(from.addr));
+    mesh_report_submit(&from, &mesh_data);
+}
+
+/**
+ * 发送聚合窗口中的记录：根节点直接交给上行，其他节点发给父节点
+ * force为false时只在窗口结束或已满时发送，flag为esp_mesh_send的附加标志
+ */
+static void mesh_agg_flush(bool force, int flag)
+{
+    mesh_data_t mesh_data = {
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+    mesh_addr_t parent;
+    bool root = esp_mesh_is_root();
+    bool due;
+    uint16_t len = 0;
+
+    // 切换父节点期间没有目的地址，记录保留在窗口中，直到连接到新的父节点或成为根节点
+    if(!root && (mesh_get_parent_addr(&parent) != ESP_OK)) {
+        return;
+    }
+    xSemaphoreTake(mesh_agg_mutex, portMAX_DELAY);
+    due = force || my_agg_due(&mesh_agg, esp_timer_get_time());
+    xSemaphoreGive(mesh_agg_mutex);
+    if(!due) {
+        return;
+    }
+
+    mesh_data.data = my_pool_alloc(MESH_MPS);
+    if(mesh_data.data == NULL) {
+        return;
+    }
+    xSemaphoreTake(mesh_agg_mutex, portMAX_DELAY);
+    len = my_agg_take(&mesh_agg, mesh_data.data, MESH_MPS);
+    xSemaphoreGive(mesh_agg_mutex);
+
+    if(len > 0) {
+        mesh_data.size = len;
+        if(root) {
+            // 窗口中还有成为根节点之前的记录
+            my_agg_foreach(mesh_data.data, len, mesh_agg_submit, NULL);
+        }
+        else {
+            MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &parent, &mesh_data, MESH_DATA_P2P);
+            if(mesh_send_data(&parent, &mesh_data, MESH_DATA_P2P | flag, NULL, NULL) != ESP_OK) {
+                MY_DLOGW(MESH_TAG, "Aggregated frame (%d bytes) to parent failed!", len);
+            }
+        }
+    }
+    my_pool_free(mesh_data.data);
+}
+
+// 加入一条记录，窗口已满时先发送
+static void mesh_agg_add(void *arg, const my_agg_rec_t *rec, const uint8_t *values)
+{
+    bool added;
+
+    if(esp_mesh_is_root()) {
+        mesh_agg_submit(arg, rec, values);
+        return;
+    }
+    xSemaphoreTake(mesh_agg_mutex, portMAX_DELAY);
+    added = my_agg_add(&mesh_agg, rec, values, esp_timer_get_time());
+    xSemaphoreGive(mesh_agg_mutex);
+    if(!added) {
+        uint32_t dropped = 0;
+        // 可能在接收任务中，不阻塞
+        mesh_agg_flush(true, MESH_DATA_NONBLOCK);
+        xSemaphoreTake(mesh_agg_mutex, portMAX_DELAY);
+        added = my_agg_add(&mesh_agg, rec, values, esp_timer_get_time());
+        if(!added) {
+            dropped = ++mesh_agg.dropped;
+        }
+        xSemaphoreGive(mesh_agg_mutex);
+        // 没有父节点或内存池耗尽时窗口没有清空
+        if(!added) {
+            MY_DLOGW(MESH_TAG, "Aggregation window full, record sid %d dropped (%u in total)!",
+                     rec->sid, (unsigned)dropped);
+        }
+    }
+}
+#endif
+
+#if CONFIG_MESH_RELIABLE
+// 带序号的数据包发送到外部网络，由根节点确认，不阻塞：发送失败时等待重发
+static esp_err_t mesh_rel_out(void *arg, const uint8_t *frame, uint16_t len)
+{
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)frame,
+        .size  = len,
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+    mesh_addr_t to;
+
+    to.mip.ip4.addr = inet_addr(CONFIG_MESH_SERVER_IP);
+    to.mip.port = CONFIG_MESH_SERVER_PORT;
+    MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &to, &mesh_data, MESH_DATA_TODS);
+    // 不经过发送队列：失败时由my_rel的窗口重发，队列再重试会重复发送
+    return esp_mesh_send(&to, &mesh_data, MESH_DATA_TODS | MESH_DATA_NONBLOCK, NULL, 0);
+}
+
+// 根节点把去掉序号的数据交给上行，格式与不使用可靠传输时相同
+static esp_err_t mesh_rel_deliver(void *arg, const uint8_t *addr, const uint8_t *data, uint16_t len)
+{
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)data,
+        .size  = len,
+        .proto = MESH_PROTO_HTTP,
+        .tos   = MESH_TOS_P2P,
+    };
+    mesh_addr_t from;
+
+    memcpy(from.addr, addr, sizeof(from.addr));
+    return mesh_report_submit(&from, &mesh_data);
+}
+
+// 根节点向来源节点发送确认
+static void mesh_rel_ack(void *arg, const uint8_t *addr, const my_rel_ack_t *ack)
+{
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)ack,
+        .size  = sizeof(*ack),
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+    mesh_addr_t to;
+
+    memcpy(to.addr, addr, sizeof(to.addr));
+    MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &to, &mesh_data, MESH_DATA_P2P);
+    // 确认是累积的，丢失后由下一次确认或节点的重发补上，不需要排队
+    esp_mesh_send(&to, &mesh_data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+}
+
+// 发送任务中定期调用：重发超时的数据，成为根节点后把未确认的数据直接交给上行
+static void mesh_rel_poll(void)
+{
+    uint32_t expired;
+
+    xSemaphoreTake(mesh_rel_mutex, portMAX_DELAY);
+    expired = mesh_rel_tx.stats.expired;
+    if(esp_mesh_is_root()) {
+        my_rel_tx_flush(&mesh_rel_tx, mesh_self_addr.addr, mesh_rel_deliver, NULL);
+    }
+    else {
+        my_rel_tx_poll(&mesh_rel_tx, esp_timer_get_time(), mesh_rel_resend, mesh_rel_out, NULL);
+    }
+    mesh_rel_resend = false;
+    expired = mesh_rel_tx.stats.expired - expired;
+    xSemaphoreGive(mesh_rel_mutex);
+    if(expired > 0) {
+        MY_DLOGW(MESH_TAG, "%d packets not acknowledged by root, given up", expired);
+    }
+}
+#endif
+
+#if CONFIG_MESH_SENSOR_CONFIG && CONFIG_MESH_DATA_SEND_TO_SERVER
+/**
+ * 服务器下发的sensor配置
+ * 作为MESH_CTRL_CONFIG转发给目的节点，dst全为0xFF时发给路由表中的所有节点
+ */
+static void mesh_config_down(const my_report_down_hdr_t *hdr, const uint8_t *payload)
+{
+    static const uint8_t dst_all[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t frame[1 + MY_REPORT_DOWN_MAX];
+    mesh_data_t mesh_data = {
+        .data  = frame,
+        .size  = 1 + hdr->len,
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+    int route_num = 0;
+
+    frame[0] = MESH_CTRL_CONFIG;
+    memcpy(frame + 1, payload, hdr->len);
+
+    if(memcmp(hdr->dst, dst_all, sizeof(dst_all)) == 0) {
+        esp_mesh_get_routing_table(mesh_route_table, sizeof(mesh_route_table), &route_num);
+    }
+    else {
+        memcpy(mesh_route_table[0].addr, hdr->dst, sizeof(hdr->dst));
+        route_num = 1;
+    }
+    for(int i = 0; i < route_num; i++) {
+        if(memcmp(mesh_route_table[i].addr, mesh_self_addr.addr, 6) == 0) {
+            // 发给根节点自己的配置直接生效
+            my_config_apply(payload, hdr->len);
+            continue;
+        }
+        MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &mesh_route_table[i], &mesh_data, MESH_DATA_P2P);
+        // 配置没有重发，经过发送队列时ESP-MESH的队列满也不会丢失
+        mesh_send_data(&mesh_route_table[i], &mesh_data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, NULL);
+    }
+}
+#endif
+
+#if MESH_DOWNLINK
+// 根节点收到服务器的下行消息（上行任务中调用）
+static void mesh_uplink_down(const my_report_down_hdr_t *hdr, const uint8_t *payload)
+{
+    switch(hdr->type) {
+    case MY_REPORT_DOWN_CONFIG:
+    #if CONFIG_MESH_SENSOR_CONFIG
+        mesh_config_down(hdr, payload);
+    #endif
+        break;
+    case MY_REPORT_DOWN_OTA:
+    #if CONFIG_MESH_OTA
+        mesh_ota_start((const char *)payload, hdr->len);
+    #endif
+        break;
+    case MY_REPORT_DOWN_QUERY:
+    #if CONFIG_MESH_LATEST
+        mesh_latest_query(hdr, payload);
+    #endif
+        break;
+    default:
+        MY_DLOGW(MESH_TAG, "Unknown downlink type %d, dropped", hdr->type);
+        break;
+    }
+}
+#endif
+
+#if CONFIG_MESH_LATEST
+/**
+ * 服务器读取最新数值，在上行任务中调用，响应直接交给上行，不经过mesh
+ * 上行缓冲区放不下时停止，服务器以收到的最后一条记录的next继续查询
+ */
+static void mesh_latest_query(const my_report_down_hdr_t *hdr, const uint8_t *payload)
+{
+    const my_report_query_t *query = (const my_report_query_t *)payload;
+    mesh_data_t mesh_data = {
+        .data  = mesh_latest_buf,
+        .proto = MY_REPORT_PROTO_LATEST,
+        .tos   = MESH_TOS_P2P,
+    };
+    uint16_t cursor;
+    uint16_t records = 0;
+
+    if((hdr->len < sizeof(*query)) || (hdr->len < sizeof(*query) + query->num * sizeof(my_report_query_key_t))) {
+        MY_DLOGW(MESH_TAG, "Bad latest value query (%d bytes), dropped", hdr->len);
+        return;
+    }
+    cursor = query->cursor;
+    do {
+        xSemaphoreTake(mesh_latest_mutex, portMAX_DELAY);
+        mesh_data.size = my_latest_query(&mesh_latest, query, esp_timer_get_time(),
+                                         mesh_latest_buf, sizeof(mesh_latest_buf), &cursor);
+        xSemaphoreGive(mesh_latest_mutex);
+        if(my_uplink_submit(&mesh_self_addr, &mesh_data) != ESP_OK) {
+            break;
+        }
+        records++;
+    } while(cursor != MY_REPORT_QUERY_END);
+    MY_DLOGI(MESH_TAG, "Latest value query %d answered with %d records%s", query->id, records,
+             (cursor != MY_REPORT_QUERY_END) ? " (uplink full)" : "");
+}
+#endif
+
+#if CONFIG_MESH_OTA
+static esp_err_t mesh_ota_erase(void *arg, uint32_t offset, uint32_t len)
+{
+    return esp_partition_erase_range(mesh_ota_part, offset, len);
+}
+
+static esp_err_t mesh_ota_write(void *arg, uint32_t offset, const void *data, uint32_t len)
+{
+    return esp_partition_write(mesh_ota_part, offset, data, len);
+}
+
+static esp_err_t mesh_ota_read(void *arg, uint32_t offset, void *data, uint32_t len)
+{
+    return esp_partition_read(mesh_ota_part, offset, data, len);
+}
+
+// 发给所有子节点
+static void mesh_ota_children(const uint8_t *frame, uint16_t len)
+{
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)frame,
+        .size  = len,
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
 
-        // 接收发送向自己的数据包
-        while(rx_pendig.toSelf > 0) {
-            // 接收数据包
-            esp_mesh_recv(&from, &mesh_data, 0, &flag, NULL, 0);
-            // TODO: 从flag和mesh_data中对应变量，可以知道数据包的来源及协议
-            // 作针对性处理
-        #if 0
-            if(flag == MESH_DATA_FROMDS) {  /* 数据来自外部网络 */
-                // 根据收到的数据的协议来进行不同处理
-                switch(mesh_data.proto) {
-                case MESH_PROTO_BIN:
-                    break;
-                case MESH_PROTO_HTTP:
-                    break;
-                case MESH_PROTO_JSON:
-                    break;
-                case MESH_PROTO_MQTT:
-                    break;
-                case MESH_PROTO_AP:
-                    break;
-                case MESH_PROTO_STA:
-                    break;
-                default:
-                    break;
+    // 发送队列满时丢弃，子节点之后请求修复；不经过mesh_send_data，分块不会占满发送队列
+    mesh_send_children(&mesh_data, MESH_DATA_NONBLOCK, false);
+}
+
+// 修复时重发给请求的子节点，arg为子节点地址
+static void mesh_ota_out(void *arg, const uint8_t *frame, uint16_t len)
+{
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)frame,
+        .size  = len,
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+
+    MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, (mesh_addr_t *)arg, &mesh_data, MESH_DATA_P2P);
+    esp_mesh_send((mesh_addr_t *)arg, &mesh_data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+}
+
+// 收齐后设置启动分区（同时校验镜像），等待根节点的重启消息
+static void mesh_ota_finish(void)
+{
+    esp_err_t err = esp_ota_set_boot_partition(mesh_ota_part);
+
+    if(err != ESP_OK) {
+        ESP_LOGE(MESH_TAG, "OTA image invalid (%s)", esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(MESH_TAG, "OTA image %d bytes received, boot partition %s", mesh_ota.size, mesh_ota_part->label);
+}
+
+// 处理固件分发的控制消息，在接收任务中调用
+static void mesh_ota_recv(const mesh_addr_t *from, const mesh_data_t *data)
+{
+    my_ota_status_t status;
+    my_ota_reboot_t reboot;
+    uint8_t *frame;
+    esp_err_t err;
+    bool done;
+
+    if(mesh_ota_part == NULL) {
+        return;
+    }
+    switch(data->data[0]) {
+    case MESH_CTRL_OTA_DATA:
+        xSemaphoreTake(mesh_ota_mutex, portMAX_DELAY);
+        err = my_ota_recv(&mesh_ota, data->data, data->size, esp_timer_get_time());
+        done = (err == ESP_OK) && my_ota_complete(&mesh_ota);
+        xSemaphoreGive(mesh_ota_mutex);
+        if(err == ESP_OK) {
+            // 新的块立即转发给子节点
+            mesh_ota_children(data->data, data->size);
+        }
+        else if(err != ESP_ERR_INVALID_STATE) {
+            MY_DLOGW(MESH_TAG, "OTA chunk from "MACSTR" failed (0x%x)", MAC2STR(from->addr), err);
+        }
+        if(done) {
+            mesh_ota_finish();
+            mesh_ota_announce_at = 0;
+        }
+        break;
+    case MESH_CTRL_OTA_STATUS:
+        if(data->size < sizeof(status)) {
+            break;
+        }
+        memcpy(&status, data->data, sizeof(status));
+        if(status.done) {
+            // 根节点记录已收齐的节点
+            xSemaphoreTake(mesh_ota_src_mutex, portMAX_DELAY);
+            if(mesh_ota_source && (status.id == mesh_ota_source_id)) {
+                uint16_t i;
+                for(i = 0; (i < mesh_ota_done_num) && (memcmp(&mesh_ota_done[i], from, sizeof(*from)) != 0); i++);
+                if((i == mesh_ota_done_num) && (i < CONFIG_MESH_ROUTE_TABLE_SIZE)) {
+                    mesh_ota_done[mesh_ota_done_num++] = *from;
                 }
-            } else{   /* 数据来自其他节点 */
-                // do something
             }
-        #endif
-            rx_pendig.toSelf--;
-            if(rx_pendig.toSelf == 0) {
-                // 检查在接收期间是否又收到数据包
-                esp_mesh_get_rx_pending(&rx_pendig);
+            xSemaphoreGive(mesh_ota_src_mutex);
+            break;
+        }
+        frame = my_pool_alloc(MESH_MPS);
+        if(frame == NULL) {
+            break;
+        }
+        xSemaphoreTake(mesh_ota_mutex, portMAX_DELAY);
+        my_ota_repair(&mesh_ota, &status, frame, mesh_ota_out, (void *)from);
+        xSemaphoreGive(mesh_ota_mutex);
+        my_pool_free(frame);
+        break;
+    case MESH_CTRL_OTA_REBOOT:
+        if(data->size < sizeof(reboot)) {
+            break;
+        }
+        memcpy(&reboot, data->data, sizeof(reboot));
+        mesh_ota_children(data->data, data->size);
+        xSemaphoreTake(mesh_ota_mutex, portMAX_DELAY);
+        done = (reboot.id == mesh_ota.id) && my_ota_complete(&mesh_ota);
+        xSemaphoreGive(mesh_ota_mutex);
+        if(done && (mesh_ota_reboot_at == 0)) {
+            ESP_LOGW(MESH_TAG, "OTA reboot in %d ms", reboot.delay_ms);
+            mesh_ota_reboot_at = esp_timer_get_time() + reboot.delay_ms * 1000LL;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * 根节点的下载任务：下载镜像，每个块写入自己的OTA分区后发给子节点，
+ * 与节点收到块时的处理相同
+ */
+static void mesh_ota_task(void *arg)
+{
+    esp_http_client_config_t config = {
+        .url        = mesh_ota_url,
+        .timeout_ms = 5000,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    my_ota_data_hdr_t hdr = { .type = MESH_CTRL_OTA_DATA };
+    esp_err_t err = ESP_FAIL;
+    int size, got, ret;
+    bool done = false;
+
+    if((client == NULL) || (esp_http_client_open(client, 0) != ESP_OK)) {
+        ESP_LOGE(MESH_TAG, "OTA connect to %s failed", mesh_ota_url);
+        goto exit;
+    }
+    size = esp_http_client_fetch_headers(client);
+    hdr.id   = esp_random() | 1;
+    hdr.size = (size > 0) ? size : 0;
+    xSemaphoreTake(mesh_ota_mutex, portMAX_DELAY);
+    err = my_ota_begin(&mesh_ota, hdr.id, hdr.size, esp_timer_get_time());
+    xSemaphoreGive(mesh_ota_mutex);
+    if(err != ESP_OK) {
+        ESP_LOGE(MESH_TAG, "OTA image size %d not supported", size);
+        goto exit;
+    }
+    xSemaphoreTake(mesh_ota_src_mutex, portMAX_DELAY);
+    mesh_ota_done_num  = 0;
+    mesh_ota_deadline  = esp_timer_get_time() + CONFIG_MESH_OTA_TIMEOUT_S * 1000000LL;
+    mesh_ota_source_id = hdr.id;
+    mesh_ota_source    = true;
+    xSemaphoreGive(mesh_ota_src_mutex);
+    ESP_LOGI(MESH_TAG, "OTA image %d bytes from %s", size, mesh_ota_url);
+
+    for(hdr.chunk = 0; (uint32_t)hdr.chunk * MY_OTA_CHUNK_SIZE < hdr.size; hdr.chunk++) {
+        uint16_t len = ((hdr.size - hdr.chunk * MY_OTA_CHUNK_SIZE) < MY_OTA_CHUNK_SIZE)
+                       ? (hdr.size - hdr.chunk * MY_OTA_CHUNK_SIZE) : MY_OTA_CHUNK_SIZE;
+        memcpy(mesh_ota_buf, &hdr, sizeof(hdr));
+        for(got = 0; got < len; got += ret) {
+            ret = esp_http_client_read(client, (char *)mesh_ota_buf + sizeof(hdr) + got, len - got);
+            if(ret <= 0) {
+                ESP_LOGE(MESH_TAG, "OTA download failed at %d bytes", hdr.chunk * MY_OTA_CHUNK_SIZE + got);
+                err = ESP_FAIL;
+                goto exit;
             }
-            ESP_LOGI(MESH_TAG, "Receiving toSelf package!");
         }
+        xSemaphoreTake(mesh_ota_mutex, portMAX_DELAY);
+        err = my_ota_recv(&mesh_ota, mesh_ota_buf, sizeof(hdr) + len, esp_timer_get_time());
+        done = my_ota_complete(&mesh_ota);
+        xSemaphoreGive(mesh_ota_mutex);
+        if(err != ESP_OK) {
+            ESP_LOGE(MESH_TAG, "OTA write failed (%s)", esp_err_to_name(err));
+            goto exit;
+        }
+        mesh_ota_children(mesh_ota_buf, sizeof(hdr) + len);
+        // 控制发送速度，给转发和修复留出带宽
+        vTaskDelay(CONFIG_MESH_OTA_CHUNK_GAP_MS / portTICK_PERIOD_MS);
+    }
+    if(done) {
+        mesh_ota_finish();
+    }
 
+exit:
+    if(err != ESP_OK) {
+        xSemaphoreTake(mesh_ota_src_mutex, portMAX_DELAY);
+        mesh_ota_source = false;
+        xSemaphoreGive(mesh_ota_src_mutex);
+    }
+    if(client != NULL) {
+        esp_http_client_cleanup(client);
+    }
+    mesh_ota_busy = false;
+    my_task_exit();
+}
+
+/**
+ * 根节点开始固件分发
+ * url为下行消息中的URL，长度为0时使用CONFIG_MESH_OTA_URL
+ */
+static void mesh_ota_start(const char *url, uint16_t len)
+{
+    if(!esp_mesh_is_root() || mesh_ota_busy || (mesh_ota_part == NULL)) {
+        MY_DLOGW(MESH_TAG, "OTA not started, busy, not root or no OTA partition");
+        return;
+    }
+    if(len == 0) {
+        snprintf(mesh_ota_url, sizeof(mesh_ota_url), "%s", CONFIG_MESH_OTA_URL);
+    }
+    else {
+        len = (len < sizeof(mesh_ota_url) - 1) ? len : sizeof(mesh_ota_url) - 1;
+        memcpy(mesh_ota_url, url, len);
+        mesh_ota_url[len] = '\0';
+    }
+    mesh_ota_busy = true;
+    my_task_create(&mesh_ota_task_mem, mesh_ota_task, "ota_task", CONFIG_MESH_TASK_PRIO_UPLINK,
+                   MY_TASK_CORE(CONFIG_MESH_TASK_CORE_UPLINK), NULL);
+}
+
+/**
+ * 发送任务中定期调用：请求修复、通告、重发完成状态，
+ * 根节点在所有节点收齐或超时后发出重启
+ */
+static void mesh_ota_poll(void)
+{
+    my_ota_data_hdr_t announce;
+    my_ota_status_t status;
+    mesh_addr_t parent;
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)&status,
+        .size  = sizeof(status),
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+    int64_t now = esp_timer_get_time();
+    bool request, periodic, done, reboot_all;
+    uint16_t done_num;
+    uint32_t id;
+
+    if(mesh_ota_reboot_at != 0) {
+        if(now >= mesh_ota_reboot_at) {
+            esp_restart();
+        }
+        return;
+    }
+    xSemaphoreTake(mesh_ota_mutex, portMAX_DELAY);
+    request  = my_ota_poll(&mesh_ota, now, &status);
+    periodic = my_ota_active(&mesh_ota) && (now >= mesh_ota_announce_at);
+    done     = my_ota_complete(&mesh_ota);
+    if(periodic) {
+        my_ota_announce(&mesh_ota, &announce);
+        if(done) {
+            my_ota_get_status(&mesh_ota, &status);
+        }
+    }
+    xSemaphoreGive(mesh_ota_mutex);
+
+    if(request && (mesh_get_parent_addr(&parent) == ESP_OK)) {
+        MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &parent, &mesh_data, MESH_DATA_P2P);
+        esp_mesh_send(&parent, &mesh_data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+    }
+    if(periodic) {
+        mesh_ota_announce_at = now + MESH_OTA_ANNOUNCE_MS * 1000LL;
+        // 之后连接的子节点收到通告后开始接收
+        mesh_ota_children((const uint8_t *)&announce, sizeof(announce));
+        // 完成状态可能丢失，重启之前定期发给根节点
+        if(done && !esp_mesh_is_root()) {
+            MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, NULL, &mesh_data, MESH_DATA_P2P);
+            esp_mesh_send(NULL, &mesh_data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+        }
+    }
+
+    // 所有节点收齐或超时后只发出一次重启
+    xSemaphoreTake(mesh_ota_src_mutex, portMAX_DELAY);
+    reboot_all = mesh_ota_source && done
+                 && ((mesh_ota_done_num + 1 >= esp_mesh_get_routing_table_size()) || (now >= mesh_ota_deadline));
+    done_num = mesh_ota_done_num;
+    id       = mesh_ota_source_id;
+    if(reboot_all) {
+        mesh_ota_source = false;
+    }
+    xSemaphoreGive(mesh_ota_src_mutex);
+
+    if(reboot_all) {
+        my_ota_reboot_t reboot = {
+            .type     = MESH_CTRL_OTA_REBOOT,
+            .delay_ms = MESH_OTA_REBOOT_MS,
+            .id       = id,
+        };
+        ESP_LOGW(MESH_TAG, "OTA %d of %d nodes done, reboot", done_num + 1, esp_mesh_get_routing_table_size());
+        mesh_ota_children((const uint8_t *)&reboot, sizeof(reboot));
+        // 根节点最后重启
+        mesh_ota_reboot_at = now + 2 * MESH_OTA_REBOOT_MS * 1000LL;
+    }
+}
+#endif
+
+#if CONFIG_MESH_PARENT_BALANCE
+// 记录其他节点信标（或扫描响应）中的负载，在wifi任务中调用
+static void mesh_parent_ie_cb(void *ctx, wifi_vendor_ie_type_t type, const uint8_t sa[6],
+                              const vendor_ie_data_t *ie, int rssi)
+{
+    static const uint8_t oui[3] = MESH_PARENT_OUI;
+    my_parent_load_t load;
+
+    if(((type != WIFI_VND_IE_TYPE_BEACON) && (type != WIFI_VND_IE_TYPE_PROBE_RESP))
+       || (memcmp(ie->vendor_oui, oui, sizeof(oui)) != 0) || (ie->vendor_oui_type != MY_PARENT_IE_TYPE)
+       || (ie->length < sizeof(mesh_parent_ie) - 2)) {
+        return;
+    }
+    memcpy(&load, ie->payload, sizeof(load));
+    portENTER_CRITICAL(&mesh_parent_mux);
+    my_parent_observe(&mesh_parent, sa, rssi, &load, esp_timer_get_time());
+    portEXIT_CRITICAL(&mesh_parent_mux);
+}
+
+// 更新本节点信标中的负载
+static void mesh_parent_publish(int64_t now)
+{
+    static const uint8_t oui[3] = MESH_PARENT_OUI;
+    vendor_ie_data_t *ie = (vendor_ie_data_t *)mesh_parent_ie;
+    my_parent_load_t load = { 0 };
+    mesh_tx_pending_t pending;
+    wifi_sta_list_t sta;
+    uint32_t rate;
+
+    // 子节点的数据由ESP-MESH直接转发，按子树的节点数估计：假设每个节点产生的数据量相同
+    if(now > mesh_parent_rate_at) {
+        rate = (uint64_t)mesh_parent_sent * esp_mesh_get_routing_table_size() * 1000000 / (now - mesh_parent_rate_at);
+        mesh_parent_rate = (rate > UINT16_MAX) ? UINT16_MAX : rate;
+    }
+    mesh_parent_sent = 0;
+    mesh_parent_rate_at = now;
+
+    load.layer    = esp_mesh_get_layer();
+    load.capacity = CONFIG_MESH_AP_CONNECTIONS;
+    load.tx_rate  = mesh_parent_rate;
+    if(esp_wifi_ap_get_sta_list(&sta) == ESP_OK) {
+        load.children = sta.num;
+    }
+    if(esp_mesh_get_tx_pending(&pending) == ESP_OK) {
+        load.queue_pct = (pending.to_parent >= MESH_XON_QSIZE) ? 100 : pending.to_parent * 100 / MESH_XON_QSIZE;
+    }
+
+    ie->element_id      = WIFI_VENDOR_IE_ELEMENT_ID;
+    ie->length          = sizeof(mesh_parent_ie) - 2;   /* 不含element_id和length */
+    memcpy(ie->vendor_oui, oui, sizeof(oui));
+    ie->vendor_oui_type = MY_PARENT_IE_TYPE;
+    memcpy(ie->payload, &load, sizeof(load));
+    // 修改内容需要先删除再重新设置
+    esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_1, NULL);
+    esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_1, mesh_parent_ie);
+    esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_PROBE_RESP, WIFI_VND_IE_ID_1, NULL);
+    esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_PROBE_RESP, WIFI_VND_IE_ID_1, mesh_parent_ie);
+}
+
+// 扫描完成，在事件任务中调用：释放扫描结果，恢复自组网，由发送任务评估候选
+static void mesh_parent_scan_done(void)
+{
+    uint16_t num = 1;
+    wifi_ap_record_t record;
+
+    if(!mesh_parent_scanning || mesh_parent_scanned) {
+        return;
+    }
+    // 只需要释放扫描结果
+    esp_wifi_scan_get_ap_records(&num, &record);
+    esp_mesh_set_self_organized(true, false);
+    mesh_parent_scanned = true;
+}
+
+// 有负载低得多的候选时用esp_mesh_set_parent换到该候选
+static void mesh_parent_switch(int64_t now)
+{
+    const my_parent_cand_t *best;
+    my_parent_cand_t cand;
+    wifi_config_t parent = { 0 };
+    mesh_addr_t id;
+
+    portENTER_CRITICAL(&mesh_parent_mux);
+    best = my_parent_select(&mesh_parent, mesh_parent_addr.addr, mesh_parent_rate, now);
+    if(best != NULL) {
+        cand = *best;
+    }
+    portEXIT_CRITICAL(&mesh_parent_mux);
+    if(best == NULL) {
+        return;
+    }
+
+    ESP_LOGW(MESH_TAG, "Switch parent "MACSTR" -> "MACSTR" (rssi %d, layer %d, children %d, rate %d)",
+             MAC2STR(mesh_parent_addr.addr), MAC2STR(cand.addr), cand.rssi, cand.load.layer,
+             cand.load.children, cand.load.tx_rate);
+    memcpy(parent.sta.bssid, cand.addr, sizeof(parent.sta.bssid));
+    parent.sta.bssid_set = 1;
+    parent.sta.channel   = mesh_parent_channel;
+    memcpy(parent.sta.password, CONFIG_MESH_AP_PASSWD, strlen(CONFIG_MESH_AP_PASSWD));
+    esp_mesh_get_id(&id);
+    if(esp_mesh_set_parent(&parent, &id, MESH_NODE, cand.load.layer + 1) != ESP_OK) {
+        MY_DLOGW(MESH_TAG, "Set parent failed!");
+    }
+}
+
+/**
+ * 定期发布负载，非根节点扫描当前信道收集候选的负载，扫描完成后评估候选。
+ * 扫描不阻塞发送任务：结果由MESH_EVENT_SCAN_DONE通知，之后的调用中评估
+ */
+static void mesh_parent_poll(void)
+{
+    int64_t now = esp_timer_get_time();
+    wifi_second_chan_t second;
+    wifi_scan_config_t scan = { 0 };
+
+    if(mesh_parent_scanning) {
+        if(mesh_parent_scanned) {
+            mesh_parent_scanning = false;
+            mesh_parent_switch(now);
+        }
+        else if(now >= mesh_parent_scan_at - MESH_PARENT_PERIOD_US + MESH_PARENT_SCAN_US) {
+            // 没有收到扫描完成事件，停止扫描并恢复自组网
+            MY_DLOGW(MESH_TAG, "Parent scan timeout!");
+            mesh_parent_scanning = false;
+            esp_wifi_scan_stop();
+            esp_mesh_set_self_organized(true, false);
+        }
+        return;
+    }
+    if(now < mesh_parent_scan_at) {
+        return;
+    }
+    mesh_parent_scan_at = now + MESH_PARENT_PERIOD_US;
+    mesh_parent_publish(now);
+    if(!is_mesh_connected || esp_mesh_is_root()
+       || (esp_wifi_get_channel(&mesh_parent_channel, &second) != ESP_OK)) {
+        return;
+    }
+
+    // 扫描期间收到的信标和扫描响应由mesh_parent_ie_cb记录，扫描时不能让ESP-MESH自己选择父节点
+    scan.channel     = mesh_parent_channel;
+    scan.show_hidden = true;
+    mesh_parent_scanned  = false;
+    mesh_parent_scanning = true;
+    esp_mesh_set_self_organized(false, false);
+    if(esp_wifi_scan_start(&scan, false) != ESP_OK) {
+        mesh_parent_scanning = false;
+        esp_mesh_set_self_organized(true, false);
+    }
+}
+#endif
+
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+// sensor数据发出或放弃，没有发出时通知拥塞检测降低采样，不等到本地队列满
+static void mesh_sensor_done(void *arg, esp_err_t result)
+{
+    if(result == ESP_OK) {
+        return;
+    }
+    MY_DLOGW(MESH_TAG, "Send to server failed, data dropped!");
+#if CONFIG_MESH_ADAPTIVE_SAMPLING
+    my_congest_drop();
+#endif
+}
+
+// 将sensor数据打包后发送到服务器
+static void mesh_send_sensor_data(const my_sensorif_data_t *data)
+{
+    mesh_data_t mesh_data;
+
+#if CONFIG_MESH_AGG
+    // 非根节点的数据加入聚合窗口，由父节点合并后转发
+    if(!esp_mesh_is_root() && (data->num <= MY_AGG_VALUES)) {
+        my_agg_rec_t rec = { .sid = data->sid, .samples = 1, .num = data->num };
+        memcpy(rec.src, mesh_self_addr.addr, sizeof(rec.src));
+        mesh_agg_add(NULL, &rec, data->data);
+        return;
+    }
+#endif
+#if CONFIG_MESH_RELIABLE
+    // 非根节点的数据加上序号，保存到发送窗口中，直到根节点确认
+    if(!esp_mesh_is_root() && (MESH_SENSOR_DATA_SIZE(data->num) <= MY_REL_PAYLOAD_MAX)) {
+        uint8_t buf[MY_REL_PAYLOAD_MAX];
+        uint16_t len = mesh_pack_sensor_data(data, buf);
+        xSemaphoreTake(mesh_rel_mutex, portMAX_DELAY);
+        my_rel_tx_send(&mesh_rel_tx, buf, len, esp_timer_get_time(), mesh_rel_out, NULL);
+        xSemaphoreGive(mesh_rel_mutex);
+        return;
+    }
+#endif
+    mesh_data.proto = MESH_PROTO_HTTP;
+    mesh_data.tos   = MESH_TOS_P2P;
+    mesh_data.size  = MESH_SENSOR_DATA_SIZE(data->num);
+
+    // 从内存池申请内存存放mesh数据包
+    uint8_t *ptr = my_pool_alloc(mesh_data.size);
+    if(ptr == NULL) {
+        MY_DLOGW(MESH_TAG, "Packet pool exhausted, data dropped!");
+        return;
+    }
+
+    mesh_pack_sensor_data(data, ptr);
+    mesh_data.data = ptr;
+#if CONFIG_MESH_MQTT_GATEWAY
+    // 以MQTT消息发送，由根节点的网关发布
+    my_mqtt_gw_publish(MY_MQTT_TOPIC_DATA, CONFIG_MESH_MQTT_QOS, ptr, mesh_data.size);
+#else
+    mesh_addr_t to;
+    // 配置外部网络地址
+    to.mip.ip4.addr = inet_addr(CONFIG_MESH_SERVER_IP);
+    to.mip.port = CONFIG_MESH_SERVER_PORT;
+    MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &to, &mesh_data, MESH_DATA_TODS);
+    if(esp_mesh_is_root()) {
+        // 根节点的数据直接交给上行任务
+        mesh_report_submit(&mesh_self_addr, &mesh_data);
+    }
+    else {
+        // 发送到外部网络，由根节点转发
+        esp_err_t err = mesh_send_data(&to, &mesh_data, MESH_DATA_TODS, mesh_sensor_done, NULL);
+        if(err != ESP_OK) {
+            mesh_sensor_done(NULL, err);
+        }
+    }
+#endif
+
+    // 释放申请的内存
+    my_pool_free(ptr);
+}
+#endif
+
+// 处理其他节点发送的控制消息，第一个字节为mesh_ctrl_type_t
+static void mesh_recv_ctrl(const mesh_addr_t *from, const mesh_data_t *data)
+{
+    if(data->size < 1) {
+        return;
+    }
+    switch(data->data[0]) {
+    case MESH_CTRL_CONGEST:
+    #if CONFIG_MESH_ADAPTIVE_SAMPLING
+        my_congest_recv(from, data);
+    #endif
+        break;
+    case MESH_CTRL_TIME_REQ:
+    case MESH_CTRL_TIME_RESP:
+    #if CONFIG_MESH_TIME_SYNC
+        my_time_recv(from, data);
+    #endif
+        break;
+    case MESH_CTRL_AGG:
+    #if CONFIG_MESH_AGG
+        // 子节点的记录加入自己的窗口，根节点交给上行
+        if(my_agg_foreach(data->data, data->size, mesh_agg_add, NULL) < 0) {
+            MY_DLOGW(MESH_TAG, "Malformed aggregated frame from "MACSTR, MAC2STR(from->addr));
+        }
+    #endif
+        break;
+    case MESH_CTRL_REL_ACK:
+    #if CONFIG_MESH_RELIABLE
+        if(data->size >= sizeof(my_rel_ack_t)) {
+            my_rel_ack_t ack;
+            memcpy(&ack, data->data, sizeof(ack));
+            xSemaphoreTake(mesh_rel_mutex, portMAX_DELAY);
+            my_rel_tx_ack(&mesh_rel_tx, &ack, esp_timer_get_time(), mesh_rel_out, NULL);
+            xSemaphoreGive(mesh_rel_mutex);
+        }
+    #endif
+        break;
+    case MESH_CTRL_CONFIG:
+    #if CONFIG_MESH_SENSOR_CONFIG
+        if(my_config_apply(data->data + 1, data->size - 1) != ESP_OK) {
+            MY_DLOGW(MESH_TAG, "Config from "MACSTR" rejected", MAC2STR(from->addr));
+        }
+    #endif
+        break;
+    case MESH_CTRL_OTA_DATA:
+    case MESH_CTRL_OTA_STATUS:
+    case MESH_CTRL_OTA_REBOOT:
+    #if CONFIG_MESH_OTA
+        mesh_ota_recv(from, data);
+    #endif
+        break;
+    default:
+        break;
+    }
+}
+
+// 接收一个发送向自己的数据包，timeout_ms为等待时间
+static esp_err_t mesh_recv_self(int timeout_ms)
+{
+    mesh_data_t mesh_data;
+    mesh_addr_t from;
+    int flag = 0;
+    esp_err_t err;
+
+    // 从内存池申请接收缓冲区，用完时留在mesh队列中下次再接收
+    mesh_data.data = my_pool_alloc(MESH_MPS);
+    if(mesh_data.data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    mesh_data.size = MESH_MPS;
+    // 接收数据包
+    err = esp_mesh_recv(&from, &mesh_data, timeout_ms, &flag, NULL, 0);
+    if(err != ESP_OK) {
+        my_pool_free(mesh_data.data);
+        return err;
+    }
+    MY_CAPTURE_FRAME(MY_CAPTURE_RX, &from, NULL, &mesh_data, flag);
+    // TODO: 从flag和mesh_data中对应变量，可以知道数据包的来源及协议
+    // 作针对性处理
+    if(flag & MESH_DATA_FROMDS) {  /* 数据来自外部网络 */
+        // 根据收到的数据的协议来进行不同处理
+        switch(mesh_data.proto) {
+        case MESH_PROTO_BIN:
+            break;
+        case MESH_PROTO_HTTP:
+            break;
+        case MESH_PROTO_JSON:
+            break;
+        case MESH_PROTO_MQTT:
+        #if CONFIG_MESH_MQTT_GATEWAY
+            // 根节点网关转发的下行MQTT消息
+            my_mqtt_gw_recv(&mesh_data);
+        #endif
+            break;
+        case MESH_PROTO_AP:
+            break;
+        case MESH_PROTO_STA:
+            break;
+        default:
+            break;
+        }
+    } else{   /* 数据来自其他节点 */
+        if(mesh_data.proto == MESH_PROTO_BIN) {
+            mesh_recv_ctrl(&from, &mesh_data);
+        }
+    }
+    my_pool_free(mesh_data.data);
+    MY_DLOGD(MESH_TAG, "Receiving toSelf package!");
+
+    return ESP_OK;
+}
+
+// 接收一个发送向外网的数据包并进行转发，仅根节点调用
+static esp_err_t mesh_recv_toDS(int timeout_ms)
+{
+    mesh_data_t mesh_data;
+    mesh_addr_t from, to;
+    int flag = 0;
+    esp_err_t err;
+
+    mesh_data.data = my_pool_alloc(MESH_MPS);
+    if(mesh_data.data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    mesh_data.size = MESH_MPS;
+    // 接收数据包,此处收到的flag=MESH_DATA_TODS
+    err = esp_mesh_recv_toDS(&from, &to, &mesh_data, timeout_ms, &flag, NULL, 0);
+    if(err != ESP_OK) {
+        my_pool_free(mesh_data.data);
+        return err;
+    }
+    MY_CAPTURE_FRAME(MY_CAPTURE_RX, &from, &to, &mesh_data, flag);
+#if CONFIG_MESH_FAIR
+    // 按来源节点限速并缓存，由接收任务按轮询顺序转发
+    my_fair_enqueue(&mesh_fair, &from, &to, &mesh_data, flag, esp_timer_get_time());
+#else
+    mesh_forward_toDS(&from, &to, &mesh_data, flag);
+#endif
+    my_pool_free(mesh_data.data);
+    MY_DLOGD(MESH_TAG, "Receiving toDS package!");
+
+    return ESP_OK;
+}
+
+/**
+ * 转发一个发送向外网的数据包，仅根节点调用
+ * 返回ESP_ERR_NO_MEM表示上行缓冲区已满
+ */
+static esp_err_t mesh_forward_toDS(const mesh_addr_t *from, const mesh_addr_t *to,
+                                   const mesh_data_t *data, int flag)
+{
+#if CONFIG_MESH_MQTT_GATEWAY
+    if(data->proto == MESH_PROTO_MQTT) {
+        // 交给MQTT网关，合并后通过broker发布
+        return my_mqtt_gw_submit(from, data);
+    }
+#endif
+#if CONFIG_MESH_RELIABLE
+    if((data->proto == MESH_PROTO_BIN) && (data->size > 0) && (data->data[0] == MESH_CTRL_REL_DATA)) {
+        // 去重后交给上行，确认在接收任务中统一发送
+        return my_rel_rx_recv(&mesh_rel_rx, from->addr, data->data, data->size,
+                              esp_timer_get_time(), mesh_rel_deliver, NULL);
+    }
+#endif
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+    // 交给上行任务，合并成批次后通过TCP连接发送到服务器
+    return mesh_report_submit(from, data);
+#else
+    // 转发
+    MY_CAPTURE_FRAME(MY_CAPTURE_TX, from, to, data, flag);
+    return mesh_send_data(to, data, flag, NULL, NULL);
+#endif
+}
+
+/**
+ * mesh接收任务
+ * 优先级高于其他任务，只负责接收和转发，数据的打包发送在mesh发送任务中进行
+ */
+static void my_mesh_rx_task(void *arg)
+{
+    mesh_rx_pending_t rx_pendig = {0};  /* 各接收队列中等待的数据个数 */
+    esp_err_t err;
+    bool forward;
+#if CONFIG_MESH_FAIR
+    TickType_t last_report = xTaskGetTickCount();
+
+    my_fair_init(&mesh_fair, CONFIG_MESH_FAIR_RATE, CONFIG_MESH_FAIR_BURST, CONFIG_MESH_FAIR_QUANTUM);
+#endif
+
+    while(1) {
         // 接收发送向外网的数据包，并进行转发
         // FIXME: 当未连接外网时，此类数据包会堆积并大量占用内存，待修改
-        if(is_got_ip) {
-            while(rx_pendig.toDS > 0) {    /* 目的地为外网的数据包 */
-                if(esp_mesh_is_root()){ /* 仅根结点可以向外网发数据包 */
-                    // 接收数据包,此处收到的flag=MESH_DATA_TODS
-                    esp_mesh_recv_toDS(&from, &to, &mesh_data, 0, &flag, NULL, 0);
-                    // 转发
-                    esp_mesh_send(&to, &mesh_data, flag, NULL, 0);
-
-                    rx_pendig.toDS--;
-                    if(rx_pendig.toDS == 0) {
-                        esp_mesh_get_rx_pending(&rx_pendig);
-                    }
-                    ESP_LOGI(MESH_TAG, "Receiving toDS package!");
-                }
-                else {
-                    // 发送向外网的数据会发到根结点进行转发，其他节点不应收到该数据
-                    ESP_LOGE(MESH_TAG, "This is not a root node but received toDS package!");
-                    break;
-                }
-            }
+        forward = esp_mesh_is_root() && is_got_ip;
+
+    #if CONFIG_MESH_FAIR
+        // 按轮询顺序转发缓存的数据包，上行缓冲区满时留到下次
+        // 在接收之前进行，缓存的数据包占满内存池时接收会失败
+        if(forward) {
+            my_fair_dequeue(&mesh_fair, mesh_forward_toDS, UINT32_MAX);
+        }
+        else {
+            my_fair_flush(&mesh_fair);
+        }
+        if(forward && ((xTaskGetTickCount() - last_report) >= (MESH_FAIR_REPORT_MS / portTICK_PERIOD_MS))) {
+            last_report = xTaskGetTickCount();
+            my_fair_report(&mesh_fair);
         }
+    #endif
 
+        // 等待数据包，根节点主要是转发发往外网的数据包，在toDS队列上等待
+        if(forward) {
+            err = mesh_recv_toDS(MESH_RX_WAIT_MS);
+        }
+        else {
+            err = mesh_recv_self(MESH_RX_WAIT_MS);
+        }
+        if((err != ESP_OK) && (err != ESP_ERR_MESH_TIMEOUT)) {
+            // mesh未启动或缓冲区用完，稍后再接收
+            vTaskDelay(MESH_RX_WAIT_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        // 取出等待中的数据包，不等待
+        esp_mesh_get_rx_pending(&rx_pendig);
+        while((rx_pendig.toSelf > 0) && (mesh_recv_self(0) == ESP_OK)) {
+            rx_pendig.toSelf--;
+        }
+        // 发送向外网的数据会发到根结点进行转发，其他节点不应收到该数据
+        while(forward && (rx_pendig.toDS > 0) && (mesh_recv_toDS(0) == ESP_OK)) {
+            rx_pendig.toDS--;
+        }
+    #if CONFIG_MESH_RELIABLE
+        // 处理完一批数据包后发送确认，同一节点的多个数据包只确认一次
+        if(forward) {
+            my_rel_rx_poll(&mesh_rel_rx, esp_timer_get_time(), mesh_rel_ack, NULL);
+        }
+    #endif
+    }
+    my_task_exit();
+}
+
+/**
+ * mesh发送任务
+ * 接收sensorif发送的数据，打包后发送到服务器
+ */
+static void my_mesh_tx_task(void *arg)
+{
+    BaseType_t ret;
+    TickType_t last_query = xTaskGetTickCount();
+    my_sensorif_ctrl_t ctrl = {0};  /* 需要发送的sensor控制数据 */
+    my_sensorif_data_t data = {0};  /* 接收到的sensor数据 */
+    uint8_t sensor_ctrl = 1;        /* (假设的)控制sensor读取需要的数值 */
+
+    while(1) {
         /* 处理本设备其他模块的数据 */
-        // 从队列中读取sensorif发送的数据，无数据不等待
-        ret = xQueueReceive(main_get_mesh_queue(), &data, 0);
+        // 从队列中读取sensorif发送的数据，最多等待100ms
+        ret = xQueueReceive(main_get_mesh_queue(), &data, (100 / portTICK_PERIOD_MS));
         // 接收到sensor数据
         if(ret == pdTRUE) {
-            ESP_LOGI(MESH_TAG, "Some data received from mesh queue!");
+            MY_DLOGI(MESH_TAG, "Some data received from mesh queue!");
+        #if CONFIG_MESH_PARENT_BALANCE
+            mesh_parent_sent++;
+        #endif
             // 向服务器发送采集到的数据
         #if CONFIG_MESH_DATA_SEND_TO_SERVER
-            // 向服务器(1.2.3.4:80)发送数据
-            mesh_data.proto = MESH_PROTO_HTTP;
-            mesh_data.tos   = MESH_TOS_P2P;
-            mesh_data.size  = (data.num + 1) * sizeof(uint8_t);
-
-            // 申请内存存放mesh数据包
-            uint8_t *ptr = pvPortMalloc(mesh_data.size);    
-
-            ptr[0] = data.num;
-            // 复制sensor读取到的数据
-            memcpy(ptr+1, data.data, data.num * sizeof(uint8_t));
-            mesh_data.data = ptr;
-            // 配置外部网络地址
-            IP4_ADDR(&to.mip.ip4,1,2,3,4);
-            to.mip.port = 80;
-            // 发送到外部网络
-            esp_mesh_send(&to, &mesh_data, MESH_DATA_TODS, NULL, 0);
-
-            // 释放申请的内存
-            vPortFree(ptr);
+            mesh_send_sensor_data(&data);
         #else
             // 没有服务器，此处直接打印出来
             for(uint8_t i = 0; i < data.num; i++){
                 // 此处假设传递的数据为 uint8_t 类型
                 uint8_t dt = *(uint8_t *)(data.data + i*sizeof(uint8_t));
-                ESP_LOGW(MESH_TAG, "data[%d] : %d", i, dt);
+                MY_DLOGW(MESH_TAG, "data[%d] : %d", i, dt);
             }
         #endif
         }
         else {
-            ESP_LOGI(MESH_TAG, "No data received from mesh queue!");
+            MY_DLOGI(MESH_TAG, "No data received from mesh queue!");
         }
+    #if CONFIG_MESH_AGG
+        // 窗口结束时发送聚合帧
+        mesh_agg_flush(false, 0);
+    #endif
+    #if CONFIG_MESH_RELIABLE
+        mesh_rel_poll();
+    #endif
+    #if CONFIG_MESH_SENSOR_CONFIG
+        // 合并一段时间内的配置修改后写入NVS
+        my_config_poll(false);
+    #endif
+    #if CONFIG_MESH_OTA
+        mesh_ota_poll();
+    #endif
+    #if CONFIG_MESH_PARENT_BALANCE
+        mesh_parent_poll();
+    #endif
 
         /* XXX: 实际应用中需要修改
          * 手动读取指定sensor的数据，
          * 实际使用中应该读取其他任务发送的队列消息
          */
     #if 1
-        count++;
         // 约每5秒手动查询某一sensor的数值
-        if( (count % 50) == 0 ) {
+        if((xTaskGetTickCount() - last_query) >= (5000 / portTICK_PERIOD_MS)) {
+            last_query = xTaskGetTickCount();
             // 向sensorif队列发送控制数据，等待1s
             // 使用的是read函数，获取到的数值为10
             ctrl.sid = 1;
             ctrl.ctrl = &sensor_ctrl;
             xQueueSend(main_get_sensorif_queue(), &ctrl, (1000 / portTICK_PERIOD_MS));
-            ESP_LOGW(MESH_TAG, "Send data to sensorif queue!");
+            MY_DLOGW(MESH_TAG, "Send data to sensorif queue!");
         }
     #else
         ret = xQueueReceive(mesh_ctrl_queue, &ctrl, 0);
@@ -201,19 +1576,128 @@ static void my_mesh_task(void *arg)
             }
         }
     #endif
-        vTaskDelay(100 / portTICK_PERIOD_MS);
     }
-    vTaskDelete(NULL);
+    my_task_exit();
 }
 
+#if CONFIG_MESH_MQTT_GATEWAY
+/**
+ * 下行MQTT消息的处理
+ * cmd: 读取指定sensor的数据，按长度区分
+ *      [sid]：使用read_default读取，不使用缓存（与进行中的读取合并）
+ *      [sid][参数]：使用read读取，参数传给驱动
+ *      [sid][max_age_ms]：max_age_ms为小端的uint16_t，使用read_default读取，
+ *                         服务器接受max_age_ms内的缓存数值
+ * config: my_report_config_t，修改sensor配置
+ */
+static void mesh_mqtt_handler(my_mqtt_topic_t topic, const uint8_t *data, uint16_t len)
+{
+    // 参数在sensorif任务读取sensor时才使用，每个排队中的请求需要单独存放：
+    // 队列中最多CONFIG_MESH_QUEUE_LEN_SENSORIF个，加上sensorif任务正在读取的一个
+    static uint8_t cmd_args[CONFIG_MESH_QUEUE_LEN_SENSORIF + 1];
+    static uint8_t cmd_idx = 0;
+    my_sensorif_ctrl_t ctrl = {0};
+
+#if CONFIG_MESH_SENSOR_CONFIG
+    if(topic == MY_MQTT_TOPIC_CONFIG) {
+        if(my_config_apply(data, len) != ESP_OK) {
+            MY_DLOGW(MESH_TAG, "MQTT config rejected!");
+        }
+        return;
+    }
+#endif
+    if((topic != MY_MQTT_TOPIC_CMD) || (len < 1)) {
+        return;
+    }
+    ctrl.sid        = data[0];
+    ctrl.max_age_ms = 0;
+    ctrl.ctrl       = NULL;
+    if(len >= MESH_CMD_LEN_AGE) {
+        ctrl.max_age_ms = data[1] | ((uint16_t)data[2] << 8);
+    }
+    else if(len == MESH_CMD_LEN_ARG) {
+        cmd_idx = (cmd_idx + 1) % sizeof(cmd_args);
+        cmd_args[cmd_idx] = data[1];
+        ctrl.ctrl = &cmd_args[cmd_idx];
+    }
+    // 队列满时丢弃，不阻塞mesh任务
+    if(xQueueSend(main_get_sensorif_queue(), &ctrl, 0) != pdTRUE) {
+        MY_DLOGW(MESH_TAG, "Sensorif queue full, cmd dropped!");
+    }
+}
+#endif
+
 static esp_err_t my_mesh_task_start(void)
 {
     static bool is_task_started = false;
     if (!is_task_started) {
         is_task_started = true;
-        xTaskCreate(my_mesh_task, "MPTX", 3072, NULL, 5, NULL);
+    #if CONFIG_MESH_LATEST
+        mesh_latest_mutex = my_mutex_create(&mesh_latest_mutex_mem);
+        my_latest_init(&mesh_latest, CONFIG_MESH_LATEST_MAX_AGE_S);
+    #endif
+    #if CONFIG_MESH_TXQ
+        // 其他任务和模块可能立即提交，最先创建
+        mesh_txq_mutex = my_mutex_create(&mesh_txq_mutex_mem);
+        my_txq_init(&mesh_txq, CONFIG_MESH_TXQ_RETRY_MS, CONFIG_MESH_TXQ_RETRY_MAX_MS, CONFIG_MESH_TXQ_TTL_MS);
+        mesh_txq_task = my_task_create(&mesh_txq_task_mem, my_mesh_txq_task, "MPTQ", CONFIG_MESH_TASK_PRIO_MESH_TXQ,
+                                       MY_TASK_CORE(CONFIG_MESH_TASK_CORE_MESH_TXQ), NULL);
+    #endif
+    #if CONFIG_MESH_AGG
+        mesh_agg_mutex = my_mutex_create(&mesh_agg_mutex_mem);
+        my_agg_init(&mesh_agg, mesh_agg_slots, MESH_AGG_RECORDS, CONFIG_MESH_AGG_WINDOW_MS, MESH_AGG_AVERAGE);
+    #endif
+    #if CONFIG_MESH_RELIABLE
+        mesh_rel_mutex = my_mutex_create(&mesh_rel_mutex_mem);
+        my_rel_tx_init(&mesh_rel_tx, CONFIG_MESH_RELIABLE_RTO_MS, CONFIG_MESH_RELIABLE_RETRIES);
+        my_rel_rx_init(&mesh_rel_rx, MESH_REL_ACK_EVERY, CONFIG_MESH_RELIABLE_ACK_DELAY_MS);
+    #endif
+    #if CONFIG_MESH_OTA
+        mesh_ota_mutex     = my_mutex_create(&mesh_ota_mutex_mem);
+        mesh_ota_src_mutex = my_mutex_create(&mesh_ota_src_mutex_mem);
+        mesh_ota_part  = esp_ota_get_next_update_partition(NULL);
+        mesh_ota_flash.erase = mesh_ota_erase;
+        mesh_ota_flash.write = mesh_ota_write;
+        mesh_ota_flash.read  = mesh_ota_read;
+        my_ota_init(&mesh_ota, &mesh_ota_flash, CONFIG_MESH_OTA_REPAIR_MS);
+    #endif
+    #if CONFIG_MESH_PARENT_BALANCE
+        my_parent_policy_t policy = {
+            .rssi_tolerance = CONFIG_MESH_PARENT_RSSI_TOLERANCE,
+            .rssi_min       = CONFIG_MESH_PARENT_RSSI_MIN,
+            .hysteresis_pct = CONFIG_MESH_PARENT_HYSTERESIS_PCT,
+            .confirm        = CONFIG_MESH_PARENT_CONFIRM,
+            .hold_us        = CONFIG_MESH_PARENT_HOLD_S * 1000000LL,
+            .stale_us       = 2 * MESH_PARENT_PERIOD_US,
+        };
+        my_parent_init(&mesh_parent, &policy);
+        mesh_parent_rate_at = esp_timer_get_time();
+        mesh_parent_scan_at = mesh_parent_rate_at;
+        ESP_ERROR_CHECK(esp_wifi_set_vendor_ie_cb(mesh_parent_ie_cb, NULL));
+    #endif
+        // 接收和发送分为两个任务，接收任务优先级更高，发送任务可以放在另一个核上
+        my_task_create(&mesh_rx_task_mem, my_mesh_rx_task, "MPRX", CONFIG_MESH_TASK_PRIO_MESH_RX,
+                       MY_TASK_CORE(CONFIG_MESH_TASK_CORE_MESH_RX), NULL);
+        my_task_create(&mesh_tx_task_mem, my_mesh_tx_task, "MPTX", CONFIG_MESH_TASK_PRIO_MESH_TX,
+                       MY_TASK_CORE(CONFIG_MESH_TASK_CORE_MESH_TX), NULL);
+    #if CONFIG_MESH_DATA_SEND_TO_SERVER
+        // 创建上行任务，根节点获取到IP后连接服务器
+    #if MESH_DOWNLINK
+        my_uplink_set_down_handler(mesh_uplink_down);
+    #endif
+        my_uplink_init();
+    #endif
+    #if CONFIG_MESH_MQTT_GATEWAY
+        // 创建MQTT网关，处理下行的控制命令
+        my_mqtt_gw_set_handler(mesh_mqtt_handler);
+        my_mqtt_gw_init();
+    #endif
         // 创建sensorif任务,使之发送sensor数据到mesh任务中
         sensorif_init();
+    #if CONFIG_MESH_BENCH
+        // sensor初始化完成后进行性能测试
+        my_bench_start();
+    #endif
     }
     return ESP_OK;
 }
@@ -237,9 +1721,12 @@ static void mesh_event_handler(void *arg, esp_event_base_t event_base,
             .callback = &mesh_timeout_callback,
             .name = "mesh-timeout"
         };
-        // 创建定时器
-        ESP_ERROR_CHECK(esp_timer_create(&mesh_timer_args, &mesh_timer));
-        // 启动定时器
+        // 定时器只创建一次，之后重复使用
+        if(mesh_timer == NULL) {
+            ESP_ERROR_CHECK(esp_timer_create(&mesh_timer_args, &mesh_timer));
+        }
+        // 启动定时器，之前可能已经启动过
+        esp_timer_stop(mesh_timer);
         ESP_ERROR_CHECK(esp_timer_start_once(mesh_timer, (CONFIG_MESH_TIMEOUT_TIME)*1000*1000));
 #endif
     }
@@ -301,11 +1788,21 @@ static void mesh_event_handler(void *arg, esp_event_base_t event_base,
             // 开启dhcp
             ESP_ERROR_CHECK (esp_netif_dhcpc_start(netif_mesh_sta) );
         }
+    #if CONFIG_MESH_TIME_SYNC
+        // 向新的父节点重新同步时间
+        my_time_parent_changed();
+    #endif
+    #if CONFIG_MESH_RELIABLE
+        // 切换父节点期间发送的数据可能丢失，不等超时立即重发
+        mesh_rel_resend = true;
+    #endif
+    #if CONFIG_MESH_TXQ
+        mesh_txq_kick();
+    #endif
     #if CONFIG_MESH_ENABLE_TIMEOUT
-        // 停止并删除定时器
+        // 停止定时器
         esp_timer_stop(mesh_timer);
-        esp_timer_delete(mesh_timer);
-        ESP_LOGI(MESH_TAG, "mesh timer deleted.");
+        ESP_LOGI(MESH_TAG, "mesh timer stopped.");
     #endif
         // 创建mesh任務
         my_mesh_task_start();
@@ -362,6 +1859,9 @@ static void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_layer = esp_mesh_get_layer();
         esp_mesh_get_parent_bssid(&mesh_parent_addr);
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_ROOT_SWITCH_ACK>layer:%d, parent:"MACSTR"", mesh_layer, MAC2STR(mesh_parent_addr.addr));
+    #if CONFIG_MESH_TIME_SYNC
+        my_time_parent_changed();
+    #endif
     }
     break;
     case MESH_EVENT_TODS_STATE: {
@@ -393,6 +1893,9 @@ static void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_event_scan_done_t *scan_done = (mesh_event_scan_done_t *)event_data;
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_SCAN_DONE>number:%d",
                  scan_done->number);
+    #if CONFIG_MESH_PARENT_BALANCE
+        mesh_parent_scan_done();
+    #endif
     }
     break;
     case MESH_EVENT_NETWORK_STATE: {
@@ -442,21 +1945,34 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(MESH_TAG, "<IP_EVENT_STA_GOT_IP>IP:" IPSTR, IP2STR(&event->ip_info.ip));
         // 获取到IP，此时可以连接到外部网络
         is_got_ip = true;
+    #if CONFIG_MESH_DATA_SEND_TO_SERVER
+        my_uplink_set_online(true);
+    #endif
+    #if CONFIG_MESH_TIME_SYNC
+        my_time_set_online(true);
+    #endif
+    #if CONFIG_MESH_MQTT_GATEWAY
+        my_mqtt_gw_set_online(true);
+    #endif
     }
     else if(event_id == IP_EVENT_STA_LOST_IP) {
         ESP_LOGI(MESH_TAG, "<IP_EVENT_STA_LOST_IP>");
 
         is_got_ip = false;
+    #if CONFIG_MESH_DATA_SEND_TO_SERVER
+        my_uplink_set_online(false);
+    #endif
+    #if CONFIG_MESH_MQTT_GATEWAY
+        my_mqtt_gw_set_online(false);
+    #endif
     }
 }
 
 #if CONFIG_MESH_ENABLE_TIMEOUT
 static void mesh_timeout_callback(void* arg)
 {
-    // 停止并删除定时器
-    esp_timer_stop(mesh_timer);
-    esp_timer_delete(mesh_timer);
-    
+    // 单次定时器，到时后已经停止，保留给下次使用
+
     // 时间到仍然没有连上mesh网络
     if(is_mesh_connected == false){
         // 取消注册的事件
@@ -494,6 +2010,9 @@ void mesh_start(void)
     char password[65] = { 0 };
     size_t len_ssid = 0;
     size_t len_pswd = 0;
+#if CONFIG_MESH_SHARD
+    my_shard_t shard;
+#endif
 
     nvs_handle_t wifi_handle;
     ESP_ERROR_CHECK( nvs_open(MESH_NVS_KEY_NAMESPACE, NVS_READWRITE, &wifi_handle) );
@@ -506,6 +2025,19 @@ void mesh_start(void)
     nvs_close(wifi_handle);
     // printf("Read router success,ssid=%s,psw=%s\n",ssid,password);
 
+    // mesh中以STA MAC作为节点地址
+    esp_read_mac(mesh_self_addr.addr, ESP_MAC_WIFI_STA);
+#if CONFIG_MESH_SHARD
+    // 按NVS中的设置或本节点地址确定加入哪个分片的mesh
+    my_shard_load(mesh_self_addr.addr, MESH_ID, &shard);
+#endif
+#if CONFIG_MESH_CAPTURE
+    my_capture_init(&mesh_self_addr);
+#endif
+#if CONFIG_MESH_TIME_SYNC
+    my_time_init();
+#endif
+
     // 为mesh创建网络接口
     if(netif_mesh_sta == NULL && netif_mesh_ap == NULL) {
         ESP_ERROR_CHECK(esp_netif_create_default_wifi_mesh_netifs(&netif_mesh_sta, &netif_mesh_ap));
@@ -534,7 +2066,7 @@ void mesh_start(void)
     // 根节点投票阈值，默认为0.9
     ESP_ERROR_CHECK(esp_mesh_set_vote_percentage(1));
     // mesh接收队列长度
-    ESP_ERROR_CHECK(esp_mesh_set_xon_qsize(64));
+    ESP_ERROR_CHECK(esp_mesh_set_xon_qsize(MESH_XON_QSIZE));
 
 #ifdef CONFIG_MESH_ENABLE_PS
     /* Enable mesh PS function */
@@ -552,9 +2084,14 @@ void mesh_start(void)
 
     mesh_cfg_t cfg = MESH_INIT_CONFIG_DEFAULT();
     /* mesh ID */
+#if CONFIG_MESH_SHARD
+    memcpy((uint8_t *) &cfg.mesh_id, shard.mesh_id, 6);
+    cfg.channel = shard.channel;
+#else
     memcpy((uint8_t *) &cfg.mesh_id, MESH_ID, 6);
-    /* router */
     cfg.channel = CONFIG_MESH_CHANNEL;
+#endif
+    /* router */
     cfg.router.ssid_len = len_ssid;
     memcpy((uint8_t *) &cfg.router.ssid, ssid, cfg.router.ssid_len);
     memcpy((uint8_t *) &cfg.router.password, password, len_pswd);
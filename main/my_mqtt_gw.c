@@ -0,0 +1,418 @@
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_mesh.h"
+#include "lwip/sockets.h"
+#include "mqtt_client.h"
+
+#include "my_mqtt_gw.h"
+#include "my_mem.h"
+#include "my_pool.h"
+#include "my_capture.h"
+#include "my_mesh.h"
+
+#if CONFIG_MESH_MQTT_GATEWAY
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define MQTT_GW_SLOTS       CONFIG_MESH_MQTT_BATCH_SLOTS
+#define MQTT_GW_SLOT_SIZE   CONFIG_MESH_MQTT_BATCH_SIZE
+#define MQTT_GW_TIMEOUT_US  (CONFIG_MESH_MQTT_BATCH_TIMEOUT * 1000LL)
+#define MQTT_GW_TOPIC_LEN   (64)
+#define MQTT_GW_PREFIX      CONFIG_MESH_MQTT_TOPIC_PREFIX
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 批次槽，收集同一(节点, topic, qos)的消息
+typedef struct {
+    bool     used;
+    bool     full;          /* 已放不下新消息，等待发布 */
+    uint8_t  src[6];
+    uint8_t  topic_id;
+    uint8_t  qos;
+    uint16_t len;
+    int64_t  first_time;    /* 第一条消息提交的时间(us) */
+    uint8_t  buf[MQTT_GW_SLOT_SIZE];
+} mqtt_gw_slot_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *MQTT_GW_TAG = "mqtt_gw";
+static const char *topic_names[MY_MQTT_TOPIC_NUM] = {
+    [MY_MQTT_TOPIC_DATA]   = "data",
+    [MY_MQTT_TOPIC_STATUS] = "status",
+    [MY_MQTT_TOPIC_EVENT]  = "event",
+    [MY_MQTT_TOPIC_CMD]    = "cmd",
+    [MY_MQTT_TOPIC_CONFIG] = "config",
+};
+static mqtt_gw_slot_t slots[MQTT_GW_SLOTS];
+static uint8_t pub_buf[MQTT_GW_SLOT_SIZE];      /* 仅网关任务使用 */
+static uint8_t down_buf[MESH_MPS];              /* 仅MQTT事件处理使用 */
+static mesh_addr_t route_table[CONFIG_MESH_ROUTE_TABLE_SIZE];
+static SemaphoreHandle_t slot_mutex;
+static TaskHandle_t gw_task_handle;
+MY_TASK_DEFINE(gw_task_mem, CONFIG_MESH_TASK_STACK_MQTT_GW);
+MY_MUTEX_DEFINE(slot_mutex_mem);
+static esp_mqtt_client_handle_t client;
+static volatile bool is_online = false;
+static volatile bool is_connected = false;
+static mesh_addr_t self_addr;
+static my_mqtt_gw_handler_t gw_handler;
+static uint32_t published = 0, dropped = 0;
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void mqtt_gw_task(void *arg);
+static void mqtt_gw_flush(bool force);
+static void mqtt_gw_event_handler(void *arg, esp_event_base_t event_base,
+                        int32_t event_id, void *event_data);
+static void mqtt_gw_downlink(const char *topic, int topic_len, const char *data, int data_len);
+static bool mqtt_gw_parse_mac(const char *str, uint8_t *mac);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 发布已满或已超时的批次槽，force为true时发布所有批次槽
+static void mqtt_gw_flush(bool force)
+{
+    char topic[MQTT_GW_TOPIC_LEN];
+    int64_t now = esp_timer_get_time();
+    uint16_t len;
+    uint8_t qos;
+
+    for(uint8_t i = 0; i < MQTT_GW_SLOTS; i++) {
+        mqtt_gw_slot_t *slot = &slots[i];
+
+        xSemaphoreTake(slot_mutex, portMAX_DELAY);
+        if(!slot->used || (!force && !slot->full && (now - slot->first_time < MQTT_GW_TIMEOUT_US))) {
+            xSemaphoreGive(slot_mutex);
+            continue;
+        }
+        // 复制出来后释放批次槽，发布时不阻塞mesh任务
+        snprintf(topic, sizeof(topic), "%s/%02x%02x%02x%02x%02x%02x/%s", MQTT_GW_PREFIX,
+                 MAC2STR(slot->src), topic_names[slot->topic_id]);
+        len = slot->len;
+        qos = slot->qos;
+        memcpy(pub_buf, slot->buf, len);
+        slot->used = false;
+        xSemaphoreGive(slot_mutex);
+
+        if(esp_mqtt_client_publish(client, topic, (const char *)pub_buf, len, qos, 0) < 0) {
+            dropped++;
+        }
+        else {
+            published++;
+        }
+    }
+}
+
+static void mqtt_gw_task(void *arg)
+{
+    TickType_t wait = pdMS_TO_TICKS(CONFIG_MESH_MQTT_BATCH_TIMEOUT);
+    bool is_started = false;
+
+    if(wait == 0) {
+        wait = 1;
+    }
+
+    while(1) {
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        // 根据是否获取到IP启动或停止MQTT客户端
+        if(is_online && !is_started) {
+            esp_mqtt_client_start(client);
+            is_started = true;
+        }
+        else if(!is_online && is_started) {
+            esp_mqtt_client_stop(client);
+            is_started = false;
+            is_connected = false;
+        }
+
+        // 未连接到broker时保留批次，之后再发布
+        if(is_connected) {
+            mqtt_gw_flush(false);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static bool mqtt_gw_parse_mac(const char *str, uint8_t *mac)
+{
+    unsigned int b[6];
+
+    if(sscanf(str, "%2x%2x%2x%2x%2x%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+        return false;
+    }
+    for(uint8_t i = 0; i < 6; i++) {
+        mac[i] = b[i];
+    }
+    return true;
+}
+
+/**
+ * 将broker下发的消息转发给对应节点
+ * topic格式：<prefix>/<节点mac|all>/down/<topic>
+ */
+static void mqtt_gw_downlink(const char *topic, int topic_len, const char *data, int data_len)
+{
+    char buf[MQTT_GW_TOPIC_LEN];
+    char node[13] = {0};
+    char name[16] = {0};
+    my_mqtt_msg_hdr_t *hdr = (my_mqtt_msg_hdr_t *)down_buf;
+    mesh_data_t mesh_data;
+    mesh_addr_t to;
+    uint8_t topic_id;
+    int route_num = 0;
+
+    if((topic_len >= sizeof(buf)) || (data_len + sizeof(my_mqtt_msg_hdr_t) > sizeof(down_buf))) {
+        ESP_LOGW(MQTT_GW_TAG, "Downlink message too long, dropped");
+        return;
+    }
+    memcpy(buf, topic, topic_len);
+    buf[topic_len] = '\0';
+
+    // 跳过前缀，解析节点和topic名称
+    if((strncmp(buf, MQTT_GW_PREFIX "/", strlen(MQTT_GW_PREFIX "/")) != 0)
+        || (sscanf(buf + strlen(MQTT_GW_PREFIX "/"), "%12[^/]/down/%15s", node, name) != 2)) {
+        return;
+    }
+    for(topic_id = 0; topic_id < MY_MQTT_TOPIC_NUM; topic_id++) {
+        if(strcmp(name, topic_names[topic_id]) == 0) {
+            break;
+        }
+    }
+    if(topic_id == MY_MQTT_TOPIC_NUM) {
+        ESP_LOGW(MQTT_GW_TAG, "Unknown downlink topic %s", name);
+        return;
+    }
+
+    hdr->topic_id = topic_id;
+    hdr->qos = 0;
+    memcpy(down_buf + sizeof(my_mqtt_msg_hdr_t), data, data_len);
+    mesh_data.data  = down_buf;
+    mesh_data.size  = data_len + sizeof(my_mqtt_msg_hdr_t);
+    mesh_data.proto = MESH_PROTO_MQTT;
+    mesh_data.tos   = MESH_TOS_P2P;
+
+    if(strcmp(node, "all") == 0) {
+        // 发给路由表中的所有节点
+        esp_mesh_get_routing_table(route_table, sizeof(route_table), &route_num);
+    }
+    else if(mqtt_gw_parse_mac(node, to.addr)) {
+        memcpy(&route_table[0], &to, sizeof(mesh_addr_t));
+        route_num = 1;
+    }
+
+    for(int i = 0; i < route_num; i++) {
+        if(memcmp(route_table[i].addr, self_addr.addr, 6) == 0) {
+            // 发给根节点自己的消息直接处理
+            my_mqtt_gw_recv(&mesh_data);
+        }
+        else {
+            MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &route_table[i], &mesh_data, MESH_DATA_FROMDS);
+            mesh_send_data(&route_table[i], &mesh_data, MESH_DATA_FROMDS, NULL, NULL);
+        }
+    }
+}
+
+static void mqtt_gw_event_handler(void *arg, esp_event_base_t event_base,
+                        int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+    char topic[MQTT_GW_TOPIC_LEN];
+
+    switch(event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(MQTT_GW_TAG, "<MQTT_EVENT_CONNECTED>");
+        is_connected = true;
+        // 一次订阅所有节点的下行topic
+        snprintf(topic, sizeof(topic), "%s/+/down/#", MQTT_GW_PREFIX);
+        esp_mqtt_client_subscribe(client, topic, 1);
+        xTaskNotifyGive(gw_task_handle);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGI(MQTT_GW_TAG, "<MQTT_EVENT_DISCONNECTED>published:%u, dropped:%u", published, dropped);
+        is_connected = false;
+        break;
+    case MQTT_EVENT_DATA:
+        // 不支持分片的长消息
+        if((event->current_data_offset != 0) || (event->data_len != event->total_data_len)) {
+            ESP_LOGW(MQTT_GW_TAG, "Fragmented downlink message dropped");
+            break;
+        }
+        mqtt_gw_downlink(event->topic, event->topic_len, event->data, event->data_len);
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t my_mqtt_gw_publish(my_mqtt_topic_t topic, uint8_t qos, const uint8_t *data, uint16_t len)
+{
+    esp_err_t ret;
+    mesh_data_t mesh_data;
+    mesh_addr_t to;
+    my_mqtt_msg_hdr_t *hdr;
+
+    if((topic >= MY_MQTT_TOPIC_NUM) || (len + sizeof(my_mqtt_msg_hdr_t) > MESH_MPS)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // 从内存池申请内存存放mesh数据包
+    uint8_t *ptr = my_pool_alloc(len + sizeof(my_mqtt_msg_hdr_t));
+    if(ptr == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    hdr = (my_mqtt_msg_hdr_t *)ptr;
+    hdr->topic_id = topic;
+    hdr->qos = qos;
+    memcpy(ptr + sizeof(my_mqtt_msg_hdr_t), data, len);
+
+    mesh_data.data  = ptr;
+    mesh_data.size  = len + sizeof(my_mqtt_msg_hdr_t);
+    mesh_data.proto = MESH_PROTO_MQTT;
+    mesh_data.tos   = MESH_TOS_P2P;
+
+    if(esp_mesh_is_root()) {
+        ret = my_mqtt_gw_submit(&self_addr, &mesh_data);
+    }
+    else {
+        // 目的地址只用于让mesh将数据交给根节点，根节点根据proto交给网关
+        to.mip.ip4.addr = inet_addr(CONFIG_MESH_SERVER_IP);
+        to.mip.port = CONFIG_MESH_SERVER_PORT;
+        MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &to, &mesh_data, MESH_DATA_TODS);
+        ret = mesh_send_data(&to, &mesh_data, MESH_DATA_TODS, NULL, NULL);
+    }
+
+    // 释放申请的内存
+    my_pool_free(ptr);
+    return ret;
+}
+
+esp_err_t my_mqtt_gw_submit(const mesh_addr_t *from, const mesh_data_t *data)
+{
+    const my_mqtt_msg_hdr_t *hdr = (const my_mqtt_msg_hdr_t *)data->data;
+    uint16_t len;
+    mqtt_gw_slot_t *slot = NULL;
+    esp_err_t ret = ESP_OK;
+    bool flush = false;
+
+    if((slot_mutex == NULL) || (data->size < sizeof(my_mqtt_msg_hdr_t))
+        || (hdr->topic_id >= MY_MQTT_TOPIC_NUM) || (hdr->qos > 1)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    len = data->size - sizeof(my_mqtt_msg_hdr_t);
+
+    xSemaphoreTake(slot_mutex, portMAX_DELAY);
+    // 查找同一(节点, topic, qos)且还能放下的批次槽
+    for(uint8_t i = 0; i < MQTT_GW_SLOTS; i++) {
+        mqtt_gw_slot_t *s = &slots[i];
+        if(s->used && !s->full && (s->topic_id == hdr->topic_id) && (s->qos == hdr->qos)
+            && (memcmp(s->src, from->addr, 6) == 0)) {
+            if(s->len + sizeof(uint16_t) + len <= MQTT_GW_SLOT_SIZE) {
+                slot = s;
+            }
+            else {
+                s->full = true;
+                flush = true;
+            }
+            break;
+        }
+    }
+    // 没有可用的批次槽，使用一个空闲的
+    if(slot == NULL) {
+        for(uint8_t i = 0; i < MQTT_GW_SLOTS; i++) {
+            if(!slots[i].used) {
+                slot = &slots[i];
+                slot->used = true;
+                slot->full = false;
+                memcpy(slot->src, from->addr, 6);
+                slot->topic_id = hdr->topic_id;
+                slot->qos = hdr->qos;
+                slot->len = 0;
+                slot->first_time = esp_timer_get_time();
+                break;
+            }
+        }
+    }
+
+    if((slot != NULL) && (slot->len + sizeof(uint16_t) + len <= MQTT_GW_SLOT_SIZE)) {
+        memcpy(slot->buf + slot->len, &len, sizeof(uint16_t));
+        memcpy(slot->buf + slot->len + sizeof(uint16_t), data->data + sizeof(my_mqtt_msg_hdr_t), len);
+        slot->len += sizeof(uint16_t) + len;
+    }
+    else {
+        if((slot != NULL) && (slot->len == 0)) {
+            slot->used = false;
+        }
+        dropped++;
+        ret = ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(slot_mutex);
+
+    if(flush) {
+        xTaskNotifyGive(gw_task_handle);
+    }
+    return ret;
+}
+
+void my_mqtt_gw_recv(const mesh_data_t *data)
+{
+    const my_mqtt_msg_hdr_t *hdr = (const my_mqtt_msg_hdr_t *)data->data;
+
+    if((data->size < sizeof(my_mqtt_msg_hdr_t)) || (hdr->topic_id >= MY_MQTT_TOPIC_NUM)) {
+        ESP_LOGW(MQTT_GW_TAG, "Invalid downlink message");
+        return;
+    }
+    if(gw_handler != NULL) {
+        gw_handler(hdr->topic_id, data->data + sizeof(my_mqtt_msg_hdr_t),
+                   data->size - sizeof(my_mqtt_msg_hdr_t));
+    }
+}
+
+void my_mqtt_gw_set_handler(my_mqtt_gw_handler_t handler)
+{
+    gw_handler = handler;
+}
+
+void my_mqtt_gw_set_online(bool online)
+{
+    is_online = online;
+    if(gw_task_handle != NULL) {
+        xTaskNotifyGive(gw_task_handle);
+    }
+}
+
+void my_mqtt_gw_init(void)
+{
+    if(slot_mutex != NULL) {
+        return;
+    }
+
+    esp_read_mac(self_addr.addr, ESP_MAC_WIFI_STA);
+
+    const esp_mqtt_client_config_t mqtt_cfg = {
+        .uri = CONFIG_MESH_MQTT_BROKER_URI,
+    };
+    // 只创建客户端，根节点获取到IP后在网关任务中启动
+    client = esp_mqtt_client_init(&mqtt_cfg);
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_gw_event_handler, NULL);
+
+    slot_mutex = my_mutex_create(&slot_mutex_mem);
+    // 创建网关任务
+    gw_task_handle = my_task_create(&gw_task_mem, mqtt_gw_task, "mqtt_gw_task",
+                                    CONFIG_MESH_TASK_PRIO_MQTT_GW,
+                                    MY_TASK_CORE(CONFIG_MESH_TASK_CORE_MQTT_GW), NULL);
+}
+
+#endif /* CONFIG_MESH_MQTT_GATEWAY */
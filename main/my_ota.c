@@ -0,0 +1,222 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "my_ota.h"
+#include "my_mesh.h"
+
+#if CONFIG_MESH_OTA
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define OTA_CHUNKS_PER_SECTOR   (MY_OTA_SECTOR_SIZE / MY_OTA_CHUNK_SIZE)
+
+_Static_assert(MY_OTA_SECTOR_SIZE % MY_OTA_CHUNK_SIZE == 0, "chunks must not straddle flash sectors");
+_Static_assert(MY_OTA_FRAME_MAX <= MESH_MPS, "MY_OTA_CHUNK_SIZE too large for one mesh packet");
+_Static_assert(MY_OTA_MAX_CHUNKS <= UINT16_MAX, "CONFIG_MESH_OTA_MAX_KB too large");
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static inline bool ota_bit(const uint8_t *map, uint32_t i);
+static inline void ota_set(uint8_t *map, uint32_t i);
+static uint16_t ota_chunk_len(const my_ota_t *ota, uint16_t chunk);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static inline bool ota_bit(const uint8_t *map, uint32_t i)
+{
+    return (map[i / 8] >> (i % 8)) & 1;
+}
+
+static inline void ota_set(uint8_t *map, uint32_t i)
+{
+    map[i / 8] |= 1 << (i % 8);
+}
+
+// 块的长度，只有最后一个块可能更短
+static uint16_t ota_chunk_len(const my_ota_t *ota, uint16_t chunk)
+{
+    uint32_t offset = (uint32_t)chunk * MY_OTA_CHUNK_SIZE;
+
+    return (ota->size - offset < MY_OTA_CHUNK_SIZE) ? ota->size - offset : MY_OTA_CHUNK_SIZE;
+}
+
+void my_ota_init(my_ota_t *ota, const my_ota_flash_t *flash, uint32_t repair_ms)
+{
+    memset(ota, 0, sizeof(*ota));
+    ota->flash     = flash;
+    ota->repair_us = (int64_t)repair_ms * 1000;
+}
+
+esp_err_t my_ota_begin(my_ota_t *ota, uint32_t id, uint32_t size, int64_t now)
+{
+    if(id == ota->id) {
+        return ESP_OK;
+    }
+    if((id == 0) || (size == 0) || (size > (uint32_t)MY_OTA_MAX_CHUNKS * MY_OTA_CHUNK_SIZE)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ota->id          = id;
+    ota->size        = size;
+    ota->total       = (size + MY_OTA_CHUNK_SIZE - 1) / MY_OTA_CHUNK_SIZE;
+    ota->count       = 0;
+    ota->last_rx     = now;
+    ota->last_status = now;
+    memset(ota->have, 0, sizeof(ota->have));
+    memset(ota->erased, 0, sizeof(ota->erased));
+    return ESP_OK;
+}
+
+esp_err_t my_ota_recv(my_ota_t *ota, const uint8_t *frame, uint16_t len, int64_t now)
+{
+    const my_ota_flash_t *flash = ota->flash;
+    my_ota_data_hdr_t hdr;
+    uint32_t sector;
+    esp_err_t err;
+
+    if(len < sizeof(hdr)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&hdr, frame, sizeof(hdr));
+    if(hdr.type != MESH_CTRL_OTA_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    err = my_ota_begin(ota, hdr.id, hdr.size, now);
+    if(err != ESP_OK) {
+        return err;
+    }
+    if(len == sizeof(hdr)) {
+        // 通告
+        return ESP_ERR_INVALID_STATE;
+    }
+    if((hdr.chunk >= ota->total) || (len - sizeof(hdr) != ota_chunk_len(ota, hdr.chunk))) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if(ota_bit(ota->have, hdr.chunk)) {
+        ota->stats.duplicate++;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 扇区中第一个到达的块写入之前擦除整个扇区，之后同一扇区的块直接写入
+    sector = hdr.chunk / OTA_CHUNKS_PER_SECTOR;
+    if(!ota_bit(ota->erased, sector)) {
+        err = flash->erase(flash->arg, sector * MY_OTA_SECTOR_SIZE, MY_OTA_SECTOR_SIZE);
+        if(err != ESP_OK) {
+            ota->stats.errors++;
+            return err;
+        }
+        ota_set(ota->erased, sector);
+    }
+    err = flash->write(flash->arg, (uint32_t)hdr.chunk * MY_OTA_CHUNK_SIZE, frame + sizeof(hdr), len - sizeof(hdr));
+    if(err != ESP_OK) {
+        ota->stats.errors++;
+        return err;
+    }
+    ota_set(ota->have, hdr.chunk);
+    ota->count++;
+    ota->last_rx = now;
+    ota->stats.received++;
+    return ESP_OK;
+}
+
+bool my_ota_active(const my_ota_t *ota)
+{
+    return ota->id != 0;
+}
+
+bool my_ota_complete(const my_ota_t *ota)
+{
+    return (ota->id != 0) && (ota->count == ota->total);
+}
+
+void my_ota_get_status(const my_ota_t *ota, my_ota_status_t *status)
+{
+    uint16_t base = 0;
+
+    memset(status, 0, sizeof(*status));
+    status->type = MESH_CTRL_OTA_STATUS;
+    status->id   = ota->id;
+    status->done = my_ota_complete(ota);
+    while((base < ota->total) && ota_bit(ota->have, base)) {
+        base++;
+    }
+    status->base = base;
+    for(uint16_t i = 0; (i < MY_OTA_STATUS_BITS) && (base + i < ota->total); i++) {
+        if(!ota_bit(ota->have, base + i)) {
+            ota_set(status->missing, i);
+        }
+    }
+}
+
+bool my_ota_poll(my_ota_t *ota, int64_t now, my_ota_status_t *status)
+{
+    if(!my_ota_active(ota) || my_ota_complete(ota)
+       || (now - ota->last_rx < ota->repair_us) || (now - ota->last_status < ota->repair_us)) {
+        return false;
+    }
+    ota->last_status = now;
+    ota->stats.requests++;
+    my_ota_get_status(ota, status);
+    return true;
+}
+
+esp_err_t my_ota_frame(my_ota_t *ota, uint16_t chunk, uint8_t *frame, uint16_t *len)
+{
+    const my_ota_flash_t *flash = ota->flash;
+    my_ota_data_hdr_t hdr = {
+        .type  = MESH_CTRL_OTA_DATA,
+        .chunk = chunk,
+        .id    = ota->id,
+        .size  = ota->size,
+    };
+    uint16_t data_len;
+    esp_err_t err;
+
+    if(!my_ota_active(ota) || (chunk >= ota->total) || !ota_bit(ota->have, chunk)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    data_len = ota_chunk_len(ota, chunk);
+    err = flash->read(flash->arg, (uint32_t)chunk * MY_OTA_CHUNK_SIZE, frame + sizeof(hdr), data_len);
+    if(err != ESP_OK) {
+        ota->stats.errors++;
+        return err;
+    }
+    memcpy(frame, &hdr, sizeof(hdr));
+    *len = sizeof(hdr) + data_len;
+    return ESP_OK;
+}
+
+void my_ota_announce(const my_ota_t *ota, my_ota_data_hdr_t *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->type = MESH_CTRL_OTA_DATA;
+    hdr->id   = ota->id;
+    hdr->size = ota->size;
+}
+
+uint16_t my_ota_repair(my_ota_t *ota, const my_ota_status_t *status, uint8_t *frame,
+                       my_ota_out_cb_t out, void *arg)
+{
+    uint16_t len, sent = 0;
+
+    if(!my_ota_active(ota) || (status->id != ota->id)) {
+        // 子节点还不知道当前镜像，或者是之前的镜像
+        if(my_ota_active(ota)) {
+            my_ota_announce(ota, (my_ota_data_hdr_t *)frame);
+            out(arg, frame, sizeof(my_ota_data_hdr_t));
+        }
+        return 0;
+    }
+    for(uint16_t i = 0; (i < MY_OTA_STATUS_BITS) && (sent < MY_OTA_REPAIR_BURST); i++) {
+        if(ota_bit(status->missing, i) && (my_ota_frame(ota, status->base + i, frame, &len) == ESP_OK)) {
+            out(arg, frame, len);
+            sent++;
+        }
+    }
+    ota->stats.repaired += sent;
+    return sent;
+}
+
+#endif
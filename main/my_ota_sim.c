@@ -0,0 +1,270 @@
+#include <string.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_ota.h"
+#include "my_mesh.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_OTA
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 固件分发的模拟：每个节点3个子节点的树，每一步每个节点的SoftAP向一个子节点发送一个块，
+// 随机丢包；OTA分区在内存中模拟，数据按偏移生成，写入时检查擦除状态和内容
+#define OTA_SIM_BRANCH      (3)
+#define OTA_SIM_NODES_MAX   (100)       /* 含根节点 */
+#define OTA_SIM_KB          ((CONFIG_MESH_OTA_MAX_KB < 128) ? CONFIG_MESH_OTA_MAX_KB : 128)
+#define OTA_SIM_SIZE        (OTA_SIM_KB * 1024 - 300)   /* 最后一个块不满 */
+#define OTA_SIM_CHUNKS      ((OTA_SIM_SIZE + MY_OTA_CHUNK_SIZE - 1) / MY_OTA_CHUNK_SIZE)
+#define OTA_SIM_SECTORS     ((OTA_SIM_SIZE + MY_OTA_SECTOR_SIZE - 1) / MY_OTA_SECTOR_SIZE)
+#define OTA_SIM_FRAME_MS    (10)        /* 一跳发送一个块的时间 */
+#define OTA_SIM_REPAIR_MS   (500)
+#define OTA_SIM_STEPS       (100000)    /* 模拟的步数上限 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 模拟的OTA分区，只记录状态，数据由偏移生成
+typedef struct {
+    uint8_t  erased[(OTA_SIM_SECTORS + 7) / 8];
+    uint8_t  written[(OTA_SIM_CHUNKS + 7) / 8];
+    uint32_t bad;               /* 写入未擦除或已写入的区域、数据错误的次数 */
+} ota_sim_flash_t;
+// 模拟中的节点，按层次遍历的顺序编号，节点i的父节点为(i - 1) / OTA_SIM_BRANCH
+typedef struct {
+    my_ota_t        ota;
+    my_ota_flash_t  ops;
+    ota_sim_flash_t flash;
+    uint8_t         pending[(OTA_SIM_CHUNKS + 7) / 8];  /* 父节点等待发给本节点的块 */
+    uint8_t         next_child; /* SoftAP轮流发给各子节点 */
+    int64_t         done_at;    /* 收齐的时间(us)，-1为没有收齐 */
+} ota_sim_node_t;
+typedef struct {
+    uint16_t nodes;
+    uint8_t  loss;              /* 丢包率(%) */
+    uint32_t steps;             /* 所有节点收齐的步数 */
+    uint32_t frames;            /* 发出的块数，含重发 */
+    uint32_t requests;          /* 修复请求数 */
+    uint32_t repaired;          /* 修复重发的块数 */
+    uint32_t bad;
+    uint16_t done;
+} ota_sim_result_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static ota_sim_node_t ota_sim[OTA_SIM_NODES_MAX];
+static uint8_t ota_sim_frame[MY_OTA_FRAME_MAX];
+static uint32_t ota_sim_seed;
+static const struct { uint16_t nodes; uint8_t loss; } ota_sim_runs[] = {
+    { 13, 5 }, { 40, 5 }, { 100, 0 }, { 100, 5 }, { 100, 20 },
+};
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static bool ota_sim_lost(uint8_t loss);
+static void ota_sim_run(ota_sim_result_t *res);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static inline uint8_t ota_sim_byte(uint32_t offset)
+{
+    return (uint8_t)((offset * 7) ^ (offset >> 9));
+}
+
+static inline bool ota_sim_bit(const uint8_t *map, uint32_t i)
+{
+    return (map[i / 8] >> (i % 8)) & 1;
+}
+
+static bool ota_sim_lost(uint8_t loss)
+{
+    return my_bench_rand(&ota_sim_seed, 100) < loss;
+}
+
+// 擦除一个扇区，其中的块都变为未写入
+static esp_err_t ota_sim_erase(void *arg, uint32_t offset, uint32_t len)
+{
+    ota_sim_flash_t *flash = arg;
+
+    for(uint32_t c = offset / MY_OTA_CHUNK_SIZE; (c < (offset + len) / MY_OTA_CHUNK_SIZE) && (c < OTA_SIM_CHUNKS); c++) {
+        flash->written[c / 8] &= ~(1 << (c % 8));
+    }
+    flash->erased[offset / MY_OTA_SECTOR_SIZE / 8] |= 1 << (offset / MY_OTA_SECTOR_SIZE % 8);
+    return ESP_OK;
+}
+
+// 与NOR flash相同，只能写入擦除过的区域，同时检查数据
+static esp_err_t ota_sim_write(void *arg, uint32_t offset, const void *data, uint32_t len)
+{
+    ota_sim_flash_t *flash = arg;
+    uint32_t c = offset / MY_OTA_CHUNK_SIZE;
+    const uint8_t *p = data;
+
+    if(!ota_sim_bit(flash->erased, offset / MY_OTA_SECTOR_SIZE) || ota_sim_bit(flash->written, c)) {
+        flash->bad++;
+    }
+    for(uint32_t i = 0; i < len; i++) {
+        if(p[i] != ota_sim_byte(offset + i)) {
+            flash->bad++;
+            break;
+        }
+    }
+    flash->written[c / 8] |= 1 << (c % 8);
+    return ESP_OK;
+}
+
+static esp_err_t ota_sim_read(void *arg, uint32_t offset, void *data, uint32_t len)
+{
+    ota_sim_flash_t *flash = arg;
+    uint8_t *p = data;
+
+    for(uint32_t i = 0; i < len; i++) {
+        p[i] = ota_sim_bit(flash->written, (offset + i) / MY_OTA_CHUNK_SIZE) ? ota_sim_byte(offset + i) : 0xFF;
+    }
+    return ESP_OK;
+}
+
+// 节点收到一个块，新块加入各子节点的待发送位图
+static void ota_sim_deliver(ota_sim_result_t *res, uint16_t node, const uint8_t *frame, uint16_t len, int64_t now)
+{
+    my_ota_data_hdr_t hdr;
+
+    if(my_ota_recv(&ota_sim[node].ota, frame, len, now) != ESP_OK) {
+        return;
+    }
+    memcpy(&hdr, frame, sizeof(hdr));
+    for(uint16_t c = node * OTA_SIM_BRANCH + 1; (c <= node * OTA_SIM_BRANCH + OTA_SIM_BRANCH) && (c < res->nodes); c++) {
+        ota_sim[c].pending[hdr.chunk / 8] |= 1 << (hdr.chunk % 8);
+    }
+    if(my_ota_complete(&ota_sim[node].ota)) {
+        ota_sim[node].done_at = now;
+        res->done++;
+    }
+}
+
+// 修复的块与转发的块一样排队等待SoftAP发送，arg为请求的子节点
+static void ota_sim_out(void *arg, const uint8_t *frame, uint16_t len)
+{
+    ota_sim_node_t *child = arg;
+    my_ota_data_hdr_t hdr;
+
+    memcpy(&hdr, frame, sizeof(hdr));
+    if(len > sizeof(hdr)) {
+        child->pending[hdr.chunk / 8] |= 1 << (hdr.chunk % 8);
+    }
+}
+
+// SoftAP发送一个块：从上次之后的子节点开始，找到第一个有待发送块的子节点
+static void ota_sim_send(ota_sim_result_t *res, uint16_t node, int64_t now)
+{
+    ota_sim_node_t *parent = &ota_sim[node];
+    uint16_t first = node * OTA_SIM_BRANCH + 1;
+    uint16_t len;
+
+    for(uint8_t k = 0; k < OTA_SIM_BRANCH; k++) {
+        uint16_t c = first + (parent->next_child + k) % OTA_SIM_BRANCH;
+        if(c >= res->nodes) {
+            continue;
+        }
+        for(uint16_t chunk = 0; chunk < OTA_SIM_CHUNKS; chunk++) {
+            if(!ota_sim_bit(ota_sim[c].pending, chunk)) {
+                continue;
+            }
+            ota_sim[c].pending[chunk / 8] &= ~(1 << (chunk % 8));
+            parent->next_child = (parent->next_child + k + 1) % OTA_SIM_BRANCH;
+            res->frames++;
+            if(!ota_sim_lost(res->loss) && (my_ota_frame(&parent->ota, chunk, ota_sim_frame, &len) == ESP_OK)) {
+                ota_sim_deliver(res, c, ota_sim_frame, len, now);
+            }
+            return;
+        }
+    }
+}
+
+// 按my_mesh中的处理模拟一次分发，根节点在开始时已下载完整的镜像
+static void ota_sim_run(ota_sim_result_t *res)
+{
+    my_ota_data_hdr_t hdr = { .type = MESH_CTRL_OTA_DATA, .id = 1, .size = OTA_SIM_SIZE };
+    my_ota_status_t status;
+    uint32_t step;
+    int64_t now = 0;
+
+    for(uint16_t i = 0; i < res->nodes; i++) {
+        ota_sim_node_t *node = &ota_sim[i];
+        memset(node, 0, sizeof(*node));
+        node->ops.erase = ota_sim_erase;
+        node->ops.write = ota_sim_write;
+        node->ops.read  = ota_sim_read;
+        node->ops.arg   = &node->flash;
+        node->done_at   = -1;
+        my_ota_init(&node->ota, &node->ops, OTA_SIM_REPAIR_MS);
+    }
+    for(hdr.chunk = 0; hdr.chunk < OTA_SIM_CHUNKS; hdr.chunk++) {
+        uint16_t len = (OTA_SIM_SIZE - hdr.chunk * MY_OTA_CHUNK_SIZE < MY_OTA_CHUNK_SIZE)
+                       ? OTA_SIM_SIZE - hdr.chunk * MY_OTA_CHUNK_SIZE : MY_OTA_CHUNK_SIZE;
+        memcpy(ota_sim_frame, &hdr, sizeof(hdr));
+        for(uint16_t i = 0; i < len; i++) {
+            ota_sim_frame[sizeof(hdr) + i] = ota_sim_byte(hdr.chunk * MY_OTA_CHUNK_SIZE + i);
+        }
+        ota_sim_deliver(res, 0, ota_sim_frame, sizeof(hdr) + len, now);
+    }
+
+    for(step = 1; (step < OTA_SIM_STEPS) && (res->done < res->nodes); step++) {
+        now = (int64_t)step * OTA_SIM_FRAME_MS * 1000;
+        // 从最深的节点开始，本步收到的块下一步才转发
+        for(int i = res->nodes - 1; i >= 0; i--) {
+            ota_sim_send(res, i, now);
+        }
+        for(uint16_t i = 1; i < res->nodes; i++) {
+            if(my_ota_poll(&ota_sim[i].ota, now, &status) && !ota_sim_lost(res->loss)) {
+                my_ota_repair(&ota_sim[(i - 1) / OTA_SIM_BRANCH].ota, &status, ota_sim_frame, ota_sim_out, &ota_sim[i]);
+            }
+        }
+    }
+    res->steps = step;
+    for(uint16_t i = 0; i < res->nodes; i++) {
+        res->requests += ota_sim[i].ota.stats.requests;
+        res->repaired += ota_sim[i].ota.stats.repaired;
+        res->bad      += ota_sim[i].flash.bad;
+    }
+}
+
+/**
+ * 比较逐跳多播与每个节点单独经过根节点下载的时间，
+ * 单独下载时根节点的链路要发送(节点数 - 1)倍的镜像，按这一条链路计算下限
+ */
+void my_ota_sim(void)
+{
+    ota_sim_result_t res;
+    uint8_t depth;
+
+    ota_sim_seed = 1;
+    my_bench_json_begin("mesh_ota", "\"image_bytes\":%u,\"chunks\":%u,\"branch\":%u,\"frame_ms\":%u,\"repair_ms\":%u",
+                        OTA_SIM_SIZE, OTA_SIM_CHUNKS, OTA_SIM_BRANCH, OTA_SIM_FRAME_MS, OTA_SIM_REPAIR_MS);
+    my_bench_json_list("runs");
+    for(uint8_t r = 0; r < MY_BENCH_COUNT(ota_sim_runs); r++) {
+        memset(&res, 0, sizeof(res));
+        res.nodes = ota_sim_runs[r].nodes;
+        res.loss  = ota_sim_runs[r].loss;
+        ota_sim_run(&res);
+        depth = 0;
+        for(uint16_t i = res.nodes - 1; i > 0; i = (i - 1) / OTA_SIM_BRANCH) {
+            depth++;
+        }
+        double tree_s = res.steps * OTA_SIM_FRAME_MS / 1000.0;
+        double unicast_s = (double)(res.nodes - 1) * OTA_SIM_CHUNKS * OTA_SIM_FRAME_MS / 1000.0 / (1 - res.loss / 100.0);
+        ESP_LOGI(MY_BENCH_TAG, "ota %u nodes depth %u loss %u%%: %u done in %.1f s (unicast >= %.1f s), repaired %u, flash errors %u",
+                 res.nodes, depth, res.loss, res.done, tree_s, unicast_s, res.repaired, res.bad);
+        my_bench_json_item("\"nodes\":%u,\"depth\":%u,\"loss_pct\":%u,\"done\":%u,\"tree_s\":%.1f,\"unicast_min_s\":%.1f,"
+                           "\"frames_per_link_chunk\":%.2f,\"requests\":%u,\"repaired\":%u,\"flash_errors\":%u",
+                           res.nodes, depth, res.loss, res.done, tree_s, unicast_s,
+                           (double)res.frames / ((res.nodes - 1) * OTA_SIM_CHUNKS), res.requests, res.repaired, res.bad);
+    }
+    my_bench_json_end();
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "my_parent.h"
+
+#if CONFIG_MESH_PARENT_BALANCE
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static my_parent_cand_t *parent_find(my_parent_t *parent, const uint8_t addr[6], int64_t now);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 查找没有过期的候选
+static my_parent_cand_t *parent_find(my_parent_t *parent, const uint8_t addr[6], int64_t now)
+{
+    for(uint8_t i = 0; i < parent->num; i++) {
+        my_parent_cand_t *cand = &parent->cand[i];
+        if((memcmp(cand->addr, addr, sizeof(cand->addr)) == 0) && (now - cand->seen <= parent->policy.stale_us)) {
+            return cand;
+        }
+    }
+    return NULL;
+}
+
+void my_parent_init(my_parent_t *parent, const my_parent_policy_t *policy)
+{
+    memset(parent, 0, sizeof(*parent));
+    parent->policy = *policy;
+}
+
+void my_parent_observe(my_parent_t *parent, const uint8_t addr[6], int8_t rssi,
+                       const my_parent_load_t *load, int64_t now)
+{
+    my_parent_cand_t *cand = NULL;
+
+    for(uint8_t i = 0; i < parent->num; i++) {
+        if(memcmp(parent->cand[i].addr, addr, sizeof(parent->cand[i].addr)) == 0) {
+            cand = &parent->cand[i];
+            break;
+        }
+    }
+    if(cand == NULL) {
+        if(parent->num < MY_PARENT_CANDS) {
+            cand = &parent->cand[parent->num++];
+        }
+        else {
+            cand = &parent->cand[0];
+            for(uint8_t i = 1; i < parent->num; i++) {
+                if(parent->cand[i].seen < cand->seen) {
+                    cand = &parent->cand[i];
+                }
+            }
+        }
+        memcpy(cand->addr, addr, sizeof(cand->addr));
+    }
+    cand->rssi = rssi;
+    cand->seen = now;
+    cand->load = *load;
+}
+
+uint32_t my_parent_cost(const my_parent_load_t *load)
+{
+    return (uint32_t)load->tx_rate * (100 + load->queue_pct) / 100 + load->children;
+}
+
+const my_parent_cand_t *my_parent_select(my_parent_t *parent, const uint8_t current[6],
+                                         uint16_t my_rate, int64_t now)
+{
+    const my_parent_policy_t *policy = &parent->policy;
+    const my_parent_cand_t *cur;
+    const my_parent_cand_t *best = NULL;
+    uint32_t best_cost = UINT32_MAX;
+    uint32_t cur_cost;
+
+    parent->stats.evaluations++;
+    cur = parent_find(parent, current, now);
+    if(cur == NULL) {
+        parent->pending_count = 0;
+        return NULL;
+    }
+    // 当前父节点发布的负载已包含本节点
+    cur_cost = my_parent_cost(&cur->load);
+
+    for(uint8_t i = 0; i < parent->num; i++) {
+        const my_parent_cand_t *cand = &parent->cand[i];
+        my_parent_load_t after = cand->load;
+        uint32_t cost;
+
+        // 层数更大的可能是本节点的子树，不使用
+        if((cand == cur) || (now - cand->seen > policy->stale_us) || (cand->load.layer > cur->load.layer)
+           || (cand->load.children >= cand->load.capacity) || (cand->rssi < policy->rssi_min)
+           || (cand->rssi + policy->rssi_tolerance < cur->rssi)) {
+            continue;
+        }
+        after.children++;
+        after.tx_rate = (after.tx_rate + my_rate > UINT16_MAX) ? UINT16_MAX : after.tx_rate + my_rate;
+        cost = my_parent_cost(&after);
+        if((cost * 100ULL < (uint64_t)cur_cost * (100 - policy->hysteresis_pct)) && (cost < best_cost)) {
+            best = cand;
+            best_cost = cost;
+        }
+    }
+
+    if(best == NULL) {
+        parent->pending_count = 0;
+        return NULL;
+    }
+    if((parent->pending_count > 0) && (memcmp(parent->pending, best->addr, sizeof(parent->pending)) == 0)) {
+        parent->pending_count++;
+    }
+    else {
+        memcpy(parent->pending, best->addr, sizeof(parent->pending));
+        parent->pending_count = 1;
+    }
+    if((parent->pending_count < policy->confirm)
+       || ((parent->last_switch != 0) && (now - parent->last_switch < policy->hold_us))) {
+        parent->stats.held++;
+        return NULL;
+    }
+    parent->pending_count = 0;
+    parent->last_switch = now;
+    parent->stats.switches++;
+    return best;
+}
+
+#endif
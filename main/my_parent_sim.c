@@ -0,0 +1,190 @@
+#include <string.h>
+#include <stdio.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_parent.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_PARENT_BALANCE
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 父节点选择的模拟：第2层的父节点每隔20m排成一行，第3层的子节点大多集中在一端，
+// 信号强度随距离线性衰减，每次扫描有随机波动；先按信号最强、有空位选择（与ESP-MESH相同），
+// 之后每个周期按负载评估，同一周期内各节点使用周期开始时发布的负载
+#define PARENT_SIM_PARENTS  (6)
+#define PARENT_SIM_CHILDREN (36)
+#define PARENT_SIM_CAP      (10)        /* SoftAP最多的子节点数 */
+#define PARENT_SIM_SPACING  (20)        /* 父节点的间隔(m) */
+#define PARENT_SIM_OWN_RATE (2)         /* 父节点自己每秒产生的数据包数 */
+#define PARENT_SIM_SERVICE  (60)        /* 父节点每秒能转发的数据包数，超过时队列增长 */
+#define PARENT_SIM_NOISE    (4)         /* 信号强度的随机波动(dB) */
+#define PARENT_SIM_ROUNDS   (30)
+#define PARENT_SIM_PERIOD_S (60)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    uint16_t x;                 /* 位置(m) */
+    uint8_t  rate;              /* 每秒产生的数据包数 */
+    uint8_t  parent;
+    my_parent_t state;
+} parent_sim_child_t;
+typedef struct {
+    const char *name;
+    uint8_t  hysteresis_pct;
+    uint8_t  confirm;
+    uint16_t hold_s;
+} parent_sim_policy_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static parent_sim_child_t parent_sim[PARENT_SIM_CHILDREN];
+static uint32_t parent_sim_seed;
+static const parent_sim_policy_t parent_sim_policies[] = {
+    { "no_hysteresis", 0, 1, 0 },
+    { "default", CONFIG_MESH_PARENT_HYSTERESIS_PCT, CONFIG_MESH_PARENT_CONFIRM, CONFIG_MESH_PARENT_HOLD_S },
+};
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static int8_t parent_sim_rssi(uint8_t c, uint8_t p);
+static void parent_sim_loads(my_parent_load_t *loads);
+static uint16_t parent_sim_max(const my_parent_load_t *loads);
+static void parent_sim_format_loads(const my_parent_load_t *loads, char *buf, size_t size);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 子节点c到父节点p的信号强度，不含波动
+static int8_t parent_sim_rssi(uint8_t c, uint8_t p)
+{
+    int d = (int)parent_sim[c].x - p * PARENT_SIM_SPACING;
+
+    return -35 - ((d < 0) ? -d : d) / 2;
+}
+
+// 各父节点发布的负载
+static void parent_sim_loads(my_parent_load_t *loads)
+{
+    memset(loads, 0, sizeof(my_parent_load_t) * PARENT_SIM_PARENTS);
+    for(uint8_t p = 0; p < PARENT_SIM_PARENTS; p++) {
+        loads[p].layer    = 2;
+        loads[p].capacity = PARENT_SIM_CAP;
+        loads[p].tx_rate  = PARENT_SIM_OWN_RATE;
+    }
+    for(uint8_t c = 0; c < PARENT_SIM_CHILDREN; c++) {
+        loads[parent_sim[c].parent].children++;
+        loads[parent_sim[c].parent].tx_rate += parent_sim[c].rate;
+    }
+    for(uint8_t p = 0; p < PARENT_SIM_PARENTS; p++) {
+        uint32_t over = (loads[p].tx_rate > PARENT_SIM_SERVICE) ? loads[p].tx_rate - PARENT_SIM_SERVICE : 0;
+        loads[p].queue_pct = (over * 100 / PARENT_SIM_SERVICE > 100) ? 100 : over * 100 / PARENT_SIM_SERVICE;
+    }
+}
+
+static uint16_t parent_sim_max(const my_parent_load_t *loads)
+{
+    uint16_t max = 0;
+
+    for(uint8_t p = 0; p < PARENT_SIM_PARENTS; p++) {
+        max = (loads[p].tx_rate > max) ? loads[p].tx_rate : max;
+    }
+    return max;
+}
+
+// 各父节点的转发数据包数，输出为JSON数组
+static void parent_sim_format_loads(const my_parent_load_t *loads, char *buf, size_t size)
+{
+    int len = snprintf(buf, size, "[");
+
+    for(uint8_t p = 0; p < PARENT_SIM_PARENTS; p++) {
+        len += snprintf(buf + len, size - len, "%s%u", (p == 0) ? "" : ",", loads[p].tx_rate);
+    }
+    snprintf(buf + len, size - len, "]");
+}
+
+/**
+ * 输出默认选择和按负载选择之后各父节点每秒转发的数据包数，
+ * 以及切换次数，后一半周期的切换次数反映来回切换
+ */
+void my_parent_sim(void)
+{
+    my_parent_load_t before[PARENT_SIM_PARENTS], loads[PARENT_SIM_PARENTS];
+    char before_s[PARENT_SIM_PARENTS * 6 + 3], after_s[PARENT_SIM_PARENTS * 6 + 3];
+    uint8_t addr[6] = { 0x02, 0, 0, 0, 0, 0 };
+
+    my_bench_json_begin("mesh_parent", "\"parents\":%u,\"children\":%u,\"capacity\":%u,\"service\":%u,\"rounds\":%u",
+                        PARENT_SIM_PARENTS, PARENT_SIM_CHILDREN, PARENT_SIM_CAP, PARENT_SIM_SERVICE, PARENT_SIM_ROUNDS);
+    my_bench_json_list("runs");
+    for(uint8_t r = 0; r < MY_BENCH_COUNT(parent_sim_policies); r++) {
+        const parent_sim_policy_t *ps = &parent_sim_policies[r];
+        my_parent_policy_t policy = {
+            .rssi_tolerance = CONFIG_MESH_PARENT_RSSI_TOLERANCE,
+            .rssi_min       = CONFIG_MESH_PARENT_RSSI_MIN,
+            .hysteresis_pct = ps->hysteresis_pct,
+            .confirm        = ps->confirm,
+            .hold_us        = ps->hold_s * 1000000LL,
+            .stale_us       = 2 * PARENT_SIM_PERIOD_S * 1000000LL,
+        };
+        uint32_t switches = 0, late = 0;
+        uint8_t count[PARENT_SIM_PARENTS] = { 0 };
+
+        // 每次使用相同的布局，大约3/4的子节点在最左边两个父节点附近
+        parent_sim_seed = 7;
+        for(uint8_t c = 0; c < PARENT_SIM_CHILDREN; c++) {
+            parent_sim[c].x    = (my_bench_rand(&parent_sim_seed, 4) != 0) ? my_bench_rand(&parent_sim_seed, PARENT_SIM_SPACING * 2)
+                                 : my_bench_rand(&parent_sim_seed, PARENT_SIM_SPACING * PARENT_SIM_PARENTS);
+            parent_sim[c].rate = 1 + my_bench_rand(&parent_sim_seed, 6);
+            my_parent_init(&parent_sim[c].state, &policy);
+            // 信号最强并且有空位的父节点
+            uint8_t best = 0;
+            for(uint8_t p = 1; p < PARENT_SIM_PARENTS; p++) {
+                if((count[best] >= PARENT_SIM_CAP)
+                   || ((count[p] < PARENT_SIM_CAP) && (parent_sim_rssi(c, p) > parent_sim_rssi(c, best)))) {
+                    best = p;
+                }
+            }
+            parent_sim[c].parent = best;
+            count[best]++;
+        }
+        parent_sim_loads(before);
+
+        for(uint16_t round = 1; round <= PARENT_SIM_ROUNDS; round++) {
+            int64_t now = (int64_t)round * PARENT_SIM_PERIOD_S * 1000000;
+            parent_sim_loads(loads);
+            for(uint8_t c = 0; c < PARENT_SIM_CHILDREN; c++) {
+                parent_sim_child_t *child = &parent_sim[c];
+                for(uint8_t p = 0; p < PARENT_SIM_PARENTS; p++) {
+                    int8_t rssi = parent_sim_rssi(c, p) + (int)my_bench_rand(&parent_sim_seed, 2 * PARENT_SIM_NOISE + 1) - PARENT_SIM_NOISE;
+                    if(rssi >= CONFIG_MESH_PARENT_RSSI_MIN) {
+                        addr[5] = p;
+                        my_parent_observe(&child->state, addr, rssi, &loads[p], now);
+                    }
+                }
+                addr[5] = child->parent;
+                const my_parent_cand_t *cand = my_parent_select(&child->state, addr, child->rate, now);
+                if(cand != NULL) {
+                    child->parent = cand->addr[5];
+                    switches++;
+                    late += (round > PARENT_SIM_ROUNDS / 2);
+                }
+            }
+        }
+        parent_sim_loads(loads);
+        ESP_LOGI(MY_BENCH_TAG, "parent %s: busiest parent %u -> %u pkt/s, %u switches (%u in the second half)",
+                 ps->name, parent_sim_max(before), parent_sim_max(loads), switches, late);
+        parent_sim_format_loads(before, before_s, sizeof(before_s));
+        parent_sim_format_loads(loads, after_s, sizeof(after_s));
+        my_bench_json_item("\"policy\":\"%s\",\"before\":%s,\"after\":%s,"
+                           "\"max_before\":%u,\"max_after\":%u,\"switches\":%u,\"late_switches\":%u",
+                           ps->name, before_s, after_s, parent_sim_max(before), parent_sim_max(loads), switches, late);
+    }
+    my_bench_json_end();
+}
+
+#endif
@@ -0,0 +1,193 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_mesh.h"
+
+#include "my_pool.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define POOL_SMALL_SIZE     ((CONFIG_MESH_POOL_SMALL_SIZE + 3) & ~3)
+#define POOL_SMALL_NUM      CONFIG_MESH_POOL_SMALL_NUM
+#define POOL_LARGE_SIZE     ((MESH_MPS + 3) & ~3)
+#define POOL_LARGE_NUM      CONFIG_MESH_POOL_LARGE_NUM
+#define POOL_INDEX_NONE     (0xFFFF)    /* 空闲链表结束 */
+#define POOL_INDEX_MASK     (0xFFFF)
+#define POOL_TAG_INC        (0x10000)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    uint8_t  *base;
+    uint16_t block_size;
+    uint16_t num;
+    /**
+     * 空闲链表头，低16位为第一个空闲块的序号，高16位为版本号。
+     * 每次修改版本号加1，避免CAS的ABA问题。
+     * 空闲块的前2个字节存放下一个空闲块的序号。
+     */
+    uint32_t head;
+    uint32_t free;
+    uint32_t min_free;
+    uint32_t alloc_count;
+    uint32_t alloc_fail;
+} pool_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *POOL_TAG = "pool";
+static uint8_t small_blocks[POOL_SMALL_NUM][POOL_SMALL_SIZE] __attribute__((aligned(4)));
+static uint8_t large_blocks[POOL_LARGE_NUM][POOL_LARGE_SIZE] __attribute__((aligned(4)));
+static pool_t pools[MY_POOL_NUM] = {
+    [MY_POOL_SMALL] = { (uint8_t *)small_blocks, POOL_SMALL_SIZE, POOL_SMALL_NUM },
+    [MY_POOL_LARGE] = { (uint8_t *)large_blocks, POOL_LARGE_SIZE, POOL_LARGE_NUM },
+};
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void *pool_pop(pool_t *pool);
+static void pool_push(pool_t *pool, uint16_t idx);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static void *pool_pop(pool_t *pool)
+{
+    uint32_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    uint32_t next;
+    uint16_t idx;
+    uint32_t free, min;
+
+    do {
+        idx = head & POOL_INDEX_MASK;
+        if(idx == POOL_INDEX_NONE) {
+            return NULL;
+        }
+        // 块可能同时被其他任务取走，此时读到的next无效，但版本号已变，CAS会失败
+        next = ((head + POOL_TAG_INC) & ~POOL_INDEX_MASK)
+               | *(volatile uint16_t *)(pool->base + idx * pool->block_size);
+    } while(!__atomic_compare_exchange_n(&pool->head, &head, next, true,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    __atomic_add_fetch(&pool->alloc_count, 1, __ATOMIC_RELAXED);
+    free = __atomic_sub_fetch(&pool->free, 1, __ATOMIC_RELAXED);
+    min = __atomic_load_n(&pool->min_free, __ATOMIC_RELAXED);
+    while((free < min) && !__atomic_compare_exchange_n(&pool->min_free, &min, free, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    return pool->base + idx * pool->block_size;
+}
+
+static void pool_push(pool_t *pool, uint16_t idx)
+{
+    uint16_t *block = (uint16_t *)(pool->base + idx * pool->block_size);
+    uint32_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    uint32_t next;
+
+    do {
+        *block = head & POOL_INDEX_MASK;
+        next = ((head + POOL_TAG_INC) & ~POOL_INDEX_MASK) | idx;
+    } while(!__atomic_compare_exchange_n(&pool->head, &head, next, true,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    __atomic_add_fetch(&pool->free, 1, __ATOMIC_RELAXED);
+}
+
+void *my_pool_alloc(size_t size)
+{
+    void *ptr;
+
+    for(uint8_t i = 0; i < MY_POOL_NUM; i++) {
+        if(size > pools[i].block_size) {
+            continue;
+        }
+        ptr = pool_pop(&pools[i]);
+        if(ptr != NULL) {
+            return ptr;
+        }
+        // 该类别已用完，尝试更大的块
+        __atomic_add_fetch(&pools[i].alloc_fail, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+void *my_pool_alloc_class(my_pool_class_t cls)
+{
+    void *ptr = pool_pop(&pools[cls]);
+
+    if(ptr == NULL) {
+        __atomic_add_fetch(&pools[cls].alloc_fail, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+my_pool_class_t my_pool_class(size_t size)
+{
+    uint8_t i;
+
+    for(i = 0; (i < MY_POOL_NUM) && (size > pools[i].block_size); i++);
+    return (my_pool_class_t)i;
+}
+
+void my_pool_free(void *ptr)
+{
+    uint8_t *p = ptr;
+
+    if(ptr == NULL) {
+        return;
+    }
+
+    for(uint8_t i = 0; i < MY_POOL_NUM; i++) {
+        pool_t *pool = &pools[i];
+        if((p >= pool->base) && (p < pool->base + pool->num * pool->block_size)) {
+            if((p - pool->base) % pool->block_size != 0) {
+                break;
+            }
+            pool_push(pool, (p - pool->base) / pool->block_size);
+            return;
+        }
+    }
+
+    ESP_LOGE(POOL_TAG, "Free invalid block %p!", ptr);
+}
+
+void my_pool_get_stats(my_pool_class_t cls, my_pool_stats_t *stats)
+{
+    pool_t *pool = &pools[cls];
+
+    stats->block_size = pool->block_size;
+    stats->total      = pool->num;
+    stats->free       = __atomic_load_n(&pool->free, __ATOMIC_RELAXED);
+    stats->min_free   = __atomic_load_n(&pool->min_free, __ATOMIC_RELAXED);
+    stats->alloc_count = __atomic_load_n(&pool->alloc_count, __ATOMIC_RELAXED);
+    stats->alloc_fail = __atomic_load_n(&pool->alloc_fail, __ATOMIC_RELAXED);
+}
+
+uint32_t my_pool_static_size(void)
+{
+    return sizeof(small_blocks) + sizeof(large_blocks);
+}
+
+void my_pool_init(void)
+{
+    for(uint8_t i = 0; i < MY_POOL_NUM; i++) {
+        pool_t *pool = &pools[i];
+
+        // 所有块串成空闲链表
+        for(uint16_t n = 0; n < pool->num; n++) {
+            *(uint16_t *)(pool->base + n * pool->block_size) =
+                (n + 1 < pool->num) ? (n + 1) : POOL_INDEX_NONE;
+        }
+        pool->head = 0;
+        pool->free = pool->num;
+        pool->min_free = pool->num;
+        pool->alloc_count = 0;
+        pool->alloc_fail = 0;
+    }
+}
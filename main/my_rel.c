@@ -0,0 +1,312 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "my_rel.h"
+#include "my_mesh.h"
+
+#if CONFIG_MESH_RELIABLE
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define REL_WINDOW      CONFIG_MESH_RELIABLE_WINDOW
+
+_Static_assert(REL_WINDOW <= MY_REL_SACK_BITS, "CONFIG_MESH_RELIABLE_WINDOW must not exceed the SACK bitmap");
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static inline int16_t rel_diff(uint16_t a, uint16_t b);
+static my_rel_slot_t *rel_tx_oldest(my_rel_tx_t *tx);
+static void rel_tx_expire(my_rel_tx_t *tx, my_rel_slot_t *slot);
+static void rel_tx_out(my_rel_tx_t *tx, my_rel_slot_t *slot, int64_t now, my_rel_out_cb_t out, void *arg);
+static void rel_tx_retransmit(my_rel_tx_t *tx, my_rel_slot_t *slot, int64_t now, my_rel_out_cb_t out, void *arg);
+static my_rel_peer_t *rel_rx_peer(my_rel_rx_t *rx, const uint8_t *addr, uint16_t base, int64_t now);
+static void rel_rx_slide(my_rel_peer_t *peer);
+static void rel_rx_skip(my_rel_rx_t *rx, my_rel_peer_t *peer, uint16_t to);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 序号a - b，回绕后仍然正确，a在b之后时为正
+static inline int16_t rel_diff(uint16_t a, uint16_t b)
+{
+    return (int16_t)(a - b);
+}
+
+void my_rel_tx_init(my_rel_tx_t *tx, uint32_t rto_ms, uint8_t retries)
+{
+    memset(tx, 0, sizeof(*tx));
+    tx->rto_us  = (int64_t)rto_ms * 1000;
+    tx->retries = retries;
+}
+
+// 窗口中序号最早的数据包，窗口为空时返回NULL
+static my_rel_slot_t *rel_tx_oldest(my_rel_tx_t *tx)
+{
+    my_rel_slot_t *oldest = NULL;
+
+    for(uint8_t i = 0; i < REL_WINDOW; i++) {
+        if(tx->slots[i].used && ((oldest == NULL) || (rel_diff(tx->slots[i].seq, oldest->seq) < 0))) {
+            oldest = &tx->slots[i];
+        }
+    }
+    return oldest;
+}
+
+static void rel_tx_expire(my_rel_tx_t *tx, my_rel_slot_t *slot)
+{
+    slot->used = false;
+    tx->inflight--;
+    tx->stats.expired++;
+}
+
+// 加上头部后发送，头部的base为当前窗口中最早的序号
+static void rel_tx_out(my_rel_tx_t *tx, my_rel_slot_t *slot, int64_t now, my_rel_out_cb_t out, void *arg)
+{
+    uint8_t frame[sizeof(my_rel_hdr_t) + MY_REL_PAYLOAD_MAX];
+    my_rel_hdr_t hdr = {
+        .type  = MESH_CTRL_REL_DATA,
+        .retry = slot->retry,
+        .seq   = slot->seq,
+        .base  = rel_tx_oldest(tx)->seq,
+    };
+
+    memcpy(frame, &hdr, sizeof(hdr));
+    memcpy(frame + sizeof(hdr), slot->data, slot->len);
+    slot->sent = now;
+    out(arg, frame, sizeof(hdr) + slot->len);
+}
+
+// 重发一个数据包，超过重试次数时放弃
+static void rel_tx_retransmit(my_rel_tx_t *tx, my_rel_slot_t *slot, int64_t now, my_rel_out_cb_t out, void *arg)
+{
+    if(slot->retry >= tx->retries) {
+        rel_tx_expire(tx, slot);
+        return;
+    }
+    slot->retry++;
+    tx->stats.retransmit++;
+    rel_tx_out(tx, slot, now, out, arg);
+}
+
+esp_err_t my_rel_tx_send(my_rel_tx_t *tx, const uint8_t *data, uint16_t len, int64_t now,
+                         my_rel_out_cb_t out, void *arg)
+{
+    my_rel_slot_t *slot = NULL, *oldest;
+
+    if(len > MY_REL_PAYLOAD_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // 新序号超出窗口时放弃最早的数据包，根节点的位图才能覆盖所有发送中的序号
+    while(((oldest = rel_tx_oldest(tx)) != NULL) && (rel_diff(tx->next_seq, oldest->seq) >= REL_WINDOW)) {
+        rel_tx_expire(tx, oldest);
+    }
+    for(uint8_t i = 0; i < REL_WINDOW; i++) {
+        if(!tx->slots[i].used) {
+            slot = &tx->slots[i];
+            break;
+        }
+    }
+    slot->used  = true;
+    slot->retry = 0;
+    slot->seq   = tx->next_seq++;
+    slot->len   = len;
+    memcpy(slot->data, data, len);
+    tx->inflight++;
+    tx->stats.sent++;
+    rel_tx_out(tx, slot, now, out, arg);
+    return ESP_OK;
+}
+
+void my_rel_tx_ack(my_rel_tx_t *tx, const my_rel_ack_t *ack, int64_t now, my_rel_out_cb_t out, void *arg)
+{
+    int64_t latest = INT64_MIN;     /* 被确认的数据包中最晚的发送时间 */
+    bool acked;
+    int16_t d;
+
+    // 确认了还没有发送的序号，是之前的根节点或本节点重启之前的状态
+    if(rel_diff(ack->next, tx->next_seq) > 0) {
+        return;
+    }
+    tx->stats.acks++;
+    for(uint8_t i = 0; i < REL_WINDOW; i++) {
+        my_rel_slot_t *slot = &tx->slots[i];
+        if(!slot->used) {
+            continue;
+        }
+        d = rel_diff(slot->seq, ack->next);
+        acked = (d < 0) || ((d > 0) && (d <= MY_REL_SACK_BITS) && (ack->sack & (1UL << (d - 1))));
+        if(acked) {
+            latest = (slot->sent > latest) ? slot->sent : latest;
+            slot->used = false;
+            tx->inflight--;
+            tx->stats.acked++;
+        }
+    }
+    // mesh中同一路径上的数据包按顺序到达，更晚发送的已经到达说明更早发送的丢失了
+    for(uint8_t i = 0; i < REL_WINDOW; i++) {
+        my_rel_slot_t *slot = &tx->slots[i];
+        if(slot->used && (slot->sent < latest)) {
+            tx->stats.fast++;
+            rel_tx_retransmit(tx, slot, now, out, arg);
+        }
+    }
+}
+
+void my_rel_tx_poll(my_rel_tx_t *tx, int64_t now, bool all, my_rel_out_cb_t out, void *arg)
+{
+    for(uint8_t i = 0; i < REL_WINDOW; i++) {
+        my_rel_slot_t *slot = &tx->slots[i];
+        if(slot->used && (all || (now - slot->sent >= tx->rto_us))) {
+            rel_tx_retransmit(tx, slot, now, out, arg);
+        }
+    }
+}
+
+void my_rel_tx_flush(my_rel_tx_t *tx, const uint8_t *addr, my_rel_deliver_cb_t cb, void *arg)
+{
+    my_rel_slot_t *slot;
+
+    while((slot = rel_tx_oldest(tx)) != NULL) {
+        cb(arg, addr, slot->data, slot->len);
+        slot->used = false;
+        tx->inflight--;
+    }
+}
+
+void my_rel_rx_init(my_rel_rx_t *rx, uint8_t ack_every, uint32_t ack_delay_ms)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->ack_every    = (ack_every > 0) ? ack_every : 1;
+    rx->ack_delay_us = (int64_t)ack_delay_ms * 1000;
+}
+
+// 查找来源节点，没有时使用空闲的记录或替换最久没有收到数据的节点，从base开始接收
+static my_rel_peer_t *rel_rx_peer(my_rel_rx_t *rx, const uint8_t *addr, uint16_t base, int64_t now)
+{
+    my_rel_peer_t *peer = NULL;
+
+    for(uint16_t i = 0; i < CONFIG_MESH_RELIABLE_PEERS; i++) {
+        my_rel_peer_t *p = &rx->peers[i];
+        if(p->used && (memcmp(p->addr, addr, sizeof(p->addr)) == 0)) {
+            p->last_seen = now;
+            return p;
+        }
+        if((peer == NULL) || (peer->used && (!p->used || (p->last_seen < peer->last_seen)))) {
+            peer = p;
+        }
+    }
+    memset(peer, 0, sizeof(*peer));
+    memcpy(peer->addr, addr, sizeof(peer->addr));
+    peer->used      = true;
+    peer->next      = base;
+    peer->last_seen = now;
+    return peer;
+}
+
+// next已收到，累积确认向前移动到下一个没有收到的序号
+static void rel_rx_slide(my_rel_peer_t *peer)
+{
+    bool received;
+
+    do {
+        received = peer->sack & 1;
+        peer->sack >>= 1;
+        peer->next++;
+    } while(received);
+}
+
+// 发送节点已经放弃to之前的序号，不再等待
+static void rel_rx_skip(my_rel_rx_t *rx, my_rel_peer_t *peer, uint16_t to)
+{
+    int16_t d = rel_diff(to, peer->next);
+
+    if(d > MY_REL_SACK_BITS) {
+        // 位图中的序号都已经跳过
+        rx->stats.skipped += d - __builtin_popcount(peer->sack);
+        peer->next = to;
+        peer->sack = 0;
+        return;
+    }
+    while(rel_diff(to, peer->next) > 0) {
+        rx->stats.skipped++;
+        rel_rx_slide(peer);
+    }
+}
+
+esp_err_t my_rel_rx_recv(my_rel_rx_t *rx, const uint8_t *addr, const uint8_t *frame, uint16_t len,
+                         int64_t now, my_rel_deliver_cb_t deliver, void *arg)
+{
+    my_rel_peer_t *peer;
+    my_rel_hdr_t hdr;
+    esp_err_t err;
+    int16_t d;
+
+    if(len < sizeof(hdr)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&hdr, frame, sizeof(hdr));
+    if(hdr.type != MESH_CTRL_REL_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    peer = rel_rx_peer(rx, addr, hdr.base, now);
+    rel_rx_skip(rx, peer, hdr.base);
+
+    d = rel_diff(hdr.seq, peer->next);
+    if((d < 0) || ((d > 0) && (d <= MY_REL_SACK_BITS) && (peer->sack & (1UL << (d - 1))))) {
+        // 重复的数据包，之前的确认可能丢失了，尽快确认
+        rx->stats.duplicate++;
+        peer->ack_pending = true;
+        peer->ack_due = now;
+        return ESP_OK;
+    }
+    if(d > MY_REL_SACK_BITS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    err = deliver(arg, addr, frame + sizeof(hdr), len - sizeof(hdr));
+    if(err != ESP_OK) {
+        return err;
+    }
+    rx->stats.delivered++;
+    if(d == 0) {
+        rel_rx_slide(peer);
+    }
+    else {
+        // 新出现的空洞立即确认，发送节点可以快速重传
+        if(peer->sack == 0) {
+            peer->ack_due = now;
+        }
+        peer->sack |= 1UL << (d - 1);
+    }
+    if(!peer->ack_pending) {
+        peer->ack_pending = true;
+        peer->ack_due = (d == 0) ? now + rx->ack_delay_us : now;
+    }
+    // 重发的数据包和收到足够多的数据包时尽快确认
+    if((hdr.retry > 0) || (++peer->unacked >= rx->ack_every)) {
+        peer->ack_due = now;
+    }
+    return ESP_OK;
+}
+
+void my_rel_rx_poll(my_rel_rx_t *rx, int64_t now, my_rel_ack_cb_t cb, void *arg)
+{
+    my_rel_ack_t ack = { .type = MESH_CTRL_REL_ACK };
+
+    for(uint16_t i = 0; i < CONFIG_MESH_RELIABLE_PEERS; i++) {
+        my_rel_peer_t *peer = &rx->peers[i];
+        if(!peer->used || !peer->ack_pending || (now < peer->ack_due)) {
+            continue;
+        }
+        ack.next = peer->next;
+        ack.sack = peer->sack;
+        peer->ack_pending = false;
+        peer->unacked = 0;
+        rx->stats.acks++;
+        cb(arg, peer->addr, &ack);
+    }
+}
+
+#endif
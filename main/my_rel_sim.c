@@ -0,0 +1,192 @@
+#include <string.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_rel.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_RELIABLE
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 可靠传输的模拟：一个节点每100ms发送一个数据包，经过多跳到根节点，两个方向独立随机丢包，
+// 中途切换父节点，2s内的数据包全部丢失
+#define REL_SIM_SECONDS     (60)
+#define REL_SIM_DRAIN_MS    (10000)     /* 停止发送后继续运行的时间，等待重发完成 */
+#define REL_SIM_STEP_MS     (10)
+#define REL_SIM_PERIOD_MS   (100)
+#define REL_SIM_DELAY_MS    (40)        /* 单向延时 */
+#define REL_SIM_OUTAGE_MS   (30000)     /* 切换父节点的时间 */
+#define REL_SIM_OUTAGE_LEN  (2000)
+#define REL_SIM_QUEUE       (32)        /* 每个方向在途的数据包上限 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 一个方向的链路，延时固定，按发送顺序到达
+typedef struct {
+    struct {
+        int64_t  due;
+        uint16_t len;
+        uint8_t  data[sizeof(my_rel_hdr_t) + MY_REL_PAYLOAD_MAX];
+    } pkt[REL_SIM_QUEUE];
+    uint16_t head;
+    uint16_t num;
+} rel_sim_link_t;
+typedef struct {
+    my_rel_tx_t    tx;
+    my_rel_rx_t    rx;
+    rel_sim_link_t up;          /* 节点到根节点 */
+    rel_sim_link_t down;        /* 根节点到节点 */
+    int64_t        now;
+    uint8_t        loss;        /* 丢包率(%) */
+    bool           outage;
+    uint32_t       generated;
+    uint32_t       no_ack;      /* 对比：不确认时到达的数据包数 */
+    uint32_t       unique;      /* 根节点交给上行的不同数据包数 */
+    uint32_t       duplicate;   /* 重复交给上行的数据包数 */
+    uint32_t       frames;      /* 节点发出的数据包数，含重发 */
+    uint8_t        seen[(REL_SIM_SECONDS * 1000 / REL_SIM_PERIOD_MS + 7) / 8];
+} rel_sim_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static rel_sim_t rel_sim;
+static uint32_t rel_sim_seed;
+static const uint8_t rel_sim_loss[] = { 0, 5, 10, 20, 30 };
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static bool rel_sim_lost(rel_sim_t *sim);
+static void rel_sim_run(rel_sim_t *sim, uint8_t loss);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static bool rel_sim_lost(rel_sim_t *sim)
+{
+    return sim->outage || (my_bench_rand(&rel_sim_seed, 100) < sim->loss);
+}
+
+static void rel_sim_link_send(rel_sim_t *sim, rel_sim_link_t *link, const void *data, uint16_t len)
+{
+    uint16_t i = (link->head + link->num) % REL_SIM_QUEUE;
+
+    if(rel_sim_lost(sim) || (link->num >= REL_SIM_QUEUE)) {
+        return;
+    }
+    link->pkt[i].due = sim->now + REL_SIM_DELAY_MS * 1000;
+    link->pkt[i].len = len;
+    memcpy(link->pkt[i].data, data, len);
+    link->num++;
+}
+
+// 取出一个已经到达的数据包，没有时返回NULL
+static const uint8_t *rel_sim_link_recv(rel_sim_t *sim, rel_sim_link_t *link, uint16_t *len)
+{
+    uint16_t i = link->head;
+
+    if((link->num == 0) || (link->pkt[i].due > sim->now)) {
+        return NULL;
+    }
+    link->head = (link->head + 1) % REL_SIM_QUEUE;
+    link->num--;
+    *len = link->pkt[i].len;
+    return link->pkt[i].data;
+}
+
+static esp_err_t rel_sim_out(void *arg, const uint8_t *frame, uint16_t len)
+{
+    rel_sim_t *sim = arg;
+
+    sim->frames++;
+    rel_sim_link_send(sim, &sim->up, frame, len);
+    return ESP_OK;
+}
+
+// 根节点交给上行，数据为[num][序号低字节][序号高字节]
+static esp_err_t rel_sim_deliver(void *arg, const uint8_t *addr, const uint8_t *data, uint16_t len)
+{
+    rel_sim_t *sim = arg;
+    uint16_t idx = data[1] | (data[2] << 8);
+
+    if(sim->seen[idx / 8] & (1 << (idx % 8))) {
+        sim->duplicate++;
+    }
+    else {
+        sim->seen[idx / 8] |= 1 << (idx % 8);
+        sim->unique++;
+    }
+    return ESP_OK;
+}
+
+static void rel_sim_ack(void *arg, const uint8_t *addr, const my_rel_ack_t *ack)
+{
+    rel_sim_t *sim = arg;
+
+    rel_sim_link_send(sim, &sim->down, ack, sizeof(*ack));
+}
+
+// 按my_mesh中的调用顺序模拟一种丢包率
+static void rel_sim_run(rel_sim_t *sim, uint8_t loss)
+{
+    static const uint8_t addr[6] = { 0 };
+    const uint8_t *frame;
+    my_rel_ack_t ack;
+    uint16_t len;
+
+    memset(sim, 0, sizeof(*sim));
+    sim->loss = loss;
+    my_rel_tx_init(&sim->tx, CONFIG_MESH_RELIABLE_RTO_MS, CONFIG_MESH_RELIABLE_RETRIES);
+    my_rel_rx_init(&sim->rx, CONFIG_MESH_RELIABLE_WINDOW / 4, CONFIG_MESH_RELIABLE_ACK_DELAY_MS);
+
+    for(uint32_t ms = 0; ms < REL_SIM_SECONDS * 1000 + REL_SIM_DRAIN_MS; ms += REL_SIM_STEP_MS) {
+        sim->now = (int64_t)ms * 1000;
+        sim->outage = (ms >= REL_SIM_OUTAGE_MS) && (ms < REL_SIM_OUTAGE_MS + REL_SIM_OUTAGE_LEN);
+        if((ms < REL_SIM_SECONDS * 1000) && (ms % REL_SIM_PERIOD_MS == 0)) {
+            uint8_t data[3] = { 2, sim->generated & 0xFF, sim->generated >> 8 };
+            sim->no_ack += !rel_sim_lost(sim);
+            sim->generated++;
+            my_rel_tx_send(&sim->tx, data, sizeof(data), sim->now, rel_sim_out, sim);
+        }
+        while((frame = rel_sim_link_recv(sim, &sim->up, &len)) != NULL) {
+            my_rel_rx_recv(&sim->rx, addr, frame, len, sim->now, rel_sim_deliver, sim);
+        }
+        my_rel_rx_poll(&sim->rx, sim->now, rel_sim_ack, sim);
+        while((frame = rel_sim_link_recv(sim, &sim->down, &len)) != NULL) {
+            memcpy(&ack, frame, sizeof(ack));
+            my_rel_tx_ack(&sim->tx, &ack, sim->now, rel_sim_out, sim);
+        }
+        // 连接到新的父节点后立即重发
+        my_rel_tx_poll(&sim->tx, sim->now, ms == REL_SIM_OUTAGE_MS + REL_SIM_OUTAGE_LEN, rel_sim_out, sim);
+    }
+}
+
+/**
+ * 比较不同丢包率下不确认和可靠传输时根节点收到的数据比例，以及重发和确认的开销
+ */
+void my_rel_sim(void)
+{
+    rel_sim_seed = 1;
+    my_bench_json_begin("mesh_reliable", "\"seconds\":%u,\"period_ms\":%u,\"delay_ms\":%u,\"window\":%u,\"outage_ms\":%u",
+                        REL_SIM_SECONDS, REL_SIM_PERIOD_MS, REL_SIM_DELAY_MS, CONFIG_MESH_RELIABLE_WINDOW, REL_SIM_OUTAGE_LEN);
+    my_bench_json_list("runs");
+    for(uint8_t i = 0; i < MY_BENCH_COUNT(rel_sim_loss); i++) {
+        rel_sim_t *sim = &rel_sim;
+        rel_sim_run(sim, rel_sim_loss[i]);
+        ESP_LOGI(MY_BENCH_TAG, "reliable loss %u%%: delivered %u/%u (without acks %u), retransmit %u, acks %u, expired %u",
+                 sim->loss, sim->unique, sim->generated, sim->no_ack, sim->tx.stats.retransmit,
+                 sim->rx.stats.acks, sim->tx.stats.expired);
+        my_bench_json_item("\"loss_pct\":%u,\"generated\":%u,\"no_ack_pct\":%.1f,\"delivered_pct\":%.1f,"
+                           "\"retransmit_pct\":%.1f,\"fast\":%u,\"acks_per_packet\":%.2f,\"suppressed\":%u,\"duplicates\":%u,\"expired\":%u",
+                           sim->loss, sim->generated, 100.0 * sim->no_ack / sim->generated,
+                           100.0 * sim->unique / sim->generated, 100.0 * (sim->frames - sim->generated) / sim->generated,
+                           sim->tx.stats.fast, (double)sim->rx.stats.acks / sim->generated, sim->rx.stats.duplicate, sim->duplicate,
+                           sim->tx.stats.expired);
+    }
+    my_bench_json_end();
+}
+
+#endif
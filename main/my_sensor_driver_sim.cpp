@@ -0,0 +1,145 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "my_bench.h"
+#include "my_sensor_driver.hpp"
+
+#if CONFIG_MESH_BENCH
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// C++驱动层两种读取方式的比较：同样的4个驱动，
+// my_sensor_group::read_all在编译时展开，sif()生成的my_sensorif_t与sensorif任务一样通过函数指针调用
+#define DRIVER_SIM_ROUNDS   CONFIG_MESH_BENCH_ITERATIONS
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+struct driver_sim_accel {
+    int16_t x, y, z;
+};
+
+// 驱动读取的"硬件"，每次读取后变化，读取不会被优化掉
+static volatile uint32_t driver_sim_reg;
+
+struct driver_sim_bin : my_sensor_driver<driver_sim_bin, uint8_t> {
+    static constexpr my_sensor_type_t type = MY_SENSOR_TYPE_BIN;
+    static my_sensor_err_t sample(uint8_t &out) { out = driver_sim_reg & 1; return MY_SENSOR_ERR_OK; }
+};
+
+struct driver_sim_temp : my_sensor_driver<driver_sim_temp, uint16_t> {
+    static my_sensor_err_t sample(uint16_t &out) { out = (uint16_t)driver_sim_reg++; return MY_SENSOR_ERR_OK; }
+};
+
+struct driver_sim_count : my_sensor_driver<driver_sim_count, uint32_t> {
+    static my_sensor_err_t sample(uint32_t &out) { out = driver_sim_reg; return MY_SENSOR_ERR_OK; }
+};
+
+struct driver_sim_acc : my_sensor_driver<driver_sim_acc, driver_sim_accel> {
+    static constexpr my_sensor_type_t type = MY_SENSOR_TYPE_MORE;
+    static my_sensor_err_t sample(driver_sim_accel &out)
+    {
+        uint32_t reg = driver_sim_reg;
+
+        out.x = (int16_t)reg;
+        out.y = (int16_t)(reg >> 8);
+        out.z = (int16_t)(reg >> 16);
+        return MY_SENSOR_ERR_OK;
+    }
+};
+
+typedef my_sensor_group<driver_sim_bin, driver_sim_temp, driver_sim_count, driver_sim_acc> driver_sim_group;
+
+// 与mesh任务打包时相同，只使用数据的内容和长度
+struct driver_sim_sink {
+    uint32_t sum;
+
+    void operator()(uint8_t index, const uint8_t *data, uint8_t len)
+    {
+        sum += index + data[0] + len;
+    }
+};
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *DRIVER_SIM_TAG = MY_BENCH_TAG;
+// 与MY_SENSOR_DRIVER_REGISTER生成的描述相同，放在flash中
+static const my_sensorif_t driver_sim_sifs[] = {
+    driver_sim_bin::sif(), driver_sim_temp::sif(), driver_sim_count::sif(), driver_sim_acc::sif(),
+};
+// sensorif通过链接段中的数组访问描述，编译器看不到其中的函数，这里同样通过volatile指针访问
+static const my_sensorif_t *volatile driver_sim_table = driver_sim_sifs;
+static volatile uint32_t driver_sim_result;
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static int64_t driver_sim_template(void);
+static int64_t driver_sim_fnptr(void);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static int64_t driver_sim_template(void)
+{
+    driver_sim_sink sink = { 0 };
+    int64_t start = esp_timer_get_time();
+
+    for(uint32_t i = 0; i < DRIVER_SIM_ROUNDS; i++) {
+        driver_sim_group::read_all(sink);
+    }
+    driver_sim_result = sink.sum;
+    return esp_timer_get_time() - start;
+}
+
+// 与sensorif任务的循环读取相同，每个sensor调用一次read_default
+static int64_t driver_sim_fnptr(void)
+{
+    driver_sim_sink sink = { 0 };
+    my_sensorif_data_t data;
+    int64_t start = esp_timer_get_time();
+
+    for(uint32_t i = 0; i < DRIVER_SIM_ROUNDS; i++) {
+        const my_sensorif_t *sifs = driver_sim_table;
+        for(uint8_t k = 0; k < driver_sim_group::num; k++) {
+            if(sifs[k].read_default(&data) == MY_SENSOR_ERR_OK) {
+                sink(k, static_cast<const uint8_t *>(data.data), data.num);
+            }
+        }
+    }
+    driver_sim_result = sink.sum;
+    return esp_timer_get_time() - start;
+}
+
+/**
+ * 输出两种方式每轮（读取所有驱动）和每次读取的时间
+ * 两种方式读取的数据和编码相同，差别为函数指针调用、my_sensorif_data_t的传递以及编译器能否内联
+ */
+void my_sensor_driver_sim(void)
+{
+    static const char *names[] = { "template", "fnptr" };
+    int64_t us[2];
+
+    // 预热
+    driver_sim_template();
+    driver_sim_fnptr();
+    us[0] = driver_sim_template();
+    us[1] = driver_sim_fnptr();
+
+    my_bench_json_begin("sensor_driver", "\"drivers\":%u,\"rounds\":%u",
+                        driver_sim_group::num, DRIVER_SIM_ROUNDS);
+    my_bench_json_list("paths");
+    for(uint8_t i = 0; i < 2; i++) {
+        double ns = (double)us[i] * 1000 / DRIVER_SIM_ROUNDS;
+        ESP_LOGI(DRIVER_SIM_TAG, "sensor driver %-8s: %.1f ns/sweep, %.1f ns/read", names[i],
+                 ns, ns / driver_sim_group::num);
+        my_bench_json_item("\"path\":\"%s\",\"ns_per_sweep\":%.1f,\"ns_per_read\":%.1f",
+                           names[i], ns, ns / driver_sim_group::num);
+    }
+    my_bench_json_end();
+}
+
+#endif
@@ -2,141 +2,603 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "my_sensorif.h"
 #include "my_main.h"
+#include "my_mem.h"
+#include "my_dlog.h"
+#if CONFIG_MESH_ADAPTIVE_SAMPLING
+#include "my_congest.h"
+#endif
+#if CONFIG_MESH_BUS
+#include "my_bus.h"
+#endif
+#if CONFIG_MESH_TIME_SYNC
+#include "my_time.h"
+#endif
+#if CONFIG_MESH_SENSOR_CONFIG
+#include "my_config.h"
+#endif
 
 /*******************************************************
  *                Constants
  *******************************************************/
-#define SENSOR_NUM_MAX  (5)
 #define AUTO_READ       (1)
+#define SENSORIF_PERIOD_MS  (1000)  /* 没有拥塞时循环读取的周期，开启CONFIG_MESH_SENSOR_CONFIG时为默认值 */
+#define SENSORIF_READ_GAP_MS    (100)   /* 循环读取时每个sensor之间的间隔 */
+#if CONFIG_MESH_ADAPTIVE_SAMPLING
+#define SENSORIF_SEND_WAIT  (100 / portTICK_PERIOD_MS)  /* 队列满时等待的时间，超时丢弃 */
+#else
+#define SENSORIF_SEND_WAIT  portMAX_DELAY
+#endif
+// 拥塞时或配置了平均次数时聚合多次采样
+#define SENSORIF_AGG        (CONFIG_MESH_ADAPTIVE_SAMPLING || CONFIG_MESH_SENSOR_CONFIG)
+#if SENSORIF_AGG
+#define SENSORIF_AGG_SENSORS    (8)     /* 支持聚合的sensor数，sid更大的sensor只降低频率 */
+#define SENSORIF_AGG_VALUES     (8)     /* 聚合的数值个数，更多的数值只发送最新一次 */
+#endif
+// MY_SENSOR_REGISTER定义的sensor描述数组的起止地址
+#if defined(ESP_PLATFORM)
+#define SENSOR_DESC_START   _my_sensor_desc_start
+#define SENSOR_DESC_END     _my_sensor_desc_end
+#else
+#define SENSOR_DESC_START   __start_my_sensor_desc
+#define SENSOR_DESC_END     __stop_my_sensor_desc
+#endif
+#define SENSOR_NUM          ((uint8_t)(SENSOR_DESC_END - SENSOR_DESC_START))
+#if CONFIG_MESH_BUS
+#define SENSORIF_BUS_TIMEOUT    (500 / portTICK_PERIOD_MS)  /* 等待总线完成的时间 */
+#endif
+#if CONFIG_MESH_SENSOR_CACHE
+#define SENSOR_CACHE_LOCKS  (4)     /* 读取锁的个数，按sid分配，使用同一个锁的sensor依次读取 */
+#endif
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+#if SENSORIF_AGG
+// 聚合模式下一个sensor的累计值，发送时取平均
+typedef struct {
+    uint8_t  count;
+    uint8_t  num;
+    uint16_t sum[SENSORIF_AGG_VALUES];
+    uint8_t  avg[SENSORIF_AGG_VALUES];  /* 发送的平均值，由mesh任务读取 */
+} sensorif_agg_t;
+#endif
 
 /*******************************************************
  *                Variable Definitions
  *******************************************************/
-static my_sensor_t sensors[SENSOR_NUM_MAX] = {0};
-static char sensor_num = 0;
-static uint8_t sensor_id = 1;
+// 由链接脚本(linker.lf)或编译器生成，没有注册sensor时为空数组
+extern const my_sensor_desc_t SENSOR_DESC_START[] __attribute__((weak));
+extern const my_sensor_desc_t SENSOR_DESC_END[] __attribute__((weak));
 static const char *SENSORIF_TAG = "Sensorif";
+MY_TASK_DEFINE(sensorif_task_mem, CONFIG_MESH_TASK_STACK_SENSORIF);
+static TaskHandle_t sensorif_task_handle;
+static portMUX_TYPE event_mux = portMUX_INITIALIZER_UNLOCKED;   /* 事件型sensor的状态 */
+#if CONFIG_MESH_BUS
+// 总线完成通知，每条总线同时最多提交一次
+static QueueHandle_t bus_done;
+MY_QUEUE_DEFINE(bus_done_mem, CONFIG_MESH_BUS_NUM, sizeof(uint8_t));
+static uint8_t bus_pending = 0;     /* 已提交还没有完成的总线数 */
+#endif
+#if SENSORIF_AGG
+static sensorif_agg_t sensor_agg[SENSORIF_AGG_SENSORS];
+#endif
+#if CONFIG_MESH_SENSOR_CACHE
+// 缓存内容由cache_mux保护，cache_lock保证同一sensor同时只有一个读取
+static portMUX_TYPE cache_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t cache_lock[SENSOR_CACHE_LOCKS];
+static my_mutex_mem_t cache_lock_mem[SENSOR_CACHE_LOCKS];
+#if CONFIG_MESH_STATIC_ALLOC
+static StaticSemaphore_t cache_lock_buf[SENSOR_CACHE_LOCKS];
+#endif
+#endif
 
 /*******************************************************
  *                Function Declarations
  *******************************************************/
 static void sensorif_task(void *args);
+static void sensorif_send(uint8_t sid, my_sensorif_data_t *data, bool urgent);
+static TickType_t sensorif_event_poll(TickType_t wake);
+static void sensorif_read_gap(uint32_t gap_ms);
+static void sensorif_publish(uint8_t idx, my_sensorif_data_t *data, uint8_t samples);
+static bool sensorif_on_bus(const my_sensor_desc_t *sensor);
+static bool sensorif_due(uint8_t idx, uint32_t sweep);
+#if CONFIG_MESH_BUS
+static void sensorif_bus_sweep(uint8_t samples, uint32_t sweep);
+#endif
+#if SENSORIF_AGG
+static bool sensorif_aggregate(uint8_t idx, const my_sensorif_data_t *data, uint8_t samples,
+                               my_sensorif_data_t *out);
+#endif
+static const my_sensor_desc_t *sensor_find(uint8_t sid, my_sensor_err_t *err);
+#if CONFIG_MESH_SENSOR_CACHE
+static bool sensor_cache_get(my_sensor_t *state, int64_t max_age_us, uint32_t seq,
+                             my_sensorif_data_t *out);
+static void sensor_cache_put(my_sensor_t *state, my_sensorif_data_t *data, int64_t start);
+#endif
 
 /*******************************************************
  *                Function Definitions
  *******************************************************/
+/**
+ * 向mesh任务队列发送数据，开启自适应采样时队列满等待一段时间后丢弃
+ * urgent为true时放在队列最前面
+ */
+static void sensorif_send(uint8_t sid, my_sensorif_data_t *data, bool urgent)
+{
+    BaseType_t ret;
+
+    data->sid = sid;
+    if(urgent) {
+        ret = xQueueSendToFront(main_get_mesh_queue(), data, SENSORIF_SEND_WAIT);
+    }
+    else {
+        ret = xQueueSend(main_get_mesh_queue(), data, SENSORIF_SEND_WAIT);
+    }
+    if(ret != pdTRUE) {
+    #if CONFIG_MESH_ADAPTIVE_SAMPLING
+        my_congest_drop();
+    #endif
+        MY_DLOGW(SENSORIF_TAG, "Mesh queue full, data dropped!");
+    }
+}
+
+/**
+ * 处理事件型sensor：发送中断通知的变化，去抖时间结束后数值与发送的不同时再发送一次
+ * 参数wake为其他需要唤醒的时间，返回与去抖结束时间中较早的一个
+ */
+static TickType_t sensorif_event_poll(TickType_t wake)
+{
+    my_sensorif_data_t data = { .num = 1 };
+
+    for(uint8_t i = 0; i < SENSOR_NUM; i++) {
+        const my_sensor_desc_t *sensor = &SENSOR_DESC_START[i];
+        my_sensor_t *state = sensor->state;
+        int64_t debounce_us = (int64_t)sensor->sif.debounce_ms * 1000;
+        int64_t now = esp_timer_get_time();
+        bool send = false;
+        uint8_t value;
+        int64_t time;
+
+        if(!sensor->sif.event || !state->valid) {
+            continue;
+        }
+        portENTER_CRITICAL(&event_mux);
+        value = state->event_value;
+        time  = state->event_time;
+        if(state->event_posted) {
+            state->event_posted  = false;
+            state->event_recheck = true;
+            send = true;
+        }
+        else if(state->event_recheck && (now - time >= debounce_us)) {
+            state->event_recheck = false;
+            send = (value != state->event_sent);
+        }
+        portEXIT_CRITICAL(&event_mux);
+
+        if(send) {
+            state->event_sent = value;
+            data.data = &state->event_sent;
+            memcpy(&state->data, &data, sizeof(my_sensorif_data_t));
+            sensorif_send(i + 1, &state->data, false);
+            MY_DLOGI(SENSORIF_TAG, "Event sid %d value %d, %d us after interrupt",
+                     i + 1, value, (int)(esp_timer_get_time() - time));
+        }
+        if(state->event_recheck) {
+            // 去抖结束的时间，向上取整到tick
+            int64_t remain_ms = (time + debounce_us - now + 999) / 1000;
+            TickType_t end = xTaskGetTickCount()
+                             + ((remain_ms > 0) ? (remain_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS : 0);
+            if((int32_t)(end - wake) < 0) {
+                wake = end;
+            }
+        }
+    }
+    return wake;
+}
+
+// 循环读取时sensor之间的间隔，期间有事件时立即处理
+static void sensorif_read_gap(uint32_t gap_ms)
+{
+    TickType_t end = xTaskGetTickCount() + gap_ms / portTICK_PERIOD_MS;
+    TickType_t now = xTaskGetTickCount();
+
+    while((int32_t)(end - now) > 0) {
+        TickType_t wake = sensorif_event_poll(end);
+        if((int32_t)(wake - now) <= 0) {
+            wake = now + 1;
+        }
+        ulTaskNotifyTake(pdTRUE, wake - now);
+        now = xTaskGetTickCount();
+    }
+}
+
+/**
+ * 循环读取到的数据保存到sensor状态中，发送给mesh任务
+ * samples为拥塞控制要求的聚合次数，开启CONFIG_MESH_SENSOR_CONFIG时再乘以配置的平均次数
+ */
+static void sensorif_publish(uint8_t idx, my_sensorif_data_t *data, uint8_t samples)
+{
+    const my_sensor_desc_t *sensor = &SENSOR_DESC_START[idx];
+    bool urgent = false;
+
+    memcpy(&sensor->state->data, data, sizeof(my_sensorif_data_t));
+#if CONFIG_MESH_SENSOR_CONFIG
+    my_report_config_sensor_t cfg;
+    const uint8_t *values = data->data;
+
+    my_config_get_sensor(idx + 1, &cfg);
+    samples = ((uint16_t)samples * cfg.samples > UINT8_MAX) ? UINT8_MAX : samples * cfg.samples;
+    urgent = (cfg.priority != 0);
+    // 超出阈值的数值立即发送，不等待平均
+    for(uint8_t v = 0; (values != NULL) && (v < data->num); v++) {
+        if((values[v] < cfg.low) || (values[v] > cfg.high)) {
+            sensorif_send(idx + 1, &sensor->state->data, true);
+            MY_DLOGW(SENSORIF_TAG, "Sensor %d value %d out of range, sent first", idx + 1, values[v]);
+            return;
+        }
+    }
+#endif
+#if SENSORIF_AGG
+    // 拥塞较重或配置了平均次数时聚合多次采样后发送平均值
+    if((samples > 1) && (idx < SENSORIF_AGG_SENSORS)
+       && (data->num <= SENSORIF_AGG_VALUES) && (data->data != NULL)) {
+        if(sensorif_aggregate(idx, data, samples, data)) {
+            sensorif_send(idx + 1, data, urgent);
+            MY_DLOGW(SENSORIF_TAG, "Send data(5) to mesh queue!");
+        }
+        return;
+    }
+#endif
+    // 向mesh任务队列发送数据
+    sensorif_send(idx + 1, &sensor->state->data, urgent);
+    MY_DLOGW(SENSORIF_TAG, "Send data(5) to mesh queue!");
+}
+
+// 本次循环读取是否读取这个sensor：配置为读取，并且到了每every次读取一次的时候
+static bool sensorif_due(uint8_t idx, uint32_t sweep)
+{
+#if CONFIG_MESH_SENSOR_CONFIG
+    my_report_config_sensor_t cfg;
+
+    my_config_get_sensor(idx + 1, &cfg);
+    return cfg.enabled && ((sweep % cfg.every) == 0);
+#else
+    return true;
+#endif
+}
+
+// 是否由总线调度读取
+static bool sensorif_on_bus(const my_sensor_desc_t *sensor)
+{
+#if CONFIG_MESH_BUS
+    return (sensor->sif.bus != MY_BUS_NONE) && (sensor->sif.bus <= CONFIG_MESH_BUS_NUM)
+           && (sensor->sif.xfer != NULL) && (sensor->sif.decode != NULL);
+#else
+    return false;
+#endif
+}
+
+#if CONFIG_MESH_BUS
+/**
+ * 读取总线上的sensor：每条总线上的传输连成一个链表一次提交，各总线并行执行，
+ * 全部完成后逐个转换并发送，sensor之间没有间隔
+ */
+static void sensorif_bus_sweep(uint8_t samples, uint32_t sweep)
+{
+    my_bus_xfer_t *head[CONFIG_MESH_BUS_NUM] = { NULL };
+    my_bus_xfer_t *tail[CONFIG_MESH_BUS_NUM] = { NULL };
+    my_sensorif_data_t data;
+    uint8_t bus;
+    int64_t start = esp_timer_get_time();
+
+    // 上次超时的总线还在使用传输链表时不能重新提交
+    while((bus_pending > 0) && (xQueueReceive(bus_done, &bus, 0) == pdTRUE)) {
+        bus_pending--;
+    }
+    if(bus_pending > 0) {
+        MY_DLOGW(SENSORIF_TAG, "%d buses still busy, skip", bus_pending);
+        return;
+    }
+
+    for(uint8_t i = 0; i < SENSOR_NUM; i++) {
+        const my_sensor_desc_t *sensor = &SENSOR_DESC_START[i];
+        // 提交时的配置决定是否读取，等待期间修改的配置从下一次开始生效
+        sensor->state->bus_due = sensor->state->valid && !sensor->sif.event && sensorif_on_bus(sensor)
+                                 && sensorif_due(i, sweep);
+        if(!sensor->state->bus_due) {
+            continue;
+        }
+        my_bus_xfer_t *xfer = sensor->sif.xfer;
+        bus = sensor->sif.bus - 1;
+        xfer->next = NULL;
+        xfer->err  = ESP_ERR_TIMEOUT;
+        if(tail[bus] == NULL) {
+            head[bus] = xfer;
+        }
+        else {
+            tail[bus]->next = xfer;
+        }
+        tail[bus] = xfer;
+    }
+    for(bus = 0; bus < CONFIG_MESH_BUS_NUM; bus++) {
+        if((head[bus] != NULL) && (my_bus_submit(bus + 1, head[bus], bus_done) == ESP_OK)) {
+            bus_pending++;
+        }
+    }
+    if(bus_pending == 0) {
+        return;
+    }
+    // 等待所有总线完成，超时的总线下次读取前再检查
+    while((bus_pending > 0) && (xQueueReceive(bus_done, &bus, SENSORIF_BUS_TIMEOUT) == pdTRUE)) {
+        bus_pending--;
+    }
+    if(bus_pending > 0) {
+        MY_DLOGW(SENSORIF_TAG, "Bus sweep timeout, %d buses busy", bus_pending);
+        return;
+    }
+    MY_DLOGI(SENSORIF_TAG, "Bus sweep %d us", (int)(esp_timer_get_time() - start));
+
+    for(uint8_t i = 0; i < SENSOR_NUM; i++) {
+        const my_sensor_desc_t *sensor = &SENSOR_DESC_START[i];
+        if(!sensor->state->bus_due) {
+            continue;
+        }
+        if((sensor->sif.xfer->err != ESP_OK)
+           || (sensor->sif.decode(sensor->sif.xfer, &data) != MY_SENSOR_ERR_OK)) {
+            MY_DLOGW(SENSORIF_TAG, "Sensor %d bus read failed (0x%x)", i + 1, sensor->sif.xfer->err);
+            continue;
+        }
+    #if CONFIG_MESH_SENSOR_CACHE
+        sensor_cache_put(sensor->state, &data, start);
+    #endif
+        sensorif_publish(i, &data, samples);
+    }
+}
+#endif
+
+#if SENSORIF_AGG
+/**
+ * 聚合模式下累计一次采样，累计samples次后输出平均值
+ * 返回true时out为需要发送的数据
+ */
+static bool sensorif_aggregate(uint8_t idx, const my_sensorif_data_t *data, uint8_t samples,
+                               my_sensorif_data_t *out)
+{
+    sensorif_agg_t *agg = &sensor_agg[idx];
+    const uint8_t *values = data->data;
+
+    // 数值个数变化时重新累计
+    if(agg->num != data->num) {
+        memset(agg, 0, sizeof(*agg));
+        agg->num = data->num;
+    }
+    for(uint8_t v = 0; v < data->num; v++) {
+        agg->sum[v] += values[v];
+    }
+    if(++agg->count < samples) {
+        return false;
+    }
+    for(uint8_t v = 0; v < data->num; v++) {
+        agg->avg[v] = (agg->sum[v] + agg->count / 2) / agg->count;
+        agg->sum[v] = 0;
+    }
+    agg->count = 0;
+    out->num  = data->num;
+    out->data = agg->avg;
+    return true;
+}
+#endif
+
 static void sensorif_task(void *args)
 {
     unsigned char i = 0;
     BaseType_t ret;
     my_sensorif_data_t data = {0};
     my_sensorif_ctrl_t ctrl = {0};
+    uint32_t base_ms = SENSORIF_PERIOD_MS;      /* 没有拥塞时的循环读取周期 */
+    uint32_t gap_ms = SENSORIF_READ_GAP_MS;
+    TickType_t period = base_ms / portTICK_PERIOD_MS;
+    TickType_t next_sweep = xTaskGetTickCount() + period;
+    TickType_t wake, now;
+    uint8_t samples = 1;        /* 聚合模式下每次发送的采样次数 */
+    uint32_t sweep = 0;         /* 循环读取的次数，时间同步后为mesh时间中的周期序号 */
+#if CONFIG_MESH_ADAPTIVE_SAMPLING
+    my_congest_level_t level = MY_CONGEST_NONE;
+#endif
 
     while (1)
     {
-        // 从队列中读取数据，看是否需要单独读取某一sensor的数据，等待1s
-        ret = xQueueReceive(main_get_sensorif_queue(), &ctrl, (1000 / portTICK_PERIOD_MS));
+    #if CONFIG_MESH_SENSOR_CONFIG
+        // 远程修改的周期和间隔在下一次循环读取时生效
+        my_report_config_global_t global;
+        my_config_get_global(&global);
+        base_ms = global.period_ms;
+        gap_ms  = global.gap_ms;
+        period  = base_ms / portTICK_PERIOD_MS;
+    #endif
+    #if CONFIG_MESH_ADAPTIVE_SAMPLING
+        // 每升高一级，发送的数据量减半：
+        // 聚合之前加倍采样周期，聚合之后采样周期保持2倍，每次发送的采样次数加倍
+        level = my_congest_update();
+        if(level < MY_CONGEST_HEAVY) {
+            period  = (base_ms << level) / portTICK_PERIOD_MS;
+            samples = 1;
+        }
+        else {
+            uint8_t n = 1 << (level - MY_CONGEST_HEAVY + 1);
+            period = (base_ms << (MY_CONGEST_HEAVY - 1)) / portTICK_PERIOD_MS;
+            if(n != samples) {
+                // 聚合次数变化，丢弃未完成的累计
+                memset(sensor_agg, 0, sizeof(sensor_agg));
+                samples = n;
+            }
+        }
+    #endif
+        // 发送事件型sensor的变化
+        wake = sensorif_event_poll(next_sweep);
+        // 从队列中读取数据，看是否需要单独读取某一sensor的数据，
+        // 等到下一次循环读取或者去抖结束的时间
+        now = xTaskGetTickCount();
+        ret = xQueueReceive(main_get_sensorif_queue(), &ctrl,
+                            ((int32_t)(wake - now) > 0) ? (wake - now) : 0);
         // 从队列获取到消息
         if (ret == pdTRUE) {
-            ESP_LOGI(SENSORIF_TAG, "Some data received from sensorif queue!");
-            for(i = 0; i < SENSOR_NUM_MAX; i++) {
-                if((sensors[i].sid == ctrl.sid) && (sensors[i].valid == true)) {
-                    // 读取信息
-                    sensors[i].sif.read(ctrl.ctrl, &data);
-                    memcpy(&sensors[i].data, &data, sizeof(my_sensorif_data_t));
-                    // 向mesh任务队列发送数据，队列满无限等待
-                    xQueueSend(main_get_mesh_queue(), &sensors[i].data, portMAX_DELAY);
-                    ESP_LOGW(SENSORIF_TAG, "Send data(10) to mesh queue!");
-                    break;
+            if(ctrl.event) {
+                // 中断通知的变化，回到循环开始处立即发送
+                continue;
+            }
+            MY_DLOGI(SENSORIF_TAG, "Some data received from sensorif queue!");
+            const my_sensor_desc_t *sensor = my_sensor_get(ctrl.sid);
+            if((sensor != NULL) && (sensor->state->valid == true)) {
+                // 读取信息，没有控制数据时可以使用缓存
+                if(ctrl.ctrl == NULL) {
+                    my_sensor_read_cached(ctrl.sid, ctrl.max_age_ms, &data);
                 }
+                else {
+                    my_sensor_read(ctrl.sid, ctrl.ctrl, &data);
+                }
+                memcpy(&sensor->state->data, &data, sizeof(my_sensorif_data_t));
+                // 向mesh任务队列发送数据
+                sensorif_send(ctrl.sid, &sensor->state->data, false);
+                MY_DLOGW(SENSORIF_TAG, "Send data(10) to mesh queue!");
             }
         }
-        else { /* 没有从队列获取到消息 */
-        #if AUTO_READ
-            ESP_LOGI(SENSORIF_TAG, "No data received from sensorif queue!");
-            // 循环读取各个sensor的数据并发送给mesh任务，
-            // 由mesh任务发送数据到服务器端
-            for(i = 0; i < SENSOR_NUM_MAX; i++) {
-                if(sensors[i].valid == true){
-                    // 读取sensor获取的数据
-                    sensors[i].sif.read_default(&data);
-                    memcpy(&sensors[i].data, &data, sizeof(my_sensorif_data_t));
-                    // 向mesh任务队列发送数据，队列满无限等待
-                    xQueueSend(main_get_mesh_queue(), &sensors[i].data, portMAX_DELAY);
-                    ESP_LOGW(SENSORIF_TAG, "Send data(5) to mesh queue!");
-                    // 每读完一个sensor延时100ms
-                    vTaskDelay(100 / portTICK_PERIOD_MS);
-                }
+        // 还没到循环读取的时间
+        if((int32_t)(xTaskGetTickCount() - next_sweep) < 0) {
+            continue;
+        }
+    #if AUTO_READ
+        MY_DLOGI(SENSORIF_TAG, "Read all sensors!");
+        // 循环读取各个sensor的数据并发送给mesh任务，
+        // 由mesh任务发送数据到服务器端，事件型sensor不需要读取
+    #if CONFIG_MESH_TIME_SYNC
+        // 时间同步之后使用mesh时间中的周期序号，各节点在同一次循环读取同一组sensor
+        if(my_time_synced()) {
+            uint32_t period_ms = period * portTICK_PERIOD_MS;
+            sweep = (my_time_get_us() / 1000 + period_ms / 2) / period_ms;
+        }
+    #endif
+    #if CONFIG_MESH_BUS
+        // 总线上的sensor一起读取
+        sensorif_bus_sweep(samples, sweep);
+    #endif
+        for(i = 0; i < SENSOR_NUM; i++) {
+            const my_sensor_desc_t *sensor = &SENSOR_DESC_START[i];
+            if((sensor->state->valid == true) && !sensor->sif.event && !sensorif_on_bus(sensor)
+               && sensorif_due(i, sweep)) {
+                // 读取sensor获取的数据，同时更新缓存
+                my_sensor_read_cached(i + 1, 0, &data);
+                sensorif_publish(i, &data, samples);
+                // 每读完一个sensor延时
+                sensorif_read_gap(gap_ms);
             }
-        #endif
         }
+    #endif
+        sweep++;
+        next_sweep = xTaskGetTickCount() + period;
+    #if CONFIG_MESH_TIME_SYNC
+        // 时间同步之后在mesh时间的周期边界上读取，各节点的采样时刻相同
+        if(my_time_synced()) {
+            next_sweep = xTaskGetTickCount() + my_time_until_boundary(period * portTICK_PERIOD_MS);
+        }
+    #endif
     }
     vTaskDelete(NULL);
 }
 
-my_sensor_err_t my_sensor_register(my_sensorif_t *sif, uint8_t *sid)
+static const my_sensor_desc_t *sensor_find(uint8_t sid, my_sensor_err_t *err)
 {
-    my_sensor_err_t ret = MY_SENSOR_ERR_OK;
+    const my_sensor_desc_t *sensor = NULL;
 
-    if((sif == NULL) || (sid == NULL)){
-        ret = MY_SENSOR_ERR_ARGS;
+    if (sid == 0){
+        *err = MY_SENSOR_ERR_ARGS;
+    }
+    else if((sensor = my_sensor_get(sid)) == NULL) {
+        *err = MY_SENSOR_ERR_NOT_FOUND;
     }
-    else if(sensor_num >= SENSOR_NUM_MAX) {
-        *sid = 0;
-        ret = MY_SENSOR_ERR_OVER_CAP;
+    else if(sensor->state->valid == false) {
+        *err = MY_SENSOR_ERR_INVALID;
+        sensor = NULL;
     }
     else {
-        // 寻找剩余的可存放sensor信息的空间
-        for(unsigned char i = 0; i < SENSOR_NUM_MAX; i++) {
-            if(sensors[i].valid == false){
-                sensors[i].valid = true;        /* sensor设置为有效 */
-                sensors[i].sid = sensor_id;     /* 分配一个sensor id */
-                *sid = sensor_id;               /* 传出分配的sid */
-                sensor_num++;                   /* 当前系统的sensor数量+1 */
-                sensor_id++;
-                // 复制sensor的各个参数
-                memcpy(&sensors[i].sif, sif, sizeof(my_sensorif_t));
-                // 执行注册时初始化函数
-                ret = sensors[i].sif.init();
-                break;
-            }
+        *err = MY_SENSOR_ERR_OK;
+    }
+
+    return sensor;
+}
+
+uint8_t my_sensor_get_num(void)
+{
+    return SENSOR_NUM;
+}
+
+void my_sensor_event_from_isr(const my_sensor_desc_t *sensor, uint8_t value)
+{
+    my_sensor_t *state = sensor->state;
+    int64_t now = esp_timer_get_time();
+    my_sensorif_ctrl_t ctrl = {
+        .sid   = sensor - SENSOR_DESC_START + 1,
+        .event = true,
+    };
+    BaseType_t woken = pdFALSE;
+    bool post;
+
+    if(!state->valid || !sensor->sif.event) {
+        return;
+    }
+    // 去抖时间内的变化只记录数值，去抖结束时由sensorif任务检查
+    portENTER_CRITICAL_ISR(&event_mux);
+    state->event_value = value;
+    post = !state->event_posted && (now - state->event_time >= (int64_t)sensor->sif.debounce_ms * 1000);
+    if(post) {
+        state->event_posted = true;
+        state->event_time   = now;
+    }
+    portEXIT_CRITICAL_ISR(&event_mux);
+
+    if(post) {
+        // 放在队列最前面，队列满时由任务在下次唤醒时处理
+        xQueueSendToFrontFromISR(main_get_sensorif_queue(), &ctrl, &woken);
+        // 循环读取的间隔中通过通知唤醒
+        if(sensorif_task_handle != NULL) {
+            vTaskNotifyGiveFromISR(sensorif_task_handle, &woken);
+        }
+        if(woken == pdTRUE) {
+            portYIELD_FROM_ISR();
         }
     }
+}
 
-    return ret;
+const my_sensor_desc_t *my_sensor_get(uint8_t sid)
+{
+    if((sid == 0) || (sid > SENSOR_NUM)) {
+        return NULL;
+    }
+    // sid为sensor在数组中的序号+1
+    return &SENSOR_DESC_START[sid - 1];
 }
 
 my_sensor_err_t my_sensor_unregister(uint8_t sid)
 {
-    my_sensor_err_t ret = MY_SENSOR_ERR_OK;
+    my_sensor_err_t ret;
+    const my_sensor_desc_t *sensor = sensor_find(sid, &ret);
 
-    if (sid == 0){
-        ret = MY_SENSOR_ERR_ARGS;
+    if(sensor != NULL) {
+        // sensor有效，即还没被注销，执行注销程序
+        sensor->state->valid = false;   /* 设置为无效 */
+        sensor->state->cached = false;
+        ret = sensor->sif.exits();
     }
-    else {
-        for(unsigned char i = 0; i < SENSOR_NUM_MAX; i++) {
-            // 找到需要注销的sensor
-            if(sensors[i].sid == sid) {
-                // sensor有效，即还没被注销，执行注销程序
-                if(sensors[i].valid == true) {
-                    sensors[i].valid = false;   /* 设置为无效 */
-                    sensor_num--;               /* sensor数量调整 */
-                    ret = sensors[i].sif.exits();
-                }
-                else {
-                    // 指定的sensor已经注销，不需要额外操作
-                    ret = MY_SENSOR_ERR_OK;
-                }
-                break;
-            }
-            else {
-                ret = MY_SENSOR_ERR_NOT_FOUND;
-            }
-        }
+    else if(ret == MY_SENSOR_ERR_INVALID) {
+        // 指定的sensor已经注销，不需要额外操作
+        ret = MY_SENSOR_ERR_OK;
     }
 
     return ret;
@@ -144,57 +606,117 @@ my_sensor_err_t my_sensor_unregister(uint8_t sid)
 
 my_sensor_err_t my_sensor_read(uint8_t sid, void *in, my_sensorif_data_t *out)
 {
-    my_sensor_err_t ret = MY_SENSOR_ERR_OK;
+    my_sensor_err_t ret;
+    const my_sensor_desc_t *sensor;
 
-    if (sid == 0){
-        ret = MY_SENSOR_ERR_ARGS;
+    // 没有参数时就是默认读取，经过缓存并与进行中的读取合并
+    if(in == NULL) {
+        return my_sensor_read_cached(sid, 0, out);
     }
-    else {
-        for(unsigned char i = 0; i < SENSOR_NUM_MAX; i++) {
-            // 找到对应的sensor
-            if(sensors[i].sid == sid) {
-                if(sensors[i].valid == true) {
-                    // 调用对应的读取函数
-                    ret = sensors[i].sif.read(in, out);
-                }
-                else {
-                    ret = MY_SENSOR_ERR_INVALID;
-                }
-                break;
-            }
-            else {
-                ret = MY_SENSOR_ERR_NOT_FOUND;
-            }
-        }
+    sensor = sensor_find(sid, &ret);
+    if(sensor != NULL) {
+    #if CONFIG_MESH_SENSOR_CACHE
+        // 带参数的读取不使用缓存，但与同一sensor的其他读取一样依次访问硬件
+        SemaphoreHandle_t lock = cache_lock[(sid - 1) % SENSOR_CACHE_LOCKS];
+        xSemaphoreTake(lock, portMAX_DELAY);
+        ret = sensor->sif.read(in, out);
+        xSemaphoreGive(lock);
+    #else
+        // 调用对应的读取函数
+        ret = sensor->sif.read(in, out);
+    #endif
     }
 
     return ret;
 }
 
-my_sensor_err_t my_sensor_write(uint8_t sid, void *args)
+#if CONFIG_MESH_SENSOR_CACHE
+/**
+ * 缓存有效，并且不超过max_age_us或者在seq之后又读取过时，返回缓存的数据
+ * seq为调用者开始等待时的读取次数，之后完成的读取结果都可以使用
+ */
+static bool sensor_cache_get(my_sensor_t *state, int64_t max_age_us, uint32_t seq,
+                             my_sensorif_data_t *out)
 {
-    my_sensor_err_t ret = MY_SENSOR_ERR_OK;
+    bool hit;
 
-    if (sid == 0){
-        ret = MY_SENSOR_ERR_ARGS;
+    portENTER_CRITICAL(&cache_mux);
+    hit = state->cached && ((state->cache_seq != seq)
+                            || (esp_timer_get_time() - state->cache_time <= max_age_us));
+    if(hit) {
+        out->num  = state->cache_num;
+        out->data = state->cache;
     }
-    else {
-        for(unsigned char i = 0; i < SENSOR_NUM_MAX; i++) {
-            // 找到对应的sensor
-            if(sensors[i].sid == sid) {
-                if(sensors[i].valid == true) {
-                    // 调用对应的读取函数
-                    ret = sensors[i].sif.write(args);
-                }
-                else {
-                    ret = MY_SENSOR_ERR_INVALID;
-                }
-                break;
-            }
-            else {
-                ret = MY_SENSOR_ERR_NOT_FOUND;
-            }
-        }
+    portEXIT_CRITICAL(&cache_mux);
+
+    return hit;
+}
+
+/**
+ * 读取的数据复制到缓存中，驱动的数据可能被下一次读取覆盖
+ * 成功时data改为指向缓存，start为开始读取的时间
+ */
+static void sensor_cache_put(my_sensor_t *state, my_sensorif_data_t *data, int64_t start)
+{
+    if((data->data == NULL) || (data->num > MY_SENSOR_CACHE_SIZE)) {
+        return;
+    }
+    portENTER_CRITICAL(&cache_mux);
+    memcpy(state->cache, data->data, data->num);
+    state->cache_num  = data->num;
+    state->cache_time = start;
+    state->cache_seq++;
+    state->cached     = true;
+    portEXIT_CRITICAL(&cache_mux);
+    data->data = state->cache;
+}
+#endif
+
+my_sensor_err_t my_sensor_read_cached(uint8_t sid, uint32_t max_age_ms, my_sensorif_data_t *out)
+{
+    my_sensor_err_t ret;
+    const my_sensor_desc_t *sensor = sensor_find(sid, &ret);
+
+    if(sensor == NULL) {
+        return ret;
+    }
+#if CONFIG_MESH_SENSOR_CACHE
+    my_sensor_t *state = sensor->state;
+    int64_t max_age_us = (int64_t)max_age_ms * 1000;
+    uint32_t seq = state->cache_seq;
+    SemaphoreHandle_t lock = cache_lock[(sid - 1) % SENSOR_CACHE_LOCKS];
+
+    if(sensor_cache_get(state, max_age_us, seq, out)) {
+        return MY_SENSOR_ERR_OK;
+    }
+    // 同一sensor正在读取时在这里等待，读取完成后直接使用它的结果
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(sensor_cache_get(state, max_age_us, seq, out)) {
+        xSemaphoreGive(lock);
+        return MY_SENSOR_ERR_OK;
+    }
+
+    int64_t start = esp_timer_get_time();
+    ret = sensor->sif.read_default(out);
+    if(ret == MY_SENSOR_ERR_OK) {
+        sensor_cache_put(state, out, start);
+    }
+    xSemaphoreGive(lock);
+#else
+    ret = sensor->sif.read_default(out);
+#endif
+
+    return ret;
+}
+
+my_sensor_err_t my_sensor_write(uint8_t sid, void *args)
+{
+    my_sensor_err_t ret;
+    const my_sensor_desc_t *sensor = sensor_find(sid, &ret);
+
+    if(sensor != NULL) {
+        // 调用对应的写入函数
+        ret = sensor->sif.write(args);
     }
 
     return ret;
@@ -202,6 +724,33 @@ my_sensor_err_t my_sensor_write(uint8_t sid, void *args)
 
 void sensorif_init(void)
 {
+#if CONFIG_MESH_SENSOR_CONFIG
+    // 读取保存的配置，sensorif任务开始后立即使用
+    my_config_init();
+#endif
+#if CONFIG_MESH_SENSOR_CACHE
+    for(uint8_t i = 0; i < SENSOR_CACHE_LOCKS; i++) {
+    #if CONFIG_MESH_STATIC_ALLOC
+        cache_lock_mem[i].mutex = &cache_lock_buf[i];
+    #endif
+        cache_lock[i] = my_mutex_create(&cache_lock_mem[i]);
+    }
+#endif
+
+    // 执行各sensor的初始化函数，成功的sensor设置为有效
+    for(uint8_t i = 0; i < SENSOR_NUM; i++) {
+        const my_sensor_desc_t *sensor = &SENSOR_DESC_START[i];
+        sensor->state->valid = (sensor->sif.init() == MY_SENSOR_ERR_OK);
+        ESP_LOGI(SENSORIF_TAG, "Sensor %s sid = %d, %s", sensor->name, i + 1,
+                 sensor->state->valid ? "OK" : "init failed");
+    }
+
+#if CONFIG_MESH_BUS
+    bus_done = my_queue_create(&bus_done_mem);
+#endif
+
     // 创建sensorif任务
-    xTaskCreate(sensorif_task, "sensorif_task", 3072, NULL, 4, NULL);
+    sensorif_task_handle = my_task_create(&sensorif_task_mem, sensorif_task, "sensorif_task",
+                                          CONFIG_MESH_TASK_PRIO_SENSORIF,
+                                          MY_TASK_CORE(CONFIG_MESH_TASK_CORE_SENSORIF), NULL);
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <string.h>
+#include <stdlib.h>
+#include "esp_system.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+
+#include "my_shard.h"
+#include "my_mesh.h"
+
+#if CONFIG_MESH_SHARD
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define SHARD_CHANNEL_MAX   (14)
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *SHARD_TAG = "shard";
+static uint8_t shard_self = 0;      /* 启动时确定，之后不再修改 */
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static uint64_t shard_weight(uint64_t addr, uint8_t shard);
+static uint8_t shard_channel(uint8_t shard);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 地址在某个分片上的随机权重（murmur3的fmix64），地址相近时权重也不相关
+static uint64_t shard_weight(uint64_t addr, uint8_t shard)
+{
+    uint64_t x = addr ^ ((uint64_t)(shard + 1) * 0x9E3779B97F4A7C15ULL);
+
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// CONFIG_MESH_SHARD_CHANNELS中第shard个信道（循环使用），为空时使用CONFIG_MESH_CHANNEL
+static uint8_t shard_channel(uint8_t shard)
+{
+    uint8_t channels[MY_SHARD_MAX];
+    uint8_t num = 0;
+    const char *p = CONFIG_MESH_SHARD_CHANNELS;
+    char *end;
+
+    while((*p != '\0') && (num < MY_SHARD_MAX)) {
+        long ch = strtol(p, &end, 10);
+        if(end == p) {
+            p++;        /* 跳过分隔符 */
+            continue;
+        }
+        if((ch >= 0) && (ch <= SHARD_CHANNEL_MAX)) {
+            channels[num++] = ch;
+        }
+        p = end;
+    }
+    return (num == 0) ? CONFIG_MESH_CHANNEL : channels[shard % num];
+}
+
+uint8_t my_shard_pick(const uint8_t addr[6], uint8_t num)
+{
+    uint64_t v = 0, best_w = 0;
+    uint8_t best = 0;
+
+    for(int i = 0; i < 6; i++) {
+        v = (v << 8) | addr[i];
+    }
+    // 权重最高的分片，增加分片时只有新分片权重最高的地址会移动
+    for(uint8_t s = 0; s < num; s++) {
+        uint64_t w = shard_weight(v, s);
+        if((s == 0) || (w > best_w)) {
+            best_w = w;
+            best = s;
+        }
+    }
+    return best;
+}
+
+void my_shard_load(const uint8_t addr[6], const uint8_t base_id[6], my_shard_t *shard)
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(shard->mesh_id);
+    uint8_t num = CONFIG_MESH_SHARD_NUM;
+    uint8_t self = UINT8_MAX;
+    uint8_t channel = UINT8_MAX;
+
+    memset(shard, 0, sizeof(*shard));
+    memcpy(shard->mesh_id, base_id, sizeof(shard->mesh_id));
+    if(nvs_open(MESH_NVS_KEY_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_u8(handle, MESH_NVS_KEY_SHARD_NUM, &num);
+        nvs_get_u8(handle, MESH_NVS_KEY_SHARD, &self);
+        nvs_get_u8(handle, MESH_NVS_KEY_CHANNEL, &channel);
+        if((nvs_get_blob(handle, MESH_NVS_KEY_MESH_ID, shard->mesh_id, &len) != ESP_OK)
+           || (len != sizeof(shard->mesh_id))) {
+            memcpy(shard->mesh_id, base_id, sizeof(shard->mesh_id));
+        }
+        nvs_close(handle);
+    }
+    if((num == 0) || (num > MY_SHARD_MAX)) {
+        ESP_LOGW(SHARD_TAG, "Invalid shard number %u, using %u", num, CONFIG_MESH_SHARD_NUM);
+        num = CONFIG_MESH_SHARD_NUM;
+    }
+    shard->num = num;
+    if(self < num) {
+        shard->shard    = self;
+        shard->assigned = true;
+    }
+    else {
+        shard->shard = my_shard_pick(addr, num);
+    }
+    shard->mesh_id[5] += shard->shard;
+    shard->channel = (channel <= SHARD_CHANNEL_MAX) ? channel : shard_channel(shard->shard);
+    shard_self = shard->shard;
+
+    ESP_LOGI(SHARD_TAG, "Shard %u/%u (%s), mesh id "MACSTR", channel %u", shard->shard, shard->num,
+             shard->assigned ? "assigned" : "by address", MAC2STR(shard->mesh_id), shard->channel);
+}
+
+uint8_t my_shard_get(void)
+{
+    return shard_self;
+}
+
+#endif
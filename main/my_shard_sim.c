@@ -0,0 +1,59 @@
+#include <string.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_shard.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_SHARD
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 分片分配的模拟：同一厂商连续分配的地址，统计各分片的节点数，
+// 以及分片数加1时改变分片的节点比例，与按地址取模比较
+#define SHARD_SIM_NODES     (1200)
+#define SHARD_SIM_OUI       (0x246F28)
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+/**
+ * 取模时地址连续也能均分，但分片数改变后大部分节点都要换到另一个mesh；
+ * 最高随机权重只移动分给新分片的节点
+ */
+void my_shard_sim(void)
+{
+    uint16_t count[MY_SHARD_MAX + 1];
+    uint8_t addr[6] = { SHARD_SIM_OUI >> 16, (SHARD_SIM_OUI >> 8) & 0xFF, SHARD_SIM_OUI & 0xFF };
+
+    my_bench_json_begin("mesh_shard", "\"nodes\":%u", SHARD_SIM_NODES);
+    my_bench_json_list("runs");
+    for(uint8_t num = 2; num < MY_SHARD_MAX; num *= 2) {
+        uint32_t moved = 0, moved_mod = 0;
+        uint16_t min = UINT16_MAX, max = 0;
+
+        memset(count, 0, sizeof(count));
+        for(uint32_t i = 0; i < SHARD_SIM_NODES; i++) {
+            addr[3] = (uint8_t)(i >> 16);
+            addr[4] = (uint8_t)(i >> 8);
+            addr[5] = (uint8_t)i;
+            uint8_t shard = my_shard_pick(addr, num);
+            count[shard]++;
+            moved += (my_shard_pick(addr, num + 1) != shard);
+            moved_mod += ((i % num) != (i % (num + 1)));    /* 地址的高位相同，取模只取决于i */
+        }
+        for(uint8_t k = 0; k < num; k++) {
+            min = (count[k] < min) ? count[k] : min;
+            max = (count[k] > max) ? count[k] : max;
+        }
+        ESP_LOGI(MY_BENCH_TAG, "shard %u: %u~%u nodes per shard (mean %u), %u -> %u shards moves %u nodes (modulo %u)",
+                 num, min, max, SHARD_SIM_NODES / num, num, num + 1, moved, moved_mod);
+        my_bench_json_item("\"shards\":%u,\"min_nodes\":%u,\"max_nodes\":%u,\"moved_pct\":%.1f,\"ideal_pct\":%.1f,"
+                           "\"modulo_moved_pct\":%.1f",
+                           num, min, max, 100.0 * moved / SHARD_SIM_NODES, 100.0 / (num + 1),
+                           100.0 * moved_mod / SHARD_SIM_NODES);
+    }
+    my_bench_json_end();
+}
+
+#endif
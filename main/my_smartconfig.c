@@ -23,12 +23,17 @@
 #include "my_main.h"
 #include "my_smartconfig.h"
 #include "my_mesh.h"
+#include "my_mem.h"
 
 
 /*******************************************************
  *                Variable Definitions
  *******************************************************/
 static EventGroupHandle_t s_wifi_event_group;
+#if CONFIG_MESH_STATIC_ALLOC
+static StaticEventGroup_t s_wifi_event_group_mem;
+#endif
+MY_TASK_DEFINE(smartconfig_task_mem, CONFIG_MESH_TASK_STACK_SMARTCONFIG);
 
 static const int CONNECTED_BIT = BIT0;
 static const int ESPTOUCH_DONE_BIT = BIT1;
@@ -53,7 +58,8 @@ static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_
     // wifi station start
     if ((event_base == WIFI_EVENT) && (event_id == WIFI_EVENT_STA_START)) {
         // 创建任务，开启smartconfig
-        xTaskCreate(smartconfig_task, "smartconfig_task", 4096, NULL, 3, NULL);
+        my_task_create(&smartconfig_task_mem, smartconfig_task, "smartconfig_task", 3,
+                       tskNO_AFFINITY, NULL);
     }
     // 连上ap，获得ip
     else if ((event_base == IP_EVENT) && (event_id == IP_EVENT_STA_GOT_IP)) {
@@ -165,7 +171,7 @@ static void smartconfig_task(void * parm)
             // 连接成功，开始mesh
             mesh_start();
             // smartconfig结束，删除当前任务
-            vTaskDelete(NULL);
+            my_task_exit();
         }
     }
 }
@@ -173,7 +179,15 @@ static void smartconfig_task(void * parm)
 void smartconfig_start(void)
 {
     ESP_LOGI(TAG, "SmartConfig start!");
-    s_wifi_event_group = xEventGroupCreate();
+    // 事件组只创建一次，再次进入smartconfig时重复使用
+    if(s_wifi_event_group == NULL) {
+    #if CONFIG_MESH_STATIC_ALLOC
+        s_wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_mem);
+    #else
+        s_wifi_event_group = xEventGroupCreate();
+    #endif
+    }
+    xEventGroupClearBits(s_wifi_event_group, CONNECTED_BIT | ESPTOUCH_DONE_BIT | GOT_INFO_BIT);
     // ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     if(netif_sta == NULL){
@@ -0,0 +1,331 @@
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mesh.h"
+
+#include "my_time.h"
+#include "my_mesh.h"
+#include "my_capture.h"
+#include "my_dlog.h"
+#if CONFIG_MESH_TIME_NTP
+#include "esp_sntp.h"
+#endif
+
+#if CONFIG_MESH_TIME_SYNC
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define TIME_TICK_US        (1000 * 1000LL)         /* 定时器周期 */
+#define TIME_PERIOD         CONFIG_MESH_TIME_SYNC_PERIOD    /* 滤波器填满之后的请求周期(s) */
+#define TIME_LOST           (TIME_PERIOD * 4)       /* 超过这个时间(s)没有收到响应则失去同步 */
+#define TIME_DRIFT_PPM      (50)                    /* 两个节点之间时钟漂移的上限 */
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *TIME_TAG = "time";
+static esp_timer_handle_t time_timer = NULL;
+// 以下变量在esp_timer任务、mesh接收任务和事件任务中使用，由time_mux保护
+static portMUX_TYPE time_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t time_offset = 0;     /* mesh时间 - 本地时间 */
+static uint8_t stratum = MY_TIME_STRATUM_NONE;
+static bool utc = false;
+static my_time_filter_t filter;
+static mesh_addr_t parent;
+static bool parent_valid = false;
+static uint8_t req_seq = 0;         /* 最近一次请求的序号 */
+static uint32_t req_wait = 0;       /* 距下次请求的秒数 */
+static uint32_t lost_wait = 0;      /* 距上次收到响应的秒数 */
+#if CONFIG_MESH_TIME_NTP
+static bool ntp_started = false;
+#endif
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void time_timer_cb(void *arg);
+static void time_reply(const mesh_addr_t *from, my_time_msg_t *msg, int64_t now);
+static void time_update(const mesh_addr_t *from, const my_time_msg_t *msg, int64_t t4);
+#if CONFIG_MESH_TIME_NTP
+static void time_ntp_synced(struct timeval *tv);
+#endif
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+void my_time_filter_reset(my_time_filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+}
+
+bool my_time_filter_add(my_time_filter_t *filter, int64_t t1, int64_t t2, int64_t t3, int64_t t4,
+                        int64_t *offset, int64_t *delay)
+{
+    uint8_t best = filter->next;
+    int64_t best_err = INT64_MAX;
+
+    filter->offset[filter->next] = ((t2 - t1) + (t3 - t4)) / 2;
+    filter->delay[filter->next]  = (t4 - t1) - (t3 - t2);
+    filter->time[filter->next]   = t4;
+    if((filter->floor == 0) || (filter->delay[filter->next] < filter->floor)) {
+        filter->floor = (filter->delay[filter->next] > 0) ? filter->delay[filter->next] : 1;
+    }
+    filter->next = (filter->next + 1) % MY_TIME_FILTER_SIZE;
+    if(filter->num < MY_TIME_FILTER_SIZE) {
+        filter->num++;
+    }
+
+    // 时间差的误差不超过往返延时的一半，较早的结果再加上之后可能的漂移
+    for(uint8_t i = 0; i < filter->num; i++) {
+        int64_t err = filter->delay[i] / 2 + (t4 - filter->time[i]) * TIME_DRIFT_PPM / 1000000;
+        if(err < best_err) {
+            best_err = err;
+            best = i;
+        }
+    }
+    if(delay != NULL) {
+        *delay = filter->delay[best];
+    }
+    if(filter->delay[best] > filter->floor * 2) {
+        filter->floor += filter->floor / 4;
+        return false;
+    }
+    *offset = filter->offset[best];
+    return true;
+}
+
+// 每秒执行一次：根节点保持参考，其他节点按周期向父节点发送请求
+static void time_timer_cb(void *arg)
+{
+    my_time_msg_t msg = { .type = MESH_CTRL_TIME_REQ };
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)&msg,
+        .size  = sizeof(msg),
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+    mesh_addr_t to;
+    bool send = false, lost = false;
+
+    if(esp_mesh_is_root()) {
+        // 根节点为参考，保持原来的时间差，根节点切换时mesh时间仍然连续
+        portENTER_CRITICAL(&time_mux);
+        stratum = 0;
+        portEXIT_CRITICAL(&time_mux);
+        return;
+    }
+
+    portENTER_CRITICAL(&time_mux);
+    if((stratum != MY_TIME_STRATUM_NONE) && (++lost_wait >= TIME_LOST)) {
+        stratum = MY_TIME_STRATUM_NONE;
+        my_time_filter_reset(&filter);
+        lost = true;
+    }
+    if(parent_valid && ((req_wait == 0) || (--req_wait == 0))) {
+        // 滤波器填满之前每秒请求一次，尽快同步
+        req_wait = (filter.num < MY_TIME_FILTER_SIZE) ? 1 : TIME_PERIOD;
+        msg.seq = ++req_seq;
+        to = parent;
+        send = true;
+    }
+    portEXIT_CRITICAL(&time_mux);
+
+    if(lost) {
+        ESP_LOGW(TIME_TAG, "No response from parent in %d s, time sync lost", TIME_LOST);
+    }
+    if(send) {
+        msg.t1 = esp_timer_get_time();
+        MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, &to, &mesh_data, MESH_DATA_P2P);
+        // 直接发送，不经过发送队列：排队的时间会计入单程延时，使偏移产生误差
+        esp_mesh_send(&to, &mesh_data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+    }
+}
+
+void my_time_init(void)
+{
+    const esp_timer_create_args_t time_timer_args = {
+        .callback = &time_timer_cb,
+        .name = "time-sync"
+    };
+
+    if(time_timer != NULL) {
+        return;
+    }
+    my_time_filter_reset(&filter);
+    ESP_ERROR_CHECK(esp_timer_create(&time_timer_args, &time_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(time_timer, TIME_TICK_US));
+}
+
+void my_time_parent_changed(void)
+{
+    mesh_addr_t addr;
+    bool root = esp_mesh_is_root();
+    bool valid = (mesh_get_parent_addr(&addr) == ESP_OK);
+
+    portENTER_CRITICAL(&time_mux);
+    parent = addr;
+    parent_valid = valid;
+    // 之前的结果是到原来父节点的路径上测得的，丢弃后立即重新请求；
+    // 时间差保持不变，在新的父节点响应之前mesh时间仍然可用
+    my_time_filter_reset(&filter);
+    req_wait = 0;
+    lost_wait = 0;
+    if(root) {
+        stratum = 0;
+    }
+    else if(stratum == 0) {
+        stratum = MY_TIME_STRATUM_NONE;
+    }
+    portEXIT_CRITICAL(&time_mux);
+}
+
+#if CONFIG_MESH_TIME_NTP
+// SNTP更新了系统时间，根节点把mesh时间校准为UTC
+static void time_ntp_synced(struct timeval *tv)
+{
+    struct timeval now;
+    int64_t offset, step;
+
+    if(!esp_mesh_is_root()) {
+        return;
+    }
+    // 平滑调整模式下tv为服务器时间，使用调整后的系统时间
+    gettimeofday(&now, NULL);
+    offset = (int64_t)now.tv_sec * 1000000 + now.tv_usec - esp_timer_get_time();
+    portENTER_CRITICAL(&time_mux);
+    step = offset - time_offset;
+    time_offset = offset;
+    utc = true;
+    portEXIT_CRITICAL(&time_mux);
+    ESP_LOGI(TIME_TAG, "SNTP synced, mesh time stepped %lld ms", (long long)(step / 1000));
+}
+#endif
+
+void my_time_set_online(bool online)
+{
+#if CONFIG_MESH_TIME_NTP
+    // 断开期间SNTP继续按周期重试，不需要停止
+    if(!online || ntp_started) {
+        return;
+    }
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, CONFIG_MESH_TIME_NTP_SERVER);
+    sntp_set_time_sync_notification_cb(time_ntp_synced);
+    sntp_init();
+    ntp_started = true;
+    ESP_LOGI(TIME_TAG, "SNTP started, server %s", CONFIG_MESH_TIME_NTP_SERVER);
+#endif
+}
+
+int64_t my_time_get_us(void)
+{
+    int64_t offset;
+
+    portENTER_CRITICAL(&time_mux);
+    offset = time_offset;
+    portEXIT_CRITICAL(&time_mux);
+    return esp_timer_get_time() + offset;
+}
+
+bool my_time_synced(void)
+{
+    return stratum != MY_TIME_STRATUM_NONE;
+}
+
+bool my_time_is_utc(void)
+{
+    return utc;
+}
+
+TickType_t my_time_until_boundary(uint32_t period_ms)
+{
+    int64_t period = (int64_t)period_ms * 1000;
+    int64_t tick = portTICK_PERIOD_MS * 1000;
+    int64_t wait = period - ((my_time_get_us() % period) + period) % period;
+
+    return (TickType_t)((wait + tick - 1) / tick);
+}
+
+// 子节点的请求，t2在收到时记录，t3在发送前记录
+static void time_reply(const mesh_addr_t *from, my_time_msg_t *msg, int64_t now)
+{
+    mesh_data_t mesh_data = {
+        .data  = (uint8_t *)msg,
+        .size  = sizeof(*msg),
+        .proto = MESH_PROTO_BIN,
+        .tos   = MESH_TOS_P2P,
+    };
+
+    portENTER_CRITICAL(&time_mux);
+    msg->type    = MESH_CTRL_TIME_RESP;
+    msg->stratum = stratum;
+    msg->utc     = utc;
+    msg->t2      = now + time_offset;
+    portEXIT_CRITICAL(&time_mux);
+    msg->t3 = my_time_get_us();
+    MY_CAPTURE_FRAME(MY_CAPTURE_TX, NULL, from, &mesh_data, MESH_DATA_P2P);
+    // t3已经填写，同样不经过发送队列
+    esp_mesh_send(from, &mesh_data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+}
+
+// 父节点的响应，只使用最近一次请求的响应
+static void time_update(const mesh_addr_t *from, const my_time_msg_t *msg, int64_t t4)
+{
+    int64_t offset, delay, step = 0;
+    uint8_t last;
+    bool valid;
+
+    if(msg->stratum == MY_TIME_STRATUM_NONE) {
+        // 父节点还没有同步
+        return;
+    }
+    portENTER_CRITICAL(&time_mux);
+    if(!parent_valid || (memcmp(from->addr, parent.addr, sizeof(parent.addr)) != 0)
+       || (msg->seq != req_seq)) {
+        portEXIT_CRITICAL(&time_mux);
+        return;
+    }
+    req_seq++;
+    valid = my_time_filter_add(&filter, msg->t1, msg->t2, msg->t3, t4, &offset, &delay);
+    if(valid) {
+        step = offset - time_offset;
+        time_offset = offset;
+    }
+    last = stratum;
+    stratum = msg->stratum + 1;
+    utc = msg->utc;
+    lost_wait = 0;
+    portEXIT_CRITICAL(&time_mux);
+
+    if(last == MY_TIME_STRATUM_NONE) {
+        ESP_LOGI(TIME_TAG, "Synced to parent, stratum %d%s, step %lld us, delay %lld us",
+                 msg->stratum + 1, msg->utc ? " (UTC)" : "", (long long)step, (long long)delay);
+    }
+    else {
+        MY_DLOGD(TIME_TAG, "Offset step %d us, delay %d us", (int32_t)step, (int32_t)delay);
+    }
+}
+
+void my_time_recv(const mesh_addr_t *from, const mesh_data_t *data)
+{
+    // 尽早记录收到的时间
+    int64_t now = esp_timer_get_time();
+    my_time_msg_t msg;
+
+    if(data->size < sizeof(msg)) {
+        return;
+    }
+    memcpy(&msg, data->data, sizeof(msg));
+    if(msg.type == MESH_CTRL_TIME_REQ) {
+        time_reply(from, &msg, now);
+    }
+    else if(msg.type == MESH_CTRL_TIME_RESP) {
+        time_update(from, &msg, now);
+    }
+}
+
+#endif
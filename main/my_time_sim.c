@@ -0,0 +1,157 @@
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_time.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_TIME_SYNC
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 时间同步的模拟：根节点下4条6层的链，每个节点的时钟有随机的初始值和漂移，
+// 每跳两个方向的延时独立随机，偶尔有排队
+#define TIME_SIM_LAYERS     (6)         /* 根节点以下的层数 */
+#define TIME_SIM_BRANCHES   (4)
+#define TIME_SIM_SECONDS    (600)
+#define TIME_SIM_WARMUP     (60)        /* 开始统计误差的时间(s) */
+#define TIME_SIM_DRIFT_PPM  (40)        /* 时钟漂移范围(±ppm) */
+#define TIME_SIM_DELAY_US   (2000)      /* 单向的最小延时 */
+#define TIME_SIM_JITTER_US  (3000)      /* 单向延时的随机部分 */
+#define TIME_SIM_QUEUE_US   (30000)     /* 排队时增加的延时上限，1/8的数据包排队 */
+#define TIME_SIM_PROC_US    (2000)      /* 父节点收到请求到发送响应的时间上限 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef struct {
+    int64_t  boot;          /* 真实时间为0时的本地时间(us) */
+    int32_t  ppm;
+    int64_t  offset;        /* 逐跳补偿延时的时间差 */
+    int64_t  offset_ow;     /* 对比：直接使用父节点发送响应时的时间，不补偿延时 */
+    bool     synced;
+    uint32_t next;          /* 下次请求的时间(s) */
+    my_time_filter_t filter;
+} time_sim_node_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+// [0]为根节点，[1 + branch * TIME_SIM_LAYERS + layer - 1]为各链上的节点
+static time_sim_node_t time_sim[1 + TIME_SIM_BRANCHES * TIME_SIM_LAYERS];
+static uint32_t time_sim_seed;
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static int64_t time_sim_delay(void);
+static int64_t time_sim_local(const time_sim_node_t *node, int64_t t);
+static void time_sim_exchange(time_sim_node_t *node, const time_sim_node_t *parent, int64_t t);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 单向延时
+static int64_t time_sim_delay(void)
+{
+    int64_t delay = TIME_SIM_DELAY_US + my_bench_rand(&time_sim_seed, TIME_SIM_JITTER_US);
+
+    if(my_bench_rand(&time_sim_seed, 8) == 0) {
+        delay += my_bench_rand(&time_sim_seed, TIME_SIM_QUEUE_US);
+    }
+    return delay;
+}
+
+// 节点在真实时间t的本地时间
+static int64_t time_sim_local(const time_sim_node_t *node, int64_t t)
+{
+    return node->boot + t + t * node->ppm / 1000000;
+}
+
+// 子节点在真实时间t向父节点请求一次，两种方法使用同一次交换
+static void time_sim_exchange(time_sim_node_t *node, const time_sim_node_t *parent, int64_t t)
+{
+    int64_t d1 = time_sim_delay();
+    int64_t proc = 100 + my_bench_rand(&time_sim_seed, TIME_SIM_PROC_US);
+    int64_t d2 = time_sim_delay();
+    int64_t t1 = time_sim_local(node, t);
+    int64_t t2 = time_sim_local(parent, t + d1) + parent->offset;
+    int64_t t3 = time_sim_local(parent, t + d1 + proc) + parent->offset;
+    int64_t t4 = time_sim_local(node, t + d1 + proc + d2);
+
+    my_time_filter_add(&node->filter, t1, t2, t3, t4, &node->offset, NULL);
+    node->offset_ow = time_sim_local(parent, t + d1 + proc) + parent->offset_ow - t4;
+}
+
+/**
+ * 按my_time的方法模拟TIME_SIM_SECONDS秒，滤波器填满之前每秒请求一次，
+ * 之后每CONFIG_MESH_TIME_SYNC_PERIOD秒一次。预热之后每秒比较各节点与根节点的mesh时间，
+ * 输出每层误差的平均值和最大值，并与不补偿延时的方法比较
+ */
+void my_time_sim(void)
+{
+    double sum[TIME_SIM_LAYERS] = { 0 }, sum_ow[TIME_SIM_LAYERS] = { 0 };
+    int64_t max[TIME_SIM_LAYERS] = { 0 }, max_ow[TIME_SIM_LAYERS] = { 0 };
+    uint32_t samples = (TIME_SIM_SECONDS - TIME_SIM_WARMUP) * TIME_SIM_BRANCHES;
+    time_sim_node_t *root = &time_sim[0];
+
+    time_sim_seed = 1;
+    memset(time_sim, 0, sizeof(time_sim));
+    for(uint8_t i = 0; i < MY_BENCH_COUNT(time_sim); i++) {
+        time_sim[i].boot = my_bench_rand(&time_sim_seed, 10 * 1000000);
+        time_sim[i].ppm  = (int32_t)my_bench_rand(&time_sim_seed, 2 * TIME_SIM_DRIFT_PPM + 1) - TIME_SIM_DRIFT_PPM;
+        my_time_filter_reset(&time_sim[i].filter);
+    }
+    root->synced = true;
+
+    for(uint32_t sec = 0; sec < TIME_SIM_SECONDS; sec++) {
+        for(uint8_t b = 0; b < TIME_SIM_BRANCHES; b++) {
+            for(uint8_t l = 0; l < TIME_SIM_LAYERS; l++) {
+                time_sim_node_t *node = &time_sim[1 + b * TIME_SIM_LAYERS + l];
+                const time_sim_node_t *parent = (l == 0) ? root : (node - 1);
+                // 各节点的请求时间错开
+                int64_t t = sec * 1000000LL + (b * TIME_SIM_LAYERS + l) * 10000;
+
+                if(!parent->synced || (sec < node->next)) {
+                    continue;
+                }
+                time_sim_exchange(node, parent, t);
+                node->synced = true;
+                node->next = sec + ((node->filter.num < MY_TIME_FILTER_SIZE) ? 1 : CONFIG_MESH_TIME_SYNC_PERIOD);
+            }
+        }
+        if(sec < TIME_SIM_WARMUP) {
+            continue;
+        }
+        // 在两次请求之间比较，包含两次同步之间的漂移
+        int64_t t = sec * 1000000LL + 500000;
+        for(uint8_t b = 0; b < TIME_SIM_BRANCHES; b++) {
+            for(uint8_t l = 0; l < TIME_SIM_LAYERS; l++) {
+                const time_sim_node_t *node = &time_sim[1 + b * TIME_SIM_LAYERS + l];
+                int64_t local = time_sim_local(node, t), ref = time_sim_local(root, t);
+                int64_t err = llabs(local + node->offset - ref);
+                int64_t err_ow = llabs(local + node->offset_ow - ref);
+                sum[l] += err;
+                sum_ow[l] += err_ow;
+                max[l] = (err > max[l]) ? err : max[l];
+                max_ow[l] = (err_ow > max_ow[l]) ? err_ow : max_ow[l];
+            }
+        }
+    }
+
+    for(uint8_t l = 0; l < TIME_SIM_LAYERS; l++) {
+        ESP_LOGI(MY_BENCH_TAG, "time sync layer %u: skew avg %.0f us max %lld us, without delay compensation avg %.0f us max %lld us",
+                 l + 2, sum[l] / samples, (long long)max[l], sum_ow[l] / samples, (long long)max_ow[l]);
+    }
+    my_bench_json_begin("time_sync", "\"branches\":%u,\"seconds\":%u,\"period_s\":%u,\"drift_ppm\":%u",
+                        TIME_SIM_BRANCHES, TIME_SIM_SECONDS, CONFIG_MESH_TIME_SYNC_PERIOD, TIME_SIM_DRIFT_PPM);
+    my_bench_json_list("layers");
+    for(uint8_t l = 0; l < TIME_SIM_LAYERS; l++) {
+        my_bench_json_item("\"layer\":%u,\"avg_us\":%.0f,\"max_us\":%lld,\"one_way_avg_us\":%.0f,\"one_way_max_us\":%lld",
+                           l + 2, sum[l] / samples, (long long)max[l], sum_ow[l] / samples, (long long)max_ow[l]);
+    }
+    my_bench_json_end();
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "my_txq.h"
+#include "my_pool.h"
+
+#if CONFIG_MESH_TXQ
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define TXQ_BACKOFF_MAX     (16)    /* 连续失败次数的上限，避免移位溢出 */
+#define TXQ_DEST_MAX        (CONFIG_MESH_TXQ_LEN - CONFIG_MESH_TXQ_LEN / 4)   /* 一个目的地址最多的数据包数 */
+// 队列中的数据包长时间占用内存块，每个类别留给其他模块的块数：
+// 小块留给发送前的打包（sensor数据先打包到一个小块，再由mesh_send_data复制到队列中）、
+// MQTT网关和控制消息；大块留给接收缓冲区和发送任务组帧（聚合帧、OTA修复）
+#define TXQ_SMALL_RESERVE   (4)
+#define TXQ_LARGE_RESERVE   (2)
+#define TXQ_SMALL_MAX       (CONFIG_MESH_POOL_SMALL_NUM - TXQ_SMALL_RESERVE)
+#define TXQ_LARGE_MAX       (CONFIG_MESH_POOL_LARGE_NUM - TXQ_LARGE_RESERVE)
+
+_Static_assert(CONFIG_MESH_POOL_SMALL_NUM > TXQ_SMALL_RESERVE, "CONFIG_MESH_POOL_SMALL_NUM too small for the transmit queue");
+_Static_assert(CONFIG_MESH_POOL_LARGE_NUM > TXQ_LARGE_RESERVE, "CONFIG_MESH_POOL_LARGE_NUM too small for the transmit queue");
+_Static_assert(CONFIG_MESH_TXQ_LEN <= TXQ_SMALL_MAX + TXQ_LARGE_MAX,
+               "CONFIG_MESH_TXQ_LEN exceeds the pool blocks the transmit queue may hold");
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static bool txq_retryable(esp_err_t err);
+static int txq_dest_find(my_txq_t *txq, const mesh_addr_t *to);
+static my_txq_item_t *txq_oldest(my_txq_t *txq, uint8_t dest);
+static void txq_complete(my_txq_t *txq, my_txq_item_t *item, esp_err_t result,
+                         my_txq_result_t *results, uint16_t *num);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// ESP-MESH暂时无法发送，稍后可能成功的错误
+static bool txq_retryable(esp_err_t err)
+{
+    return (err == ESP_ERR_MESH_QUEUE_FULL) || (err == ESP_ERR_MESH_NO_MEMORY)
+           || (err == ESP_ERR_MESH_TIMEOUT) || (err == ESP_ERR_MESH_DISCONNECTED);
+}
+
+// 查找或分配目的地址，优先使用已有的（保留它的重试状态），已满时返回-1
+static int txq_dest_find(my_txq_t *txq, const mesh_addr_t *to)
+{
+    int idle = -1;
+
+    for(int i = 0; i < CONFIG_MESH_TXQ_DESTS; i++) {
+        my_txq_dest_t *dest = &txq->dests[i];
+        if((to == NULL) ? dest->to_root : (!dest->to_root && (memcmp(&dest->addr, to, sizeof(*to)) == 0))) {
+            return i;
+        }
+        if((dest->pending == 0) && (idle < 0)) {
+            idle = i;
+        }
+    }
+    if(idle >= 0) {
+        my_txq_dest_t *dest = &txq->dests[idle];
+        memset(dest, 0, sizeof(*dest));
+        dest->to_root = (to == NULL);
+        if(to != NULL) {
+            dest->addr = *to;
+        }
+    }
+    return idle;
+}
+
+// 发往某个目的地址的最早提交的数据包
+static my_txq_item_t *txq_oldest(my_txq_t *txq, uint8_t dest)
+{
+    my_txq_item_t *oldest = NULL;
+
+    for(int i = 0; i < CONFIG_MESH_TXQ_LEN; i++) {
+        my_txq_item_t *item = &txq->items[i];
+        if(item->used && (item->dest == dest)
+           && ((oldest == NULL) || ((int32_t)(item->seq - oldest->seq) < 0))) {
+            oldest = item;
+        }
+    }
+    return oldest;
+}
+
+// 释放数据包，需要通知提交者时记录到results中
+static void txq_complete(my_txq_t *txq, my_txq_item_t *item, esp_err_t result,
+                         my_txq_result_t *results, uint16_t *num)
+{
+    if(item->done != NULL) {
+        my_txq_result_t *out = &results[(*num)++];
+        out->done   = item->done;
+        out->arg    = item->arg;
+        out->result = result;
+    }
+    my_pool_free(item->data.data);
+    txq->blocks[item->cls]--;
+    txq->dests[item->dest].pending--;
+    txq->stats.depth--;
+    memset(item, 0, sizeof(*item));
+}
+
+void my_txq_init(my_txq_t *txq, uint32_t retry_ms, uint32_t retry_max_ms, uint32_t ttl_ms)
+{
+    memset(txq, 0, sizeof(*txq));
+    txq->retry_us     = (int64_t)retry_ms * 1000;
+    txq->retry_max_us = (int64_t)retry_max_ms * 1000;
+    txq->ttl_us       = (int64_t)ttl_ms * 1000;
+}
+
+esp_err_t my_txq_submit(my_txq_t *txq, const mesh_addr_t *to, const mesh_data_t *data, int flag,
+                        int64_t now, my_txq_done_cb_t done, void *arg)
+{
+    static const uint16_t block_max[MY_POOL_NUM] = {
+        [MY_POOL_SMALL] = TXQ_SMALL_MAX,
+        [MY_POOL_LARGE] = TXQ_LARGE_MAX,
+    };
+    my_pool_class_t cls = my_pool_class(data->size);
+    my_txq_item_t *item = NULL;
+    int dest;
+
+    for(int i = 0; i < CONFIG_MESH_TXQ_LEN; i++) {
+        if(!txq->items[i].used) {
+            item = &txq->items[i];
+            break;
+        }
+    }
+    dest = (item == NULL) ? -1 : txq_dest_find(txq, to);
+    // 留出一部分给其他目的地址，一个地址停住时不会占满整个队列
+    if((dest < 0) || (txq->dests[dest].pending >= TXQ_DEST_MAX)) {
+        txq->stats.full++;
+        return ESP_ERR_NO_MEM;
+    }
+    // 只使用能放下的最小类别，不占用留给其他模块的块
+    if((cls == MY_POOL_NUM) || (txq->blocks[cls] >= block_max[cls])) {
+        txq->stats.full++;
+        return ESP_ERR_NO_MEM;
+    }
+    item->data = *data;
+    item->data.data = my_pool_alloc_class(cls);
+    if(item->data.data == NULL) {
+        memset(item, 0, sizeof(*item));
+        txq->stats.full++;
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(item->data.data, data->data, data->size);
+    item->used   = true;
+    item->cls    = cls;
+    item->dest   = dest;
+    item->seq    = txq->next_seq++;
+    item->flag   = flag | MESH_DATA_NONBLOCK;
+    item->expire = now + txq->ttl_us;
+    item->done   = done;
+    item->arg    = arg;
+
+    txq->dests[dest].pending++;
+    txq->blocks[cls]++;
+    txq->stats.submitted++;
+    if(++txq->stats.depth > txq->stats.depth_max) {
+        txq->stats.depth_max = txq->stats.depth;
+    }
+    return ESP_OK;
+}
+
+int64_t my_txq_poll(my_txq_t *txq, int64_t now, my_txq_send_t send, void *arg,
+                    my_txq_result_t *results, uint16_t *num)
+{
+    int64_t next = INT64_MAX;
+
+    // 每个数据包最多完成一次，不超过CONFIG_MESH_TXQ_LEN个
+    *num = 0;
+
+    // 放弃超时的数据包
+    for(int i = 0; i < CONFIG_MESH_TXQ_LEN; i++) {
+        my_txq_item_t *item = &txq->items[i];
+        if(item->used && (now >= item->expire)) {
+            txq->stats.expired++;
+            txq_complete(txq, item, ESP_ERR_TIMEOUT, results, num);
+        }
+    }
+
+    // 各目的地址按顺序发送，遇到需要重试的错误时停止这个地址，不影响其他地址
+    for(uint8_t d = 0; d < CONFIG_MESH_TXQ_DESTS; d++) {
+        my_txq_dest_t *dest = &txq->dests[d];
+        my_txq_item_t *item;
+
+        while((dest->pending > 0) && (now >= dest->retry_at) && ((item = txq_oldest(txq, d)) != NULL)) {
+            esp_err_t err = send(arg, dest->to_root ? NULL : &dest->addr, &item->data, item->flag);
+            if(err == ESP_OK) {
+                dest->backoff  = 0;
+                dest->retry_at = 0;
+                txq->stats.sent++;
+                txq_complete(txq, item, ESP_OK, results, num);
+            }
+            else if(txq_retryable(err)) {
+                int64_t delay = txq->retry_us << dest->backoff;
+                if(delay > txq->retry_max_us) {
+                    delay = txq->retry_max_us;
+                }
+                if(dest->backoff < TXQ_BACKOFF_MAX) {
+                    dest->backoff++;
+                }
+                dest->retry_at = now + delay;
+                txq->stats.retries++;
+            }
+            else {
+                txq->stats.failed++;
+                txq_complete(txq, item, err, results, num);
+            }
+        }
+    }
+
+    // 下次需要发送或放弃的时间
+    for(int i = 0; i < CONFIG_MESH_TXQ_LEN; i++) {
+        const my_txq_item_t *item = &txq->items[i];
+        if(item->used) {
+            int64_t at = txq->dests[item->dest].retry_at;
+            if(item->expire < at) {
+                at = item->expire;
+            }
+            if(at < next) {
+                next = at;
+            }
+        }
+    }
+    return next;
+}
+
+void my_txq_notify(const my_txq_result_t *results, uint16_t num)
+{
+    for(uint16_t i = 0; i < num; i++) {
+        results[i].done(results[i].arg, results[i].result);
+    }
+}
+
+void my_txq_kick(my_txq_t *txq, int64_t now)
+{
+    for(int i = 0; i < CONFIG_MESH_TXQ_DESTS; i++) {
+        txq->dests[i].backoff  = 0;
+        txq->dests[i].retry_at = now;
+    }
+}
+
+void my_txq_get_stats(const my_txq_t *txq, my_txq_stats_t *stats)
+{
+    *stats = txq->stats;
+}
+
+#endif
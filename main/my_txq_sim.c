@@ -0,0 +1,217 @@
+#include <string.h>
+#include "esp_log.h"
+
+#include "my_bench.h"
+#include "my_txq.h"
+#include "my_mesh.h"
+
+#if CONFIG_MESH_BENCH && CONFIG_MESH_TXQ
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+// 异步发送队列的模拟：发送任务每10ms产生一个数据包，一半发往根节点（经过父节点），
+// 另一半轮流发往3个子节点；根节点方向在2s时停住一段时间（ESP-MESH的队列一直满），
+// 其他时间每次发送有少量概率遇到队列满。比较直接阻塞发送和使用发送队列时
+// 生产者被阻塞的时间、各方向数据包交给ESP-MESH的延时和丢弃数
+#define TXQ_SIM_STEP_US     (1000)
+#define TXQ_SIM_PERIOD_US   (10000)
+#define TXQ_SIM_PACKETS     (1000)      /* 共10s */
+#define TXQ_SIM_CHILDREN    (3)
+#define TXQ_SIM_STALL_AT_US (2000000)
+#define TXQ_SIM_BUSY_PCT    (2)         /* 没有停住时遇到队列满的概率 */
+#define TXQ_SIM_BUSY_US     (2000)      /* 阻塞发送遇到队列满时等待的时间 */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 一个方向（根节点或子节点）的结果
+typedef struct {
+    uint32_t sent;
+    uint32_t dropped;
+    int64_t  latency_sum;       /* 产生到交给ESP-MESH的时间(us) */
+    int64_t  latency_max;
+} txq_sim_dir_t;
+typedef struct {
+    int64_t  now;
+    int64_t  stall_end;         /* 根节点方向恢复的时间(us) */
+    int64_t  block_max;         /* 生产者一次被阻塞的最长时间(us) */
+    uint32_t retries;
+    txq_sim_dir_t dir[2];       /* 0为根节点，1为子节点 */
+} txq_sim_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static txq_sim_t txq_sim;
+static my_txq_t txq_sim_q;
+static my_txq_result_t txq_sim_results[CONFIG_MESH_TXQ_LEN];
+static uint32_t txq_sim_seed;
+static const uint16_t txq_sim_stall_ms[] = { 500, 3000, 8000 };
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static esp_err_t txq_sim_result(txq_sim_t *sim, bool to_root);
+static void txq_sim_record(txq_sim_t *sim, bool to_root, int64_t latency);
+static void txq_sim_blocking(txq_sim_t *sim);
+static void txq_sim_queued(txq_sim_t *sim);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 第k个数据包发往根节点（to为NULL）时返回true，否则为第几个子节点
+static bool txq_sim_to_root(uint32_t k, mesh_addr_t *to)
+{
+    memset(to, 0, sizeof(*to));
+    to->addr[0] = 0x02;
+    to->addr[5] = (k / 2) % TXQ_SIM_CHILDREN;
+    return (k % 2) == 0;
+}
+
+// 模拟ESP-MESH的发送结果，根节点方向停住期间队列一直满
+static esp_err_t txq_sim_result(txq_sim_t *sim, bool to_root)
+{
+    if(to_root && (sim->now >= TXQ_SIM_STALL_AT_US) && (sim->now < sim->stall_end)) {
+        return ESP_ERR_MESH_QUEUE_FULL;
+    }
+    return (my_bench_rand(&txq_sim_seed, 100) < TXQ_SIM_BUSY_PCT) ? ESP_ERR_MESH_QUEUE_FULL : ESP_OK;
+}
+
+static void txq_sim_record(txq_sim_t *sim, bool to_root, int64_t latency)
+{
+    txq_sim_dir_t *dir = &sim->dir[to_root ? 0 : 1];
+
+    if(latency < 0) {
+        dir->dropped++;
+        return;
+    }
+    dir->sent++;
+    dir->latency_sum += latency;
+    if(latency > dir->latency_max) {
+        dir->latency_max = latency;
+    }
+}
+
+static esp_err_t txq_sim_send(void *arg, const mesh_addr_t *to, const mesh_data_t *data, int flag)
+{
+    esp_err_t err = txq_sim_result(arg, to == NULL);
+
+    if(err != ESP_OK) {
+        ((txq_sim_t *)arg)->retries++;
+    }
+    return err;
+}
+
+// 数据包中保存产生的时间
+static void txq_sim_done(void *arg, esp_err_t result)
+{
+    int64_t produced = (intptr_t)arg & ~(intptr_t)1;
+    bool to_root = ((intptr_t)arg & 1) == 0;
+
+    txq_sim_record(&txq_sim, to_root, (result == ESP_OK) ? txq_sim.now - produced : -1);
+}
+
+// 直接调用阻塞的esp_mesh_send：停住或队列满时等待，之后的数据包都要等这次发送完成
+static void txq_sim_blocking(txq_sim_t *sim)
+{
+    int64_t free_at = 0;
+    mesh_addr_t to;
+
+    for(uint32_t k = 0; k < TXQ_SIM_PACKETS; k++) {
+        int64_t produced = (int64_t)k * TXQ_SIM_PERIOD_US;
+        bool to_root = txq_sim_to_root(k, &to);
+
+        sim->now = (produced > free_at) ? produced : free_at;
+        int64_t start = sim->now;
+        while(txq_sim_result(sim, to_root) != ESP_OK) {
+            sim->now = (to_root && (sim->now >= TXQ_SIM_STALL_AT_US) && (sim->now < sim->stall_end))
+                       ? sim->stall_end : sim->now + TXQ_SIM_BUSY_US;
+        }
+        free_at = sim->now;
+        if(free_at - start > sim->block_max) {
+            sim->block_max = free_at - start;
+        }
+        txq_sim_record(sim, to_root, free_at - produced);
+    }
+}
+
+// 提交到发送队列，发送队列任务在下一个需要发送的时间被唤醒
+static void txq_sim_queued(txq_sim_t *sim)
+{
+    int64_t next = INT64_MAX;
+    uint8_t buf[MESH_SENSOR_DATA_SIZE(1)] = { 1, 0 };
+    mesh_data_t data = { .data = buf, .size = sizeof(buf), .proto = MESH_PROTO_HTTP, .tos = MESH_TOS_P2P };
+    mesh_addr_t to;
+    uint32_t k = 0;
+    uint16_t num;
+    int64_t end = (int64_t)TXQ_SIM_PACKETS * TXQ_SIM_PERIOD_US + CONFIG_MESH_TXQ_TTL_MS * 1000LL + TXQ_SIM_STEP_US;
+
+    my_txq_init(&txq_sim_q, CONFIG_MESH_TXQ_RETRY_MS, CONFIG_MESH_TXQ_RETRY_MAX_MS, CONFIG_MESH_TXQ_TTL_MS);
+    for(sim->now = 0; sim->now < end; sim->now += TXQ_SIM_STEP_US) {
+        if((k < TXQ_SIM_PACKETS) && (sim->now >= (int64_t)k * TXQ_SIM_PERIOD_US)) {
+            bool to_root = txq_sim_to_root(k, &to);
+            // 产生的时间是TXQ_SIM_PERIOD_US的整数倍，最低位记录方向
+            void *arg = (void *)(intptr_t)(sim->now | !to_root);
+            if(my_txq_submit(&txq_sim_q, to_root ? NULL : &to, &data, MESH_DATA_TODS, sim->now,
+                             txq_sim_done, arg) != ESP_OK) {
+                txq_sim_record(sim, to_root, -1);
+            }
+            else {
+                next = sim->now;
+            }
+            k++;
+        }
+        if(sim->now >= next) {
+            next = my_txq_poll(&txq_sim_q, sim->now, txq_sim_send, sim, txq_sim_results, &num);
+            my_txq_notify(txq_sim_results, num);
+        }
+    }
+}
+
+/**
+ * 比较阻塞发送和使用发送队列时生产者被阻塞的最长时间，以及根节点方向停住时
+ * 两个方向交给ESP-MESH的数据包数、延时和丢弃数
+ */
+void my_txq_sim(void)
+{
+    my_bench_json_begin("mesh_txq", "\"packets\":%u,\"period_ms\":%u,\"queue\":%u,\"retry_ms\":%u,\"ttl_ms\":%u",
+                        TXQ_SIM_PACKETS, TXQ_SIM_PERIOD_US / 1000, CONFIG_MESH_TXQ_LEN, CONFIG_MESH_TXQ_RETRY_MS,
+                        CONFIG_MESH_TXQ_TTL_MS);
+    my_bench_json_list("runs");
+    for(uint8_t i = 0; i < 2 * MY_BENCH_COUNT(txq_sim_stall_ms); i++) {
+        txq_sim_t *sim = &txq_sim;
+        bool queued = (i % 2) != 0;
+        uint16_t stall_ms = txq_sim_stall_ms[i / 2];
+
+        memset(sim, 0, sizeof(*sim));
+        sim->stall_end = TXQ_SIM_STALL_AT_US + stall_ms * 1000LL;
+        txq_sim_seed = 1;
+        if(queued) {
+            txq_sim_queued(sim);
+        }
+        else {
+            txq_sim_blocking(sim);
+        }
+        ESP_LOGI(MY_BENCH_TAG, "txq %s, stall %ums: producer blocked %.1fms, root %u sent (max %.1fms, dropped %u), "
+                 "children %u sent (avg %.1fms, max %.1fms, dropped %u)",
+                 queued ? "queued" : "blocking", stall_ms, sim->block_max / 1000.0, sim->dir[0].sent,
+                 sim->dir[0].latency_max / 1000.0, sim->dir[0].dropped, sim->dir[1].sent,
+                 sim->dir[1].sent ? sim->dir[1].latency_sum / 1000.0 / sim->dir[1].sent : 0.0,
+                 sim->dir[1].latency_max / 1000.0, sim->dir[1].dropped);
+        const txq_sim_dir_t *root = &sim->dir[0], *children = &sim->dir[1];
+        my_bench_json_item("\"mode\":\"%s\",\"stall_ms\":%u,\"producer_block_max_ms\":%.1f,\"retries\":%u,\"depth_max\":%u,"
+                           "\"root\":{\"sent\":%u,\"dropped\":%u,\"avg_ms\":%.1f,\"max_ms\":%.1f},"
+                           "\"children\":{\"sent\":%u,\"dropped\":%u,\"avg_ms\":%.1f,\"max_ms\":%.1f}",
+                           queued ? "queued" : "blocking", stall_ms, sim->block_max / 1000.0,
+                           sim->retries, queued ? txq_sim_q.stats.depth_max : 0,
+                           root->sent, root->dropped, root->sent ? root->latency_sum / 1000.0 / root->sent : 0.0,
+                           root->latency_max / 1000.0,
+                           children->sent, children->dropped,
+                           children->sent ? children->latency_sum / 1000.0 / children->sent : 0.0,
+                           children->latency_max / 1000.0);
+    }
+    my_bench_json_end();
+}
+
+#endif
@@ -0,0 +1,509 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include "my_uplink.h"
+#include "my_report.h"
+#include "my_mem.h"
+#if CONFIG_MESH_SHARD
+#include "my_shard.h"
+#endif
+
+#if CONFIG_MESH_DATA_SEND_TO_SERVER
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define UPLINK_CONN_NUM         CONFIG_MESH_UPLINK_CONN_NUM
+#define UPLINK_BATCH_SIZE       CONFIG_MESH_UPLINK_BATCH_SIZE
+#define UPLINK_BATCH_MAX        CONFIG_MESH_UPLINK_BATCH_MAX
+#define UPLINK_BATCH_TIMEOUT_US (CONFIG_MESH_UPLINK_BATCH_TIMEOUT * 1000LL)
+#define UPLINK_BACKOFF_MIN      (500)       /* 重连退避初始值(ms) */
+#define UPLINK_CONNECT_TIMEOUT  (3000)      /* 建立连接超时(ms) */
+#define UPLINK_SEND_TIMEOUT     (2000)      /* 发送超时(ms) */
+#define UPLINK_STATS_PERIOD     (10)        /* 统计信息输出周期(s) */
+#define UPLINK_LAT_BUCKETS      (16)        /* 延时直方图桶数，第n个桶为[2^(n-1), 2^n)ms */
+#define UPLINK_REC_MAX          (UPLINK_BATCH_SIZE - sizeof(my_report_batch_hdr_t))   /* 一条记录的最大长度 */
+_Static_assert(MESH_MPS + sizeof(my_report_rec_hdr_t) <= UPLINK_REC_MAX,
+               "CONFIG_MESH_UPLINK_BATCH_SIZE must hold a full mesh packet");
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 批次缓冲区
+typedef struct {
+    uint8_t  buf[UPLINK_BATCH_SIZE];
+    uint16_t len;           /* 已使用长度，包含批次头部 */
+    uint8_t  count;         /* 记录条数 */
+    int64_t  first_time;    /* 第一条记录提交的时间(us) */
+} uplink_batch_t;
+
+// 到服务器的一条持久连接
+typedef struct {
+    int      sock;          /* -1表示未连接 */
+    uint16_t seq;           /* 下一个批次序号 */
+    uint32_t backoff_ms;    /* 当前重连退避时间 */
+    int64_t  retry_at;      /* 允许下次重连的时间(us) */
+    uint16_t rx_len;        /* rx中已收到的长度 */
+    uint8_t  rx[sizeof(my_report_down_hdr_t) + MY_REPORT_DOWN_MAX];    /* 未处理完的下行消息 */
+} uplink_conn_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *UPLINK_TAG = "uplink";
+// 双缓冲：一个用于接收提交的数据，另一个等待发送
+static uplink_batch_t batches[2];
+static uplink_batch_t *filling = &batches[0];
+static uplink_batch_t *sending = NULL;
+static SemaphoreHandle_t batch_mutex;
+static TaskHandle_t uplink_task_handle;
+MY_TASK_DEFINE(uplink_task_mem, CONFIG_MESH_TASK_STACK_UPLINK);
+MY_MUTEX_DEFINE(batch_mutex_mem);
+
+static uplink_conn_t conns[UPLINK_CONN_NUM];
+static uint8_t conn_next = 0;
+static volatile bool is_online = false;
+static my_uplink_down_handler_t down_handler = NULL;
+
+static my_uplink_stats_t stats;
+static uint32_t lat_hist[UPLINK_LAT_BUCKETS];
+
+/*******************************************************
+ *                Function Declarations
+ *******************************************************/
+static void uplink_task(void *arg);
+static void uplink_batch_reset(uplink_batch_t *batch);
+static bool uplink_batch_rotate(bool force);
+static bool uplink_batch_send(uplink_batch_t *batch);
+static void uplink_conn_open(uplink_conn_t *conn);
+static void uplink_conn_close(uplink_conn_t *conn, bool failed);
+static void uplink_conn_check(void);
+static void uplink_conn_drain(void);
+static void uplink_conn_parse(uplink_conn_t *conn);
+static void uplink_stats_report(uint32_t period_s);
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static void uplink_batch_reset(uplink_batch_t *batch)
+{
+    batch->len = sizeof(my_report_batch_hdr_t);
+    batch->count = 0;
+    batch->first_time = 0;
+}
+
+/**
+ * 将正在填充的批次交给发送，需持有batch_mutex
+ * force为false时，只有批次已满或已超时才交出
+ * 返回值：是否交出了批次
+ */
+static bool uplink_batch_rotate(bool force)
+{
+    my_report_batch_hdr_t *hdr;
+
+    // 上一个批次还未发送完成，或当前批次为空
+    if((sending != NULL) || (filling->count == 0)) {
+        return false;
+    }
+    if(!force && (filling->count < UPLINK_BATCH_MAX)
+        && (esp_timer_get_time() - filling->first_time < UPLINK_BATCH_TIMEOUT_US)) {
+        return false;
+    }
+
+    // 填写批次头部，序号在发送时根据连接填写
+    hdr = (my_report_batch_hdr_t *)filling->buf;
+    hdr->magic   = MY_REPORT_MAGIC;
+    hdr->version = MY_REPORT_VERSION;
+    hdr->count   = filling->count;
+    hdr->len     = filling->len - sizeof(my_report_batch_hdr_t);
+
+    sending = filling;
+    filling = (filling == &batches[0]) ? &batches[1] : &batches[0];
+    uplink_batch_reset(filling);
+    return true;
+}
+
+// 在某一可用连接上发送批次，失败时换下一条连接
+static bool uplink_batch_send(uplink_batch_t *batch)
+{
+    my_report_batch_hdr_t *hdr = (my_report_batch_hdr_t *)batch->buf;
+
+    for(uint8_t n = 0; n < UPLINK_CONN_NUM; n++) {
+        uplink_conn_t *conn = &conns[conn_next];
+        conn_next = (conn_next + 1) % UPLINK_CONN_NUM;
+        if(conn->sock < 0) {
+            continue;
+        }
+
+        hdr->seq = conn->seq;
+        // 批次之间不等待服务器应答，直接在连接上连续写入
+        size_t sent = 0;
+        while(sent < batch->len) {
+            int ret = send(conn->sock, batch->buf + sent, batch->len - sent, 0);
+            if(ret <= 0) {
+                break;
+            }
+            sent += ret;
+        }
+
+        if(sent == batch->len) {
+            conn->seq++;
+            stats.reports += batch->count;
+            stats.batches++;
+            stats.bytes += batch->len;
+
+            // 以批次中最早的记录计算排队延时
+            uint32_t lat_ms = (esp_timer_get_time() - batch->first_time) / 1000;
+            uint8_t b = 0;
+            while((lat_ms > 0) && (b < UPLINK_LAT_BUCKETS - 1)) {
+                lat_ms >>= 1;
+                b++;
+            }
+            lat_hist[b] += batch->count;
+            return true;
+        }
+
+        // 发送中断的连接上可能残留半个批次，只能关闭重连
+        ESP_LOGW(UPLINK_TAG, "Send failed on conn %d, errno %d", (int)(conn - conns), errno);
+        uplink_conn_close(conn, true);
+    }
+
+    return false;
+}
+
+static void uplink_conn_open(uplink_conn_t *conn)
+{
+    struct sockaddr_in addr = {0};
+    struct timeval tv;
+    fd_set wfds;
+    int opt;
+    socklen_t opt_len = sizeof(opt);
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(CONFIG_MESH_SERVER_PORT);
+    addr.sin_addr.s_addr = inet_addr(CONFIG_MESH_SERVER_IP);
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if(sock < 0) {
+        ESP_LOGE(UPLINK_TAG, "Socket create failed, errno %d", errno);
+        uplink_conn_close(conn, true);
+        return;
+    }
+
+    // 保活，及时发现中间路由器丢弃的连接
+    opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+    opt = CONFIG_MESH_UPLINK_KEEPALIVE_IDLE;
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &opt, sizeof(opt));
+    opt = 5;
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &opt, sizeof(opt));
+    opt = 3;
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &opt, sizeof(opt));
+#if CONFIG_MESH_UPLINK_NODELAY
+    // 已经按批次发送，不需要Nagle算法再合并
+    opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+#endif
+    tv.tv_sec  = UPLINK_SEND_TIMEOUT / 1000;
+    tv.tv_usec = (UPLINK_SEND_TIMEOUT % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // 非阻塞connect，服务器不可达时不会长时间阻塞上行任务
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    if((connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) && (errno != EINPROGRESS)) {
+        goto fail;
+    }
+    FD_ZERO(&wfds);
+    FD_SET(sock, &wfds);
+    tv.tv_sec  = UPLINK_CONNECT_TIMEOUT / 1000;
+    tv.tv_usec = (UPLINK_CONNECT_TIMEOUT % 1000) * 1000;
+    if(select(sock + 1, NULL, &wfds, NULL, &tv) <= 0) {
+        goto fail;
+    }
+    opt = 0;
+    if((getsockopt(sock, SOL_SOCKET, SO_ERROR, &opt, &opt_len) != 0) || (opt != 0)) {
+        goto fail;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+
+    conn->sock = sock;
+    conn->seq = 0;
+    conn->rx_len = 0;
+    conn->backoff_ms = UPLINK_BACKOFF_MIN;
+    stats.reconnects++;
+    stats.conn_up++;
+    ESP_LOGI(UPLINK_TAG, "Conn %d connected to %s:%d", (int)(conn - conns),
+             CONFIG_MESH_SERVER_IP, CONFIG_MESH_SERVER_PORT);
+    return;
+
+fail:
+    close(sock);
+    uplink_conn_close(conn, true);
+}
+
+/**
+ * 关闭连接
+ * failed为true时按退避时间推迟下次重连，退避时间加倍
+ */
+static void uplink_conn_close(uplink_conn_t *conn, bool failed)
+{
+    if(conn->sock >= 0) {
+        close(conn->sock);
+        conn->sock = -1;
+        stats.conn_up--;
+    }
+
+    if(failed) {
+        conn->retry_at = esp_timer_get_time() + conn->backoff_ms * 1000LL;
+        conn->backoff_ms *= 2;
+        if(conn->backoff_ms > CONFIG_MESH_UPLINK_RECONNECT_MAX) {
+            conn->backoff_ms = CONFIG_MESH_UPLINK_RECONNECT_MAX;
+        }
+    }
+    else {
+        conn->retry_at = 0;
+        conn->backoff_ms = UPLINK_BACKOFF_MIN;
+    }
+}
+
+// 重连已到退避时间的连接
+static void uplink_conn_check(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    for(uint8_t i = 0; i < UPLINK_CONN_NUM; i++) {
+        if((conns[i].sock < 0) && (now >= conns[i].retry_at)) {
+            uplink_conn_open(&conns[i]);
+        }
+    }
+}
+
+/**
+ * 处理rx中完整的下行消息
+ * 头部错误时丢弃一个字节后重新查找头部，payload超长的消息被丢弃
+ */
+static void uplink_conn_parse(uplink_conn_t *conn)
+{
+    my_report_down_hdr_t hdr;
+    uint16_t used;
+
+    while(conn->rx_len >= sizeof(hdr)) {
+        memcpy(&hdr, conn->rx, sizeof(hdr));
+        if((hdr.magic != MY_REPORT_DOWN_MAGIC) || (hdr.version != MY_REPORT_VERSION)
+           || (hdr.len > MY_REPORT_DOWN_MAX)) {
+            stats.down_errors++;
+            used = 1;
+        }
+        else if(conn->rx_len < sizeof(hdr) + hdr.len) {
+            break;
+        }
+        else {
+            used = sizeof(hdr) + hdr.len;
+            stats.down_msgs++;
+            if(down_handler != NULL) {
+                down_handler(&hdr, conn->rx + sizeof(hdr));
+            }
+        }
+        conn->rx_len -= used;
+        memmove(conn->rx, conn->rx + used, conn->rx_len);
+    }
+}
+
+// 读取服务器发来的下行消息，同时检测连接是否被对端关闭
+static void uplink_conn_drain(void)
+{
+    for(uint8_t i = 0; i < UPLINK_CONN_NUM; i++) {
+        uplink_conn_t *conn = &conns[i];
+        while(conn->sock >= 0) {
+            int ret = recv(conn->sock, conn->rx + conn->rx_len, sizeof(conn->rx) - conn->rx_len, MSG_DONTWAIT);
+            if(ret > 0) {
+                conn->rx_len += ret;
+                uplink_conn_parse(conn);
+                continue;
+            }
+            if((ret == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+                ESP_LOGW(UPLINK_TAG, "Conn %d closed by server", i);
+                uplink_conn_close(&conns[i], true);
+            }
+            break;
+        }
+    }
+}
+
+static void uplink_stats_report(uint32_t period_s)
+{
+    static uint32_t last_reports = 0;
+    uint32_t total = 0, sum = 0, p99 = 0;
+
+    for(uint8_t b = 0; b < UPLINK_LAT_BUCKETS; b++) {
+        total += lat_hist[b];
+    }
+    // 直方图中累计达到99%的桶的上限
+    for(uint8_t b = 0; b < UPLINK_LAT_BUCKETS; b++) {
+        sum += lat_hist[b];
+        if((total > 0) && (sum * 100 >= total * 99)) {
+            p99 = 1 << b;
+            break;
+        }
+    }
+
+    ESP_LOGI(UPLINK_TAG, "reports/s:%u, p99:<%ums, batches:%u, dropped:%u, conn up:%u",
+             (stats.reports - last_reports) / period_s, p99,
+             stats.batches, stats.dropped, stats.conn_up);
+
+    last_reports = stats.reports;
+    memset(lat_hist, 0, sizeof(lat_hist));
+}
+
+static void uplink_task(void *arg)
+{
+    TickType_t wait = pdMS_TO_TICKS(CONFIG_MESH_UPLINK_BATCH_TIMEOUT);
+    int64_t stats_time = esp_timer_get_time();
+    uplink_batch_t *batch;
+
+    if(wait == 0) {
+        wait = 1;
+    }
+
+    while(1) {
+        // 批次已满时会被提前唤醒
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        if(!is_online) {
+            for(uint8_t i = 0; i < UPLINK_CONN_NUM; i++) {
+                uplink_conn_close(&conns[i], false);
+            }
+            continue;
+        }
+
+        uplink_conn_check();
+
+        // 发送完一个批次后，另一个缓冲区可能也已经满了
+        for(uint8_t n = 0; n < 2; n++) {
+            xSemaphoreTake(batch_mutex, portMAX_DELAY);
+            uplink_batch_rotate(false);
+            batch = sending;
+            xSemaphoreGive(batch_mutex);
+
+            // 没有可用连接时保留批次，之后重试
+            if((batch == NULL) || !uplink_batch_send(batch)) {
+                break;
+            }
+
+            xSemaphoreTake(batch_mutex, portMAX_DELAY);
+            uplink_batch_reset(sending);
+            sending = NULL;
+            xSemaphoreGive(batch_mutex);
+        }
+
+        uplink_conn_drain();
+
+        if(esp_timer_get_time() - stats_time >= UPLINK_STATS_PERIOD * 1000000LL) {
+            stats_time = esp_timer_get_time();
+            uplink_stats_report(UPLINK_STATS_PERIOD);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t my_uplink_submit(const mesh_addr_t *from, const mesh_data_t *data)
+{
+    my_report_rec_hdr_t rec;
+    size_t need = sizeof(rec) + data->size;
+    bool flush = false;
+    esp_err_t ret = ESP_OK;
+
+    if(batch_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 一个空的批次也放不下，不要为它交出未满的批次
+    if(need > UPLINK_REC_MAX) {
+        ESP_LOGE(UPLINK_TAG, "Record too large: %u bytes", (unsigned)need);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(batch_mutex, portMAX_DELAY);
+    // 当前批次放不下，交给上行任务并换用另一个缓冲区
+    if(filling->len + need > UPLINK_BATCH_SIZE) {
+        uplink_batch_rotate(true);
+        flush = true;
+    }
+
+    if(filling->len + need <= UPLINK_BATCH_SIZE) {
+        memcpy(rec.src, from->addr, sizeof(rec.src));
+        rec.proto    = data->proto;
+#if CONFIG_MESH_SHARD
+        rec.shard    = my_shard_get();
+#else
+        rec.shard    = 0;
+#endif
+        rec.len      = data->size;
+        memcpy(filling->buf + filling->len, &rec, sizeof(rec));
+        memcpy(filling->buf + filling->len + sizeof(rec), data->data, data->size);
+
+        if(filling->count == 0) {
+            filling->first_time = esp_timer_get_time();
+        }
+        filling->len += need;
+        filling->count++;
+        if(filling->count >= UPLINK_BATCH_MAX) {
+            flush = true;
+        }
+    }
+    else {
+        // 两个缓冲区都在使用中
+        stats.dropped++;
+        ret = ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(batch_mutex);
+
+    if(flush) {
+        xTaskNotifyGive(uplink_task_handle);
+    }
+    return ret;
+}
+
+void my_uplink_set_online(bool online)
+{
+    is_online = online;
+    if(uplink_task_handle != NULL) {
+        xTaskNotifyGive(uplink_task_handle);
+    }
+}
+
+void my_uplink_set_down_handler(my_uplink_down_handler_t handler)
+{
+    down_handler = handler;
+}
+
+void my_uplink_get_stats(my_uplink_stats_t *out)
+{
+    memcpy(out, &stats, sizeof(my_uplink_stats_t));
+}
+
+void my_uplink_init(void)
+{
+    if(batch_mutex != NULL) {
+        return;
+    }
+
+    for(uint8_t i = 0; i < UPLINK_CONN_NUM; i++) {
+        conns[i].sock = -1;
+        conns[i].backoff_ms = UPLINK_BACKOFF_MIN;
+    }
+    uplink_batch_reset(&batches[0]);
+    uplink_batch_reset(&batches[1]);
+
+    batch_mutex = my_mutex_create(&batch_mutex_mem);
+    // 创建上行任务
+    uplink_task_handle = my_task_create(&uplink_task_mem, uplink_task, "uplink_task",
+                                        CONFIG_MESH_TASK_PRIO_UPLINK,
+                                        MY_TASK_CORE(CONFIG_MESH_TASK_CORE_UPLINK), NULL);
+}
+
+#endif /* CONFIG_MESH_DATA_SEND_TO_SERVER */
@@ -0,0 +1,837 @@
+/**
+ * 服务器端数据收集程序(Linux)
+ *
+ * 接收根节点上行的TCP连接（格式见main/include/my_report.h），
+ * 解码各节点的数据后追加写入按时间分区的列式存储，并提供各节点的接收统计。
+ * 多个mesh分片(CONFIG_MESH_SHARD)的根节点连接到同一个collector时，数据按节点地址合并，
+ * 统计信息中另外给出各分片的根节点数、节点数和记录数，以及节点所在的分片。
+ *
+ * 用法：
+ *  collector [-p 端口] [-m 统计端口] [-d 数据目录] [-P 分区时长(s)]
+ *  collector dump [-n 行数] <分区目录>
+ *
+ * 存储格式：每个分区一个目录(<数据目录>/<开始时间UTC>)，每列一个文件，
+ * 第i行的各列分别位于各文件的第i个元素：
+ *  ts.col    int64_t   接收时间(us)
+ *  node.col  uint64_t  节点mesh地址
+ *  proto.col uint8_t   mesh_proto_t
+ *  off.col   uint64_t  payload在data.bin中的偏移
+ *  len.col   uint16_t  payload长度
+ *  data.bin            payload
+ * 文件只追加写入，读取时使用mmap。
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "my_report.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define COLLECTOR_PORT          (8070)      /* 与CONFIG_MESH_SERVER_PORT的默认值相同 */
+#define COLLECTOR_METRICS_PORT  (8071)
+#define COLLECTOR_PARTITION_S   (3600)
+#define CONN_NUM_MAX            (1024)
+#define CONN_BUF_SIZE           (64 * 1024) /* 大于根节点的最大批次 */
+#define EPOLL_EVENTS            (64)
+#define NODE_TABLE_SIZE         (1 << 16)   /* 节点表大小，2的幂 */
+#define STORE_BUF_SIZE          (64 * 1024) /* 每列的写缓冲 */
+#define STORE_FLUSH_MS          (1000)
+#define STATS_PERIOD_S          (10)
+#define SHARD_NUM_MAX           (256)       /* 记录头部中shard为uint8_t */
+
+// 监听socket使用的epoll数据
+#define EPOLL_LISTEN_UPLINK     ((void *)1)
+#define EPOLL_LISTEN_METRICS    ((void *)2)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+typedef enum {
+    CONN_UPLINK = 0,    /* 根节点的上行连接 */
+    CONN_METRICS,       /* 读取统计信息的HTTP连接 */
+} conn_type_t;
+
+typedef struct {
+    int         fd;
+    conn_type_t type;
+    char        peer[32];
+    uint8_t     *buf;           /* 上行：接收缓冲；统计：待发送的响应 */
+    size_t      len;
+    size_t      off;            /* 统计：已发送的长度 */
+    uint32_t    batches;
+    int         shard;          /* 上行：第一条记录的分片，-1表示还没有收到记录 */
+} conn_t;
+
+typedef struct {
+    uint64_t addr;              /* 0表示空位 */
+    uint64_t reports;
+    uint64_t bytes;
+    int64_t  last_seen;         /* us */
+    uint8_t  shard;             /* 最近一次记录的分片 */
+    uint32_t shard_moves;       /* 改变分片的次数 */
+} node_t;
+
+// 每个分片的统计
+typedef struct {
+    uint32_t roots;             /* 当前的上行连接数 */
+    uint32_t nodes;             /* 最近一次记录在本分片的节点数 */
+    uint64_t records;
+    uint64_t bytes;
+} shard_t;
+
+typedef enum {
+    COL_TS = 0,
+    COL_NODE,
+    COL_PROTO,
+    COL_OFF,
+    COL_LEN,
+    COL_DATA,
+
+    COL_NUM,
+} store_col_t;
+
+typedef struct {
+    int64_t  start;             /* 当前分区的开始时间(s)，0表示未打开 */
+    int      fd[COL_NUM];
+    uint8_t  *buf[COL_NUM];
+    size_t   len[COL_NUM];
+    uint64_t data_off;          /* data.bin的长度，包括未写入的缓冲 */
+} store_t;
+
+typedef struct {
+    uint64_t connections;
+    uint64_t batches;
+    uint64_t records;
+    uint64_t bad_batches;
+    uint64_t bytes;
+} collector_stats_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static const char *col_names[COL_NUM] = {
+    [COL_TS]    = "ts.col",
+    [COL_NODE]  = "node.col",
+    [COL_PROTO] = "proto.col",
+    [COL_OFF]   = "off.col",
+    [COL_LEN]   = "len.col",
+    [COL_DATA]  = "data.bin",
+};
+static const char *data_dir = "data";
+static int partition_s = COLLECTOR_PARTITION_S;
+static volatile sig_atomic_t running = 1;
+static int epfd = -1;
+static node_t *nodes;
+static uint32_t node_num = 0;
+static store_t store = { 0 };
+static collector_stats_t stats = { 0 };
+static shard_t shards[SHARD_NUM_MAX];
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t mac_to_u64(const uint8_t mac[6])
+{
+    uint64_t v = 0;
+
+    for(int i = 0; i < 6; i++) {
+        v = (v << 8) | mac[i];
+    }
+    return v;
+}
+
+static void u64_to_macstr(uint64_t v, char *str)
+{
+    sprintf(str, "%02x:%02x:%02x:%02x:%02x:%02x",
+            (uint8_t)(v >> 40), (uint8_t)(v >> 32), (uint8_t)(v >> 24),
+            (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v);
+}
+
+/* ---------------- 节点表 ---------------- */
+
+// 查找节点，不存在时添加；表满时返回NULL
+static node_t *node_get(uint64_t addr)
+{
+    // 地址为0的节点不会出现，0用来表示空位
+    uint32_t h = (uint32_t)((addr * 0x9E3779B97F4A7C15ULL) >> 48) & (NODE_TABLE_SIZE - 1);
+
+    for(uint32_t i = 0; i < NODE_TABLE_SIZE; i++) {
+        node_t *node = &nodes[(h + i) & (NODE_TABLE_SIZE - 1)];
+        if(node->addr == addr) {
+            return node;
+        }
+        if(node->addr == 0) {
+            if(node_num >= NODE_TABLE_SIZE / 2) {
+                return NULL;
+            }
+            node->addr = addr;
+            node_num++;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+// 记录来自哪个分片，节点第一次出现或改变分片时更新各分片的节点数
+static void node_set_shard(node_t *node, bool is_new, uint8_t shard)
+{
+    if(!is_new && (node->shard == shard)) {
+        return;
+    }
+    if(!is_new) {
+        shards[node->shard].nodes--;
+        node->shard_moves++;
+    }
+    node->shard = shard;
+    shards[shard].nodes++;
+}
+
+/* ---------------- 列式存储 ---------------- */
+
+static int store_flush(void)
+{
+    for(int c = 0; c < COL_NUM; c++) {
+        size_t off = 0;
+        while(off < store.len[c]) {
+            ssize_t ret = write(store.fd[c], store.buf[c] + off, store.len[c] - off);
+            if(ret < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                perror("store write");
+                return -1;
+            }
+            off += ret;
+        }
+        store.len[c] = 0;
+    }
+    return 0;
+}
+
+static void store_close(void)
+{
+    if(store.start == 0) {
+        return;
+    }
+    store_flush();
+    for(int c = 0; c < COL_NUM; c++) {
+        close(store.fd[c]);
+        store.fd[c] = -1;
+    }
+    store.start = 0;
+}
+
+// 打开ts所在的分区，分区已存在时继续追加
+static int store_open(int64_t ts)
+{
+    char path[512];
+    struct tm tm;
+    struct stat st;
+    time_t start = (time_t)(ts / 1000000 / partition_s * partition_s);
+
+    store_close();
+
+    gmtime_r(&start, &tm);
+    snprintf(path, sizeof(path), "%s/%04d%02d%02d-%02d%02d%02d", data_dir,
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    if((mkdir(path, 0755) < 0) && (errno != EEXIST)) {
+        perror(path);
+        return -1;
+    }
+
+    size_t dir_len = strlen(path);
+    for(int c = 0; c < COL_NUM; c++) {
+        snprintf(path + dir_len, sizeof(path) - dir_len, "/%s", col_names[c]);
+        store.fd[c] = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if(store.fd[c] < 0) {
+            perror(path);
+            while(--c >= 0) {
+                close(store.fd[c]);
+            }
+            return -1;
+        }
+    }
+    fstat(store.fd[COL_DATA], &st);
+    store.data_off = st.st_size;
+    store.start = start;
+    path[dir_len] = '\0';
+    fprintf(stderr, "partition %s\n", path);
+
+    return 0;
+}
+
+static void store_put(store_col_t c, const void *data, size_t len)
+{
+    // payload可能大于缓冲区，直接写入
+    if(store.len[c] + len > STORE_BUF_SIZE) {
+        store_flush();
+        if(len > STORE_BUF_SIZE) {
+            if(write(store.fd[c], data, len) != (ssize_t)len) {
+                perror("store write");
+            }
+            return;
+        }
+    }
+    memcpy(store.buf[c] + store.len[c], data, len);
+    store.len[c] += len;
+}
+
+// 追加一行记录
+static void store_append(int64_t ts, uint64_t node, uint8_t proto, const uint8_t *data, uint16_t len)
+{
+    if((store.start == 0) || (ts / 1000000 >= store.start + partition_s)) {
+        if(store_open(ts) < 0) {
+            return;
+        }
+    }
+    // 先写数据，其他列在同一次flush中写入，读取时以ts列的行数为准
+    uint64_t off = store.data_off;
+    store_put(COL_DATA, data, len);
+    store.data_off += len;
+    store_put(COL_NODE, &node, sizeof(node));
+    store_put(COL_PROTO, &proto, sizeof(proto));
+    store_put(COL_OFF, &off, sizeof(off));
+    store_put(COL_LEN, &len, sizeof(len));
+    store_put(COL_TS, &ts, sizeof(ts));
+}
+
+/* ---------------- 连接 ---------------- */
+
+static void conn_close(conn_t *conn)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if(conn->type == CONN_UPLINK) {
+        stats.connections--;
+        if(conn->shard >= 0) {
+            shards[conn->shard].roots--;
+        }
+        fprintf(stderr, "%s closed, %u batches\n", conn->peer, conn->batches);
+    }
+    free(conn->buf);
+    free(conn);
+}
+
+// 解析缓冲区中完整的批次，格式错误时返回-1
+static int conn_parse(conn_t *conn)
+{
+    size_t pos = 0;
+    int64_t ts = now_us();
+
+    while(conn->len - pos >= sizeof(my_report_batch_hdr_t)) {
+        my_report_batch_hdr_t hdr;
+        memcpy(&hdr, conn->buf + pos, sizeof(hdr));
+        if((hdr.magic != MY_REPORT_MAGIC) || (hdr.version != MY_REPORT_VERSION)
+           || (hdr.len > CONN_BUF_SIZE - sizeof(hdr))) {
+            fprintf(stderr, "%s bad batch header\n", conn->peer);
+            stats.bad_batches++;
+            return -1;
+        }
+        if(conn->len - pos < sizeof(hdr) + hdr.len) {
+            break;      /* 批次未接收完 */
+        }
+
+        const uint8_t *rec = conn->buf + pos + sizeof(hdr);
+        const uint8_t *end = rec + hdr.len;
+        uint8_t count = 0;
+        while(rec + sizeof(my_report_rec_hdr_t) <= end) {
+            my_report_rec_hdr_t rh;
+            memcpy(&rh, rec, sizeof(rh));
+            rec += sizeof(rh);
+            if(rec + rh.len > end) {
+                break;
+            }
+            uint64_t addr = mac_to_u64(rh.src);
+            // 最新数值查询的响应来自根节点，不计入节点的统计
+            node_t *node = (rh.proto == MY_REPORT_PROTO_LATEST) ? NULL : node_get(addr);
+            // 一个根节点只属于一个分片，以连接上第一条记录的分片计算根节点数
+            if(conn->shard < 0) {
+                conn->shard = rh.shard;
+                shards[rh.shard].roots++;
+            }
+            shards[rh.shard].records++;
+            shards[rh.shard].bytes += rh.len;
+            if(node != NULL) {
+                node_set_shard(node, node->reports == 0, rh.shard);
+                node->reports++;
+                node->bytes += rh.len;
+                node->last_seen = ts;
+            }
+            store_append(ts, addr, rh.proto, rec, rh.len);
+            rec += rh.len;
+            count++;
+        }
+        if((rec != end) || (count != hdr.count)) {
+            fprintf(stderr, "%s bad batch seq %u\n", conn->peer, hdr.seq);
+            stats.bad_batches++;
+            return -1;
+        }
+
+        stats.batches++;
+        stats.records += count;
+        conn->batches++;
+        pos += sizeof(hdr) + hdr.len;
+    }
+
+    // 剩余不完整的批次移到缓冲区开头
+    if(pos > 0) {
+        memmove(conn->buf, conn->buf + pos, conn->len - pos);
+        conn->len -= pos;
+    }
+    return 0;
+}
+
+static void conn_uplink_read(conn_t *conn)
+{
+    while(1) {
+        ssize_t ret = recv(conn->fd, conn->buf + conn->len, CONN_BUF_SIZE - conn->len, 0);
+        if(ret > 0) {
+            stats.bytes += ret;
+            conn->len += ret;
+            if(conn_parse(conn) < 0) {
+                conn_close(conn);
+                return;
+            }
+            continue;
+        }
+        if((ret < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            return;
+        }
+        conn_close(conn);
+        return;
+    }
+}
+
+// 生成Prometheus文本格式的统计信息
+static size_t metrics_build(uint8_t **out)
+{
+    size_t cap = 1024 + (size_t)node_num * 384 + SHARD_NUM_MAX * 256;
+    char *buf = malloc(cap);
+    size_t len = 0;
+    char mac[18];
+
+    if(buf == NULL) {
+        return 0;
+    }
+    len += snprintf(buf + len, cap - len,
+                    "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n"
+                    "mesh_collector_connections %llu\n"
+                    "mesh_collector_nodes %u\n"
+                    "mesh_collector_batches_total %llu\n"
+                    "mesh_collector_records_total %llu\n"
+                    "mesh_collector_bad_batches_total %llu\n"
+                    "mesh_collector_bytes_total %llu\n",
+                    (unsigned long long)stats.connections, node_num,
+                    (unsigned long long)stats.batches, (unsigned long long)stats.records,
+                    (unsigned long long)stats.bad_batches, (unsigned long long)stats.bytes);
+    // 只输出收到过记录的分片，未分片时只有分片0
+    for(uint32_t s = 0; (s < SHARD_NUM_MAX) && (len < cap); s++) {
+        shard_t *shard = &shards[s];
+        if((shard->records == 0) && (shard->roots == 0)) {
+            continue;
+        }
+        len += snprintf(buf + len, cap - len,
+                        "mesh_shard_roots{shard=\"%u\"} %u\n"
+                        "mesh_shard_nodes{shard=\"%u\"} %u\n"
+                        "mesh_shard_records_total{shard=\"%u\"} %llu\n"
+                        "mesh_shard_bytes_total{shard=\"%u\"} %llu\n",
+                        s, shard->roots, s, shard->nodes,
+                        s, (unsigned long long)shard->records, s, (unsigned long long)shard->bytes);
+    }
+    for(uint32_t i = 0; (i < NODE_TABLE_SIZE) && (len < cap); i++) {
+        node_t *node = &nodes[i];
+        if(node->addr == 0) {
+            continue;
+        }
+        u64_to_macstr(node->addr, mac);
+        len += snprintf(buf + len, cap - len,
+                        "mesh_node_reports_total{node=\"%s\"} %llu\n"
+                        "mesh_node_bytes_total{node=\"%s\"} %llu\n"
+                        "mesh_node_last_seen_seconds{node=\"%s\"} %.3f\n"
+                        "mesh_node_shard{node=\"%s\"} %u\n"
+                        "mesh_node_shard_moves_total{node=\"%s\"} %u\n",
+                        mac, (unsigned long long)node->reports,
+                        mac, (unsigned long long)node->bytes,
+                        mac, node->last_seen / 1e6,
+                        mac, node->shard, mac, node->shard_moves);
+    }
+    *out = (uint8_t *)buf;
+    return (len < cap) ? len : cap - 1;
+}
+
+static void conn_metrics_write(conn_t *conn)
+{
+    while(conn->off < conn->len) {
+        ssize_t ret = send(conn->fd, conn->buf + conn->off, conn->len - conn->off, MSG_NOSIGNAL);
+        if(ret > 0) {
+            conn->off += ret;
+            continue;
+        }
+        if((ret < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            return;     /* 等待EPOLLOUT */
+        }
+        break;
+    }
+    conn_close(conn);
+}
+
+// 收到请求后返回统计信息，请求的内容不做解析
+static void conn_metrics_read(conn_t *conn)
+{
+    uint8_t req[1024];
+    struct epoll_event ev;
+
+    if(conn->buf != NULL) {
+        conn_metrics_write(conn);
+        return;
+    }
+    if(recv(conn->fd, req, sizeof(req), 0) <= 0) {
+        conn_close(conn);
+        return;
+    }
+    conn->len = metrics_build(&conn->buf);
+    conn->off = 0;
+    ev.events = EPOLLOUT;
+    ev.data.ptr = conn;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn_metrics_write(conn);
+}
+
+static void conn_accept(int lfd, conn_type_t type)
+{
+    while(1) {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        struct epoll_event ev;
+        int fd = accept4(lfd, (struct sockaddr *)&addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                perror("accept");
+            }
+            return;
+        }
+
+        conn_t *conn = calloc(1, sizeof(conn_t));
+        if((conn == NULL) || ((type == CONN_UPLINK) && (stats.connections >= CONN_NUM_MAX))) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->type = type;
+        conn->shard = -1;
+        snprintf(conn->peer, sizeof(conn->peer), "%s:%u", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+        if(type == CONN_UPLINK) {
+            conn->buf = malloc(CONN_BUF_SIZE);
+            if(conn->buf == NULL) {
+                free(conn);
+                close(fd);
+                continue;
+            }
+            stats.connections++;
+            fprintf(stderr, "%s connected\n", conn->peer);
+        }
+
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static int listen_on(uint16_t port, void *tag)
+{
+    struct sockaddr_in addr = { 0 };
+    struct epoll_event ev;
+    int on = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, 128) < 0)) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+
+    return fd;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static int collector_run(uint16_t port, uint16_t metrics_port)
+{
+    struct epoll_event events[EPOLL_EVENTS];
+    int lfd, mfd;
+    int64_t last_flush, last_stats;
+    uint64_t last_records = 0;
+
+    nodes = calloc(NODE_TABLE_SIZE, sizeof(node_t));
+    for(int c = 0; c < COL_NUM; c++) {
+        store.buf[c] = malloc(STORE_BUF_SIZE);
+        if(store.buf[c] == NULL) {
+            return 1;
+        }
+    }
+    if((nodes == NULL) || ((mkdir(data_dir, 0755) < 0) && (errno != EEXIST))) {
+        perror(data_dir);
+        return 1;
+    }
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    lfd = listen_on(port, EPOLL_LISTEN_UPLINK);
+    mfd = listen_on(metrics_port, EPOLL_LISTEN_METRICS);
+    if((epfd < 0) || (lfd < 0) || (mfd < 0)) {
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "listening on %u, metrics on %u, data in %s\n", port, metrics_port, data_dir);
+
+    last_flush = last_stats = now_us();
+    while(running) {
+        int n = epoll_wait(epfd, events, EPOLL_EVENTS, STORE_FLUSH_MS);
+        for(int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if(ptr == EPOLL_LISTEN_UPLINK) {
+                conn_accept(lfd, CONN_UPLINK);
+            }
+            else if(ptr == EPOLL_LISTEN_METRICS) {
+                conn_accept(mfd, CONN_METRICS);
+            }
+            else if(((conn_t *)ptr)->type == CONN_UPLINK) {
+                conn_uplink_read(ptr);
+            }
+            else {
+                conn_metrics_read(ptr);
+            }
+        }
+
+        int64_t now = now_us();
+        // 定期将缓冲写入文件
+        if(now - last_flush >= STORE_FLUSH_MS * 1000) {
+            last_flush = now;
+            if(store.start != 0) {
+                store_flush();
+            }
+        }
+        if(now - last_stats >= STATS_PERIOD_S * 1000000LL) {
+            uint32_t shard_num = 0;
+            for(uint32_t s = 0; s < SHARD_NUM_MAX; s++) {
+                shard_num += (shards[s].roots > 0);
+            }
+            fprintf(stderr, "conns:%llu, shards:%u, nodes:%u, records/s:%llu, bad batches:%llu\n",
+                    (unsigned long long)stats.connections, shard_num, node_num,
+                    (unsigned long long)((stats.records - last_records) * 1000000 / (now - last_stats)),
+                    (unsigned long long)stats.bad_batches);
+            last_records = stats.records;
+            last_stats = now;
+        }
+    }
+
+    store_close();
+    fprintf(stderr, "exit, %llu records\n", (unsigned long long)stats.records);
+    return 0;
+}
+
+/* ---------------- 读取分区 ---------------- */
+
+static void *map_col(const char *dir, store_col_t c, size_t *size)
+{
+    char path[512];
+    struct stat st;
+    void *ptr;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, col_names[c]);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if((fd < 0) || (fstat(fd, &st) < 0)) {
+        perror(path);
+        if(fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    *size = st.st_size;
+    if(st.st_size == 0) {
+        close(fd);
+        return (void *)"";
+    }
+    ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+    return ptr;
+}
+
+// 输出分区中各节点的统计和最后rows行记录
+static int collector_dump(const char *dir, size_t rows)
+{
+    void *cols[COL_NUM];
+    size_t sizes[COL_NUM];
+    size_t num;
+    char mac[18];
+
+    for(int c = 0; c < COL_NUM; c++) {
+        cols[c] = map_col(dir, c, &sizes[c]);
+        if(cols[c] == NULL) {
+            return 1;
+        }
+    }
+    const int64_t  *ts    = cols[COL_TS];
+    const uint64_t *node  = cols[COL_NODE];
+    const uint8_t  *proto = cols[COL_PROTO];
+    const uint64_t *off   = cols[COL_OFF];
+    const uint16_t *len   = cols[COL_LEN];
+    const uint8_t  *data  = cols[COL_DATA];
+
+    // 写入过程中各列长度可能不一致，取完整的行数
+    num = sizes[COL_TS] / sizeof(int64_t);
+    if(sizes[COL_NODE] / sizeof(uint64_t) < num) num = sizes[COL_NODE] / sizeof(uint64_t);
+    if(sizes[COL_PROTO] < num) num = sizes[COL_PROTO];
+    if(sizes[COL_OFF] / sizeof(uint64_t) < num) num = sizes[COL_OFF] / sizeof(uint64_t);
+    if(sizes[COL_LEN] / sizeof(uint16_t) < num) num = sizes[COL_LEN] / sizeof(uint16_t);
+
+    nodes = calloc(NODE_TABLE_SIZE, sizeof(node_t));
+    if(nodes == NULL) {
+        return 1;
+    }
+    for(size_t i = 0; i < num; i++) {
+        node_t *n = node_get(node[i]);
+        if(n != NULL) {
+            n->reports++;
+            n->bytes += len[i];
+            n->last_seen = ts[i];
+        }
+    }
+    printf("%zu records, %u nodes\n", num, node_num);
+    for(uint32_t i = 0; i < NODE_TABLE_SIZE; i++) {
+        if(nodes[i].addr != 0) {
+            u64_to_macstr(nodes[i].addr, mac);
+            printf("%s reports:%llu bytes:%llu last:%.3f\n", mac, (unsigned long long)nodes[i].reports,
+                   (unsigned long long)nodes[i].bytes, nodes[i].last_seen / 1e6);
+        }
+    }
+
+    for(size_t i = (num > rows) ? (num - rows) : 0; i < num; i++) {
+        u64_to_macstr(node[i], mac);
+        printf("%.6f %s proto:%u len:%u", ts[i] / 1e6, mac, proto[i], len[i]);
+        if(off[i] + len[i] > sizes[COL_DATA]) {
+            printf(" (truncated)\n");
+            continue;
+        }
+        // 节点数据格式：[num][num个uint8_t][sid]，旧版本没有sid
+        const uint8_t *p = data + off[i];
+        if(proto[i] == MY_REPORT_PROTO_LATEST) {
+            my_report_latest_hdr_t lh;
+            if(len[i] >= sizeof(lh)) {
+                memcpy(&lh, p, sizeof(lh));
+                printf(" query:%u values:%u next:%u", lh.id, lh.count, lh.next);
+            }
+        }
+        else if((len[i] > 0) && (p[0] + 1u <= len[i])) {
+            if(p[0] + 2u <= len[i]) {
+                printf(" sid:%u", p[1 + p[0]]);
+            }
+            printf(" values:");
+            for(uint8_t v = 0; v < p[0]; v++) {
+                printf(" %u", p[1 + v]);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-p port] [-m metrics_port] [-d data_dir] [-P partition_seconds]\n"
+            "       %s dump [-n rows] <partition_dir>\n", prog, prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *prog = argv[0];
+    uint16_t port = COLLECTOR_PORT;
+    uint16_t metrics_port = COLLECTOR_METRICS_PORT;
+    size_t rows = 10;
+    bool dump = false;
+    int opt;
+
+    if((argc > 1) && (strcmp(argv[1], "dump") == 0)) {
+        dump = true;
+        argc--;
+        argv++;
+    }
+    while((opt = getopt(argc, argv, "p:m:d:P:n:h")) != -1) {
+        switch(opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'm': metrics_port = atoi(optarg); break;
+        case 'd': data_dir = optarg; break;
+        case 'P': partition_s = atoi(optarg); break;
+        case 'n': rows = strtoul(optarg, NULL, 0); break;
+        default:
+            usage(prog);
+            return 1;
+        }
+    }
+    if(partition_s <= 0) {
+        partition_s = COLLECTOR_PARTITION_S;
+    }
+
+    if(dump) {
+        if(optind >= argc) {
+            usage(prog);
+            return 1;
+        }
+        return collector_dump(argv[optind], rows);
+    }
+    return collector_run(port, metrics_port);
+}
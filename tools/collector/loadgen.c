@@ -0,0 +1,207 @@
+/**
+ * collector的压力测试程序(Linux)
+ *
+ * 模拟一个或多个根节点，按my_report.h的格式向collector发送批次，
+ * 每条记录来自模拟的节点，数据格式与节点发送的sensor数据相同。
+ * 指定分片数时第i条连接模拟分片i % 分片数的根节点，只发送该分片的节点（节点序号 % 分片数）。
+ *
+ * 用法：
+ *  loadgen [-h 地址] [-p 端口] [-c 连接数] [-n 节点数] [-r 每秒记录数(0为不限速)]
+ *          [-b 每批记录数] [-v 每条记录的数值个数] [-t 时长(s)] [-s 分片数]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "my_report.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define LOADGEN_CONN_MAX    (256)
+#define LOADGEN_BATCH_MAX   (255)       /* 批次头部中count为uint8_t */
+#define LOADGEN_VALUES_MAX  (255)
+#define LOADGEN_SHARD_MAX   (16)        /* 与MY_SHARD_MAX相同 */
+#define LOADGEN_PROTO       (1)         /* MESH_PROTO_HTTP，与节点发送sensor数据时相同 */
+#define LOADGEN_TICK_US     (1000)
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int send_all(int fd, const uint8_t *buf, size_t len)
+{
+    while(len > 0) {
+        ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+// 生成一个批次，返回长度；node_idx依次取shard, shard + shard_num, ...
+static size_t build_batch(uint8_t *buf, uint16_t seq, uint8_t count, uint32_t *node_idx,
+                          uint32_t node_num, uint8_t values, uint8_t shard, uint8_t shard_num)
+{
+    my_report_batch_hdr_t hdr;
+    my_report_rec_hdr_t rec;
+    size_t len = sizeof(hdr);
+
+    for(uint8_t i = 0; i < count; i++) {
+        uint32_t n = *node_idx;
+        *node_idx = (n + shard_num < node_num) ? n + shard_num : shard;
+
+        // 模拟节点的地址：02:00:00:xx:xx:xx
+        rec.src[0] = 0x02;
+        rec.src[1] = 0x00;
+        rec.src[2] = 0x00;
+        rec.src[3] = (uint8_t)(n >> 16);
+        rec.src[4] = (uint8_t)(n >> 8);
+        rec.src[5] = (uint8_t)(n + 1);
+        rec.proto = LOADGEN_PROTO;
+        rec.shard = shard;
+        rec.len = values + 2;
+        memcpy(buf + len, &rec, sizeof(rec));
+        len += sizeof(rec);
+
+        // [num][num个uint8_t][sid]
+        buf[len++] = values;
+        for(uint8_t v = 0; v < values; v++) {
+            buf[len++] = (uint8_t)(n + seq + v);
+        }
+        buf[len++] = 1 + seq % 2;
+    }
+
+    hdr.magic = MY_REPORT_MAGIC;
+    hdr.version = MY_REPORT_VERSION;
+    hdr.count = count;
+    hdr.len = (uint16_t)(len - sizeof(hdr));
+    hdr.seq = seq;
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    return len;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *host = "127.0.0.1";
+    uint16_t port = 8070;
+    int conn_num = 1;
+    uint32_t node_num = 1000;
+    uint32_t rate = 10000;
+    int batch = 32;
+    int values = 1;
+    int duration = 10;
+    int shard_num = 1;
+    int opt;
+
+    while((opt = getopt(argc, argv, "h:p:c:n:r:b:v:t:s:")) != -1) {
+        switch(opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'c': conn_num = atoi(optarg); break;
+        case 'n': node_num = strtoul(optarg, NULL, 0); break;
+        case 'r': rate = strtoul(optarg, NULL, 0); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'v': values = atoi(optarg); break;
+        case 't': duration = atoi(optarg); break;
+        case 's': shard_num = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-c conns] [-n nodes] [-r records/s]"
+                            " [-b records/batch] [-v values/record] [-t seconds] [-s shards]\n", argv[0]);
+            return 1;
+        }
+    }
+    if((conn_num < 1) || (conn_num > LOADGEN_CONN_MAX) || (node_num < 1)
+       || (batch < 1) || (batch > LOADGEN_BATCH_MAX) || (values < 0) || (values > LOADGEN_VALUES_MAX)
+       || (shard_num < 1) || (shard_num > LOADGEN_SHARD_MAX) || ((uint32_t)shard_num > node_num)) {
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    int fds[LOADGEN_CONN_MAX];
+    uint16_t seqs[LOADGEN_CONN_MAX] = { 0 };
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad host %s\n", host);
+        return 1;
+    }
+    for(int i = 0; i < conn_num; i++) {
+        fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        if((fds[i] < 0) || (connect(fds[i], (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+            perror("connect");
+            return 1;
+        }
+    }
+
+    size_t buf_size = sizeof(my_report_batch_hdr_t)
+                      + (size_t)batch * (sizeof(my_report_rec_hdr_t) + 2 + values);
+    uint8_t *buf = malloc(buf_size);
+    if(buf == NULL) {
+        return 1;
+    }
+
+    uint64_t sent = 0, bytes = 0;
+    uint32_t node_idx[LOADGEN_SHARD_MAX];
+    for(int s = 0; s < shard_num; s++) {
+        node_idx[s] = s;
+    }
+    int conn = 0;
+    int64_t start = now_us();
+    int64_t end = start + (int64_t)duration * 1000000;
+    int64_t now = start;
+
+    while(now < end) {
+        // 限速时按经过的时间计算应发送的记录数
+        uint64_t due = (rate == 0) ? sent + batch : (uint64_t)(now - start) * rate / 1000000;
+        while(sent + batch <= due) {
+            uint8_t shard = conn % shard_num;
+            size_t len = build_batch(buf, seqs[conn]++, batch, &node_idx[shard], node_num, values,
+                                     shard, shard_num);
+            if(send_all(fds[conn], buf, len) < 0) {
+                perror("send");
+                return 1;
+            }
+            sent += batch;
+            bytes += len;
+            conn = (conn + 1) % conn_num;
+        }
+        if(rate != 0) {
+            usleep(LOADGEN_TICK_US);
+        }
+        now = now_us();
+    }
+
+    double secs = (now - start) / 1e6;
+    printf("{\"records\":%llu,\"bytes\":%llu,\"seconds\":%.3f,\"records_per_s\":%.0f,\"mbytes_per_s\":%.3f}\n",
+           (unsigned long long)sent, (unsigned long long)bytes, secs, sent / secs, bytes / secs / 1e6);
+
+    for(int i = 0; i < conn_num; i++) {
+        close(fds[i]);
+    }
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * 延迟日志的解析程序(Linux)
+ *
+ * 从串口日志中找出以"DLOG:"开头的行（格式见main/include/my_dlog.h），
+ * 根据固件的elf文件找到格式字符串和tag，格式化后按ESP_LOGx的格式输出，
+ * 其他行原样输出。
+ *
+ * 用法：
+ *  dlog <固件elf文件> [日志文件，默认为标准输入]
+ *  例如：idf.py monitor | tee monitor.log，然后 dlog build/xxx.elf monitor.log
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <elf.h>
+
+#include "my_dlog.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define DLOG_SECTIONS_MAX   (64)
+#define DLOG_LINE_MAX       (1024)
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// elf中加载到内存的段
+typedef struct {
+    uint32_t addr;
+    uint32_t size;
+    const char *data;
+} section_t;
+
+/*******************************************************
+ *                Variable Definitions
+ *******************************************************/
+static section_t sections[DLOG_SECTIONS_MAX];
+static int section_num = 0;
+static const char level_char[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+// 读取elf文件中所有有内容的段，只支持32位小端序（esp32）
+static int elf_load(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *elf = malloc(size);
+    if((elf == NULL) || (fread(elf, 1, size, fp) != (size_t)size)) {
+        fprintf(stderr, "read %s failed\n", path);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    Elf32_Ehdr *eh = (Elf32_Ehdr *)elf;
+    if((size < (long)sizeof(*eh)) || (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0)
+       || (eh->e_ident[EI_CLASS] != ELFCLASS32) || (eh->e_ident[EI_DATA] != ELFDATA2LSB)) {
+        fprintf(stderr, "%s is not a 32-bit little-endian elf\n", path);
+        return -1;
+    }
+    if(eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf32_Shdr) > (uint64_t)size) {
+        fprintf(stderr, "%s: bad section table\n", path);
+        return -1;
+    }
+    Elf32_Shdr *sh = (Elf32_Shdr *)(elf + eh->e_shoff);
+    for(int i = 0; (i < eh->e_shnum) && (section_num < DLOG_SECTIONS_MAX); i++) {
+        if(!(sh[i].sh_flags & SHF_ALLOC) || (sh[i].sh_type == SHT_NOBITS) || (sh[i].sh_size == 0)
+           || (sh[i].sh_offset + (uint64_t)sh[i].sh_size > (uint64_t)size)) {
+            continue;
+        }
+        sections[section_num].addr = sh[i].sh_addr;
+        sections[section_num].size = sh[i].sh_size;
+        sections[section_num].data = elf + sh[i].sh_offset;
+        section_num++;
+    }
+    return 0;
+}
+
+// 查找地址处的字符串，找不到时返回NULL
+static const char *elf_string(uint32_t addr)
+{
+    for(int i = 0; i < section_num; i++) {
+        section_t *s = &sections[i];
+        if((addr >= s->addr) && (addr - s->addr < s->size)) {
+            const char *str = s->data + (addr - s->addr);
+            // 字符串必须在段内结束
+            if(memchr(str, '\0', s->size - (addr - s->addr)) == NULL) {
+                return NULL;
+            }
+            return str;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 按格式字符串输出参数
+ * 每个转换说明单独调用snprintf，参数按说明转换为对应的类型
+ */
+static void dlog_format(char *out, size_t size, const char *fmt, const uint32_t *args, int nargs)
+{
+    size_t len = 0;
+    int argi = 0;
+
+#define DLOG_ARG()  ((argi < nargs) ? args[argi++] : 0)
+#define DLOG_PUT(...) do { \
+        int _n = snprintf(out + len, size - len, __VA_ARGS__); \
+        if(_n > 0) { len += ((size_t)_n < size - len) ? (size_t)_n : size - len - 1; } \
+    } while(0)
+
+    out[0] = '\0';
+    while((*fmt != '\0') && (len + 1 < size)) {
+        if(*fmt != '%') {
+            out[len++] = *fmt++;
+            out[len] = '\0';
+            continue;
+        }
+        if(fmt[1] == '%') {
+            DLOG_PUT("%%");
+            fmt += 2;
+            continue;
+        }
+
+        // 复制标志、宽度和精度，去掉长度修饰
+        char spec[32] = "%";
+        size_t n = 1;
+        int star[2], stars = 0;
+        const char *p = fmt + 1;
+        while((*p != '\0') && (strchr("-+ #0123456789.*", *p) != NULL) && (n < sizeof(spec) - 2)) {
+            if((*p == '*') && (stars < 2)) {
+                star[stars++] = (int32_t)DLOG_ARG();
+            }
+            spec[n++] = *p++;
+        }
+        while((*p != '\0') && (strchr("hlLqjzt", *p) != NULL)) {
+            p++;
+        }
+        char conv = *p;
+        if(conv == '\0') {
+            break;
+        }
+        fmt = p + 1;
+
+        switch(conv) {
+        case 'd':
+        case 'i':
+            spec[n++] = 'd';
+            spec[n] = '\0';
+            if(stars == 2)      DLOG_PUT(spec, star[0], star[1], (int32_t)DLOG_ARG());
+            else if(stars == 1) DLOG_PUT(spec, star[0], (int32_t)DLOG_ARG());
+            else                DLOG_PUT(spec, (int32_t)DLOG_ARG());
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            spec[n++] = conv;
+            spec[n] = '\0';
+            if(stars == 2)      DLOG_PUT(spec, star[0], star[1], DLOG_ARG());
+            else if(stars == 1) DLOG_PUT(spec, star[0], DLOG_ARG());
+            else                DLOG_PUT(spec, DLOG_ARG());
+            break;
+        case 'p':
+            DLOG_PUT("0x%08x", DLOG_ARG());
+            break;
+        case 's': {
+            uint32_t addr = DLOG_ARG();
+            const char *str = elf_string(addr);
+            char unknown[16];
+            if(str == NULL) {
+                snprintf(unknown, sizeof(unknown), "<0x%08x>", addr);
+                str = unknown;
+            }
+            spec[n++] = 's';
+            spec[n] = '\0';
+            if(stars == 2)      DLOG_PUT(spec, star[0], star[1], str);
+            else if(stars == 1) DLOG_PUT(spec, star[0], str);
+            else                DLOG_PUT(spec, str);
+            break;
+        }
+        default:
+            // 不支持的转换（浮点数等）
+            DLOG_ARG();
+            DLOG_PUT("<%%%c?>", conv);
+            break;
+        }
+    }
+#undef DLOG_ARG
+#undef DLOG_PUT
+}
+
+static int hex_val(char c)
+{
+    if((c >= '0') && (c <= '9')) return c - '0';
+    if((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+// 解析一行DLOG记录，格式错误时返回-1
+static int dlog_line(const char *hex, uint64_t *lost)
+{
+    uint8_t buf[sizeof(my_dlog_rec_hdr_t) + MY_DLOG_ARGS_MAX * sizeof(uint32_t)];
+    size_t n = 0;
+    my_dlog_rec_hdr_t hdr;
+    uint32_t args[MY_DLOG_ARGS_MAX];
+    char msg[DLOG_LINE_MAX];
+
+    while((n < sizeof(buf)) && (hex_val(hex[0]) >= 0) && (hex_val(hex[1]) >= 0)) {
+        buf[n++] = (uint8_t)((hex_val(hex[0]) << 4) | hex_val(hex[1]));
+        hex += 2;
+    }
+    if(n < sizeof(hdr)) {
+        return -1;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if((hdr.nargs > MY_DLOG_ARGS_MAX) || (n != sizeof(hdr) + hdr.nargs * sizeof(uint32_t))) {
+        return -1;
+    }
+    memcpy(args, buf + sizeof(hdr), hdr.nargs * sizeof(uint32_t));
+
+    if(hdr.lost > 0) {
+        printf("dlog: %u records lost\n", hdr.lost);
+        *lost += hdr.lost;
+    }
+    const char *fmt = elf_string(hdr.fmt);
+    const char *tag = elf_string(hdr.tag);
+    if(fmt == NULL) {
+        printf("dlog: unknown format 0x%08x, elf does not match the firmware?\n", hdr.fmt);
+        return 0;
+    }
+    dlog_format(msg, sizeof(msg), fmt, args, hdr.nargs);
+    printf("%c (%u) %s: %s\n", (hdr.level < sizeof(level_char)) ? level_char[hdr.level] : '?',
+           hdr.ts_us / 1000, (tag != NULL) ? tag : "?", msg);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    char line[DLOG_LINE_MAX];
+    uint64_t records = 0, bad = 0, lost = 0;
+
+    if((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "usage: %s <firmware.elf> [log file]\n", argv[0]);
+        return 1;
+    }
+    if(elf_load(argv[1]) < 0) {
+        return 1;
+    }
+    if((argc == 3) && ((in = fopen(argv[2], "r")) == NULL)) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    while(fgets(line, sizeof(line), in) != NULL) {
+        // 行首可能有其他输出，在行内查找标记
+        char *p = strstr(line, "DLOG:");
+        if(p == NULL) {
+            fputs(line, stdout);
+            continue;
+        }
+        if(dlog_line(p + 5, &lost) < 0) {
+            bad++;
+            fputs(line, stdout);
+            continue;
+        }
+        records++;
+    }
+    fprintf(stderr, "%llu records, %llu lost, %llu bad lines\n",
+            (unsigned long long)records, (unsigned long long)lost, (unsigned long long)bad);
+    return 0;
+}
@@ -0,0 +1,372 @@
+/**
+ * 抓包数据的解析和回放程序(Linux)
+ *
+ * 读取节点导出的抓包数据（格式见main/include/my_capture.h），
+ * 可以是保存的串口日志（包含CAP-BEGIN/CAP:/CAP-END行），也可以是二进制文件。
+ *
+ * 用法：
+ *  replay print <文件>
+ *      输出每个数据包
+ *  replay send [-h 地址] [-p 端口] [-s 倍速] [-l 循环次数] [-b 每批最大记录数] <文件>
+ *      将发往外网的数据包按根节点上行的格式(my_report.h)发送给collector，
+ *      按记录的时间间隔回放，-s为1~100倍速，0为不等待
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "my_capture.h"
+#include "my_report.h"
+
+/*******************************************************
+ *                Constants
+ *******************************************************/
+#define REPLAY_BATCH_SIZE   (8192)      /* 与CONFIG_MESH_UPLINK_BATCH_SIZE的最大值相同 */
+#define REPLAY_BATCH_MAX    (255)
+#define REPLAY_PROTO_MQTT   (3)         /* MESH_PROTO_MQTT，由MQTT网关处理，不经过上行 */
+#define REPLAY_DATA_TODS    (0x08)      /* MESH_DATA_TODS */
+
+/*******************************************************
+ *                Type Definitions
+ *******************************************************/
+// 解析后的数据包
+typedef struct {
+    my_capture_rec_t rec;
+    const uint8_t    *payload;
+} frame_t;
+
+typedef struct {
+    frame_t  *frames;
+    size_t   num;
+    size_t   cap;
+    uint32_t dropped;
+} capture_t;
+
+/*******************************************************
+ *                Function Definitions
+ *******************************************************/
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int hex_val(char c)
+{
+    if((c >= '0') && (c <= '9')) return c - '0';
+    if((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+// 解析一段导出的数据
+static int capture_parse(const uint8_t *data, size_t len, capture_t *cap)
+{
+    my_capture_file_hdr_t hdr;
+    size_t pos = sizeof(hdr);
+
+    if(len < sizeof(hdr)) {
+        fprintf(stderr, "capture too short\n");
+        return -1;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if((hdr.magic != MY_CAPTURE_MAGIC) || (hdr.version != MY_CAPTURE_VERSION)) {
+        fprintf(stderr, "bad capture header\n");
+        return -1;
+    }
+    cap->dropped += hdr.dropped;
+
+    while(pos + sizeof(my_capture_rec_t) <= len) {
+        my_capture_rec_t rec;
+        memcpy(&rec, data + pos, sizeof(rec));
+        if((rec.cap_len > rec.len) || (pos + sizeof(rec) + rec.cap_len > len)) {
+            fprintf(stderr, "truncated record at %zu\n", pos);
+            return -1;
+        }
+        if(cap->num == cap->cap) {
+            cap->cap = cap->cap ? cap->cap * 2 : 1024;
+            cap->frames = realloc(cap->frames, cap->cap * sizeof(frame_t));
+            if(cap->frames == NULL) {
+                return -1;
+            }
+        }
+        cap->frames[cap->num].rec = rec;
+        cap->frames[cap->num].payload = data + pos + sizeof(rec);
+        cap->num++;
+        pos += sizeof(rec) + rec.cap_len;
+    }
+    return 0;
+}
+
+// 从串口日志中提取CAP-BEGIN与CAP-END之间的数据，可以包含多次导出
+static int capture_parse_log(const char *text, size_t len, uint8_t *out, capture_t *cap)
+{
+    size_t n = 0, begin = 0;
+    bool in_dump = false;
+    int dumps = 0;
+    const char *p = text, *end = text + len;
+
+    while(p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if(eol == NULL) {
+            eol = end;
+        }
+        // 行首可能有其他输出，在行内查找标记
+        const char *cap_line = memmem(p, eol - p, "CAP:", 4);
+        if(memmem(p, eol - p, "CAP-BEGIN", 9) != NULL) {
+            in_dump = true;
+            begin = n;
+        }
+        else if(in_dump && (memmem(p, eol - p, "CAP-END", 7) != NULL)) {
+            in_dump = false;
+            if(capture_parse(out + begin, n - begin, cap) < 0) {
+                return -1;
+            }
+            dumps++;
+        }
+        else if(in_dump && (cap_line != NULL)) {
+            for(cap_line += 4; cap_line + 1 < eol; cap_line += 2) {
+                int hi = hex_val(cap_line[0]), lo = hex_val(cap_line[1]);
+                if((hi < 0) || (lo < 0)) {
+                    break;
+                }
+                out[n++] = (uint8_t)((hi << 4) | lo);
+            }
+        }
+        p = eol + 1;
+    }
+    if(dumps == 0) {
+        fprintf(stderr, "no complete CAP-BEGIN/CAP-END dump found\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void print_addr(const uint8_t addr[6])
+{
+    printf("%02x:%02x:%02x:%02x:%02x:%02x", addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+}
+
+static int replay_print(const capture_t *cap)
+{
+    uint64_t t = 0;
+
+    for(size_t i = 0; i < cap->num; i++) {
+        const my_capture_rec_t *rec = &cap->frames[i].rec;
+        // 第一个记录的间隔是相对于被覆盖的记录或启动时间，不计入
+        if(i > 0) {
+            t += rec->dt_us;
+        }
+        printf("%10.6f %s ", t / 1e6, (rec->dir == MY_CAPTURE_TX) ? "TX" : "RX");
+        print_addr(rec->from);
+        printf(" -> ");
+        print_addr(rec->to);
+        printf(" proto:%u tos:%u flag:0x%02x len:%u", rec->proto, rec->tos, rec->flag, rec->len);
+        for(uint16_t b = 0; (b < rec->cap_len) && (b < 16); b++) {
+            printf("%s%02x", (b == 0) ? " " : "", cap->frames[i].payload[b]);
+        }
+        printf("%s\n", (rec->cap_len > 16) ? "..." : "");
+    }
+    printf("%zu frames, %u dropped on device\n", cap->num, cap->dropped);
+    return 0;
+}
+
+static int send_all(int fd, const uint8_t *buf, size_t len)
+{
+    while(len > 0) {
+        ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+// 发往外网的数据包：节点发出的toDS数据包，或根节点收到的toDS数据包
+static bool frame_is_uplink(const my_capture_rec_t *rec)
+{
+    return (rec->flag & REPLAY_DATA_TODS) && (rec->proto != REPLAY_PROTO_MQTT);
+}
+
+static int replay_send(const capture_t *cap, const char *host, uint16_t port,
+                       double speed, int loops, int batch_max)
+{
+    struct sockaddr_in addr = { 0 };
+    static uint8_t batch[REPLAY_BATCH_SIZE];
+    my_report_batch_hdr_t hdr = { MY_REPORT_MAGIC, MY_REPORT_VERSION, 0, 0, 0 };
+    size_t len = sizeof(hdr);
+    uint64_t records = 0, truncated = 0;
+    int fd;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad host %s\n", host);
+        return 1;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if((fd < 0) || (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+        perror("connect");
+        return 1;
+    }
+
+    int64_t start = now_us();
+    double t = 0;       /* 回放时间轴上的当前时间(us) */
+    for(int l = 0; l < loops; l++) {
+        for(size_t i = 0; i < cap->num; i++) {
+            const my_capture_rec_t *rec = &cap->frames[i].rec;
+            if((i > 0) && (speed > 0)) {
+                t += rec->dt_us / speed;
+            }
+            if(!frame_is_uplink(rec)) {
+                continue;
+            }
+            if(rec->cap_len < rec->len) {
+                truncated++;    /* 只能发送保存的部分 */
+            }
+
+            // 批次已满，或下一个数据包还没到发送时间时，发送当前批次
+            int64_t due = start + (int64_t)t;
+            bool wait = (speed > 0) && (due > now_us());
+            if((hdr.count > 0) && (wait || (hdr.count >= batch_max)
+               || (len + sizeof(my_report_rec_hdr_t) + rec->cap_len > sizeof(batch)))) {
+                hdr.len = len - sizeof(hdr);
+                memcpy(batch, &hdr, sizeof(hdr));
+                if(send_all(fd, batch, len) < 0) {
+                    perror("send");
+                    return 1;
+                }
+                hdr.seq++;
+                hdr.count = 0;
+                len = sizeof(hdr);
+            }
+            if(wait) {
+                int64_t d = due - now_us();
+                if(d > 0) {
+                    usleep(d);
+                }
+            }
+
+            my_report_rec_hdr_t rh;
+            memcpy(rh.src, rec->from, sizeof(rh.src));
+            rh.proto = rec->proto;
+            rh.shard = 0;
+            rh.len = rec->cap_len;
+            memcpy(batch + len, &rh, sizeof(rh));
+            memcpy(batch + len + sizeof(rh), cap->frames[i].payload, rec->cap_len);
+            len += sizeof(rh) + rec->cap_len;
+            hdr.count++;
+            records++;
+        }
+    }
+    if(hdr.count > 0) {
+        hdr.len = len - sizeof(hdr);
+        memcpy(batch, &hdr, sizeof(hdr));
+        if(send_all(fd, batch, len) < 0) {
+            perror("send");
+            return 1;
+        }
+    }
+    close(fd);
+
+    double secs = (now_us() - start) / 1e6;
+    printf("{\"records\":%llu,\"truncated\":%llu,\"seconds\":%.3f,\"records_per_s\":%.0f,\"speed\":%g}\n",
+           (unsigned long long)records, (unsigned long long)truncated, secs,
+           (secs > 0) ? records / secs : 0, speed);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s print <file>\n"
+            "       %s send [-h host] [-p port] [-s speed] [-l loops] [-b records/batch] <file>\n",
+            prog, prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *prog = argv[0];
+    const char *host = "127.0.0.1";
+    uint16_t port = 8070;
+    double speed = 1;
+    int loops = 1;
+    int batch_max = 64;
+    capture_t cap = { 0 };
+    int opt;
+
+    if(argc < 2) {
+        usage(prog);
+        return 1;
+    }
+    const char *mode = argv[1];
+    argc--;
+    argv++;
+    while((opt = getopt(argc, argv, "h:p:s:l:b:")) != -1) {
+        switch(opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 's': speed = atof(optarg); break;
+        case 'l': loops = atoi(optarg); break;
+        case 'b': batch_max = atoi(optarg); break;
+        default:
+            usage(prog);
+            return 1;
+        }
+    }
+    if((optind >= argc) || (speed < 0) || (speed > 100) || (loops < 1)
+       || (batch_max < 1) || (batch_max > REPLAY_BATCH_MAX)) {
+        usage(prog);
+        return 1;
+    }
+
+    // 读取整个文件
+    FILE *fp = fopen(argv[optind], "rb");
+    if(fp == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *raw = malloc(size + 1);
+    uint8_t *data = malloc(size / 2 + 1);
+    if((raw == NULL) || (data == NULL) || (fread(raw, 1, size, fp) != (size_t)size)) {
+        fprintf(stderr, "read %s failed\n", argv[optind]);
+        return 1;
+    }
+    fclose(fp);
+
+    // 二进制文件以头部的magic开始，否则按串口日志处理
+    uint16_t magic = (size >= 2) ? (raw[0] | (raw[1] << 8)) : 0;
+    int ret = (magic == MY_CAPTURE_MAGIC) ? capture_parse(raw, size, &cap)
+                                          : capture_parse_log((const char *)raw, size, data, &cap);
+    if(ret < 0) {
+        return 1;
+    }
+
+    if(strcmp(mode, "print") == 0) {
+        return replay_print(&cap);
+    }
+    if(strcmp(mode, "send") == 0) {
+        return replay_send(&cap, host, port, speed, loops, batch_max);
+    }
+    usage(prog);
+    return 1;
+}